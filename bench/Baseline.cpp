@@ -0,0 +1,417 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Baseline.hpp"
+
+#include <boost/math/distributions/students_t.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <numeric>
+#include <sstream>
+
+namespace bpt = boost::property_tree;
+
+namespace {
+/**
+ * @return string as a quoted JSON string
+ */
+std::string quote(std::string const& string)
+{
+    std::string quoted = "\"";
+    for (char const c: string) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+MacroBenchmarkResult resultFromTree(bpt::ptree const& tree)
+{
+    MacroBenchmarkResult result;
+    result.goal = tree.get<bool>("goal");
+    result.runtimeSeconds = tree.get<double>("runtime_in_seconds");
+    result.closedStates = tree.get<std::uint64_t>("closed_states");
+    result.generatedStates = tree.get<std::uint64_t>("generated_states");
+    result.generatedStatesPerSecond = tree.get<double>("generated_states_per_second");
+    result.costG = tree.get<double>("cost_g");
+    result.steps = tree.get<std::uint64_t>("steps");
+    result.peakRssMib = tree.get<double>("peak_rss_in_mib");
+    for (auto const& child: tree.get_child("operators")) {
+        OperatorBenchmarkResult op;
+        op.name = child.second.get<std::string>("name");
+        op.applications = child.second.get<std::uint64_t>("num_applications");
+        op.generatedStates = child.second.get<std::uint64_t>("num_generated_states");
+        op.runtimeMicros = child.second.get<std::uint64_t>("runtime_in_micros");
+        result.operators.push_back(op);
+    }
+    return result;
+}
+
+/**
+ * Mean and sample standard deviation of repeated measurements.
+ */
+struct Summary {
+    std::size_t n = 0;
+    double mean = 0.0;
+    double variance = 0.0;
+};
+
+Summary summarize(std::vector<double> const& values)
+{
+    Summary summary;
+    summary.n = values.size();
+    if (values.empty()) {
+        return summary;
+    }
+    summary.mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+    if (values.size() > 1) {
+        double sumOfSquares = 0.0;
+        for (auto const v: values) {
+            sumOfSquares += (v - summary.mean) * (v - summary.mean);
+        }
+        summary.variance = sumOfSquares / (values.size() - 1);
+    }
+    return summary;
+}
+
+/**
+ * One-sided Welch's t-test of whether the mean of <tt>current</tt> is worse than the mean of <tt>baseline</tt>.
+ *
+ * @return p-value, or NaN if either side has less than two measurements
+ */
+double worsePValue(Summary const& baseline, Summary const& current, bool higherIsBetter)
+{
+    if (baseline.n < 2 || current.n < 2) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    auto const worse = higherIsBetter ? baseline.mean - current.mean : current.mean - baseline.mean;
+    auto const vb = baseline.variance / baseline.n;
+    auto const vc = current.variance / current.n;
+    if (vb + vc <= 0.0) {
+        return worse > 0.0 ? 0.0 : 1.0;
+    }
+    auto const t = worse / std::sqrt(vb + vc);
+    auto const df = (vb + vc) * (vb + vc) / (vb * vb / (baseline.n - 1) + vc * vc / (current.n - 1));
+    return boost::math::cdf(boost::math::complement(boost::math::students_t(df), t));
+}
+
+/**
+ * Compare one metric of all runs and report it.
+ *
+ * A metric regresses if its mean is worse than the baseline by more than <tt>maxRegression</tt>
+ * and the difference is significant at the given confidence. With less than two runs on either
+ * side, the difference of the means alone decides.
+ *
+ * @return false if the metric regressed
+ */
+bool compareMetric(std::string const& name, std::vector<double> const& baselineValues,
+        std::vector<double> const& currentValues, bool higherIsBetter, double maxRegression, double confidence,
+        std::ostream& out)
+{
+    auto const baseline = summarize(baselineValues);
+    auto const current = summarize(currentValues);
+    auto const p = worsePValue(baseline, current, higherIsBetter);
+    auto const worse = higherIsBetter ? baseline.mean - current.mean : current.mean - baseline.mean;
+    auto const relative = baseline.mean != 0.0 ? worse / std::abs(baseline.mean) : 0.0;
+    bool const significant = std::isnan(p) ? worse > 0.0 : p < 1.0 - confidence;
+    bool const regressed = significant && relative > maxRegression;
+
+    out << "  " << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(1)
+        << std::setw(12) << baseline.mean << " +- " << std::setw(8) << std::sqrt(baseline.variance)
+        << std::setw(12) << current.mean << " +- " << std::setw(8) << std::sqrt(current.variance)
+        << std::setw(8) << std::showpos << (higherIsBetter ? -100.0 : 100.0) * relative << std::noshowpos << " %";
+    if (std::isnan(p)) {
+        out << "           ";
+    } else {
+        out << "  p=" << std::setprecision(3) << p;
+    }
+    out << "  " << (regressed ? "REGRESSION" : "ok") << "\n";
+    return !regressed;
+}
+
+template<typename Function>
+std::vector<double> collect(std::vector<MacroBenchmarkResult> const& runs, Function value)
+{
+    std::vector<double> values;
+    for (auto const& run: runs) {
+        values.push_back(value(run));
+    }
+    return values;
+}
+
+/**
+ * @return runtime per application of the named operator in each run (runs without applications are left out)
+ */
+std::vector<double> operatorMicrosPerApplication(std::vector<MacroBenchmarkResult> const& runs,
+        std::string const& name)
+{
+    std::vector<double> values;
+    for (auto const& run: runs) {
+        for (auto const& op: run.operators) {
+            if (op.name == name && op.applications > 0) {
+                values.push_back(static_cast<double>(op.runtimeMicros) / op.applications);
+            }
+        }
+    }
+    return values;
+}
+
+/**
+ * Compare the runs of one search strategy.
+ *
+ * @return false if any metric regressed
+ */
+bool compareSeries(MacroBenchmarkSeries const& baseline, MacroBenchmarkSeries const& current,
+        double maxRegression, double confidence, std::ostream& out)
+{
+    auto const numGoals = [](std::vector<MacroBenchmarkResult> const& runs) {
+        return std::count_if(runs.begin(), runs.end(), [](MacroBenchmarkResult const& r) { return r.goal; });
+    };
+    auto const baselineGoals = static_cast<std::size_t>(numGoals(baseline.runs));
+    auto const currentGoals = static_cast<std::size_t>(numGoals(current.runs));
+
+    out << "Strategy: " << current.strategy << " (weight " << current.heuristicWeight << "), "
+        << baseline.runs.size() << " baseline runs, " << current.runs.size() << " runs\n"
+        << "  " << std::left << std::setw(40) << "metric" << std::right
+        << std::setw(24) << "baseline" << std::setw(24) << "current" << std::setw(10) << "change" << "\n";
+
+    bool ok = true;
+    ok &= compareMetric("generated states/s",
+            collect(baseline.runs, [](MacroBenchmarkResult const& r) { return r.generatedStatesPerSecond; }),
+            collect(current.runs, [](MacroBenchmarkResult const& r) { return r.generatedStatesPerSecond; }),
+            true, maxRegression, confidence, out);
+    if (baselineGoals == baseline.runs.size() && currentGoals == current.runs.size()) {
+        ok &= compareMetric("time to goal (s)",
+                collect(baseline.runs, [](MacroBenchmarkResult const& r) { return r.runtimeSeconds; }),
+                collect(current.runs, [](MacroBenchmarkResult const& r) { return r.runtimeSeconds; }),
+                false, maxRegression, confidence, out);
+    }
+    ok &= compareMetric("peak RSS (MiB)",
+            collect(baseline.runs, [](MacroBenchmarkResult const& r) { return r.peakRssMib; }),
+            collect(current.runs, [](MacroBenchmarkResult const& r) { return r.peakRssMib; }),
+            false, maxRegression, confidence, out);
+
+    // operators applied too rarely to be timed reliably are left out
+    std::size_t constexpr minApplications = 100;
+    for (auto const& op: baseline.runs.front().operators) {
+        if (op.applications < minApplications) {
+            continue;
+        }
+        auto const currentValues = operatorMicrosPerApplication(current.runs, op.name);
+        if (currentValues.empty()) {
+            continue;
+        }
+        ok &= compareMetric(op.name + " (us/application)", operatorMicrosPerApplication(baseline.runs, op.name),
+                currentValues, false, maxRegression, confidence, out);
+    }
+
+    if (baselineGoals > 0 && currentGoals * baseline.runs.size() < baselineGoals * current.runs.size()) {
+        out << "  goal reached in " << currentGoals << " of " << current.runs.size() << " runs (baseline: "
+            << baselineGoals << " of " << baseline.runs.size() << ")  REGRESSION\n";
+        ok = false;
+    }
+    if (baselineGoals > 0 && currentGoals > 0) {
+        auto const cost = [](std::vector<MacroBenchmarkResult> const& runs) {
+            for (auto const& run: runs) {
+                if (run.goal) {
+                    return run.costG;
+                }
+            }
+            return 0.0;
+        };
+        if (cost(baseline.runs) != cost(current.runs)) {
+            out << "  note: solution cost g(x) changed from " << std::setprecision(3) << cost(baseline.runs)
+                << " to " << cost(current.runs) << "\n";
+        }
+    }
+    return ok;
+}
+}
+
+/**
+ * Write the result of one end-to-end obfuscation as a single-line JSON object.
+ *
+ * @param out output stream
+ * @param result result to write
+ */
+void writeMacroBenchmarkResult(std::ostream& out, MacroBenchmarkResult const& result)
+{
+    std::ostringstream line;
+    line << std::setprecision(9)
+         << "{\"goal\":" << (result.goal ? "true" : "false")
+         << ",\"runtime_in_seconds\":" << result.runtimeSeconds
+         << ",\"closed_states\":" << result.closedStates
+         << ",\"generated_states\":" << result.generatedStates
+         << ",\"generated_states_per_second\":" << result.generatedStatesPerSecond
+         << ",\"cost_g\":" << result.costG
+         << ",\"steps\":" << result.steps
+         << ",\"peak_rss_in_mib\":" << result.peakRssMib
+         << ",\"operators\":[";
+    for (std::size_t i = 0; i < result.operators.size(); ++i) {
+        auto const& op = result.operators[i];
+        line << (i == 0 ? "" : ",")
+             << "{\"name\":" << quote(op.name)
+             << ",\"num_applications\":" << op.applications
+             << ",\"num_generated_states\":" << op.generatedStates
+             << ",\"runtime_in_micros\":" << op.runtimeMicros << "}";
+    }
+    line << "]}";
+    out << line.str();
+}
+
+/**
+ * Read a result written by writeMacroBenchmarkResult().
+ *
+ * @param in input stream
+ * @param result read result
+ * @return false if the input is not a valid result
+ */
+bool readMacroBenchmarkResult(std::istream& in, MacroBenchmarkResult& result)
+{
+    try {
+        bpt::ptree tree;
+        bpt::read_json(in, tree);
+        result = resultFromTree(tree);
+        return true;
+    } catch (bpt::ptree_error const& e) {
+        std::cerr << "Invalid benchmark result: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+/**
+ * Write a baseline to a JSON file.
+ *
+ * @param fileName output file
+ * @param baseline baseline to write
+ * @return false if the file cannot be written
+ */
+bool writeBaseline(std::string const& fileName, PerformanceBaseline const& baseline)
+{
+    std::ofstream file(fileName);
+    file << "{\n"
+         << "  \"input\": " << quote(baseline.inputFile) << ",\n"
+         << "  \"seed\": " << baseline.seed << ",\n"
+         << "  \"series\": [";
+    for (std::size_t i = 0; i < baseline.series.size(); ++i) {
+        auto const& series = baseline.series[i];
+        file << (i == 0 ? "\n" : ",\n")
+             << "    {\n"
+             << "      \"strategy\": " << quote(series.strategy) << ",\n"
+             << "      \"weight\": " << std::setprecision(9) << series.heuristicWeight << ",\n"
+             << "      \"runs\": [";
+        for (std::size_t j = 0; j < series.runs.size(); ++j) {
+            file << (j == 0 ? "\n" : ",\n") << "        ";
+            writeMacroBenchmarkResult(file, series.runs[j]);
+        }
+        file << "\n      ]\n"
+             << "    }";
+    }
+    file << "\n  ]\n"
+         << "}\n";
+
+    if (!file) {
+        std::cerr << "Could not write baseline '" << fileName << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Read a baseline written by writeBaseline().
+ *
+ * @param fileName input file
+ * @param baseline read baseline
+ * @return false if the file cannot be read or is not a valid baseline
+ */
+bool readBaseline(std::string const& fileName, PerformanceBaseline& baseline)
+{
+    try {
+        bpt::ptree tree;
+        bpt::read_json(fileName, tree);
+        baseline.inputFile = tree.get<std::string>("input");
+        baseline.seed = tree.get<std::uint64_t>("seed");
+        baseline.series.clear();
+        for (auto const& child: tree.get_child("series")) {
+            MacroBenchmarkSeries series;
+            series.strategy = child.second.get<std::string>("strategy");
+            series.heuristicWeight = child.second.get<float>("weight");
+            for (auto const& run: child.second.get_child("runs")) {
+                series.runs.push_back(resultFromTree(run.second));
+            }
+            if (!series.runs.empty()) {
+                baseline.series.push_back(series);
+            }
+        }
+        return true;
+    } catch (bpt::ptree_error const& e) {
+        std::cerr << "Could not read baseline '" << fileName << "': " << e.what() << std::endl;
+        return false;
+    }
+}
+
+/**
+ * Compare end-to-end results against a baseline and report each metric.
+ * The baseline must have been recorded with the same input and seed and contain every strategy that was run.
+ *
+ * @param baseline baseline results
+ * @param current results of this build
+ * @param maxRegression largest tolerated relative regression of a metric mean (e.g. 0.05 for 5 %)
+ * @param confidence confidence level of the significance test of a regression
+ * @param out stream to report results to
+ * @return false if any metric regressed or the results cannot be compared
+ */
+bool compareWithBaseline(PerformanceBaseline const& baseline, PerformanceBaseline const& current,
+        double maxRegression, double confidence, std::ostream& out)
+{
+    if (baseline.inputFile != current.inputFile || baseline.seed != current.seed) {
+        out << "Baseline was recorded with input " << baseline.inputFile << " and seed " << baseline.seed
+            << ", not " << current.inputFile << " and seed " << current.seed << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+    for (auto const& series: current.series) {
+        auto const it = std::find_if(baseline.series.begin(), baseline.series.end(),
+                [&series](MacroBenchmarkSeries const& s) {
+                    return s.strategy == series.strategy && s.heuristicWeight == series.heuristicWeight;
+                });
+        if (it == baseline.series.end()) {
+            out << "Strategy: " << series.strategy << " (weight " << series.heuristicWeight
+                << ") is not in the baseline" << std::endl;
+            ok = false;
+            continue;
+        }
+        ok &= compareSeries(*it, series, maxRegression, confidence, out);
+    }
+    out << (ok ? "No regressions" : "Performance regressed") << " (threshold " << std::setprecision(1)
+        << 100.0 * maxRegression << " %, confidence " << 100.0 * confidence << " %)" << std::endl;
+    return ok;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_BENCH_BASELINE_HPP
+#define OBFUSCATION_BENCH_BASELINE_HPP
+
+#include "Benchmark.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Repeated end-to-end obfuscations with one search strategy.
+ */
+struct MacroBenchmarkSeries {
+    std::string strategy;
+    float heuristicWeight = 2.0f;
+    std::vector<MacroBenchmarkResult> runs;
+};
+
+/**
+ * End-to-end results of a build, which later builds are compared against.
+ */
+struct PerformanceBaseline {
+    std::string inputFile;
+    std::uint64_t seed = 0;
+    std::vector<MacroBenchmarkSeries> series;
+};
+
+void writeMacroBenchmarkResult(std::ostream& out, MacroBenchmarkResult const& result);
+bool readMacroBenchmarkResult(std::istream& in, MacroBenchmarkResult& result);
+
+bool writeBaseline(std::string const& fileName, PerformanceBaseline const& baseline);
+bool readBaseline(std::string const& fileName, PerformanceBaseline& baseline);
+bool compareWithBaseline(PerformanceBaseline const& baseline, PerformanceBaseline const& current,
+        double maxRegression, double confidence, std::ostream& out);
+
+#endif //OBFUSCATION_BENCH_BASELINE_HPP
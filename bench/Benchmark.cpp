@@ -0,0 +1,103 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+/**
+ * @param out stream to report results to
+ * @param filter only run benchmarks whose name contains this string (empty to run all)
+ * @param minSampleTime minimum duration of one sample
+ * @param numSamples number of samples per benchmark
+ */
+BenchmarkRunner::BenchmarkRunner(std::ostream& out, std::string filter, std::chrono::milliseconds minSampleTime,
+        std::size_t numSamples)
+        : m_out(out)
+        , m_filter(std::move(filter))
+        , m_minSampleTime(minSampleTime)
+        , m_numSamples(std::max<std::size_t>(1, numSamples))
+{
+}
+
+/**
+ * @param name benchmark name
+ * @return whether a benchmark of this name passes the filter
+ */
+bool BenchmarkRunner::enabled(std::string const& name) const
+{
+    return m_filter.empty() || name.find(m_filter) != std::string::npos;
+}
+
+/**
+ * Run a benchmark and report its result.
+ *
+ * @param name benchmark name
+ * @param body benchmark body
+ * @return false if the benchmark was skipped by the filter
+ */
+bool BenchmarkRunner::run(std::string const& name, BenchmarkRunner::Body const& body)
+{
+    if (!enabled(name)) {
+        return false;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    auto const time = [&body](std::size_t iterations) {
+        auto const start = Clock::now();
+        body(iterations);
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+    };
+
+    // calibrate (which also warms up caches)
+    std::size_t iterations = 1;
+    auto elapsed = time(iterations);
+    while (elapsed < m_minSampleTime && iterations < (std::size_t(1) << 30)) {
+        auto const factor = elapsed.count() > 0 ? 1.5 * m_minSampleTime.count() / elapsed.count() : 10.0;
+        iterations = static_cast<std::size_t>(iterations * std::min(10.0, std::max(2.0, factor)));
+        elapsed = time(iterations);
+    }
+
+    std::vector<double> samples;
+    samples.reserve(m_numSamples);
+    for (std::size_t i = 0; i < m_numSamples; ++i) {
+        samples.push_back(static_cast<double>(time(iterations).count()) / iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    BenchmarkResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.medianNanos = samples[samples.size() / 2];
+    result.minNanos = samples.front();
+    result.maxNanos = samples.back();
+    m_results.push_back(result);
+
+    m_out << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(1)
+          << std::setw(14) << result.medianNanos << " ns/op"
+          << "  (min " << result.minNanos << ", max " << result.maxNanos
+          << ", " << iterations << " ops x " << samples.size() << ")" << std::endl;
+    return true;
+}
+
+/**
+ * @return results of all benchmarks run so far
+ */
+std::vector<BenchmarkResult> const& BenchmarkRunner::results() const
+{
+    return m_results;
+}
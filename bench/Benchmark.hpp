@@ -0,0 +1,120 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_BENCH_BENCHMARK_HPP
+#define OBFUSCATION_BENCH_BENCHMARK_HPP
+
+#include <search/generic/SearchStrategy.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Prevent the compiler from optimizing away a value computed by a benchmark.
+ */
+template<typename T>
+inline void doNotOptimize(T const& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * Timing result of a single microbenchmark.
+ */
+struct BenchmarkResult {
+    std::string name;
+    std::size_t iterations = 0;
+    double medianNanos = 0.0;
+    double minNanos = 0.0;
+    double maxNanos = 0.0;
+};
+
+/**
+ * Minimal microbenchmark runner.
+ *
+ * A benchmark body runs a given number of operations. The runner calibrates the number of operations
+ * per sample so that each sample takes at least the minimum sample time, then reports the median,
+ * minimum and maximum time per operation over all samples.
+ */
+class BenchmarkRunner {
+public:
+    /**
+     * Benchmark body, which must run the given number of operations.
+     */
+    typedef std::function<void(std::size_t)> Body;
+
+    BenchmarkRunner(std::ostream& out, std::string filter, std::chrono::milliseconds minSampleTime,
+            std::size_t numSamples);
+
+    bool run(std::string const& name, Body const& body);
+    bool enabled(std::string const& name) const;
+    std::vector<BenchmarkResult> const& results() const;
+
+private:
+    std::ostream& m_out;
+    std::string m_filter;
+    std::chrono::nanoseconds m_minSampleTime;
+    std::size_t m_numSamples;
+    std::vector<BenchmarkResult> m_results;
+};
+
+/**
+ * Settings of the end-to-end obfuscation benchmark.
+ */
+struct MacroBenchmarkOptions {
+    std::string inputFile;
+    std::vector<std::string> targetFiles;
+    std::chrono::seconds timeLimit{60};
+    std::uint64_t seed = 0;
+    search::generic::SearchStrategy strategy = search::generic::SearchStrategy::kAstar;
+    float heuristicWeight = 2.0f;
+};
+
+/**
+ * Statistics of one operator in an end-to-end obfuscation.
+ */
+struct OperatorBenchmarkResult {
+    std::string name;
+    std::uint64_t applications = 0;
+    std::uint64_t generatedStates = 0;
+    std::uint64_t runtimeMicros = 0;
+};
+
+/**
+ * Result of one end-to-end obfuscation.
+ */
+struct MacroBenchmarkResult {
+    bool goal = false;
+    double runtimeSeconds = 0.0;
+    std::uint64_t closedStates = 0;
+    std::uint64_t generatedStates = 0;
+    double generatedStatesPerSecond = 0.0;
+    double costG = 0.0;
+    std::uint64_t steps = 0;
+    double peakRssMib = 0.0;
+    std::vector<OperatorBenchmarkResult> operators;
+};
+
+void runMicroBenchmarks(BenchmarkRunner& runner, std::string const& corpusDir);
+bool runMacroBenchmark(MacroBenchmarkOptions const& options, std::ostream& out, MacroBenchmarkResult& result);
+bool runMacroBenchmarkInChild(MacroBenchmarkOptions const& options, std::ostream& out, MacroBenchmarkResult& result);
+
+#endif //OBFUSCATION_BENCH_BENCHMARK_HPP
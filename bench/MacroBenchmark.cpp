@@ -0,0 +1,199 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Benchmark.hpp"
+#include "Baseline.hpp"
+
+#include "Obfuscator.hpp"
+#include "util/LayeredOStream.hpp"
+#include "util/NgramProfile.hpp"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+/**
+ * @return peak resident set size of this process in KiB
+ */
+static long peakRssInKilobytes()
+{
+    struct rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss;
+}
+
+/**
+ * Obfuscate a fixed text against a fixed target profile and report the search throughput,
+ * the time to reach the goal and the peak memory usage.
+ *
+ * @param options benchmark settings
+ * @param out stream to report results to
+ * @param result measured result
+ * @return false if the input files cannot be read
+ */
+bool runMacroBenchmark(MacroBenchmarkOptions const& options, std::ostream& out, MacroBenchmarkResult& result)
+{
+    unsigned int const flags = NgramProfile::STRIP_POS_ANNOTATIONS;
+
+    std::ifstream inputFile(options.inputFile);
+    if (!inputFile) {
+        std::cerr << "Could not open file '" << options.inputFile << "'" << std::endl;
+        return false;
+    }
+    std::stringstream input;
+    input << inputFile.rdbuf();
+
+    auto const targetProfile = std::make_shared<NgramProfile>();
+    if (!targetProfile->generate(options.targetFiles, flags)) {
+        std::cerr << "Could not generate target profile" << std::endl;
+        return false;
+    }
+
+    std::stringstream outputBuffer;
+    LayeredOStream output(outputBuffer);
+    std::ostream log(nullptr);
+
+    Obfuscator obfuscator;
+    obfuscator.searchOptions().random_seed = options.seed;
+    obfuscator.searchOptions().search_strategy = options.strategy;
+    obfuscator.searchOptions().heuristic_weight = options.heuristicWeight;
+    obfuscator.setLogStream(log);
+    obfuscator.setDeadline(std::chrono::steady_clock::now() + options.timeLimit);
+    bool const goal = obfuscator.obfuscate(input, output, targetProfile, flags);
+
+    auto const status = obfuscator.lastStatus();
+    auto const seconds = std::max<double>(1, status->runtime_in_millis) / 1000.0;
+    auto const generated = status->size_of_open + status->size_of_closed + status->num_duplicated_states;
+
+    result = MacroBenchmarkResult();
+    result.goal = goal;
+    result.runtimeSeconds = seconds;
+    result.closedStates = status->size_of_closed;
+    result.generatedStates = generated;
+    result.generatedStatesPerSecond = generated / seconds;
+    if (goal) {
+        result.costG = status->getCurrentNodeAndContext().first.costG();
+        result.steps = obfuscator.lastSolution().steps().size() - 1;
+    }
+    result.peakRssMib = peakRssInKilobytes() / 1024.0;
+    for (std::size_t i = 0; i < status->operator_stats.size(); ++i) {
+        OperatorBenchmarkResult op;
+        op.name = i < status->operators.size() ? status->operators[i]->name() : std::to_string(i);
+        op.applications = status->operator_stats[i].num_applications;
+        op.generatedStates = status->operator_stats[i].num_generated_states;
+        op.runtimeMicros = status->operator_stats[i].runtime_in_micros;
+        result.operators.push_back(op);
+    }
+
+    out << std::fixed << std::setprecision(1)
+        << "Input: " << options.inputFile << "\n"
+        << "Seed: " << options.seed << "\n"
+        << "Strategy: " << search::generic::SearchStrategyName(options.strategy)
+                << " (weight " << options.heuristicWeight << ")\n"
+        << "Runtime: " << seconds << " s\n"
+        << "Closed states: " << status->size_of_closed << "\n"
+        << "Generated states: " << generated << "\n"
+        << "Expanded states/s: " << (status->size_of_closed / seconds) << "\n"
+        << "Generated states/s: " << (generated / seconds) << "\n"
+        << "Time to goal: ";
+    if (goal) {
+        out << seconds << " s\n"
+            << "Solution cost g(x): " << std::setprecision(3) << result.costG << std::setprecision(1) << "\n"
+            << "Solution steps: " << result.steps << "\n";
+    } else {
+        out << "not reached within " << options.timeLimit.count() << " s\n";
+    }
+    out << "Peak RSS: " << static_cast<long>(result.peakRssMib) << " MiB" << std::endl;
+    return true;
+}
+
+/**
+ * Run the end-to-end benchmark in a child process, so that repeated runs start with cold
+ * caches and each run has its own peak memory usage. The child reports to <tt>out</tt>
+ * and passes its result back through a pipe.
+ *
+ * @param options benchmark settings
+ * @param out stream to report results to
+ * @param result measured result
+ * @return false if the benchmark or the child process failed
+ */
+bool runMacroBenchmarkInChild(MacroBenchmarkOptions const& options, std::ostream& out, MacroBenchmarkResult& result)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        std::cerr << "Could not create pipe" << std::endl;
+        return false;
+    }
+    out.flush();
+    std::cerr.flush();
+
+    auto const pid = fork();
+    if (pid < 0) {
+        std::cerr << "Could not fork benchmark process" << std::endl;
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        MacroBenchmarkResult childResult;
+        bool ok = runMacroBenchmark(options, out, childResult);
+        if (ok) {
+            std::ostringstream serialized;
+            writeMacroBenchmarkResult(serialized, childResult);
+            auto const data = serialized.str();
+            for (std::size_t written = 0; ok && written < data.size();) {
+                auto const n = write(fds[1], data.data() + written, data.size() - written);
+                ok = n > 0;
+                written += ok ? static_cast<std::size_t>(n) : 0;
+            }
+        }
+        close(fds[1]);
+        out.flush();
+        std::cerr.flush();
+        _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+    std::string data;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) != 0) {
+        if (n < 0 && errno != EINTR) {
+            break;
+        }
+        data.append(buffer, static_cast<std::size_t>(std::max<ssize_t>(0, n)));
+    }
+    close(fds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        std::cerr << "Benchmark process failed" << std::endl;
+        return false;
+    }
+    std::istringstream in(data);
+    return readMacroBenchmarkResult(in, result);
+}
@@ -0,0 +1,236 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Benchmark.hpp"
+
+#include "ComputeCostH.hpp"
+#include "Context.hpp"
+#include "State.hpp"
+#include "operators/CharMapOperator.hpp"
+#include "operators/CharacterFlipOperator.hpp"
+#include "operators/ContextlessHypernymOperator.hpp"
+#include "operators/ContextlessSynonymOperator.hpp"
+#include "operators/NgramRemovalOperator.hpp"
+#include "util/DiffString.hpp"
+#include "util/NgramProfile.hpp"
+#include "util/TextNormalizer.hpp"
+
+#include <search/generic/OpenList.hpp>
+
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+/**
+ * Access to the internal hot paths of the search, which are not part of the public interface.
+ */
+struct BenchmarkAccess {
+    typedef ObfuscationOperator::FocusPoint FocusPoint;
+
+    static ComputeCostH::JsdSums calculateJsd(ComputeCostH const& costH, Context::ConstNgramPtr const& profile,
+            TargetTable const& targetTable)
+    {
+        return costH.calculateJsd(profile, targetTable);
+    }
+
+    static std::size_t rankNgrams(Context::ConstNgramPtr const& profile, TargetTable const& targetTable)
+    {
+        return ObfuscationOperator::rankNgrams(profile, targetTable).size();
+    }
+
+    /**
+     * Select the focus points an operator would be applied on for a state.
+     * The returned focus points point into <tt>text</tt>, which must be kept alive.
+     */
+    static std::vector<FocusPoint> focusPoints(State const& state, Context const& context,
+            std::shared_ptr<std::string>& text)
+    {
+        auto const data = ObfuscationOperator::getCachedNgramSelection(state, context);
+        text = data.sourceText;
+        std::vector<FocusPoint> focusPoints;
+        for (auto const& ngramPosIt: *data.ngramPositions) {
+            focusPoints.push_back(FocusPoint{ngramPosIt - text->begin(), text.get(), data.wordBounds.get()});
+        }
+        return focusPoints;
+    }
+
+    static void applyImpl(ObfuscationOperator const& op, FocusPoint const& focusPoint, State const& state,
+            Context& context, ObfuscationOperator::Successors& successors)
+    {
+        op.applyImpl(focusPoint, state, context, successors);
+    }
+};
+
+namespace {
+
+std::string readFile(std::string const& filename)
+{
+    std::ifstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Could not open file '" + filename + "'");
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+}
+
+/**
+ * Run all microbenchmarks on texts of the Brown corpus.
+ * The input text is <tt>ca01</tt>, the target profile is generated from <tt>cb01</tt> to <tt>cb04</tt>.
+ *
+ * @param runner benchmark runner
+ * @param corpusDir directory of the Brown corpus
+ * @throw std::runtime_error if the corpus cannot be read
+ */
+void runMicroBenchmarks(BenchmarkRunner& runner, std::string const& corpusDir)
+{
+    unsigned int const flags = NgramProfile::STRIP_POS_ANNOTATIONS;
+    auto const rawText = readFile(corpusDir + "/ca01");
+
+    std::vector<std::string> targetFiles;
+    for (auto const& name: {"cb01", "cb02", "cb03", "cb04"}) {
+        targetFiles.push_back(corpusDir + "/" + name);
+    }
+    auto const targetProfile = std::make_shared<NgramProfile>();
+    if (!targetProfile->generate(targetFiles, flags)) {
+        throw std::runtime_error("Could not generate target profile from '" + corpusDir + "'");
+    }
+    Context context(targetProfile);
+
+    State state;
+    state.setText(std::make_shared<std::string>(rawText), flags);
+    auto const text = state.text().string();
+
+    ComputeCostH costH;
+    context.mutableMetaData->originalTextLength = text.size();
+    context.mutableMetaData->goalJSDist = 1.0;
+    costH.initContext(state, context);
+
+    // text processing
+    runner.run("NgramProfile::generateFromString", [&](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            NgramProfile profile;
+            profile.generateFromString(std::make_shared<std::string>(rawText), flags);
+            doNotOptimize(profile.n());
+        }
+    });
+
+    runner.run("stripPosAnnotationsFromText (incl. copy)", [&](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            auto copy = rawText;
+            stripPosAnnotationsFromText(copy);
+            doNotOptimize(copy.data());
+        }
+    });
+
+    auto strippedText = rawText;
+    stripPosAnnotationsFromText(strippedText);
+    runner.run("normalizeText (incl. copy)", [&](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            auto copy = strippedText;
+            normalizeText(copy);
+            doNotOptimize(copy.data());
+        }
+    });
+
+    // evaluation and n-gram selection
+    auto const profile = state.ngramProfile();
+    runner.run("ComputeCostH::calculateJsd", [&](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            doNotOptimize(BenchmarkAccess::calculateJsd(costH, profile, *context.targetTable));
+        }
+    });
+
+    runner.run("ObfuscationOperator::rankNgrams", [&](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            doNotOptimize(BenchmarkAccess::rankNgrams(profile, *context.targetTable));
+        }
+    });
+
+    // text edits
+    std::minstd_rand generator(42);
+    std::vector<std::uint32_t> editPositions(1024);
+    for (auto& pos: editPositions) {
+        pos = static_cast<std::uint32_t>(generator() % (text.size() - 1));
+    }
+
+    DiffString const diff(text);
+    runner.run("DiffString::edit (incl. copy)", [&](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            DiffString edited = diff;
+            edited.edit(DiffString::Edit(editPositions[i % editPositions.size()], 1, "x"));
+            doNotOptimize(edited.hashValue());
+        }
+    });
+
+    DiffString edited = diff;
+    for (std::size_t i = 0; i < 32; ++i) {
+        edited.edit(DiffString::Edit(editPositions[i], 1, "xy"));
+    }
+    runner.run("DiffString::string (32 edits)", [&](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            doNotOptimize(edited.string().size());
+        }
+    });
+
+    // OPEN list
+    std::size_t constexpr numNodes = 1024;
+    std::vector<std::shared_ptr<search::generic::Node<int>>> nodes;
+    for (std::size_t i = 0; i < numNodes; ++i) {
+        nodes.push_back(std::make_shared<search::generic::Node<int>>(static_cast<int>(i)));
+        nodes.back()->setCostH(static_cast<float>(generator() % 10000));
+    }
+    search::generic::OpenList<int> open([](int const& s) { return static_cast<search::generic::HashCode>(s); });
+    runner.run("OpenList::pushOrUpdate/pop (1024 nodes)", [&](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            for (auto const& node: nodes) {
+                open.pushOrUpdate(node);
+            }
+            while (!open.empty()) {
+                doNotOptimize(open.pop());
+            }
+        }
+    });
+
+    // operators
+    std::vector<std::unique_ptr<ObfuscationOperator>> operators;
+    operators.push_back(std::make_unique<NgramRemovalOperator>("N-Gram removal", 40, ""));
+    operators.push_back(std::make_unique<CharacterFlipOperator>("Character flips", 30, ""));
+    operators.push_back(std::make_unique<SentenceSplitAndRunOnOperator>("Character mapping", 3, ""));
+    operators.push_back(std::make_unique<ContextlessSynonymOperator>("Context-less synonyms", 10, ""));
+    operators.push_back(std::make_unique<ContextlessHypernymOperator>("Context-less hypernyms", 6, ""));
+
+    ObfuscationOperator::prepareExpansion(state, context);
+    std::shared_ptr<std::string> focusText;
+    auto const focusPoints = BenchmarkAccess::focusPoints(state, context, focusText);
+    ObfuscationOperator::Successors successors;
+    for (auto const& op: operators) {
+        runner.run("applyImpl: " + op->name() + " (" + std::to_string(focusPoints.size()) + " focus points)",
+                [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                successors.clear();
+                for (auto const& focusPoint: focusPoints) {
+                    BenchmarkAccess::applyImpl(*op, focusPoint, state, context, successors);
+                }
+                doNotOptimize(successors.size());
+            }
+        });
+    }
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "NormalizerCheck.hpp"
+
+#include "util/TextNormalizer.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/locale.hpp>
+#include <boost/regex.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace bfs = boost::filesystem;
+
+namespace {
+
+/**
+ * Reference implementation of normalizeText() with the regexes it was written with originally.
+ *
+ * @param text text to normalize
+ */
+void referenceNormalizeText(std::string& text)
+{
+    static std::locale const locale = [] {
+        boost::locale::generator gen;
+        std::locale loc = gen("en_US.UTF-8");
+        std::locale::global(loc);
+        return loc;
+    }();
+    text = boost::locale::normalize(text, boost::locale::norm_default, locale);
+
+    if (text.size() > 3 && text.substr(0, 3) == "\xEF\xBB\xBF") {
+        text = text.substr(3);
+    }
+
+    static boost::regex const quoteRegex(u8"(?:''|``|\"|„|“|”|‘|’|«|»)");
+    text = boost::regex_replace(text, quoteRegex, "'");
+
+    static boost::regex const dashRegex(u8"(?:(?:‒|–|—|―)+|-{2,})");
+    text = boost::regex_replace(text, dashRegex, "--");
+
+    static boost::regex const ellipsisRegex(u8"(?:…|\\.{3,})");
+    text = boost::regex_replace(text, ellipsisRegex, "...");
+
+    static boost::regex const whitespaceRegex("\\r\\n");
+    text = boost::regex_replace(text, whitespaceRegex, "\n");
+}
+
+/**
+ * Reference implementation of stripPosAnnotationsFromText() with the regexes it was written with originally.
+ *
+ * @param text to strip POS tags from
+ */
+void referenceStripPosAnnotations(std::string& text)
+{
+    static boost::regex const wordPosRegex(R"(/[\w+\-\$\*]+(?=\s|$))");
+    text = boost::regex_replace(text, wordPosRegex, "");
+
+    static boost::regex const openQuotePosRegex(R"((?<=\s)(.{1,2})/``\s)");
+    text = boost::regex_replace(text, openQuotePosRegex, "$1");
+
+    static boost::regex const closeQuotePosRegex(R"(\s(.{1,2})/''(?=\s|$))");
+    text = boost::regex_replace(text, closeQuotePosRegex, "$1");
+
+    static boost::regex const openBracketPosRegex(R"((?<=\s)(.)/\((?:-\w\w)?\s)");
+    text = boost::regex_replace(text, openBracketPosRegex, "$1");
+
+    static boost::regex const closeBracketPosRegex(R"(\s(.)/\)(?:-\w\w)?(?=\s|$))");
+    text = boost::regex_replace(text, closeBracketPosRegex, "$1");
+
+    static boost::regex const punctPosRegex(R"(\s(.)/[\.,:'](?:-\w\w)?(?=\s|$))");
+    text = boost::regex_replace(text, punctPosRegex, "$1");
+}
+
+/**
+ * Fragments random strings are built from: everything the rewriting rules match or look at,
+ * including partial matches, POS tags, CRLF, a BOM and broken UTF-8 sequences.
+ */
+std::vector<std::string> const RANDOM_FRAGMENTS = {
+        "a", "Z", "7", "_", " ", "  ", "\t", "\n", "\r", "\r\n", "/", "//", "$", "*", "+", "-", "--", "---",
+        ".", "..", "...", "....", ",", ":", "'", "''", "`", "``", "\"", "(", ")",
+        "/nn", "/np$", "/at-tl", "/*", "/``", "/''", "/(", "/)", "/(-hl", "/)-hl", "/.", "/,", "/:", "/'", "/.-tl",
+        u8"„", u8"“", u8"”", u8"‘", u8"’", u8"«", u8"»", u8"‒", u8"–", u8"—", u8"―", u8"…", u8"é", "e\xCC\x81",
+        "\xEF\xBB\xBF", "\xE2", "\xE2\x80", "\x80", "\xC3"};
+
+/**
+ * @return text with non-printable characters escaped, for reporting differences
+ */
+std::string escape(std::string const& text)
+{
+    std::string escaped;
+    for (char c: text) {
+        auto const u = static_cast<unsigned char>(c);
+        if (u >= 0x20 && u < 0x7F && c != '\\') {
+            escaped += c;
+        } else {
+            char buffer[5];
+            std::snprintf(buffer, sizeof(buffer), "\\x%02X", u);
+            escaped += buffer;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * Differential comparison of the text normalizer against the reference implementation.
+ */
+class NormalizerComparison {
+public:
+    explicit NormalizerComparison(std::ostream& out)
+            : m_out(out)
+    {
+    }
+
+    /**
+     * Compare stripping, normalization and both combined on a text.
+     *
+     * @param name name of the text for reports
+     * @param text text to compare on
+     */
+    void compare(std::string const& name, std::string const& text)
+    {
+        for (auto const variant: {STRIP, NORMALIZE, STRIP | NORMALIZE}) {
+            auto expected = text;
+            if (variant & STRIP) {
+                referenceStripPosAnnotations(expected);
+            }
+            if (variant & NORMALIZE) {
+                referenceNormalizeText(expected);
+            }
+
+            auto actual = text;
+            if (variant == STRIP) {
+                stripPosAnnotationsFromText(actual);
+            } else if (variant == NORMALIZE) {
+                normalizeText(actual);
+            } else {
+                preprocessText(actual, true, true);
+            }
+
+            ++m_numComparisons;
+            if (actual != expected) {
+                report(name, text, variant, expected, actual);
+            }
+        }
+    }
+
+    std::size_t numComparisons() const
+    {
+        return m_numComparisons;
+    }
+
+    std::size_t numDifferences() const
+    {
+        return m_numDifferences;
+    }
+
+private:
+    static constexpr int STRIP = 1;
+    static constexpr int NORMALIZE = 2;
+    static constexpr std::size_t MAX_REPORTS = 10;
+    static constexpr std::size_t CONTEXT = 40;
+
+    void report(std::string const& name, std::string const& text, int variant, std::string const& expected,
+            std::string const& actual)
+    {
+        if (++m_numDifferences > MAX_REPORTS) {
+            return;
+        }
+        auto const common = std::min(expected.size(), actual.size());
+        auto const mismatch = std::mismatch(expected.begin(), expected.begin() + common, actual.begin());
+        auto const pos = static_cast<std::size_t>(mismatch.first - expected.begin());
+        auto const begin = pos > CONTEXT ? pos - CONTEXT : 0;
+
+        m_out << "DIFFERENCE in " << name << " ("
+              << (variant == STRIP ? "strip" : variant == NORMALIZE ? "normalize" : "strip + normalize")
+              << ") at byte " << pos << ":\n";
+        if (text.size() <= 2 * CONTEXT) {
+            m_out << "  input:    \"" << escape(text) << "\"\n";
+        }
+        m_out << "  expected: \"" << escape(expected.substr(begin, 2 * CONTEXT)) << "\"\n"
+              << "  actual:   \"" << escape(actual.substr(begin, 2 * CONTEXT)) << "\"" << std::endl;
+    }
+
+    std::ostream& m_out;
+    std::size_t m_numComparisons = 0;
+    std::size_t m_numDifferences = 0;
+};
+
+std::string readFile(std::string const& filename)
+{
+    std::ifstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Could not open file '" + filename + "'");
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+}
+
+/**
+ * Compare the text normalizer against the boost::regex implementation it replaced, on every file of
+ * the Brown corpus, on the whole corpus at once (which strips POS annotations in parallel chunks),
+ * and on random strings built from the characters the rewriting rules match.
+ *
+ * @param options check settings
+ * @param out stream for the report
+ * @return true if all outputs are equal
+ * @throw std::runtime_error if the corpus cannot be read
+ */
+bool runNormalizerCheck(NormalizerCheckOptions const& options, std::ostream& out)
+{
+    std::vector<std::string> files;
+    for (bfs::directory_iterator it(options.corpusDir), end; it != end; ++it) {
+        if (bfs::is_regular_file(it->path())) {
+            files.push_back(it->path().string());
+        }
+    }
+    if (files.empty()) {
+        throw std::runtime_error("No texts found in '" + options.corpusDir + "'");
+    }
+    std::sort(files.begin(), files.end());
+
+    NormalizerComparison comparison(out);
+    std::string corpus;
+    for (auto const& file: files) {
+        auto const text = readFile(file);
+        comparison.compare(file, text);
+        corpus += text;
+    }
+    comparison.compare(options.corpusDir + " (all files)", corpus);
+    out << "Corpus texts: " << files.size() << " + 1 concatenated" << std::endl;
+
+    std::mt19937_64 random(options.seed);
+    std::uniform_int_distribution<std::size_t> lengthDist(0, 32);
+    std::uniform_int_distribution<std::size_t> fragmentDist(0, RANDOM_FRAGMENTS.size() - 1);
+    for (std::size_t i = 0; i < options.numRandomStrings; ++i) {
+        std::string text;
+        for (auto length = lengthDist(random); length > 0; --length) {
+            text += RANDOM_FRAGMENTS[fragmentDist(random)];
+        }
+        comparison.compare("random string " + std::to_string(i), text);
+    }
+    out << "Random strings: " << options.numRandomStrings << " (seed " << options.seed << ")" << std::endl;
+
+    out << "Comparisons: " << comparison.numComparisons() << ", differences: " << comparison.numDifferences()
+        << std::endl;
+    return comparison.numDifferences() == 0;
+}
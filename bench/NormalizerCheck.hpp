@@ -0,0 +1,36 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_BENCH_NORMALIZERCHECK_HPP
+#define OBFUSCATION_BENCH_NORMALIZERCHECK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+/**
+ * Settings of the differential check of the text normalizer.
+ */
+struct NormalizerCheckOptions {
+    std::string corpusDir = "assets/brown";
+    std::size_t numRandomStrings = 100000;
+    std::uint64_t seed = 1;
+};
+
+bool runNormalizerCheck(NormalizerCheckOptions const& options, std::ostream& out);
+
+#endif //OBFUSCATION_BENCH_NORMALIZERCHECK_HPP
@@ -0,0 +1,215 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Benchmark.hpp"
+#include "Baseline.hpp"
+#include "NormalizerCheck.hpp"
+
+#include <boost/program_options.hpp>
+
+#include <cstdlib>
+#include <iostream>
+
+namespace bpo = boost::program_options;
+
+/**
+ * Benchmark suite for the search hot paths. Run from the repository root, so the
+ * operator dictionaries and the Brown corpus in <tt>assets/</tt> are found.
+ */
+int main(int argc, char const* argv[])
+{
+    std::string corpusDir;
+    std::string filter;
+    std::size_t minSampleMillis;
+    std::size_t numSamples;
+    std::size_t timeLimit;
+    std::uint64_t seed;
+    std::vector<std::string> strategyNames;
+    float heuristicWeight;
+    std::size_t numRuns;
+    std::string recordBaselineFile;
+    std::string baselineFile;
+    double maxRegressionPercent;
+    double confidence;
+    NormalizerCheckOptions normalizerCheckOptions;
+
+    bpo::options_description desc("Options");
+    desc.add_options()
+            ("help,h",
+                    "Show this help")
+            ("micro",
+                    "Run the microbenchmarks")
+            ("macro",
+                    "Run the end-to-end obfuscation benchmark")
+            ("check-normalizer",
+                    "Compare the text normalizer against its boost::regex reference and fail on differences")
+            ("corpus,c",
+                    bpo::value<std::string>(&corpusDir)->value_name("DIR")->default_value("assets/brown"),
+                    "Brown corpus directory")
+            ("filter",
+                    bpo::value<std::string>(&filter)->value_name("STRING"),
+                    "Only run microbenchmarks whose name contains this string")
+            ("min-sample-time",
+                    bpo::value<std::size_t>(&minSampleMillis)->value_name("MS")->default_value(100),
+                    "Minimum duration of one microbenchmark sample in milliseconds")
+            ("samples",
+                    bpo::value<std::size_t>(&numSamples)->value_name("NUM")->default_value(5),
+                    "Number of samples per microbenchmark")
+            ("time-limit",
+                    bpo::value<std::size_t>(&timeLimit)->value_name("SECONDS")->default_value(60),
+                    "Time limit of the end-to-end obfuscation")
+            ("seed",
+                    bpo::value<std::uint64_t>(&seed)->value_name("NUM")->default_value(1),
+                    "Random seed of the end-to-end obfuscation")
+            ("strategies",
+                    bpo::value<std::vector<std::string>>(&strategyNames)->multitoken()->value_name("NAME [NAME ...]"),
+                    "Search strategies to compare in the end-to-end obfuscation (astar, weighted, anytime, greedy)")
+            ("weight",
+                    bpo::value<float>(&heuristicWeight)->value_name("W")->default_value(2.0f),
+                    "Weight of h(x) for the weighted and anytime strategies")
+            ("runs",
+                    bpo::value<std::size_t>(&numRuns)->value_name("NUM")->default_value(1),
+                    "Number of end-to-end obfuscations per strategy, each in its own process")
+            ("record-baseline",
+                    bpo::value<std::string>(&recordBaselineFile)->value_name("FILE"),
+                    "Write the end-to-end results to a JSON baseline")
+            ("baseline",
+                    bpo::value<std::string>(&baselineFile)->value_name("FILE"),
+                    "Compare the end-to-end results against a JSON baseline and fail on regressions")
+            ("max-regression",
+                    bpo::value<double>(&maxRegressionPercent)->value_name("PERCENT")->default_value(5.0),
+                    "Largest tolerated regression of a metric against the baseline")
+            ("confidence",
+                    bpo::value<double>(&confidence)->value_name("LEVEL")->default_value(0.95),
+                    "Confidence level at which a regression must be significant")
+            ("random-strings",
+                    bpo::value<std::size_t>(&normalizerCheckOptions.numRandomStrings)->value_name("NUM")
+                            ->default_value(normalizerCheckOptions.numRandomStrings),
+                    "Number of random strings the text normalizer is checked on");
+
+    bpo::variables_map vm;
+    try {
+        bpo::store(bpo::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            std::cout << desc << std::endl;
+            return EXIT_SUCCESS;
+        }
+        bpo::notify(vm);
+
+        if (strategyNames.empty()) {
+            strategyNames.emplace_back("astar");
+        }
+        for (auto const& name : strategyNames) {
+            search::generic::SearchStrategy strategy;
+            if (!search::generic::ParseSearchStrategy(name, strategy)) {
+                throw bpo::error("unknown search strategy '" + name + "'");
+            }
+        }
+        if (numRuns == 0) {
+            throw bpo::error("--runs must be at least 1");
+        }
+        if (confidence <= 0.0 || confidence >= 1.0) {
+            throw bpo::error("--confidence must be between 0 and 1");
+        }
+        if ((vm.count("record-baseline") || vm.count("baseline")) && vm.count("micro") && !vm.count("macro")) {
+            throw bpo::error("baselines require the end-to-end obfuscation (--macro)");
+        }
+    } catch (bpo::error const& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        std::cerr << "Usage: " << desc << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // run everything unless a part is selected
+    bool const runAll = !vm.count("micro") && !vm.count("macro") && !vm.count("check-normalizer");
+
+    if (vm.count("check-normalizer")) {
+        std::cout << "==== NORMALIZER CHECK ====" << std::endl;
+        normalizerCheckOptions.corpusDir = corpusDir;
+        normalizerCheckOptions.seed = seed;
+        try {
+            if (!runNormalizerCheck(normalizerCheckOptions, std::cout)) {
+                return EXIT_FAILURE;
+            }
+        } catch (std::exception const& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (runAll || vm.count("micro")) {
+        std::cout << "==== MICROBENCHMARKS ====" << std::endl;
+        BenchmarkRunner runner(std::cout, filter, std::chrono::milliseconds(minSampleMillis), numSamples);
+        try {
+            runMicroBenchmarks(runner, corpusDir);
+        } catch (std::exception const& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (runAll || vm.count("macro")) {
+        std::cout << "==== OBFUSCATION ====" << std::endl;
+        MacroBenchmarkOptions options;
+        options.inputFile = corpusDir + "/ca01";
+        for (auto const& name: {"cb01", "cb02", "cb03", "cb04"}) {
+            options.targetFiles.push_back(corpusDir + "/" + name);
+        }
+        options.timeLimit = std::chrono::seconds(timeLimit);
+        options.seed = seed;
+        options.heuristicWeight = heuristicWeight;
+
+        PerformanceBaseline results;
+        results.inputFile = options.inputFile;
+        results.seed = seed;
+        for (auto const& name : strategyNames) {
+            search::generic::ParseSearchStrategy(name, options.strategy);
+            MacroBenchmarkSeries series;
+            series.strategy = search::generic::SearchStrategyName(options.strategy);
+            series.heuristicWeight = heuristicWeight;
+            for (std::size_t run = 0; run < numRuns; ++run) {
+                if (numRuns > 1) {
+                    std::cout << "-- Run " << (run + 1) << " of " << numRuns << std::endl;
+                }
+                MacroBenchmarkResult result;
+                if (!runMacroBenchmarkInChild(options, std::cout, result)) {
+                    return EXIT_FAILURE;
+                }
+                series.runs.push_back(result);
+            }
+            results.series.push_back(series);
+        }
+
+        if (!recordBaselineFile.empty()) {
+            if (!writeBaseline(recordBaselineFile, results)) {
+                return EXIT_FAILURE;
+            }
+            std::cout << "Baseline written to " << recordBaselineFile << std::endl;
+        }
+        if (!baselineFile.empty()) {
+            std::cout << "==== BASELINE ====" << std::endl;
+            PerformanceBaseline baseline;
+            if (!readBaseline(baselineFile, baseline)) {
+                return EXIT_FAILURE;
+            }
+            if (!compareWithBaseline(baseline, results, maxRegressionPercent / 100.0, confidence, std::cout)) {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -16,12 +16,22 @@
 
 #include "operators/ContextlessSynonymOperator.hpp"
 #include "util/NgramProfile.hpp"
-#include "util/LayeredOStream.hpp"
+#include "util/DiffString.hpp"
+#include "util/DictionaryRegistry.hpp"
+#include "util/SnapshotWriter.hpp"
+#include "util/TcpTransport.hpp"
 //#include "util/netspeak.hpp"
 
 #include "Obfuscator.hpp"
+#include "BatchObfuscator.hpp"
+#include "ObfuscationServer.hpp"
 
+#include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
+#include <search/generic/Profiler.hpp>
+#include <csignal>
+#include <cstdint>
+#include <random>
 
 namespace bpo = boost::program_options;
 
@@ -31,6 +41,42 @@ int main(int argc, char const* argv[])
     std::string outputFilename;
     std::string targetProfileFilename;
     std::string netspeakHome;
+    std::string stateHash;
+    std::string profileFormat;
+    std::string outputFormat;
+    std::size_t beamWidth;
+    std::size_t memoryBudget;
+    std::size_t memoryLimit;
+    double timeLimit;
+    std::size_t expansionLimit;
+    double acceptableJsDist;
+    std::size_t batchSize;
+    bool compactClosed;
+    bool adaptiveOperators;
+    std::string strategyName;
+    std::size_t hdaThreads;
+    std::string clusterPeers;
+    std::size_t clusterRank;
+    float heuristicWeight;
+    std::uint64_t seed;
+    std::string metricsFilename;
+    std::string metricsFormat;
+    std::size_t metricsInterval;
+    std::string cpuProfileDir;
+    double cpuProfileWindow;
+    std::string checkpointFilename;
+    std::size_t checkpointInterval;
+    std::string resumeFilename;
+    std::string manifestFilename;
+    std::string inputCorpus;
+    std::string outputCorpus;
+    std::size_t numJobs;
+    unsigned short port;
+    std::size_t queueSize;
+    std::size_t maxRequestBytes;
+    std::size_t hostMemoryBudget;
+    std::string synonymDictionary;
+    std::string hypernymDictionary;
     std::vector<std::string> targetProfileFilenames;
 
     bpo::options_description desc("Options");
@@ -38,15 +84,15 @@ int main(int argc, char const* argv[])
             ("help,h",
                     "Show this help")
             ("input,i",
-                    bpo::value<std::string>(&inputFilename)->required()->value_name("FILE"),
+                    bpo::value<std::string>(&inputFilename)->value_name("FILE"),
                     "Input text file to be obfuscated")
             ("output,o",
-                    bpo::value<std::string>(&outputFilename)->required()->value_name("FILE"),
+                    bpo::value<std::string>(&outputFilename)->value_name("FILE"),
                     "Output file for the obfuscated text")
             ("strip-pos,s",
                     "Strip POS tags from input text")
             ("profile,p",
-                    bpo::value<std::string>(&targetProfileFilename)->value_name("FILE")->required(),
+                    bpo::value<std::string>(&targetProfileFilename)->value_name("FILE"),
                     "Target n-gram profile (will be regenerated if --profile-source is set)")
             ("netspeak,n",
                     bpo::value<std::string>(&netspeakHome)->value_name("DIR")->required(),
@@ -55,9 +101,127 @@ int main(int argc, char const* argv[])
                     bpo::value<std::vector<std::string>>(&targetProfileFilenames)->multitoken()->value_name("FILE [FILE ...]"),
                     "Source files to generate a target profile from")
             ("profile-strip-pos",
-                    "Strip POS tags from target files before generating target profile");
+                    "Strip POS tags from target files before generating target profile")
+            ("profile-format",
+                    bpo::value<std::string>(&profileFormat)->default_value("text")->value_name("FORMAT"),
+                    "Format for saving a generated target profile (text or binary, loading detects the format)")
+            ("output-format",
+                    bpo::value<std::string>(&outputFormat)->default_value("text")->value_name("FORMAT"),
+                    "Format of the output file (text or edits against the normalized input text)")
+            ("state-hash",
+                    bpo::value<std::string>(&stateHash)->default_value("polynomial")->value_name("ALGORITHM"),
+                    "Hash algorithm for identifying search states (polynomial or xxhash64)")
+            ("beam-width",
+                    bpo::value<std::size_t>(&beamWidth)->default_value(40000)->value_name("N"),
+                    "Maximum number of open search states (0 = unbounded)")
+            ("memory-budget",
+                    bpo::value<std::size_t>(&memoryBudget)->default_value(1024)->value_name("MIB"),
+                    "Maximum estimated memory of open and closed search states in MiB (0 = unbounded)")
+            ("memory-limit",
+                    bpo::value<std::size_t>(&memoryLimit)->default_value(0)->value_name("MIB"),
+                    "Abort a job once the estimated memory of its search states exceeds this limit in MiB (0 = unbounded)")
+            ("time-limit",
+                    bpo::value<double>(&timeLimit)->default_value(0.0)->value_name("SECONDS"),
+                    "Stop each search after this many seconds with the best text found so far (0 = unbounded)")
+            ("expansion-limit",
+                    bpo::value<std::size_t>(&expansionLimit)->default_value(0)->value_name("N"),
+                    "Stop each search after expanding this many states with the best text found so far (0 = unbounded)")
+            ("acceptable-js-dist",
+                    bpo::value<double>(&acceptableJsDist)->value_name("DIST"),
+                    "Stop each search early at the first text reaching this JS distance, if below the goal distance")
+            ("batch-size",
+                    bpo::value<std::size_t>(&batchSize)->default_value(1)->value_name("K"),
+                    "Number of best search states to expand concurrently per iteration")
+            ("compact-closed",
+                    bpo::bool_switch(&compactClosed),
+                    "Keep only hashes and costs of expanded search states and release their texts and profiles")
+            ("adaptive-operators",
+                    bpo::bool_switch(&adaptiveOperators),
+                    "Skip operators adaptively based on their gain in h(x) per runtime")
+            ("strategy",
+                    bpo::value<std::string>(&strategyName)->default_value("astar")->value_name("STRATEGY"),
+                    "Search strategy: 'astar', 'weighted' (w * h(x)), 'anytime' (weighted, keeps improving after the first goal) "
+                    "or 'greedy' (h(x) only, with randomized restarts)")
+            ("hda",
+                    bpo::value<std::size_t>(&hdaThreads)->value_name("THREADS"),
+                    "Run a hash-distributed search with this many worker threads, each owning a partition of the "
+                    "search states (0 = one per hardware thread)")
+            ("cluster",
+                    bpo::value<std::string>(&clusterPeers)->value_name("HOST:PORT,..."),
+                    "Run a search distributed across processes, one per listed address, each of which must be started "
+                    "with the same input, target profile and list of addresses")
+            ("rank",
+                    bpo::value<std::size_t>(&clusterRank)->default_value(0)->value_name("N"),
+                    "Index of this process in the --cluster list, whose port it listens on")
+            ("weight",
+                    bpo::value<float>(&heuristicWeight)->default_value(2.0f)->value_name("W"),
+                    "Weight of h(x) for --strategy weighted and initial weight for --strategy anytime (>= 1)")
+            ("seed",
+                    bpo::value<std::uint64_t>(&seed)->value_name("NUM"),
+                    "Random seed for reproducible searches (default: random)")
+            ("metrics",
+                    bpo::value<std::string>(&metricsFilename)->value_name("FILE"),
+                    "Write search metrics to this file instead of logging the search progress")
+            ("metrics-format",
+                    bpo::value<std::string>(&metricsFormat)->default_value("json")->value_name("FORMAT"),
+                    "Metrics format: 'json' (one snapshot per line) or 'prometheus' (latest snapshot per search)")
+            ("metrics-interval",
+                    bpo::value<std::size_t>(&metricsInterval)->default_value(1000)->value_name("MS"),
+                    "Interval between metrics snapshots in milliseconds")
+            ("cpu-profile-dir",
+                    bpo::value<std::string>(&cpuProfileDir)->value_name("DIR"),
+                    "Write a CPU profile to this directory whenever the process receives SIGUSR2, one file per "
+                    "profiling window named after the job (requires a build with -DPROFILING=ON)")
+            ("cpu-profile-window",
+                    bpo::value<double>(&cpuProfileWindow)->default_value(30.0)->value_name("SECONDS"),
+                    "Duration of a profiling window opened by SIGUSR2")
+            ("cpu-profile-search",
+                    "Profile every search from start to end (requires --cpu-profile-dir)")
+            ("checkpoint",
+                    bpo::value<std::string>(&checkpointFilename)->value_name("FILE"),
+                    "Periodically write a checkpoint of the search to this file, from which it can be resumed")
+            ("checkpoint-interval",
+                    bpo::value<std::size_t>(&checkpointInterval)->default_value(600)->value_name("SECONDS"),
+                    "Interval between checkpoints in seconds")
+            ("resume",
+                    bpo::value<std::string>(&resumeFilename)->value_name("FILE"),
+                    "Resume the search from a checkpoint written for the same input and target profile")
+            ("manifest",
+                    bpo::value<std::string>(&manifestFilename)->value_name("FILE"),
+                    "Batch mode: obfuscate all jobs in a manifest (tab-separated lines of input, output, target files)")
+            ("corpus",
+                    bpo::value<std::string>(&inputCorpus)->value_name("DIR"),
+                    "Batch mode: obfuscate all same-author cases of a corpus in truth.txt layout")
+            ("output-corpus",
+                    bpo::value<std::string>(&outputCorpus)->value_name("DIR"),
+                    "Output directory for --corpus")
+            ("jobs,j",
+                    bpo::value<std::size_t>(&numJobs)->default_value(1)->value_name("N"),
+                    "Number of documents to obfuscate concurrently in batch or server mode")
+            ("server",
+                    "Server mode: accept obfuscation jobs over TCP (see ObfuscationServer.hpp for the protocol)")
+            ("port",
+                    bpo::value<unsigned short>(&port)->default_value(9191)->value_name("PORT"),
+                    "TCP port for --server")
+            ("queue-size",
+                    bpo::value<std::size_t>(&queueSize)->default_value(16)->value_name("N"),
+                    "Maximum number of waiting jobs in server mode")
+            ("max-request-bytes",
+                    bpo::value<std::size_t>(&maxRequestBytes)->default_value(16 * 1024 * 1024)->value_name("N"),
+                    "Reject server requests whose text is longer than this many bytes")
+            ("host-memory-budget",
+                    bpo::value<std::size_t>(&hostMemoryBudget)->default_value(0)->value_name("MIB"),
+                    "Only start another job in batch or server mode while the memory budgets of all running jobs "
+                    "fit into this many MiB (0 = unbounded)")
+            ("synonym-dictionary",
+                    bpo::value<std::string>(&synonymDictionary)->value_name("FILE"),
+                    "Tab-separated synonym dictionary (default: assets/synonym-dictionary.tsv)")
+            ("hypernym-dictionary",
+                    bpo::value<std::string>(&hypernymDictionary)->value_name("FILE"),
+                    "Tab-separated hypernym dictionary (default: assets/hypernym-dictionary.tsv)");
 
     bpo::variables_map vm;
+    search::generic::SearchStrategy strategy;
     try {
         bpo::store(bpo::parse_command_line(argc, argv, desc), vm);
 
@@ -68,18 +232,176 @@ int main(int argc, char const* argv[])
 
         vm.notify();
 
+        if (vm.count("manifest") && vm.count("corpus")) {
+            throw bpo::error("--manifest and --corpus are mutually exclusive");
+        }
+        if (vm.count("corpus") && !vm.count("output-corpus")) {
+            throw bpo::error("--corpus requires --output-corpus to be set");
+        }
+        if (vm.count("server") && (vm.count("manifest") || vm.count("corpus"))) {
+            throw bpo::error("--server cannot be combined with --manifest or --corpus");
+        }
+        if ((vm.count("checkpoint") || vm.count("resume"))
+                && (vm.count("server") || vm.count("manifest") || vm.count("corpus"))) {
+            throw bpo::error("--checkpoint and --resume cannot be combined with --server, --manifest or --corpus");
+        }
+        if (vm.count("hda") && (vm.count("server") || vm.count("manifest") || vm.count("corpus"))) {
+            throw bpo::error("--hda cannot be combined with --server, --manifest or --corpus, which run jobs concurrently");
+        }
+        if (vm.count("hda") && (vm.count("checkpoint") || vm.count("resume"))) {
+            throw bpo::error("--hda cannot be combined with --checkpoint or --resume");
+        }
+        if (vm.count("cluster") && (vm.count("hda") || vm.count("checkpoint") || vm.count("resume")
+                || vm.count("server") || vm.count("manifest") || vm.count("corpus"))) {
+            throw bpo::error("--cluster cannot be combined with --hda, --checkpoint, --resume, --server, --manifest or --corpus");
+        }
+        if (!vm.count("manifest") && !vm.count("corpus") && !vm.count("server")) {
+            for (auto const& option: {"input", "output", "profile"}) {
+                if (!vm.count(option)) {
+                    throw bpo::error(std::string("the option '--") + option + "' is required");
+                }
+            }
+        }
         if (vm.count("profile-source-files") && targetProfileFilenames.empty()) {
             throw bpo::error("--target-files requires at least one filename");
         }
-        if (vm.count("profile-strip-pos") && !vm.count("profile-source-files")) {
+        if (vm.count("profile-strip-pos") && !vm.count("profile-source-files") && !vm.count("manifest") && !vm.count("corpus") && !vm.count("server")) {
             throw bpo::error("--profile-strip-pos requires --profile-source-files to be set");
         }
+
+        if (vm.count("cpu-profile-dir") && !search::generic::Profiler::Supported()) {
+            throw bpo::error("--cpu-profile-dir requires a build with -DPROFILING=ON");
+        }
+        if (vm.count("cpu-profile-search") && !vm.count("cpu-profile-dir")) {
+            throw bpo::error("--cpu-profile-search requires --cpu-profile-dir to be set");
+        }
+        if (metricsFormat != "json" && metricsFormat != "prometheus") {
+            throw bpo::error("--metrics-format must be one of 'json' or 'prometheus'");
+        }
+        if (profileFormat != "text" && profileFormat != "binary") {
+            throw bpo::error("--profile-format must be one of 'text' or 'binary'");
+        }
+        if (outputFormat != "text" && outputFormat != "edits") {
+            throw bpo::error("--output-format must be one of 'text' or 'edits'");
+        }
+
+        hashing::Algorithm hashAlgorithm;
+        if (!hashing::parseAlgorithm(stateHash, hashAlgorithm)) {
+            throw bpo::error("--state-hash must be one of 'polynomial' or 'xxhash64'");
+        }
+        DiffString::setHashAlgorithm(hashAlgorithm);
+
+        if (!search::generic::ParseSearchStrategy(strategyName, strategy)) {
+            throw bpo::error("--strategy must be one of 'astar', 'weighted', 'anytime' or 'greedy'");
+        }
+        if (heuristicWeight < 1.0f) {
+            throw bpo::error("--weight must be at least 1");
+        }
     } catch (bpo::error const& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         std::cerr << "Usage: " << desc << std::endl;
         return EXIT_FAILURE;
     }
 
+    if (vm.count("synonym-dictionary")) {
+        DictionaryRegistry::instance().configure(DictionaryRegistry::SYNONYMS, synonymDictionary);
+    }
+    if (vm.count("hypernym-dictionary")) {
+        DictionaryRegistry::instance().configure(DictionaryRegistry::HYPERNYMS, hypernymDictionary);
+    }
+    DictionaryRegistry::instance().preload();
+
+    Obfuscator obfuscator;
+    obfuscator.searchOptions().beam_width = beamWidth;
+    obfuscator.searchOptions().memory_budget_in_bytes = memoryBudget * 1024 * 1024;
+    obfuscator.searchOptions().job_memory_limit_in_mbytes = memoryLimit;
+    obfuscator.searchOptions().time_limit_in_millis = static_cast<std::size_t>(std::max(0.0, timeLimit) * 1000);
+    obfuscator.searchOptions().expansion_limit = expansionLimit;
+    if (vm.count("acceptable-js-dist")) {
+        obfuscator.setAcceptableJsDist(acceptableJsDist);
+    }
+    obfuscator.searchOptions().expansion_batch_size = batchSize;
+    obfuscator.searchOptions().compact_closed_list = compactClosed;
+    obfuscator.searchOptions().adaptive_operator_scheduling = adaptiveOperators;
+    obfuscator.searchOptions().search_strategy = strategy;
+    obfuscator.searchOptions().heuristic_weight = heuristicWeight;
+    if (vm.count("hda")) {
+        obfuscator.setSearchEngine(Obfuscator::SearchEngine::HDA);
+        obfuscator.searchOptions().search_threads = hdaThreads;
+    }
+    if (!vm.count("seed")) {
+        seed = std::random_device()();
+        std::cout << "Random seed: " << seed << std::endl;
+    }
+    obfuscator.searchOptions().random_seed = seed;
+    obfuscator.searchOptions().checkpoint_filename = checkpointFilename;
+    obfuscator.searchOptions().checkpoint_interval_in_millis = checkpointInterval * 1000;
+    obfuscator.searchOptions().resume_filename = resumeFilename;
+    if (vm.count("cpu-profile-dir")) {
+        search::generic::Profiler::Instance().Configure(cpuProfileDir,
+                std::chrono::milliseconds(static_cast<std::size_t>(std::max(0.0, cpuProfileWindow) * 1000)));
+        std::signal(SIGUSR2, [](int) { search::generic::Profiler::RequestWindow(); });
+        obfuscator.searchOptions().profile_search = vm.count("cpu-profile-search") != 0;
+    }
+    if (vm.count("metrics")) {
+        try {
+            if (metricsFormat == "prometheus") {
+                obfuscator.searchOptions().metrics_sink =
+                        std::make_shared<search::generic::PrometheusMetricsSink>(metricsFilename);
+            } else {
+                obfuscator.searchOptions().metrics_sink =
+                        std::make_shared<search::generic::JsonLinesMetricsSink>(metricsFilename);
+            }
+        } catch (std::exception const& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        obfuscator.searchOptions().metrics_interval_in_millis = metricsInterval;
+    }
+    obfuscator.searchOptions().metrics_label = vm.count("input") ? inputFilename : "";
+
+    unsigned int flags = 0;
+    if (vm.count("strip-pos")) {
+        flags |= NgramProfile::STRIP_POS_ANNOTATIONS;
+    }
+
+    if (vm.count("server")) {
+        try {
+            ObfuscationServer server(obfuscator.searchOptions(), port, numJobs, queueSize,
+                    hostMemoryBudget * 1024 * 1024);
+            server.setAcceptableJsDist(obfuscator.acceptableJsDist());
+            server.setMaxRequestBytes(maxRequestBytes);
+            server.run();
+        } catch (std::exception const& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+        return EXIT_FAILURE;
+    }
+
+    if (vm.count("manifest") || vm.count("corpus")) {
+        std::vector<BatchObfuscator::Job> jobs;
+        try {
+            if (vm.count("manifest")) {
+                jobs = BatchObfuscator::readManifest(manifestFilename);
+            } else {
+                jobs = BatchObfuscator::readCorpus(inputCorpus, outputCorpus);
+            }
+        } catch (std::exception const& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        unsigned int targetFlags = 0;
+        if (vm.count("profile-strip-pos")) {
+            targetFlags |= NgramProfile::STRIP_POS_ANNOTATIONS;
+        }
+        BatchObfuscator batchObfuscator(obfuscator.searchOptions(), numJobs, hostMemoryBudget * 1024 * 1024);
+        batchObfuscator.setAcceptableJsDist(obfuscator.acceptableJsDist());
+        auto const numFailed = batchObfuscator.run(jobs, flags, targetFlags);
+        std::cerr << (jobs.size() - numFailed) << " of " << jobs.size() << " jobs finished successfully" << std::endl;
+        return numFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     // read source txt
     std::ifstream inputFile;
     inputFile.open(inputFilename);
@@ -91,14 +413,13 @@ int main(int argc, char const* argv[])
     inputBuffer << inputFile.rdbuf();
     inputFile.close();
 
-    // open output file
-    std::fstream outputFile;
-    outputFile.open(outputFilename);
-    if (!outputFile) {
+    // check output file, which is replaced by each snapshot
+    if (!std::ofstream(outputFilename, std::ios::app)) {
         std::cerr << "Could not open output file '" << outputFilename << "'" << std::endl;
         return EXIT_FAILURE;
     }
-    LayeredOStream outputBuffer(outputFilename, outputFile);
+    SnapshotWriter outputWriter(outputFilename,
+            outputFormat == "edits" ? SnapshotWriter::Format::EDITS : SnapshotWriter::Format::TEXT);
 
     // read or generate target profile
     auto targetProfile = std::make_shared<NgramProfile>();
@@ -112,7 +433,11 @@ int main(int argc, char const* argv[])
 
         try {
             std::cout << "Saving target profile to '" << targetProfileFilename << "'..." << std::endl;
-            targetProfile->save(targetProfileFilename);
+            if (profileFormat == "binary") {
+                targetProfile->saveBinary(targetProfileFilename);
+            } else {
+                targetProfile->save(targetProfileFilename);
+            }
         } catch (std::exception const& e) {
             std::cerr << "Error saving target profile: " << e.what() << std::endl;
             return EXIT_FAILURE;
@@ -135,15 +460,21 @@ int main(int argc, char const* argv[])
 //        return EXIT_FAILURE;
 //    }
 
-    unsigned int flags = 0;
-    if (vm.count("strip-pos")) {
-        flags |= NgramProfile::STRIP_POS_ANNOTATIONS;
+    // connect to the other processes once the target profile is loaded, which can take a while
+    if (vm.count("cluster")) {
+        std::vector<std::string> peers;
+        boost::split(peers, clusterPeers, boost::is_any_of(","));
+        try {
+            std::cout << "Connecting to " << peers.size() << " processes as rank " << clusterRank << "..." << std::endl;
+            obfuscator.searchOptions().transport = std::make_shared<TcpTransport>(peers, clusterRank);
+        } catch (std::exception const& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        obfuscator.setSearchEngine(Obfuscator::SearchEngine::DISTRIBUTED);
     }
-    Obfuscator obfuscator;
-    obfuscator.obfuscate(inputBuffer, outputBuffer, targetProfile, flags);
 
-    outputFile.flush();
-    outputFile.close();
+    obfuscator.obfuscate(inputBuffer, outputWriter, targetProfile, flags);
 
-    return EXIT_SUCCESS;
+    return outputWriter.flush() ? EXIT_SUCCESS : EXIT_FAILURE;
 }
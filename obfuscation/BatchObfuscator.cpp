@@ -0,0 +1,240 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BatchObfuscator.hpp"
+#include "JobScheduler.hpp"
+#include "Obfuscator.hpp"
+#include "util/NgramProfile.hpp"
+#include "util/SnapshotWriter.hpp"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+
+namespace bfs = boost::filesystem;
+
+namespace {
+/**
+ * Mutex for serializing job progress messages on std::cerr.
+ */
+std::mutex s_reportMutex;
+}
+
+/**
+ * @param searchOptions search options for all jobs. If no executor is set,
+ *                      a single executor is created and shared by all jobs.
+ * @param numJobs number of documents to obfuscate concurrently
+ * @param hostMemoryBudget bytes available to the memory budgets of all concurrent searches (0 = unbounded)
+ */
+BatchObfuscator::BatchObfuscator(search::generic::Options const& searchOptions, std::size_t numJobs,
+        std::size_t hostMemoryBudget)
+        : m_searchOptions(searchOptions)
+        , m_numJobs(std::max<std::size_t>(1, numJobs))
+        , m_hostMemoryBudget(hostMemoryBudget)
+{
+    if (!m_searchOptions.executor) {
+        m_searchOptions.executor = std::make_shared<search::generic::Executor>();
+    }
+}
+
+/**
+ * Run all given jobs and block until they are finished.
+ * Jobs are started shortest input first (see JobScheduler).
+ * A failing job is reported on std::cerr and does not affect other jobs.
+ *
+ * @param jobs jobs to run
+ * @param inputFlags n-gram profile generation flags for input texts
+ * @param targetFlags n-gram profile generation flags for target source texts
+ * @return number of failed jobs
+ */
+std::size_t BatchObfuscator::run(std::vector<Job> const& jobs, unsigned int inputFlags, unsigned int targetFlags) const
+{
+    std::atomic_size_t numStarted(0);
+    std::atomic_size_t numFailed(0);
+
+    JobScheduler scheduler(m_searchOptions.executor, m_numJobs, m_hostMemoryBudget);
+    for (auto const& job: jobs) {
+        JobScheduler::Request request;
+        request.memoryBudget = m_searchOptions.memory_budget_in_bytes;
+        boost::system::error_code error;
+        request.size = static_cast<std::size_t>(bfs::file_size(job.inputFile, error));
+        if (error) {
+            request.size = 0;
+        }
+
+        scheduler.submit(request, [&, this](std::shared_ptr<search::generic::Executor> const& executor) {
+            {
+                std::lock_guard<std::mutex> lock(s_reportMutex);
+                std::cerr << "[" << ++numStarted << "/" << jobs.size() << "] Obfuscating '" << job.inputFile << "'..." << std::endl;
+            }
+
+            try {
+                runJob(job, executor, inputFlags, targetFlags);
+            } catch (std::exception const& e) {
+                ++numFailed;
+                std::lock_guard<std::mutex> lock(s_reportMutex);
+                std::cerr << "Error obfuscating '" << job.inputFile << "': " << e.what() << std::endl;
+            }
+        });
+    }
+    scheduler.wait();
+
+    return numFailed;
+}
+
+/**
+ * Run a single obfuscation job.
+ *
+ * @param job job to run
+ * @param executor executor share to run the search on
+ * @param inputFlags n-gram profile generation flags for the input text
+ * @param targetFlags n-gram profile generation flags for the target source texts
+ * @throw std::runtime_error if the job's files cannot be read or written
+ */
+void BatchObfuscator::runJob(Job const& job, std::shared_ptr<search::generic::Executor> const& executor,
+        unsigned int inputFlags, unsigned int targetFlags) const
+{
+    std::ifstream inputFile(job.inputFile);
+    if (!inputFile) {
+        throw std::runtime_error("Could not open file '" + job.inputFile + "'");
+    }
+    std::stringstream inputBuffer;
+    inputBuffer << inputFile.rdbuf();
+    inputFile.close();
+
+    auto targetProfile = std::make_shared<NgramProfile>();
+    if (!targetProfile->generate(job.targetFiles, targetFlags)) {
+        throw std::runtime_error("Could not generate target profile");
+    }
+
+    auto const outputDir = bfs::path(job.outputFile).parent_path();
+    if (!outputDir.empty()) {
+        bfs::create_directories(outputDir);
+    }
+    if (!std::ofstream(job.outputFile, std::ios::trunc)) {
+        throw std::runtime_error("Could not open output file '" + job.outputFile + "'");
+    }
+    SnapshotWriter outputWriter(job.outputFile);
+
+    std::ofstream logFile(job.outputFile + ".log");
+
+    Obfuscator obfuscator;
+    obfuscator.searchOptions() = m_searchOptions;
+    obfuscator.searchOptions().executor = executor;
+    obfuscator.setAcceptableJsDist(m_acceptableJsDist);
+    obfuscator.searchOptions().metrics_label = job.inputFile;
+    obfuscator.setLogStream(logFile);
+    obfuscator.obfuscate(inputBuffer, outputWriter, targetProfile, inputFlags);
+    if (!outputWriter.flush()) {
+        throw std::runtime_error("Could not write output file '" + job.outputFile + "'");
+    }
+}
+
+/**
+ * Read jobs from a manifest file.
+ * Each non-empty line not starting with '#' defines one job as tab-separated list of
+ * input file, output file and one or more target source files.
+ *
+ * @param filename manifest file
+ * @return parsed jobs
+ * @throw std::runtime_error if the manifest cannot be read or is malformed
+ */
+std::vector<BatchObfuscator::Job> BatchObfuscator::readManifest(std::string const& filename)
+{
+    std::ifstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Could not open manifest '" + filename + "'");
+    }
+
+    std::vector<Job> jobs;
+    std::string line;
+    std::size_t lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        boost::trim_right(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::vector<std::string> fields;
+        boost::split(fields, line, boost::is_any_of("\t"));
+        if (fields.size() < 3) {
+            throw std::runtime_error(filename + ":" + std::to_string(lineNumber)
+                    + ": expected input, output and at least one target file");
+        }
+
+        Job job;
+        job.inputFile = fields[0];
+        job.outputFile = fields[1];
+        job.targetFiles.assign(fields.begin() + 2, fields.end());
+        jobs.push_back(std::move(job));
+    }
+
+    return jobs;
+}
+
+/**
+ * Create jobs for a corpus in the PAN authorship verification layout.
+ * The corpus directory contains a <tt>truth.txt</tt> file with one line per case ("CASE Y" or "CASE N").
+ * For each same-author case ("Y"), the case's <tt>unknown.txt</tt> is obfuscated towards the profile of its
+ * <tt>known*.txt</tt> files and written to <tt>outputDir/CASE/unknown.txt</tt>.
+ *
+ * @param inputDir input corpus directory
+ * @param outputDir output corpus directory
+ * @return jobs for all same-author cases
+ * @throw std::runtime_error if the corpus cannot be read
+ */
+std::vector<BatchObfuscator::Job> BatchObfuscator::readCorpus(std::string const& inputDir, std::string const& outputDir)
+{
+    auto const truthFilename = (bfs::path(inputDir) / "truth.txt").string();
+    std::ifstream truthFile(truthFilename);
+    if (!truthFile) {
+        throw std::runtime_error("Could not open file '" + truthFilename + "'");
+    }
+
+    std::vector<Job> jobs;
+    std::string caseName;
+    std::string answer;
+    while (truthFile >> caseName >> answer) {
+        if (answer != "Y") {
+            continue;
+        }
+
+        auto const caseDir = bfs::path(inputDir) / caseName;
+        Job job;
+        job.inputFile = (caseDir / "unknown.txt").string();
+        job.outputFile = (bfs::path(outputDir) / caseName / "unknown.txt").string();
+        for (auto const& entry: bfs::directory_iterator(caseDir)) {
+            auto const name = entry.path().filename().string();
+            if (boost::starts_with(name, "known") && boost::ends_with(name, ".txt")) {
+                job.targetFiles.push_back(entry.path().string());
+            }
+        }
+        std::sort(job.targetFiles.begin(), job.targetFiles.end());
+        if (job.targetFiles.empty()) {
+            throw std::runtime_error("No known*.txt files in '" + caseDir.string() + "'");
+        }
+        jobs.push_back(std::move(job));
+    }
+
+    return jobs;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_SEARCH_BATCHOBFUSCATOR_HPP
+#define OBFUSCATION_SEARCH_BATCHOBFUSCATOR_HPP
+
+#include <search/generic/AstarSearch.hpp>
+
+#include <boost/optional.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Runner for obfuscating many documents within one process.
+ * Jobs are processed by a configurable number of concurrent searches, which share
+ * one search executor as well as the operator dictionaries and caches. The searches are
+ * scheduled by a JobScheduler.
+ */
+class BatchObfuscator {
+public:
+    /**
+     * Single obfuscation job.
+     */
+    struct Job
+    {
+        /**
+         * Text file to obfuscate.
+         */
+        std::string inputFile;
+
+        /**
+         * Output file for the obfuscated text. Search progress is logged to <tt>outputFile + ".log"</tt>.
+         */
+        std::string outputFile;
+
+        /**
+         * Source files to generate the target profile from.
+         */
+        std::vector<std::string> targetFiles;
+    };
+
+    explicit BatchObfuscator(search::generic::Options const& searchOptions, std::size_t numJobs = 1,
+            std::size_t hostMemoryBudget = 0);
+
+    /**
+     * Set a Jensen-Shannon distance that is good enough to end searches early (see Obfuscator::setAcceptableJsDist).
+     */
+    inline void setAcceptableJsDist(boost::optional<double> jsDist)
+    {
+        m_acceptableJsDist = jsDist;
+    }
+
+    std::size_t run(std::vector<Job> const& jobs, unsigned int inputFlags = 0, unsigned int targetFlags = 0) const;
+
+    static std::vector<Job> readManifest(std::string const& filename);
+    static std::vector<Job> readCorpus(std::string const& inputDir, std::string const& outputDir);
+
+private:
+    void runJob(Job const& job, std::shared_ptr<search::generic::Executor> const& executor,
+            unsigned int inputFlags, unsigned int targetFlags) const;
+
+    search::generic::Options m_searchOptions;
+    std::size_t m_numJobs;
+    std::size_t m_hostMemoryBudget;
+    boost::optional<double> m_acceptableJsDist;
+};
+
+#endif //OBFUSCATION_SEARCH_BATCHOBFUSCATOR_HPP
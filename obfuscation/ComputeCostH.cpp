@@ -18,205 +18,428 @@
 #include "State.hpp"
 #include "util/dekker.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
 #include <numeric>
-#include <boost/optional.hpp>
+
+/**
+ * @param resyncInterval recalculate the exact JSD on every n-th search depth
+ * @param maxDrift maximum accumulated relative change of the source n-gram count
+ *                 after which incremental JSD updates are replaced by an exact recalculation
+ */
+ComputeCostH::ComputeCostH(std::size_t resyncInterval, double maxDrift)
+        : m_resyncInterval(std::max<std::size_t>(1, resyncInterval))
+        , m_maxDrift(maxDrift)
+        , m_counters(std::make_shared<Counters>())
+{
+}
 
 /**
  * Compute h(n) heuristic function based on the Jensen-Shannon divergence
  * between two n-gram distributions.
  *
+ * The JSD of a successor is updated incrementally from its parent's partial JSD sums and the n-gram
+ * updates of its edit, which only touches the changed n-grams and does not need the successor's
+ * full n-gram profile. Since incremental
+ * updates approximate the effect of a changed source n-gram count on all other n-grams, an exact
+ * recalculation is triggered every <tt>resyncInterval</tt> search depths and whenever the accumulated
+ * drift exceeds <tt>maxDrift</tt>.
+ *
  * @param node node to calculate h(n) for
  * @param context search context
- * @param whether to allow approximate cost updates (faster) or only exact recalculations
+ * @param allowUpdate whether to allow approximate cost updates (faster) or only exact recalculations
  * @return computed cost
  */
 double ComputeCostH::operator()(search::generic::Node<State> const& node, Context const& context, bool allowUpdate) const
 {
     auto const& state = node.state();
+    auto const& metaData = state.mutableMetaData();
+    auto const& targetTable = *context.targetTable;
+
+    double drift = 0.0;
+    if (needsExactEvaluation(node, allowUpdate, drift)) {
+        metaData->jsdSums = calculateJsd(state.peekNgramProfile(), targetTable);
+        metaData->jsdSyncN = state.ngramCount();
+        metaData->jsdDrift = 0.0;
+        ++m_counters->exactEvaluations;
+    } else {
+        auto const& updates = state.ngramUpdates();
+        std::vector<ChangedNgram> changed;
+        changed.reserve(updates.size());
+        long deltaN = 0;
+        for (auto const& update: updates) {
+            deltaN += update.second;
+            if (update.second != 0) {
+                auto const newQ = static_cast<double>(state.ngramFreq(update.first));
+                changed.push_back({update.first, targetTable.prob(update.first), newQ - update.second, update.second});
+            }
+        }
+        auto const newN = state.ngramCount();
+        metaData->jsdSums = calculateJsdUpdate(metaData->jsdSums, changed,
+                static_cast<std::size_t>(static_cast<long>(newN) - deltaN), newN);
+        metaData->jsdDrift = drift;
+        ++m_counters->incrementalEvaluations;
+    }
+    return finishEvaluation(node);
+}
 
-    auto const sourceProfile = state.ngramProfile();
-    auto const targetProfile = context.targetNgramProfile;
+/**
+ * Compute h(n) of sibling nodes at once, with the same result as calling operator() for each of them
+ * up to rounding.
+ *
+ * Siblings share the n-gram profile of their parent and differ from it only in the few n-grams
+ * changed by their edits. The target probability and parent count of each changed n-gram are
+ * looked up once for all siblings. Siblings due for an exact recalculation do not build profiles
+ * of their own: the parent profile is walked once to get the exact sums for each of their total
+ * n-gram counts, and the summands of the n-grams changed by each sibling are then replaced.
+ * Nodes that do not share the parent profile of the first sibling are evaluated one by one.
+ *
+ * @param nodes nodes to calculate h(n) for
+ * @param numNodes number of nodes
+ * @param context search context
+ * @param costs computed cost of each node
+ */
+void ComputeCostH::operator()(search::generic::Node<State> const* const* nodes, std::size_t numNodes,
+        Context const& context, double* costs) const
+{
+    auto const& targetTable = *context.targetTable;
+
+    Context::ConstNgramPtr parentProfile;
+    std::vector<std::size_t> siblings;
+    siblings.reserve(numNodes);
+    for (std::size_t i = 0; i < numNodes; ++i) {
+        auto const& state = nodes[i]->state();
+        if (!parentProfile) {
+            parentProfile = state.parentNgramProfile();
+        }
+        if (parentProfile && state.parentNgramProfile() == parentProfile && !state.ngramUpdates().empty()) {
+            siblings.push_back(i);
+        } else {
+            costs[i] = (*this)(*nodes[i], context);
+        }
+    }
+    if (siblings.empty()) {
+        return;
+    }
 
-    double jsd;
-//    if (!allowUpdate || !state.mutableMetaData()->jsd || node.depth() % 5 == 0 || state.ngramProfile()->lastUpdates().empty()) {
-        jsd = calculateJsd(sourceProfile, targetProfile);
+    // look up all changed n-grams once
+    std::vector<ChangedNgram> lookup;
+    for (auto i: siblings) {
+        for (auto const& update: nodes[i]->state().ngramUpdates()) {
+            lookup.push_back({update.first, 0.0, 0.0, 0});
+        }
+    }
+    auto const byNgram = [](ChangedNgram const& a, ChangedNgram const& b) { return a.ngram < b.ngram; };
+    std::sort(lookup.begin(), lookup.end(), byNgram);
+    lookup.erase(std::unique(lookup.begin(), lookup.end(),
+            [](ChangedNgram const& a, ChangedNgram const& b) { return a.ngram == b.ngram; }), lookup.end());
+    for (auto& entry: lookup) {
+        entry.p = targetTable.prob(entry.ngram);
+        entry.parentCount = static_cast<double>(parentProfile->freq(entry.ngram));
+    }
 
-//    } else {
-//        jsd = calculateJsdUpdate(state.mutableMetaData()->jsd.get(), state.ngramProfile()->lastUpdates(), sourceProfile, targetProfile);
-//    }
+    std::vector<std::vector<ChangedNgram>> changed(siblings.size());
+    std::vector<char> exact(siblings.size());
+    std::vector<double> drift(siblings.size());
+    std::vector<std::size_t> exactCounts;
+    for (std::size_t k = 0; k < siblings.size(); ++k) {
+        auto const& state = nodes[siblings[k]]->state();
+        for (auto const& update: state.ngramUpdates()) {
+            if (update.second != 0) {
+                auto entry = *std::lower_bound(lookup.begin(), lookup.end(), ChangedNgram{update.first, 0.0, 0.0, 0}, byNgram);
+                entry.delta = update.second;
+                changed[k].push_back(entry);
+            }
+        }
+        exact[k] = needsExactEvaluation(*nodes[siblings[k]], true, drift[k]);
+        if (exact[k]) {
+            exactCounts.push_back(state.ngramCount());
+        }
+    }
+
+    // exact sums of the parent profile for the total n-gram count of each exactly evaluated sibling
+    std::sort(exactCounts.begin(), exactCounts.end());
+    exactCounts.erase(std::unique(exactCounts.begin(), exactCounts.end()), exactCounts.end());
+    std::vector<JsdSums> exactSums;
+    if (!exactCounts.empty()) {
+        exactSums = calculateJsd(parentProfile, targetTable, exactCounts);
+    }
+
+    auto const parentN = parentProfile->n();
+    for (std::size_t k = 0; k < siblings.size(); ++k) {
+        auto const& node = *nodes[siblings[k]];
+        auto const& metaData = node.state().mutableMetaData();
+        auto const newN = node.state().ngramCount();
+        if (exact[k]) {
+            auto const sums = exactSums[std::lower_bound(exactCounts.begin(), exactCounts.end(), newN) - exactCounts.begin()];
+            metaData->jsdSums = calculateJsdUpdate(sums, changed[k], newN, newN);
+            metaData->jsdSyncN = newN;
+            metaData->jsdDrift = 0.0;
+            ++m_counters->exactEvaluations;
+        } else {
+            metaData->jsdSums = calculateJsdUpdate(metaData->jsdSums, changed[k], parentN, newN);
+            metaData->jsdDrift = drift[k];
+            ++m_counters->incrementalEvaluations;
+        }
+        costs[siblings[k]] = finishEvaluation(node);
+    }
+}
+
+/**
+ * Decide whether the JSD of a node has to be recalculated exactly instead of being updated from its parent.
+ *
+ * @param node node to be evaluated
+ * @param allowUpdate whether incremental updates are allowed at all
+ * @param drift set to the accumulated drift after an incremental update
+ * @return true if the JSD has to be recalculated exactly
+ */
+bool ComputeCostH::needsExactEvaluation(search::generic::Node<State> const& node, bool allowUpdate, double& drift) const
+{
+    auto const& state = node.state();
+    auto const& metaData = state.mutableMetaData();
+    auto const& updates = state.ngramUpdates();
+
+    if (!allowUpdate || !metaData->jsd || updates.empty() || metaData->jsdSyncN == 0) {
+        return true;
+    }
+    if (node.depth() % m_resyncInterval == 0) {
+        ++m_counters->depthResyncs;
+        return true;
+    }
+
+    long deltaN = 0;
+    for (auto const& update: updates) {
+        deltaN += update.second;
+    }
+    drift = metaData->jsdDrift + std::abs(static_cast<double>(deltaN)) / std::max<std::size_t>(1, state.ngramCount());
+    if (drift > m_maxDrift) {
+        ++m_counters->driftResyncs;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Derive the JSD, the Jensen-Shannon distance and h(n) of a node from its updated JSD sums.
+ *
+ * @param node evaluated node
+ * @return computed cost
+ */
+double ComputeCostH::finishEvaluation(search::generic::Node<State> const& node) const
+{
+    auto const& metaData = node.state().mutableMetaData();
+    double const jsd = metaData->jsdSums.jsd();
 
     if (jsd > 1.0) {
         std::cerr << "ERROR: Numerical underflow, jsd = " << jsd << std::endl;
     }
 
     assert(jsd <= 1.0);
-    state.mutableMetaData()->jsd = jsd;
-
-    double origJsd;
-    if (!context.mutableMetaData->originalJsd) {
-        origJsd = std::max(0.0, jsd - 1.0e-10);
-        context.mutableMetaData->originalJsd = origJsd;
-    } else {
-        origJsd = context.mutableMetaData->originalJsd.get();
-    }
-    double const jsDistance = std::sqrt(2.0 * jsd);
-    double const goal = context.mutableMetaData->goalJSDist.get();
+    metaData->jsd = jsd;
+    metaData->jsDist = std::sqrt(2.0 * jsd);
 
-    double p = node.costG() / std::max(1.0e-6, jsDistance - std::sqrt(2.0 * origJsd));
-    double r = std::max(0.0, goal - jsDistance);
+    double p = node.costG() / std::max(1.0e-6, metaData->jsDist - m_constants.originalJsDist);
+    double r = std::max(0.0, m_constants.goalJsDist - metaData->jsDist);
     double h = r * p;
 
     return h;
 }
 
-namespace {
-inline double logAdd(double s1, double s2)
+/**
+ * Initialize the context meta data this cost function depends on from the initial search state and
+ * freeze the per-search constants derived from it. The goal distance must be set in the context before.
+ * Copies of this cost function made afterwards only read their own constants, so states can be
+ * evaluated concurrently.
+ *
+ * @param initialState initial search state
+ * @param context search context to initialize
+ */
+void ComputeCostH::initContext(State const& initialState, Context& context)
 {
-    return s1 + std::log(1.0 + std::exp(s2 - s1));
-}
+    double const jsd = calculateJsd(initialState.ngramProfile(), *context.targetTable).jsd();
+    context.mutableMetaData->originalJsd = std::max(0.0, jsd - 1.0e-10);
+
+    m_constants.originalJsDist = std::sqrt(2.0 * context.mutableMetaData->originalJsd.get());
+    m_constants.goalJsDist = context.mutableMetaData->goalJSDist.value_or(std::numeric_limits<double>::infinity());
 }
 
 /**
- * Calculate the Jensen-Shannon divergence between two n-gram profiles.
+ * @return evaluation counters shared by all copies of this cost function
  */
-#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
-double ComputeCostH::calculateJsd(Context::ConstNgramPtr const& sourceProfile, Context::ConstNgramPtr const& targetProfile) const
+std::shared_ptr<ComputeCostH::Counters const> ComputeCostH::counters() const
 {
-    auto pNorm = static_cast<double>(targetProfile->n());
-    auto qNorm = static_cast<double>(sourceProfile->n());
-    auto pIt = targetProfile->cbegin();
-    auto qIt = sourceProfile->cbegin();
-    auto const pEnd = targetProfile->cend();
-    auto const qEnd = sourceProfile->cend();
-
-    dekker::Double<double> jsdP = 0.0;
-    dekker::Double<double> jsdQ = 0.0;
-
-    double const logHalf = std::log(0.5);
-
-    boost::optional<NgramProfile::NgramPair> pDeref;
-    boost::optional<NgramProfile::NgramPair> qDeref;
-    while (pIt != pEnd || qIt != qEnd) {
-        double p = 1.0;
-        double q = 1.0;
-
-        pDeref = boost::none;
-        if (pIt != pEnd) {
-            pDeref = *pIt;
-        }
+    return m_counters;
+}
 
-        qDeref = boost::none;
-        if (qIt != qEnd) {
-            qDeref = *qIt;
-        }
+namespace {
+/**
+ * Number of aligned probability pairs passed to the JSD kernel at once.
+ */
+std::size_t constexpr JSD_CHUNK_SIZE = 1024;
+}
 
-        if ((pDeref && !qDeref) || (pDeref && pDeref->first < qDeref->first)) {
-            p = pDeref->second != 0 ? std::log(pDeref->second) - std::log(pNorm) : 1.0;
-           ++pIt;
-        } else if ((qDeref && !pDeref) || (qDeref && pDeref->first > qDeref->first)) {
-            q = qDeref->second != 0 ? std::log(qDeref->second) - std::log(qNorm) : 1.0;
-            ++qIt;
-        } else if (pDeref && qDeref && pDeref->first == qDeref->first) {
-            p = pDeref->second != 0 ? std::log(pDeref->second) - std::log(pNorm) : 1.0;
-            q = qDeref->second != 0 ? std::log(qDeref->second) - std::log(qNorm) : 1.0;
-
-            ++pIt;
-            ++qIt;
-        } else {
-            assert(false);
-        }
+/**
+ * Calculate the Jensen-Shannon divergence between a source profile and the target table.
+ */
+ComputeCostH::JsdSums ComputeCostH::calculateJsd(Context::ConstNgramPtr const& sourceProfile,
+        TargetTable const& targetTable) const
+{
+    return calculateJsd(sourceProfile, targetTable, {sourceProfile->n()}).front();
+}
 
-        double m;
-        if (p <= 0.0 && q <= 0.0) {
-            m = logHalf + logAdd(p, q);
-        } else {
-            m = logHalf + std::min(p, q);
-        }
+/**
+ * Calculate the Jensen-Shannon divergence between the n-gram counts of a source profile,
+ * normalized by each of the given total counts, and the target table.
+ *
+ * Only the source n-grams are walked and merged with their target probabilities into chunks
+ * of aligned probability pairs for the vectorized JSD kernel. N-grams which appear only in
+ * the target contribute p * log2(p / (p / 2)) = p to the target sum, so their total is
+ * one minus the target probability mass covered by the source.
+ *
+ * @param sourceProfile source n-gram counts
+ * @param targetTable target probability table
+ * @param sourceCounts total source n-gram counts to normalize with
+ * @return partial sums for each total count
+ */
+std::vector<ComputeCostH::JsdSums> ComputeCostH::calculateJsd(Context::ConstNgramPtr const& sourceProfile,
+        TargetTable const& targetTable, std::vector<std::size_t> const& sourceCounts) const
+{
+    std::array<double, JSD_CHUNK_SIZE> pChunk;
+    std::array<double, JSD_CHUNK_SIZE> countChunk;
+    std::array<double, JSD_CHUNK_SIZE> qChunk;
+    std::size_t chunkSize = 0;
+
+    struct Accumulator
+    {
+        double qNorm;
+        dekker::Double<double> jsdP = 0.0;
+        dekker::Double<double> jsdQ = 0.0;
+        dekker::Double<double> jsdR = 0.0;
+    };
+    std::vector<Accumulator> accumulators;
+    for (auto count: sourceCounts) {
+        accumulators.push_back({1.0 / static_cast<double>(count)});
+    }
 
-        if (p <= 0.0) {
-            jsdP += std::exp(p) * std::log2(std::exp(p - m));
+    dekker::Double<double> coveredP = 0.0;
+    auto const flush = [&]() {
+        for (auto& acc: accumulators) {
+            for (std::size_t i = 0; i < chunkSize; ++i) {
+                qChunk[i] = countChunk[i] * acc.qNorm;
+            }
+            auto const sums = jsd::accumulate(pChunk.data(), qChunk.data(), chunkSize);
+            acc.jsdP += sums.p;
+            acc.jsdQ += sums.q;
+            acc.jsdR += sums.r;
+        }
+        chunkSize = 0;
+    };
+
+    std::size_t pos = 0;
+    auto const tableSize = targetTable.size();
+    sourceProfile->forEach([&](NgramProfile::Ngram ngram, NgramProfile::Count count) {
+        double p = 0.0;
+        pos = targetTable.lowerBound(ngram, pos);
+        if (pos != tableSize && targetTable.ngramAt(pos) == ngram) {
+            p = targetTable.probAt(pos);
+            coveredP += p;
         }
 
-        if (q <= 0.0) {
-            jsdQ += std::exp(q) * std::log2(std::exp(q - m));
+        pChunk[chunkSize] = p;
+        countChunk[chunkSize] = count;
+        if (++chunkSize == JSD_CHUNK_SIZE) {
+            flush();
         }
+    });
+    flush();
+
+    std::vector<JsdSums> result;
+    result.reserve(accumulators.size());
+    for (auto& acc: accumulators) {
+        // target-only n-grams
+        acc.jsdP += 1.0 - static_cast<double>(coveredP);
+
+        JsdSums sums;
+        sums.p = std::max(0.0, static_cast<double>(acc.jsdP));
+        sums.q = static_cast<double>(acc.jsdQ);
+        sums.r = static_cast<double>(acc.jsdR);
+        result.push_back(sums);
     }
-
-    return 0.5 * static_cast<double>(jsdP + jsdQ);
+    return result;
 }
 
 /**
- * Update the previous Jensen-Shannon divergence from a difference vector.
- * The updated value is only approximate and needs to be corrected after a few iterations.
- *
- * @param previousJsd previous JSD value
- * @param updates vector of n-gram count updates
- * @param sourceProfile new source profile
- * @param targetProfile target profile
- * @return approximate new JSD
+ * Update previous partial JSD sums from the n-grams changed by an edit.
+ *
+ * The summands of changed n-grams are recalculated exactly. A changed total source n-gram count
+ * also changes the normalized source frequencies of all other n-grams. Their summands are corrected
+ * to first order using the derivatives of the partial sums with respect to the source n-gram count:
+ *
+ *     d(sum p * log2(p / m)) / dN =  r / (N ln 2)
+ *     d(sum q * log2(q / m)) / dN = -(q + r / ln 2) / N
+ *
+ * The remaining error is quadratic in the relative change of N, so the result is still approximate
+ * and needs to be corrected after a few iterations. If both counts are equal, only the summands
+ * of the changed n-grams are replaced, which is exact.
+ *
+ * @param previous previous JSD sums, normalized by <tt>oldSourceCount</tt>
+ * @param changed changed n-grams
+ * @param oldSourceCount total source n-gram count before the edit
+ * @param newSourceCount total source n-gram count after the edit
+ * @return new JSD sums
  */
-double ComputeCostH::calculateJsdUpdate(double previousJsd, std::vector<NgramProfile::NgramUpdate> const& updates,
-        Context::ConstNgramPtr const& sourceProfile, Context::ConstNgramPtr const& targetProfile) const
+ComputeCostH::JsdSums ComputeCostH::calculateJsdUpdate(JsdSums const& previous, std::vector<ChangedNgram> const& changed,
+        std::size_t oldSourceCount, std::size_t newSourceCount) const
 {
-    std::size_t const oldQN = sourceProfile->n();
-    int newQN = 0;
-    std::unordered_map<NgramProfile::Ngram, int> updatesMap;
-    for (auto& update: updates) {
-        newQN += update.second;
-        updatesMap[update.first] += update.second;
-    }
-    newQN = oldQN + newQN;
-    assert(newQN > 0);
-
-    double const logHalf = std::log(0.5);
-    double const newQNLog = std::log(newQN);
-    double const oldQNLog = std::log(oldQN);
-
-    dekker::Double<double> oldJsdDiff = 0.0;
-    dekker::Double<double> newJsdDiff = 0.0;
-    for (auto const& update: updatesMap) {
-        double pNorm = targetProfile->normFreq(update.first);
-        double oldQ = sourceProfile->freq(update.first);
-        double newQ = oldQ + update.second;
-        assert(newQ >= 0);
-
-        pNorm = pNorm != 0.0 ? std::log(pNorm) : 1.0;
-        double newQNorm = newQ > 0 ? std::log(newQ) - newQNLog : 1.0;
-        double oldQNorm = oldQ > 0 ? std::log(oldQ) - oldQNLog : 1.0;
-
-        double newMNorm = 1.0;
-        if (pNorm <= 0.0 && newQNorm <= 0.0) {
-            newMNorm = logHalf + logAdd(pNorm, newQNorm);
-        } else if (pNorm <= 0.0 || newQNorm <= 0.0) {
-            newMNorm = logHalf + std::min(pNorm, newQNorm);
-        }
-
-        double oldMNorm = 1.0;
-        if (pNorm <= 0.0 && oldQNorm <= 0.0) {
-            oldMNorm = logHalf + logAdd(pNorm, oldQNorm);
-        } else if (pNorm <= 0.0 || oldQNorm <= 0.0) {
-            oldMNorm = logHalf + std::min(pNorm, oldQNorm);
-        }
-
-        // new diff
-        if (newMNorm <= 0.0) {
-            if (pNorm <= 0.0)
-                newJsdDiff += std::exp(pNorm) * std::log2(std::exp(pNorm - newMNorm));
-
-            if (newQNorm <= 0.0)
-                newJsdDiff += std::exp(newQNorm) * std::log2(std::exp(newQNorm - newMNorm));
-        }
-
-        // old diff
-        if (oldMNorm <= 0.0) {
-            if (pNorm <= 0.0)
-                oldJsdDiff -= std::exp(pNorm) * std::log2(std::exp(pNorm - oldMNorm));
+    auto const oldQN = static_cast<double>(oldSourceCount);
+    auto const newQN = static_cast<double>(newSourceCount);
+    assert(oldQN > 0 && newQN > 0);
+
+    std::vector<double> pValues;
+    std::vector<double> oldQValues;
+    std::vector<double> newQValues;
+    pValues.reserve(changed.size());
+    oldQValues.reserve(changed.size());
+    newQValues.reserve(changed.size());
+    for (auto const& ngram: changed) {
+        double const newQ = std::max(0.0, ngram.parentCount + ngram.delta);
+        assert(ngram.parentCount >= 0);
+        pValues.push_back(ngram.p);
+        oldQValues.push_back(ngram.parentCount / oldQN);
+        newQValues.push_back(newQ / newQN);
+    }
 
-            if (oldQNorm <= 0.0)
-                oldJsdDiff -= std::exp(oldQNorm) * std::log2(std::exp(oldQNorm - oldMNorm));
-        }
+    // remove old summands of changed n-grams
+    auto const oldSums = jsd::accumulate(pValues.data(), oldQValues.data(), pValues.size());
+    dekker::Double<double> jsdP = previous.p;
+    dekker::Double<double> jsdQ = previous.q;
+    dekker::Double<double> jsdR = previous.r;
+    jsdP -= oldSums.p;
+    jsdQ -= oldSums.q;
+    jsdR -= oldSums.r;
+
+    // first-order correction of unchanged summands for the new source n-gram count
+    if (newSourceCount != oldSourceCount) {
+        double const eps = (newQN - oldQN) / oldQN;
+        double const r = static_cast<double>(jsdR);
+        double const q = static_cast<double>(jsdQ);
+        jsdP += eps * r / M_LN2;
+        jsdQ -= eps * (q + r / M_LN2);
     }
 
-    return previousJsd + 0.5 * static_cast<double>(oldJsdDiff + newJsdDiff);
+    // add new summands of changed n-grams
+    auto const newSums = jsd::accumulate(pValues.data(), newQValues.data(), pValues.size());
+    jsdP += newSums.p;
+    jsdQ += newSums.q;
+    jsdR += newSums.r;
+
+    JsdSums sums;
+    sums.p = std::max(0.0, static_cast<double>(jsdP));
+    sums.q = std::max(0.0, static_cast<double>(jsdQ));
+    sums.r = std::max(0.0, static_cast<double>(jsdR));
+    return sums;
 }
@@ -18,8 +18,13 @@
 #define OBFUSCATION_SEARCH_COMPUTECOSTH_HPP
 
 #include "Context.hpp"
+#include "util/jsd.hpp"
 #include <search/generic/Node.hpp>
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 class State;
 
 /**
@@ -27,13 +32,79 @@ class State;
  */
 class ComputeCostH {
 public:
-    ComputeCostH() = default;
+    /**
+     * Evaluation counters, shared between all copies of a cost function.
+     */
+    struct Counters
+    {
+        std::atomic_uint_fast64_t exactEvaluations{0};
+        std::atomic_uint_fast64_t incrementalEvaluations{0};
+        std::atomic_uint_fast64_t depthResyncs{0};
+        std::atomic_uint_fast64_t driftResyncs{0};
+    };
+
+    /**
+     * Partial sums of a JSD calculation, which are needed to update it incrementally.
+     */
+    typedef jsd::Sums JsdSums;
+
+    /**
+     * Per-search constants, frozen by initContext() before the search starts.
+     */
+    struct Constants
+    {
+        /**
+         * Jensen-Shannon distance of the initial state.
+         */
+        double originalJsDist = 0.0;
+
+        /**
+         * Jensen-Shannon distance at which a state is a goal (infinite if the context has no goal).
+         */
+        double goalJsDist = 0.0;
+    };
+
+    explicit ComputeCostH(std::size_t resyncInterval = 5, double maxDrift = 1.0e-2);
     double operator()(search::generic::Node<State> const& node, Context const& context, bool allowUpdate = true) const;
+    void operator()(search::generic::Node<State> const* const* nodes, std::size_t numNodes, Context const& context,
+            double* costs) const;
+    std::shared_ptr<Counters const> counters() const;
+    void initContext(State const& initialState, Context& context);
+
+    /**
+     * @return per-search constants frozen by the last call to initContext()
+     */
+    inline Constants const& constants() const
+    {
+        return m_constants;
+    }
 
 private:
-    double calculateJsd(Context::ConstNgramPtr const& sourceProfile, Context::ConstNgramPtr const& targetProfile) const;
-    double calculateJsdUpdate(double previousJsd, std::vector<NgramProfile::NgramUpdate> const& updates,
-            Context::ConstNgramPtr const& sourceProfile, Context::ConstNgramPtr const& targetProfile) const;
+    friend struct BenchmarkAccess;
+
+    /**
+     * N-gram changed by an edit, with its target probability and its count in the parent profile.
+     */
+    struct ChangedNgram
+    {
+        NgramProfile::Ngram ngram;
+        double p;
+        double parentCount;
+        int delta;
+    };
+
+    bool needsExactEvaluation(search::generic::Node<State> const& node, bool allowUpdate, double& drift) const;
+    double finishEvaluation(search::generic::Node<State> const& node) const;
+    JsdSums calculateJsd(Context::ConstNgramPtr const& sourceProfile, TargetTable const& targetTable) const;
+    std::vector<JsdSums> calculateJsd(Context::ConstNgramPtr const& sourceProfile, TargetTable const& targetTable,
+            std::vector<std::size_t> const& sourceCounts) const;
+    JsdSums calculateJsdUpdate(JsdSums const& previous, std::vector<ChangedNgram> const& changed,
+            std::size_t oldSourceCount, std::size_t newSourceCount) const;
+
+    std::size_t m_resyncInterval;
+    double m_maxDrift;
+    std::shared_ptr<Counters> m_counters;
+    Constants m_constants;
 };
 
 #endif //OBFUSCATION_SEARCH_COMPUTECOSTH_HPP
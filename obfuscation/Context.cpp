@@ -20,5 +20,6 @@
 
 Context::Context(Context::ConstNgramPtr targetProfile)
     : targetNgramProfile(std::move(targetProfile))
+    , targetTable(targetNgramProfile ? std::make_shared<TargetTable const>(*targetNgramProfile) : nullptr)
 {
 }
@@ -18,8 +18,10 @@
 #define OBFUSCATION_CONTEXT_HPP
 
 #include "util/NgramProfile.hpp"
+#include "util/TargetTable.hpp"
 
 #include <boost/optional.hpp>
+#include <cstdint>
 
 /**
  * Global search context.
@@ -47,6 +49,18 @@ struct Context {
 
     ConstNgramPtr targetNgramProfile;
 
+    /**
+     * Frozen probability table of the target profile, built once on construction.
+     */
+    std::shared_ptr<TargetTable const> targetTable;
+
+    /**
+     * Seed of all random decisions of the operators. Operators derive the seed of each decision from
+     * this seed and the state it is made for, so a search is reproducible for a fixed seed, no matter
+     * which worker thread expands a node.
+     */
+    std::uint64_t seed = 0;
+
     /**
      * Pointer to mutable meta data for this context.
      * The target object may be modified during execution.
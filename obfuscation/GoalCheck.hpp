@@ -20,7 +20,6 @@
 #include "Context.hpp"
 #include "State.hpp"
 #include "search/generic/Node.hpp"
-#include <cmath>
 
 class State;
 struct Context;
@@ -31,23 +30,20 @@ struct Context;
 template<typename CostFunc>
 class GoalCheck {
 public:
-    GoalCheck()
-        : m_costFunc() {}
+    /**
+     * @param constants per-search constants of the cost function (see CostFunc::initContext())
+     */
+    explicit GoalCheck(typename CostFunc::Constants const& constants)
+        : m_constants(constants) {}
 
-    double operator()(search::generic::Node<State> const& node, Context const& context) const
+    double operator()(search::generic::Node<State> const& node, Context const&) const
     {
-        auto const& state = node.state();
-
-        if (!state.mutableMetaData()->jsd || !context.mutableMetaData->goalJSDist) {
-            return false;
-        }
-
-        double jsDist = std::sqrt(2.0 * state.mutableMetaData()->jsd.get());
-        return node.depth() > 0 && jsDist >= context.mutableMetaData->goalJSDist.get();
+        auto const& metaData = *node.state().mutableMetaData();
+        return metaData.jsd && node.depth() > 0 && metaData.jsDist >= m_constants.goalJsDist;
     }
 
 private:
-    CostFunc const m_costFunc;
+    typename CostFunc::Constants const m_constants;
 };
 
 #endif //OBFUSCATION_SEARCH_GOALCHECK_HPP
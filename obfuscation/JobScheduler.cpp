@@ -0,0 +1,208 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "JobScheduler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <tuple>
+
+/**
+ * Submitted job.
+ */
+struct JobScheduler::Job
+{
+    Request request;
+    Task task;
+    std::size_t sequence;
+    std::chrono::steady_clock::time_point submitted;
+
+    /**
+     * Executor share of the job while it is running.
+     */
+    std::shared_ptr<search::generic::Executor> executor;
+};
+
+/**
+ * @param executor executor whose threads are shared by all jobs
+ * @param numJobs maximum number of jobs to run concurrently
+ * @param memoryBudget host memory budget in bytes for the memory budgets of all running jobs (0 = unbounded)
+ * @param agingInterval waiting time after which the priority of a waiting job is raised by one (0 = never)
+ */
+JobScheduler::JobScheduler(std::shared_ptr<search::generic::Executor> executor, std::size_t numJobs,
+        std::size_t memoryBudget, std::chrono::seconds agingInterval)
+        : m_executor(std::move(executor))
+        , m_memoryBudget(memoryBudget)
+        , m_agingInterval(agingInterval)
+{
+    if (!m_executor) {
+        m_executor = std::make_shared<search::generic::Executor>();
+    }
+    for (std::size_t i = 0; i < std::max<std::size_t>(1, numJobs); ++i) {
+        m_threads.emplace_back(&JobScheduler::runJobs, this);
+    }
+}
+
+/**
+ * Wait until all submitted jobs have finished and stop the job threads.
+ */
+JobScheduler::~JobScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    for (auto& thread: m_threads) {
+        thread.join();
+    }
+}
+
+/**
+ * Queue a job. The task is run by one of the job threads once the job is started.
+ * Exceptions thrown by the task are reported on std::cerr.
+ *
+ * @param request scheduling parameters of the job
+ * @param task job function
+ * @param maxWaiting maximum number of waiting jobs (0 = unbounded)
+ * @return number of waiting jobs including this one
+ * @throw std::runtime_error if maxWaiting jobs are already waiting
+ * @throw std::invalid_argument if the CPU share is not positive
+ */
+std::size_t JobScheduler::submit(Request const& request, Task task, std::size_t maxWaiting)
+{
+    if (!(request.cpuShare > 0.0)) {
+        throw std::invalid_argument("CPU share must be positive");
+    }
+
+    std::size_t numWaiting;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (maxWaiting != 0 && m_waiting.size() >= maxWaiting) {
+            throw std::runtime_error("queue is full");
+        }
+        m_waiting.push_back(Job{request, std::move(task), m_numSubmitted++, std::chrono::steady_clock::now(), nullptr});
+        numWaiting = m_waiting.size();
+    }
+    m_condition.notify_all();
+    return numWaiting;
+}
+
+/**
+ * Block until all submitted jobs have finished.
+ */
+void JobScheduler::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this] { return m_waiting.empty() && m_running.empty(); });
+}
+
+std::size_t JobScheduler::numWaiting() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_waiting.size();
+}
+
+std::size_t JobScheduler::numRunning() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_running.size();
+}
+
+/**
+ * Job thread loop that starts and runs waiting jobs until the scheduler is destroyed.
+ */
+void JobScheduler::runJobs()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        auto job = m_waiting.end();
+        m_condition.wait(lock, [&] {
+            job = nextJob();
+            return job != m_waiting.end() || (m_stop && m_waiting.empty());
+        });
+        if (job == m_waiting.end()) {
+            return;
+        }
+
+        m_running.splice(m_running.end(), m_waiting, job);
+        m_usedMemory += job->request.memoryBudget;
+        job->executor = m_executor->share(0);
+        rebalance();
+        lock.unlock();
+
+        try {
+            job->task(job->executor);
+        } catch (std::exception const& e) {
+            std::cerr << "Error in scheduled job: " << e.what() << std::endl;
+        }
+
+        lock.lock();
+        m_usedMemory -= job->request.memoryBudget;
+        m_running.erase(job);
+        rebalance();
+        m_condition.notify_all();
+    }
+}
+
+/**
+ * Get the waiting job to start next. Must be called with the mutex held.
+ *
+ * @return next job or <tt>m_waiting.end()</tt> if no job is waiting or the next one does not fit into
+ *         the memory budget
+ */
+std::list<JobScheduler::Job>::iterator JobScheduler::nextJob()
+{
+    auto const now = std::chrono::steady_clock::now();
+    auto rank = [&](Job const& job) {
+        long priority = job.request.priority;
+        if (m_agingInterval.count() > 0) {
+            priority += static_cast<long>((now - job.submitted) / m_agingInterval);
+        }
+        return std::make_tuple(-priority, job.request.size, job.sequence);
+    };
+
+    auto next = m_waiting.end();
+    for (auto it = m_waiting.begin(); it != m_waiting.end(); ++it) {
+        if (next == m_waiting.end() || rank(*it) < rank(*next)) {
+            next = it;
+        }
+    }
+    if (next != m_waiting.end() && m_memoryBudget != 0 && !m_running.empty()
+            && m_usedMemory + next->request.memoryBudget > m_memoryBudget) {
+        return m_waiting.end();
+    }
+    return next;
+}
+
+/**
+ * Divide the executor threads between the running jobs by their CPU shares. Each job gets at least one
+ * thread. Must be called with the mutex held.
+ */
+void JobScheduler::rebalance()
+{
+    double totalShare = 0.0;
+    for (auto const& job: m_running) {
+        totalShare += job.request.cpuShare;
+    }
+    auto const numThreads = static_cast<double>(m_executor->numThreads());
+    for (auto const& job: m_running) {
+        job.executor->setMaxThreads(std::max<std::size_t>(1, static_cast<std::size_t>(
+                std::lround(numThreads * job.request.cpuShare / totalShare))));
+    }
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_SEARCH_JOBSCHEDULER_HPP
+#define OBFUSCATION_SEARCH_JOBSCHEDULER_HPP
+
+#include <search/generic/Executor.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Host-level scheduler for obfuscation jobs that run concurrently in one process.
+ *
+ * Jobs are run by a fixed number of job threads. All jobs share the threads of one search executor,
+ * and each running job gets its own share of it (see search::generic::Executor::share), whose size is
+ * proportional to the job's CPU share among all running jobs. The executor's pool threads steal work
+ * from each other, so a share that is not used by its job is taken up by the other jobs.
+ *
+ * Waiting jobs are started in order of priority, and jobs of equal priority in order of size, so that
+ * short documents do not wait behind book-length ones. To keep large jobs from starving, the priority
+ * of a waiting job is raised by one per aging interval. A job is only started if its memory budget fits
+ * into the host memory budget next to the budgets of the running jobs, unless no other job is running.
+ * The next job in order is never overtaken by a smaller one that would fit in its place.
+ */
+class JobScheduler {
+public:
+    /**
+     * Scheduling parameters of a job.
+     */
+    struct Request
+    {
+        /**
+         * Jobs of higher priority are started first.
+         */
+        int priority = 0;
+
+        /**
+         * Relative share of the executor threads while the job is running.
+         */
+        double cpuShare = 1.0;
+
+        /**
+         * Memory budget of the job's search in bytes (0 = unknown, always fits).
+         */
+        std::size_t memoryBudget = 0;
+
+        /**
+         * Size of the job, e.g. its text length. Of jobs with equal priority, smaller ones are started first.
+         */
+        std::size_t size = 0;
+    };
+
+    /**
+     * Job function, which is passed the executor share to run its search on.
+     */
+    typedef std::function<void(std::shared_ptr<search::generic::Executor> const&)> Task;
+
+    JobScheduler(std::shared_ptr<search::generic::Executor> executor, std::size_t numJobs,
+            std::size_t memoryBudget = 0, std::chrono::seconds agingInterval = std::chrono::seconds(60));
+    JobScheduler(JobScheduler const&) = delete;
+    JobScheduler& operator=(JobScheduler const&) = delete;
+    ~JobScheduler();
+
+    std::size_t submit(Request const& request, Task task, std::size_t maxWaiting = 0);
+    void wait();
+
+    std::size_t numWaiting() const;
+    std::size_t numRunning() const;
+
+private:
+    struct Job;
+
+    void runJobs();
+    std::list<Job>::iterator nextJob();
+    void rebalance();
+
+    std::shared_ptr<search::generic::Executor> m_executor;
+    std::size_t m_memoryBudget;
+    std::chrono::seconds m_agingInterval;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::list<Job> m_waiting;
+    std::list<Job> m_running;
+    std::size_t m_usedMemory = 0;
+    std::size_t m_numSubmitted = 0;
+    bool m_stop = false;
+
+    std::vector<std::thread> m_threads;
+};
+
+#endif //OBFUSCATION_SEARCH_JOBSCHEDULER_HPP
@@ -0,0 +1,290 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ObfuscationServer.hpp"
+#include "Obfuscator.hpp"
+#include "util/DictionaryRegistry.hpp"
+#include "util/LayeredOStream.hpp"
+#include "util/NgramProfile.hpp"
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace asio = boost::asio;
+using asio::ip::tcp;
+
+namespace {
+/**
+ * Stream buffer that prefixes each line written to it before passing it on to another stream.
+ */
+class LinePrefixStreamBuf : public std::streambuf {
+public:
+    LinePrefixStreamBuf(std::ostream& target, std::string prefix)
+            : m_target(target)
+            , m_prefix(std::move(prefix))
+    {
+    }
+
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof())) {
+            return traits_type::not_eof(c);
+        }
+        if (m_lineStart) {
+            m_target << m_prefix;
+        }
+        m_target.put(traits_type::to_char_type(c));
+        m_lineStart = traits_type::to_char_type(c) == '\n';
+        return m_target ? c : traits_type::eof();
+    }
+
+    int sync() override
+    {
+        m_target.flush();
+        return m_target ? 0 : -1;
+    }
+
+private:
+    std::ostream& m_target;
+    std::string const m_prefix;
+    bool m_lineStart = true;
+};
+}
+
+/**
+ * Queued obfuscation job.
+ */
+struct ObfuscationServer::Job
+{
+    std::stringstream input;
+    Context::NgramPtr targetProfile;
+    unsigned int flags = 0;
+    boost::optional<std::chrono::steady_clock::time_point> deadline;
+
+    /**
+     * Connection stream for progress messages, only written by the job thread while the job runs.
+     */
+    std::ostream* progress = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool queued = false;
+    bool done = false;
+    bool goal = false;
+    std::string result;
+    std::string error;
+};
+
+/**
+ * @param searchOptions search options for all jobs. If no executor is set,
+ *                      a single executor is created and shared by all jobs.
+ * @param port TCP port to listen on
+ * @param numWorkers number of jobs to run concurrently
+ * @param queueSize maximum number of waiting jobs, further requests are rejected
+ * @param hostMemoryBudget bytes available to the memory budgets of all running searches (0 = unbounded)
+ */
+ObfuscationServer::ObfuscationServer(search::generic::Options const& searchOptions, unsigned short port,
+        std::size_t numWorkers, std::size_t queueSize, std::size_t hostMemoryBudget)
+        : m_searchOptions(searchOptions)
+        , m_port(port)
+        , m_queueSize(queueSize)
+        , m_scheduler(searchOptions.executor, numWorkers, hostMemoryBudget)
+{
+}
+
+/**
+ * Accept connections. Does not return unless accepting fails.
+ *
+ * @throw boost::system::system_error if the server socket cannot be opened
+ */
+void ObfuscationServer::run()
+{
+    asio::io_context ioContext;
+    tcp::acceptor acceptor(ioContext, tcp::endpoint(tcp::v4(), m_port));
+    std::cout << "Listening on port " << m_port << "..." << std::endl;
+
+    while (true) {
+        tcp::socket socket(ioContext);
+        acceptor.accept(socket);
+        std::thread([this](tcp::socket socket) {
+            tcp::iostream stream(std::move(socket));
+            serveConnection(stream);
+        }, std::move(socket)).detach();
+    }
+}
+
+/**
+ * Read a job from a connection, enqueue it and send its progress and result.
+ *
+ * @param stream connection stream
+ */
+void ObfuscationServer::serveConnection(std::iostream& stream)
+{
+    auto job = std::make_shared<Job>();
+    try {
+        std::string line;
+        if (!std::getline(stream, line)) {
+            return;
+        }
+
+        if (line == "RELOAD_DICTIONARIES") {
+            stream << "RELOADED " << DictionaryRegistry::instance().reloadAll() << std::endl;
+            return;
+        }
+
+        JobScheduler::Request request;
+        request.memoryBudget = m_searchOptions.memory_budget_in_bytes;
+        if (line.compare(0, 9, "PRIORITY ") == 0) {
+            std::istringstream priorityLine(line.substr(9));
+            if (!(priorityLine >> request.priority) || request.priority < -4 || request.priority > 4) {
+                throw std::runtime_error("priority must be between -4 and 4");
+            }
+            request.cpuShare = std::ldexp(1.0, request.priority);
+            if (!std::getline(stream, line)) {
+                return;
+            }
+        }
+
+        std::istringstream header(line);
+        std::string command;
+        double deadlineSeconds = 0.0;
+        int stripPos = 0;
+        std::size_t textBytes = 0;
+        std::string profileFile;
+        header >> command >> deadlineSeconds >> stripPos >> textBytes >> std::ws;
+        std::getline(header, profileFile);
+        if (command != "OBFUSCATE" || !header || profileFile.empty()) {
+            throw std::runtime_error("malformed request header");
+        }
+        if (textBytes > m_maxRequestBytes) {
+            throw std::runtime_error("request text exceeds " + std::to_string(m_maxRequestBytes) + " bytes");
+        }
+
+        std::string text(textBytes, '\0');
+        if (!stream.read(&text[0], textBytes)) {
+            throw std::runtime_error("incomplete request text");
+        }
+        job->input.str(text);
+        job->flags = stripPos ? NgramProfile::STRIP_POS_ANNOTATIONS : 0u;
+        if (deadlineSeconds > 0.0) {
+            job->deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(deadlineSeconds));
+        }
+        job->targetProfile = targetProfile(profileFile);
+        job->progress = &stream;
+        request.size = textBytes;
+
+        auto const position = m_scheduler.submit(request, [this, job](
+                std::shared_ptr<search::generic::Executor> const& executor) {
+            runJob(*job, executor);
+        }, m_queueSize);
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        // Written before the job thread may write progress, which waits for it.
+        stream << "QUEUED " << position << std::endl;
+        job->queued = true;
+        job->condition.notify_all();
+        job->condition.wait(lock, [&job] { return job->done; });
+        if (!job->error.empty()) {
+            throw std::runtime_error(job->error);
+        }
+        stream << "RESULT " << (job->goal ? "GOAL" : "ABORTED") << " " << job->result.size() << "\n"
+               << job->result << std::flush;
+    } catch (std::exception const& e) {
+        stream << "ERROR " << e.what() << std::endl;
+    }
+}
+
+/**
+ * Run a job, called by a job thread of the scheduler.
+ *
+ * @param job job to run
+ * @param executor executor share to run the search on
+ */
+void ObfuscationServer::runJob(Job& job, std::shared_ptr<search::generic::Executor> const& executor)
+{
+    {
+        std::unique_lock<std::mutex> lock(job.mutex);
+        job.condition.wait(lock, [&job] { return job.queued; });
+    }
+
+    std::string result;
+    std::string error;
+    bool goal = false;
+    try {
+        if (job.deadline && std::chrono::steady_clock::now() >= job.deadline.get()) {
+            throw std::runtime_error("deadline expired while queued");
+        }
+
+        LinePrefixStreamBuf progressBuf(*job.progress, "PROGRESS ");
+        std::ostream progress(&progressBuf);
+        std::stringstream outputBuffer;
+        LayeredOStream output(outputBuffer);
+
+        Obfuscator obfuscator;
+        obfuscator.searchOptions() = m_searchOptions;
+        obfuscator.searchOptions().executor = executor;
+        obfuscator.searchOptions().metrics_label = "job-" + std::to_string(++m_numJobs);
+        obfuscator.setLogStream(progress);
+        obfuscator.setDeadline(job.deadline);
+        obfuscator.setAcceptableJsDist(m_acceptableJsDist);
+        goal = obfuscator.obfuscate(job.input, output, job.targetProfile, job.flags);
+        progress.flush();
+
+        result = outputBuffer.str();
+        if (result.empty()) {
+            // no state was better than the original text
+            result = job.input.str();
+        }
+    } catch (std::exception const& e) {
+        error = e.what();
+    }
+
+    std::lock_guard<std::mutex> lock(job.mutex);
+    job.result = std::move(result);
+    job.error = std::move(error);
+    job.goal = goal;
+    job.done = true;
+    job.condition.notify_all();
+}
+
+/**
+ * Get a resident target profile, which is loaded on first use.
+ *
+ * @param filename target profile file
+ * @return loaded profile
+ * @throw std::exception if the profile cannot be loaded
+ */
+Context::NgramPtr ObfuscationServer::targetProfile(std::string const& filename)
+{
+    std::lock_guard<std::mutex> lock(m_profileMutex);
+    auto profileIt = m_profiles.find(filename);
+    if (profileIt != m_profiles.end()) {
+        return profileIt->second;
+    }
+
+    auto profile = std::make_shared<NgramProfile>();
+    profile->load(filename);
+    m_profiles[filename] = profile;
+    return profile;
+}
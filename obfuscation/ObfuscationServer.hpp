@@ -0,0 +1,112 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_SEARCH_OBFUSCATIONSERVER_HPP
+#define OBFUSCATION_SEARCH_OBFUSCATIONSERVER_HPP
+
+#include "Context.hpp"
+#include "JobScheduler.hpp"
+
+#include <search/generic/AstarSearch.hpp>
+
+#include <boost/optional.hpp>
+
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * Long-running obfuscation service.
+ *
+ * The server accepts jobs over TCP, queues them in a bounded queue and runs them on a fixed number
+ * of job threads of a JobScheduler. Dictionaries, target profiles and the search executor stay resident
+ * between jobs.
+ *
+ * Protocol (one connection per job):
+ * <pre>
+ * client: OBFUSCATE DEADLINE_SECONDS STRIP_POS TEXT_BYTES PROFILE_FILE\n TEXT
+ * server: QUEUED POSITION\n
+ *         PROGRESS LINE\n ...
+ *         RESULT GOAL|ABORTED TEXT_BYTES\n TEXT
+ * </pre>
+ * A deadline of 0 means no deadline, STRIP_POS is 0 or 1 and PROFILE_FILE is a target profile on the
+ * server's file system. On errors, the server replies with <tt>ERROR MESSAGE\n</tt> and closes the connection.
+ * Requests whose TEXT_BYTES exceed the maximum request size (see setMaxRequestBytes) are rejected before the
+ * text is read.
+ * POSITION is the number of jobs waiting, including this one.
+ *
+ * The request header may be preceded by a line <tt>PRIORITY N</tt> with N between -4 and 4 (default 0).
+ * Jobs of higher priority are started first, and each level doubles the job's share of the executor threads.
+ *
+ * The word dictionaries can be reloaded from disk without restarting the server (see DictionaryRegistry):
+ * <pre>
+ * client: RELOAD_DICTIONARIES\n
+ * server: RELOADED NUM_DICTIONARIES\n
+ * </pre>
+ * Jobs that are already running keep the dictionaries they started with.
+ */
+class ObfuscationServer {
+public:
+    ObfuscationServer(search::generic::Options const& searchOptions, unsigned short port,
+            std::size_t numWorkers = 1, std::size_t queueSize = 16, std::size_t hostMemoryBudget = 0);
+
+    /**
+     * Set a Jensen-Shannon distance that is good enough to end searches early (see Obfuscator::setAcceptableJsDist).
+     */
+    inline void setAcceptableJsDist(boost::optional<double> jsDist)
+    {
+        m_acceptableJsDist = jsDist;
+    }
+
+    /**
+     * Set the maximum TEXT_BYTES of a request, so that a client cannot make the server allocate arbitrary amounts
+     * of memory for the request text.
+     */
+    inline void setMaxRequestBytes(std::size_t maxRequestBytes)
+    {
+        m_maxRequestBytes = maxRequestBytes;
+    }
+
+    void run();
+
+private:
+    struct Job;
+
+    void serveConnection(std::iostream& stream);
+    void runJob(Job& job, std::shared_ptr<search::generic::Executor> const& executor);
+    Context::NgramPtr targetProfile(std::string const& filename);
+
+    search::generic::Options m_searchOptions;
+    unsigned short m_port;
+    std::size_t m_queueSize;
+    boost::optional<double> m_acceptableJsDist;
+    std::size_t m_maxRequestBytes = 16 * 1024 * 1024;
+
+    /**
+     * Number of jobs started so far, used to label their metrics.
+     */
+    std::atomic_size_t m_numJobs{0};
+
+    std::mutex m_profileMutex;
+    std::map<std::string, Context::NgramPtr> m_profiles;
+
+    JobScheduler m_scheduler;
+};
+
+#endif //OBFUSCATION_SEARCH_OBFUSCATIONSERVER_HPP
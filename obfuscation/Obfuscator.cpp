@@ -25,7 +25,19 @@
 //#include "operators/WordReplacementOperator.hpp"
 //#include "operators/WordRemovalOperator.hpp"
 #include "search/generic/AstarSearch.hpp"
+#include <cmath>
 #include <iomanip>
+#include <limits>
+#include <sstream>
+
+Obfuscator::Obfuscator()
+{
+    m_searchOptions.free_memory_limit_in_mbytes = 2000;
+    m_searchOptions.status_update_interval = 500;
+    m_searchOptions.beam_width = 40000;
+    m_searchOptions.memory_budget_in_bytes = static_cast<std::size_t>(1024) * 1024 * 1024;
+    m_searchOptions.compute_cost_h_in_workers = true;
+}
 
 /**
  * Run obfuscation.
@@ -34,20 +46,63 @@
  * @param output output stream for the obfuscated text
  * @param targetDist target n-gram distribution to imitate
  * @param flags bit flags for n-gram profile generation
+ * @return whether a goal state was reached
+ */
+bool Obfuscator::obfuscate(std::stringstream& input, LayeredOStream& output, Context::NgramPtr targetDist, unsigned int flags)
+{
+    return run(input, [&output](DiffString const& text) {
+        output << text.string();
+        output.flushBase(true);
+    }, std::move(targetDist), flags);
+}
+
+/**
+ * Run obfuscation and write improved texts from a background thread, so that file I/O does not stall
+ * the search. All texts have been written when this function returns.
+ *
+ * @param input input text as stream
+ * @param output snapshot writer for the obfuscated text
+ * @param targetDist target n-gram distribution to imitate
+ * @param flags bit flags for n-gram profile generation
+ * @return whether a goal state was reached
+ */
+bool Obfuscator::obfuscate(std::stringstream& input, SnapshotWriter& output, Context::NgramPtr targetDist, unsigned int flags)
+{
+    bool const goal = run(input, [&output](DiffString const& text) { output.submit(text); },
+            std::move(targetDist), flags);
+    if (!output.flush()) {
+        *m_log << "Could not write output file '" << output.filename() << "'" << std::endl;
+    }
+    return goal;
+}
+
+/**
+ * Run obfuscation.
+ *
+ * @param input input text as stream
+ * @param publish function called with each text that improves on the previous one
+ * @param targetDist target n-gram distribution to imitate
+ * @param flags bit flags for n-gram profile generation
+ * @return whether a goal state was reached
  */
-void Obfuscator::obfuscate(std::stringstream& input, LayeredOStream& output, Context::NgramPtr targetDist, unsigned int flags)
+bool Obfuscator::run(std::stringstream& input, Publish const& publish, Context::NgramPtr targetDist, unsigned int flags)
 {
     auto sourceText = std::make_shared<std::string>(input.str());
 
     auto const status = std::make_shared<Status>();
     status->init_memory_in_kbytes = search::generic::GetUsedMemoryInKilobytes();
-    status->compute_cost_h = ComputeCostH();
-    status->is_goal_state = GoalCheck<ComputeCostH>();
+    ComputeCostH computeCostH;
     status->compute_hash = [](State const& s) { return s.hashValue(); };
+    status->compute_memory = [](State const& s) { return s.memoryUsage(); };
+    status->release_state = [](State& s) { s.releasePayload(); };
+    status->prepare_expansion = [](search::generic::Node<State> const& node, Context& c) {
+        ObfuscationOperator::prepareExpansion(node.state(), c);
+    };
 
     // define search context
     Context context(targetDist);
     context.mutableMetaData->originalTextLength = sourceText->size();
+    context.seed = m_searchOptions.random_seed;
 
     // JSD obfuscation thresholds calculated on various corpora
 
@@ -72,9 +127,25 @@ void Obfuscator::obfuscate(std::stringstream& input, LayeredOStream& output, Con
     // define initial state
     State initialState;
     initialState.setText(std::move(sourceText), flags);
+    computeCostH.initContext(initialState, context);
+    status->compute_cost_h = computeCostH;
+    status->compute_cost_h_batch = computeCostH;
+    status->is_goal_state = GoalCheck<ComputeCostH>(computeCostH.constants());
+    status->compute_progress = [](search::generic::Node<State> const& node, Context const&) {
+        return node.state().mutableMetaData()->jsDist;
+    };
+    if (m_acceptableJsDist && m_acceptableJsDist.get() < computeCostH.constants().goalJsDist) {
+        auto acceptable = computeCostH.constants();
+        acceptable.goalJsDist = m_acceptableJsDist.get();
+        status->is_acceptable_state = GoalCheck<ComputeCostH>(acceptable);
+    }
     search::generic::Node<State> const initialNode(initialState);
     status->setCurrentNodeAndContext(initialNode, context);
 
+    // checkpointed states are stored relative to the initial state
+    status->save_state = [](State const& s, std::ostream& os) { s.save(os); };
+    status->load_state = [initialState](std::istream& is) { return State::load(is, initialState); };
+
     // load operators
     std::vector<std::unique_ptr<Operator>> operators;
     operators.push_back(std::make_unique<NgramRemovalOperator>(
@@ -93,25 +164,69 @@ void Obfuscator::obfuscate(std::stringstream& input, LayeredOStream& output, Con
 //            "Word removal", 2, "Delete a word from the text if it's not strictly needed in its context"));
     status->setOperators(std::move(operators));
 
-    // configure other options
-    search::generic::Options options;
-    options.free_memory_limit_in_mbytes = 2000;
-    options.status_update_interval = 500;
+    // configure other options (the executor is reused by subsequent searches)
+    if (!m_searchOptions.executor) {
+        m_searchOptions.executor = std::make_shared<search::generic::Executor>();
+    }
+    auto const& options = m_searchOptions;
 
     double bestJsd = 0.0;
+    double bestGoalCost = std::numeric_limits<double>::infinity();
+    auto const jsdCounters = computeCostH.counters();
+
+    // structured metrics replace the progress log, except for the final summary
+    bool const logProgress = !options.metrics_sink;
+    status->annotate_metrics = [jsdCounters](search::generic::Node<State> const& node, Context const& c,
+            search::generic::MetricsSnapshot& snapshot) {
+        auto const& state = node.state();
+        double const jsd = state.mutableMetaData()->jsd.value_or(0.0);
+        auto const ngramCache = ObfuscationOperator::ngramSelectionCacheStats();
+        snapshot.values.emplace_back("jsd", jsd);
+        snapshot.values.emplace_back("js_distance", std::sqrt(2.0 * jsd));
+        snapshot.values.emplace_back("goal_js_distance", c.mutableMetaData->goalJSDist.value_or(0.0));
+        snapshot.values.emplace_back("text_length_ratio",
+                static_cast<double>(state.text().size()) / c.mutableMetaData->originalTextLength.value_or(1));
+        snapshot.values.emplace_back("jsd_exact_evaluations", jsdCounters->exactEvaluations);
+        snapshot.values.emplace_back("jsd_incremental_evaluations", jsdCounters->incrementalEvaluations);
+        snapshot.values.emplace_back("ngram_cache_hits", ngramCache.hits);
+        snapshot.values.emplace_back("ngram_cache_misses", ngramCache.misses);
+    };
 
     // define status callback
-    std::function<void(Status const&)> callback = [&context, &output, &bestJsd](Status const& s) {
-        auto const& node = s.getCurrentNodeAndContext().first;
+    std::ostream& logStream = *m_log;
+    std::function<void(Status const&)> callback = [&context, &publish, &bestJsd, &bestGoalCost, &jsdCounters, &logStream, logProgress](Status const& s) {
+        auto const current = s.getCurrentNodeAndContext();
+        auto const& node = current.first;
         auto const& state = node.state();
-        std::string text = state.text().string();
 
+        // an anytime search keeps running after its first goal, so only cheaper goals are published then
         double jsd = state.mutableMetaData()->jsd.value_or(0.0);
-        if (s.has_goal_state || jsd > bestJsd) {
-            output << text;
-            output.flushBase(true);
+        bool const isGoal = s.has_goal_state && s.is_goal_state(node, current.second);
+        if (isGoal ? node.costG() < bestGoalCost : (std::isinf(bestGoalCost) && jsd > bestJsd)) {
+            publish(state.text());
             bestJsd = jsd;
+            if (isGoal) {
+                bestGoalCost = node.costG();
+            }
+        }
+
+        if (!logProgress && !s.finished) {
+            return;
+        }
+
+        auto const ngramCache = ObfuscationOperator::ngramSelectionCacheStats();
+
+        std::ostringstream phaseTimes;
+#ifdef PHASE_TIMING_ENABLED
+        auto const phaseTotals = s.getPhaseTotals();
+        phaseTimes << std::setprecision(2);
+        for (std::size_t i = 0; i < search::generic::kNumPhases; ++i) {
+            phaseTimes << (i == 0 ? "" : ", ") << search::generic::PhaseName(static_cast<search::generic::Phase>(i))
+                       << " " << search::generic::PhaseTimers::TicksToSeconds(phaseTotals.ticks[i]);
         }
+#else
+        phaseTimes << "disabled";
+#endif
 
         double parentH = 0.0;
         double parentG = 0.0;
@@ -124,13 +239,15 @@ void Obfuscator::obfuscate(std::stringstream& input, LayeredOStream& output, Con
             parentJsd = node.parent()->state().mutableMetaData()->jsd.get();
         }
 
-        std::cout << std::setprecision(5) << std::fixed
+        logStream << std::setprecision(5) << std::fixed
                   << "Used Memory: " << (s.used_memory_in_kbytes / 1024) << " MiB\n"
                   << "Closed States: " << s.size_of_closed << "\n"
                   << "Open States: " << s.size_of_open << "\n"
                   << "Closed States/s: " << (1000.0 * s.size_of_closed / s.runtime_in_millis) << "\n"
                   << "Reopened States/s: " << s.num_reopened_states << "\n"
                   << "Duplicate States/s: " << s.num_duplicated_states << "\n"
+                  << "Pruned States: " << s.num_pruned_states << "\n"
+                  << "Search Memory (estimated): " << (s.estimated_memory_in_bytes / (1024 * 1024)) << " MiB\n"
                   << "States/s: " << (1000.0 * (s.size_of_open + s.size_of_closed + s.num_duplicated_states) / s.runtime_in_millis) << "\n"
                   << "New States/s: " << (1000.0 * (s.size_of_open + s.size_of_closed) / s.runtime_in_millis) << "\n"
                   << "Runtime: " << s.runtime_in_millis / 1000 << "s" << "\n"
@@ -148,28 +265,66 @@ void Obfuscator::obfuscate(std::stringstream& input, LayeredOStream& output, Con
                   << "jsd(x): " << std::setw(13) << jsd
                         << ",     jsd(x-1): " << std::setw(13) << parentJsd
                         << ",     diff: " << std::setw(10) << (jsd - parentJsd) << "\n"
+                  << "JSD evaluations (exact / incremental): " << jsdCounters->exactEvaluations
+                        << " / " << jsdCounters->incrementalEvaluations << "\n"
+                  << "JSD resyncs (depth / drift): " << jsdCounters->depthResyncs
+                        << " / " << jsdCounters->driftResyncs << "\n"
+                  << "N-gram cache (hits / misses / evictions): " << ngramCache.hits
+                        << " / " << ngramCache.misses << " / " << ngramCache.evictions << "\n"
+                  << "Operator applications (run / skipped): " << s.getNumOperatorApplications()
+                        << " / " << s.getNumSkippedOperatorApplications() << "\n"
+                  << "Phase times (s): " << phaseTimes.str() << "\n"
                   << "Monotone h(x-1) <= c(x-1, x) + h(x):  " << (parentH <= (node.costG() - parentG) + node.costH()) << "\n"
-                  << "Text Length Ratio: " << static_cast<double>(text.length()) / context.mutableMetaData->originalTextLength.get() << "\n"
+                  << "Text Length Ratio: " << static_cast<double>(state.text().size()) / context.mutableMetaData->originalTextLength.get() << "\n"
                   << "Target JSDist: " << context.mutableMetaData->goalJSDist.get() << "\n"
                   << "Best JSDist: " << std::sqrt(2.0 * parentJsd) << "\n"
                   << std::endl;
     };
 
-    // run A* search
-    search::generic::AstarSearch(status, callback, options);
-    std::cout << "y3, y2, y1 = np.reshape([";
-    auto node = status->getCurrentNodeAndContext().first;
-    double jsd = node.state().mutableMetaData()->jsd.value_or(0.0);
-    int i = 0;
-    while (node.parent()) {
-        node = *node.parent();
-        double prevJsd = node.state().mutableMetaData()->jsd.value_or(0.0);
-        std::cout << (jsd - prevJsd) << "," << (node.costG()) << "," << (node.costH()) << ",";
-        jsd = prevJsd;
-        ++i;
+    // run A* search (or one of its hash-distributed variants)
+    auto search = &search::generic::AstarSearch<State, Context>;
+    auto searchAsync = &search::generic::AstarSearchAsync<State, Context>;
+    if (m_searchEngine == SearchEngine::HDA) {
+        search = &search::generic::HdaSearch<State, Context>;
+        searchAsync = &search::generic::HdaSearchAsync<State, Context>;
+    } else if (m_searchEngine == SearchEngine::DISTRIBUTED) {
+        search = &search::generic::DistributedSearch<State, Context>;
+        searchAsync = &search::generic::DistributedSearchAsync<State, Context>;
+    }
+    if (m_deadline) {
+        searchAsync(status, callback, options);
+        if (!status->waitForCompletionUntil(m_deadline.get())) {
+            status->aborted_by_caller = true;
+            status->waitForCompletion();
+        }
+    } else {
+        search(status, callback, options);
+    }
+    m_lastSolution = SolutionPath(status->getCurrentNodeAndContext().first);
+    if (logProgress) {
+        logStream << "y3, y2, y1 = np.reshape([";
+        auto const& steps = m_lastSolution.steps();
+        for (std::size_t i = steps.size() - 1; i > 0; --i) {
+            logStream << (steps[i].jsd - steps[i - 1].jsd) << "," << steps[i - 1].costG << "," << steps[i - 1].costH << ",";
+        }
+        logStream << "][::-1], (3, " << (steps.size() - 1) << "), 'F')" << std::endl;
     }
-    std::cout << "][::-1], (3, " << i << "), 'F')" << std::endl;
 
-    std::cout << "==== GOAL STATE: ====" << std::endl;
+    if (status->aborted_by_memguard) {
+        logStream << "Search aborted by memory guard" << std::endl;
+    }
+    if (status->aborted_by_budget) {
+        logStream << "Search aborted by time or expansion budget, keeping the best state so far" << std::endl;
+    }
+    if (status->has_acceptable_state) {
+        logStream << "Search ended early at acceptable JS distance " << m_acceptableJsDist.get() << std::endl;
+    }
+    if (!status->error_message.empty()) {
+        logStream << "Search error: " << status->error_message << std::endl;
+    }
+    logStream << "==== GOAL STATE: ====" << std::endl;
     callback(*status);
+    m_lastStatus = status;
+
+    return status->has_goal_state;
 }
@@ -19,10 +19,20 @@
 
 #include "State.hpp"
 #include "Context.hpp"
+#include "SolutionPath.hpp"
 #include "util/LayeredOStream.hpp"
+#include "util/SnapshotWriter.hpp"
 
+#include <search/generic/AstarSearch.hpp>
+#include <search/generic/DistributedSearch.hpp>
+#include <search/generic/HdaSearch.hpp>
 #include <search/generic/Operator.hpp>
 #include <search/generic/Status.hpp>
+#include <boost/optional.hpp>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
 #include <sstream>
 
 class Obfuscator {
@@ -30,7 +40,114 @@ public:
     typedef search::generic::Operator<State, Context> Operator;
     typedef search::generic::Status<State, Context> Status;
 
-    void obfuscate(std::stringstream& input, LayeredOStream& output, Context::NgramPtr targetDist, unsigned int flags = 0);
+    /**
+     * Search algorithm run by obfuscate().
+     */
+    enum class SearchEngine {
+        /**
+         * A* on the calling thread (see search::generic::AstarSearch).
+         */
+        ASTAR,
+
+        /**
+         * Hash-distributed A* with one partition of the search states per worker thread, whose number
+         * is set by <tt>searchOptions().search_threads</tt> (see search::generic::HdaSearch).
+         */
+        HDA,
+
+        /**
+         * Hash-distributed A* across processes connected by <tt>searchOptions().transport</tt>, which
+         * all obfuscate the same input against the same target profile and end with the same goal
+         * (see search::generic::DistributedSearch).
+         */
+        DISTRIBUTED
+    };
+
+    Obfuscator();
+
+    bool obfuscate(std::stringstream& input, LayeredOStream& output, Context::NgramPtr targetDist, unsigned int flags = 0);
+    bool obfuscate(std::stringstream& input, SnapshotWriter& output, Context::NgramPtr targetDist, unsigned int flags = 0);
+
+    /**
+     * @return mutable search options used by subsequent calls to obfuscate()
+     */
+    inline search::generic::Options& searchOptions()
+    {
+        return m_searchOptions;
+    }
+
+    /**
+     * Set the stream search progress is logged to (default: std::cout).
+     * The stream must outlive all subsequent calls to obfuscate().
+     */
+    inline void setLogStream(std::ostream& log)
+    {
+        m_log = &log;
+    }
+
+    /**
+     * Set a deadline after which subsequent searches are aborted and the best text found so far is kept.
+     * Pass <tt>boost::none</tt> to run searches without deadline.
+     */
+    inline void setDeadline(boost::optional<std::chrono::steady_clock::time_point> deadline)
+    {
+        m_deadline = deadline;
+    }
+
+    /**
+     * Set a Jensen-Shannon distance below the goal distance that is good enough to end subsequent
+     * searches early with the first state reaching it. Such a search does not count as reaching its goal.
+     * Pass <tt>boost::none</tt> to only end searches at their goal.
+     */
+    inline void setAcceptableJsDist(boost::optional<double> jsDist)
+    {
+        m_acceptableJsDist = jsDist;
+    }
+
+    /**
+     * @return Jensen-Shannon distance that ends searches early or <tt>boost::none</tt>
+     */
+    inline boost::optional<double> acceptableJsDist() const
+    {
+        return m_acceptableJsDist;
+    }
+
+    /**
+     * Set the search algorithm of subsequent calls to obfuscate() (default: <tt>SearchEngine::ASTAR</tt>).
+     */
+    inline void setSearchEngine(SearchEngine engine)
+    {
+        m_searchEngine = engine;
+    }
+
+    /**
+     * @return final status of the last search or nullptr if no search has been run yet
+     */
+    inline std::shared_ptr<Status const> lastStatus() const
+    {
+        return m_lastStatus;
+    }
+
+    /**
+     * @return path to the final state of the last search (empty if no search has been run yet)
+     */
+    inline SolutionPath const& lastSolution() const
+    {
+        return m_lastSolution;
+    }
+
+private:
+    typedef std::function<void(DiffString const&)> Publish;
+
+    bool run(std::stringstream& input, Publish const& publish, Context::NgramPtr targetDist, unsigned int flags);
+
+    search::generic::Options m_searchOptions;
+    boost::optional<std::chrono::steady_clock::time_point> m_deadline;
+    boost::optional<double> m_acceptableJsDist;
+    std::ostream* m_log = &std::cout;
+    SearchEngine m_searchEngine = SearchEngine::ASTAR;
+    std::shared_ptr<Status const> m_lastStatus;
+    SolutionPath m_lastSolution;
 };
 
 #endif //OBFUSCATION_SEARCH_OBFUSCATOR_HPP
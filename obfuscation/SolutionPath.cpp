@@ -0,0 +1,64 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SolutionPath.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+/**
+ * Record the path leading to a node.
+ * The parent chain is only walked, no node or state along it is copied.
+ *
+ * @param node final node of the path
+ */
+SolutionPath::SolutionPath(search::generic::Node<State> const& node)
+        : m_edits(node.state().text().edits())
+        , m_source(node.state().text().source())
+        , m_textLength(node.state().text().size())
+{
+    m_steps.reserve(node.depth() + 1);
+    for (auto current = &node; current; current = current->parent().get()) {
+        auto const& jsd = current->state().mutableMetaData()->jsd;
+        m_steps.push_back({current->opcode(), current->costG(), current->costH(), jsd.value_or(0.0)});
+    }
+    std::reverse(m_steps.begin(), m_steps.end());
+}
+
+/**
+ * Reconstruct the final text by copying the unedited ranges of the source text and the insertions
+ * of the edits in between.
+ *
+ * @return final text
+ */
+std::string SolutionPath::text() const
+{
+    std::string result;
+    if (!m_source) {
+        return result;
+    }
+
+    result.reserve(m_textLength);
+    std::size_t sourcePos = 0;
+    for (auto const& edit: m_edits) {
+        assert(edit.editPos >= sourcePos && edit.editPos + edit.charsToDelete <= m_source->size());
+        result.append(*m_source, sourcePos, edit.editPos - sourcePos);
+        result.append(edit.insertion);
+        sourcePos = edit.editPos + edit.charsToDelete;
+    }
+    result.append(*m_source, sourcePos, std::string::npos);
+    return result;
+}
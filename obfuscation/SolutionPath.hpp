@@ -0,0 +1,93 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_SOLUTIONPATH_HPP
+#define OBFUSCATION_SOLUTIONPATH_HPP
+
+#include "State.hpp"
+#include "util/DiffString.hpp"
+
+#include <search/generic/Node.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Compact representation of the path from the initial state of a search to its final state.
+ *
+ * The path keeps one small record per search step and the text of the final state as edits against the
+ * source text, instead of the chain of parent nodes with their full states. The final text is
+ * reconstructed from the edits in one pass over the source text.
+ */
+class SolutionPath {
+public:
+    /**
+     * One step of the path.
+     */
+    struct Step {
+        /**
+         * Index of the operator which generated the state of this step (0 for the initial state).
+         */
+        std::uint8_t opcode;
+        float costG;
+        float costH;
+
+        /**
+         * Jensen-Shannon divergence of the state of this step (0 if it was not evaluated).
+         */
+        double jsd;
+    };
+
+    SolutionPath() = default;
+    explicit SolutionPath(search::generic::Node<State> const& node);
+
+    /**
+     * @return steps from the initial state to the final state
+     */
+    inline std::vector<Step> const& steps() const
+    {
+        return m_steps;
+    }
+
+    /**
+     * @return edits of the final text against the source text, ordered by position
+     */
+    inline std::vector<DiffString::Edit> const& edits() const
+    {
+        return m_edits;
+    }
+
+    /**
+     * @return length of the final text
+     */
+    inline std::size_t textLength() const
+    {
+        return m_textLength;
+    }
+
+    std::string text() const;
+
+private:
+    std::vector<Step> m_steps;
+    std::vector<DiffString::Edit> m_edits;
+    std::shared_ptr<std::string const> m_source;
+    std::size_t m_textLength = 0;
+};
+
+#endif //OBFUSCATION_SOLUTIONPATH_HPP
@@ -16,6 +16,32 @@
 
 #include "State.hpp"
 
+#include <search/generic/PoolAllocator.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+namespace {
+template<typename T>
+void writeValue(std::ostream& os, T const& value)
+{
+    os.write(reinterpret_cast<char const*>(&value), sizeof(T));
+}
+
+template<typename T>
+T readValue(std::istream& is)
+{
+    T value;
+    if (!is.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+        throw std::runtime_error("Unexpected end of state in checkpoint");
+    }
+    return value;
+}
+}
+
 State::State()
         : State(MetaData())
 {
@@ -27,7 +53,8 @@ State::State()
 State::State(MetaData const& metaData)
         : m_text(std::make_shared<std::string>())
         , m_ngramProfile(std::make_shared<NgramProfile>())
-        , m_mutableMetaData(std::make_shared<MetaData>(metaData))
+        , m_mutableMetaData(std::allocate_shared<MetaData>(
+                search::generic::PoolAllocator<MetaData>(search::generic::CurrentPoolArena()), metaData))
 {
 }
 
@@ -36,11 +63,14 @@ State::State(MetaData const& metaData)
  * @param text normalized source text
  */
 State::State(MetaData const& metaData, DiffString text)
-        : m_text(std::move(text))
+        : m_text(text)
         , m_ngramProfile(std::make_shared<NgramProfile>())
-        , m_mutableMetaData(std::make_shared<MetaData>(metaData))
+        , m_mutableMetaData(std::allocate_shared<MetaData>(
+                search::generic::PoolAllocator<MetaData>(search::generic::CurrentPoolArena()), metaData))
 {
-    m_ngramProfile->generateFromString(std::make_shared<std::string>(m_text.string()), NgramProfile::SKIP_NORMALIZATION);
+    auto const string = std::make_shared<std::string>(m_text.string());
+    m_ngramProfile->generateFromString(string, NgramProfile::SKIP_NORMALIZATION);
+    m_positions = NgramPositionIndex(*string);
 }
 
 /**
@@ -49,13 +79,15 @@ State::State(MetaData const& metaData, DiffString text)
  * @param ngramProfile source n-gram profile generated from text
  */
 State::State(MetaData const& metaData, StringPtr text, Context::NgramPtr ngramProfile)
-        : m_text(std::move(text))
+        : m_text(text)
         , m_ngramProfile(std::move(ngramProfile))
-        , m_mutableMetaData(std::make_shared<MetaData>(metaData))
+        , m_positions(*text)
+        , m_mutableMetaData(std::allocate_shared<MetaData>(
+                search::generic::PoolAllocator<MetaData>(search::generic::CurrentPoolArena()), metaData))
 {
 }
 
-std::string State::hashValue() const
+hashing::HashCode State::hashValue() const
 {
     return m_text.hashValue();
 }
@@ -66,9 +98,9 @@ bool State::operator==(State const& other) const
 }
 
 /**
- * @return raw text as string
+ * @return raw text
  */
-DiffString State::text() const
+DiffString const& State::text() const
 {
     return m_text;
 }
@@ -82,17 +114,241 @@ DiffString State::text() const
  */
 void State::setText(StringPtr text, unsigned int flags)
 {
-    DiffString diffStr(text);
+    // the text is normalized during profile generation, so the DiffString must be built afterwards
     m_ngramProfile->generateFromString(text, flags);
-    m_text = std::move(diffStr);
+    m_positions = NgramPositionIndex(*text);
+    m_text = DiffString(std::move(text));
+}
+
+/**
+ * Estimate the number of bytes owned by this state, including its text edits,
+ * its n-gram profile overlay and its meta data.
+ * Data shared with other states (source text, base n-gram storage) is not included.
+ * For states which only carry an n-gram delta, the delta is counted instead of the profile,
+ * so the estimate of a state does not change when its profile is built for an expansion.
+ *
+ * @return estimated memory usage in bytes
+ */
+std::size_t State::memoryUsage() const
+{
+    std::size_t bytes = sizeof(State) + m_text.memoryUsage() - sizeof(DiffString);
+    if (m_parentProfile) {
+        bytes += m_ngramUpdates.capacity() * sizeof(NgramProfile::NgramUpdate);
+    } else if (m_ngramProfile) {
+        bytes += m_ngramProfile->memoryUsage();
+    }
+    if (m_mutableMetaData) {
+        bytes += sizeof(MetaData);
+    }
+    bytes += m_positions.memoryUsage() - sizeof(NgramPositionIndex);
+    return bytes;
+}
+
+/**
+ * Release the text and n-gram profile of an expanded state that is only kept as a path record.
+ * The meta data is retained, since it is still read from the ancestors of a state.
+ * A released state has an empty text and no n-gram profile and must not be hashed or expanded again.
+ */
+void State::releasePayload()
+{
+    m_text = DiffString(std::make_shared<std::string>());
+    m_ngramProfile.reset();
+    m_parentProfile.reset();
+    m_ngramUpdates = std::vector<NgramProfile::NgramUpdate>();
+    m_ngramCountDelta = 0;
+    m_positions = NgramPositionIndex();
+}
+
+/**
+ * @return whether the payload of this state has been released (see \link releasePayload)
+ */
+bool State::isReleased() const
+{
+    return !m_ngramProfile && !m_parentProfile;
+}
+
+/**
+ * Write this state to a search checkpoint.
+ * The text is written as its edits against the source text, which all states of a search share,
+ * and the n-gram profile is not written at all, since it can be rebuilt from the text (see \link load).
+ * Of a released state, only the meta data is written.
+ *
+ * @param os binary output stream
+ */
+void State::save(std::ostream& os) const
+{
+    bool const released = isReleased();
+    writeValue<std::uint8_t>(os, released);
+
+    auto const& metaData = *m_mutableMetaData;
+    writeValue<std::uint8_t>(os, metaData.jsd ? 1 : 0);
+    writeValue(os, metaData.jsd.value_or(0.0));
+    writeValue(os, metaData.jsdSums.p);
+    writeValue(os, metaData.jsdSums.q);
+    writeValue(os, metaData.jsdSums.r);
+    writeValue<std::uint64_t>(os, metaData.jsdSyncN);
+    writeValue(os, metaData.jsdDrift);
+    if (released) {
+        return;
+    }
+
+    auto const edits = m_text.edits();
+    writeValue<std::uint32_t>(os, static_cast<std::uint32_t>(edits.size()));
+    for (auto const& edit: edits) {
+        writeValue(os, edit.editPos);
+        writeValue(os, edit.charsToDelete);
+        writeValue<std::uint32_t>(os, static_cast<std::uint32_t>(edit.insertion.size()));
+        os.write(edit.insertion.data(), edit.insertion.size());
+    }
+}
+
+/**
+ * Read a state written by \link save.
+ * The text is rebuilt from the source text of the initial state, and the n-gram profile is described
+ * as a delta against the profile of the initial state, which only covers the windows around the edits.
+ * The profile itself is built when the state is expanded, as for states generated by operators.
+ * The n-gram position index is not restored, so operators fall back to searching the text until
+ * the index is rebuilt.
+ *
+ * @param is binary input stream
+ * @param initialState initial state of the checkpointed search
+ * @return restored state
+ * @throw std::runtime_error if the state is malformed or does not fit the initial state
+ */
+State State::load(std::istream& is, State const& initialState)
+{
+    bool const released = readValue<std::uint8_t>(is) != 0;
+
+    MetaData metaData;
+    bool const hasJsd = readValue<std::uint8_t>(is) != 0;
+    auto const jsd = readValue<double>(is);
+    if (hasJsd) {
+        metaData.jsd = jsd;
+        metaData.jsDist = std::sqrt(2.0 * jsd);
+    }
+    metaData.jsdSums.p = readValue<double>(is);
+    metaData.jsdSums.q = readValue<double>(is);
+    metaData.jsdSums.r = readValue<double>(is);
+    metaData.jsdSyncN = static_cast<std::size_t>(readValue<std::uint64_t>(is));
+    metaData.jsdDrift = readValue<double>(is);
+
+    State state(metaData);
+    if (released) {
+        state.releasePayload();
+        return state;
+    }
+
+    auto const source = initialState.text().source();
+    std::vector<DiffString::Edit> edits;
+    auto const numEdits = readValue<std::uint32_t>(is);
+    std::size_t sourcePos = 0;
+    for (std::uint32_t i = 0; i < numEdits; ++i) {
+        auto const editPos = readValue<std::uint32_t>(is);
+        auto const charsToDelete = readValue<std::uint32_t>(is);
+        std::string insertion(readValue<std::uint32_t>(is), '\0');
+        if (!is.read(&insertion[0], insertion.size())) {
+            throw std::runtime_error("Unexpected end of state in checkpoint");
+        }
+        if (editPos < sourcePos || editPos + charsToDelete > source->size()) {
+            throw std::runtime_error("State in checkpoint does not fit the source text");
+        }
+        sourcePos = editPos + charsToDelete;
+        edits.emplace_back(editPos, charsToDelete, std::move(insertion));
+    }
+
+    // edits refer to the source text, so applying them back to front keeps their positions valid
+    DiffString text(source);
+    for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+        text.edit(*edit);
+    }
+
+    // edits whose n-gram windows overlap are grouped, so no n-gram is counted twice
+    auto const newText = text.string();
+    std::vector<NgramProfile::NgramUpdate> updates;
+    long shift = 0;
+    for (std::size_t i = 0; i < edits.size();) {
+        auto const begin = edits[i].editPos > NgramProfile::ORDER ? edits[i].editPos - NgramProfile::ORDER : 0;
+        auto const beginShift = shift;
+        std::size_t end;
+        do {
+            end = std::min(source->size(), edits[i].editPos + edits[i].charsToDelete + NgramProfile::ORDER);
+            shift += static_cast<long>(edits[i].insertion.size()) - static_cast<long>(edits[i].charsToDelete);
+            ++i;
+        } while (i < edits.size() && edits[i].editPos < end + NgramProfile::ORDER);
+
+        auto const groupUpdates = NgramProfile::updatesFromStringRange(
+                source->cbegin() + begin, source->cbegin() + end,
+                newText.cbegin() + (static_cast<long>(begin) + beginShift),
+                newText.cbegin() + (static_cast<long>(end) + shift));
+        updates.insert(updates.end(), groupUpdates.begin(), groupUpdates.end());
+    }
+
+    state.setNgramDelta(std::move(text), initialState.ngramProfile(), std::move(updates));
+    return state;
+}
+
+/**
+ * @return index of the n-gram positions in the text
+ */
+NgramPositionIndex const& State::positionIndex() const
+{
+    return m_positions;
+}
+
+/**
+ * @param positions index of the n-gram positions in the text, which must match the text of this state
+ */
+void State::setPositionIndex(NgramPositionIndex positions)
+{
+    m_positions = std::move(positions);
 }
 
 /**
+ * Get the n-gram profile of this state. If this state only carries an n-gram delta, the profile is
+ * built from the parent profile and kept for subsequent calls. This is safe to call concurrently.
+ *
  * @return pointer to current n-gram profile
  */
 Context::NgramPtr State::ngramProfile() const
 {
-    return m_ngramProfile;
+    auto profile = std::atomic_load(&m_ngramProfile);
+    if (profile || !m_parentProfile) {
+        return profile;
+    }
+
+    auto built = buildNgramProfile();
+    if (std::atomic_compare_exchange_strong(&m_ngramProfile, &profile, built)) {
+        return built;
+    }
+    return profile;
+}
+
+/**
+ * Get the n-gram profile of this state without keeping a profile built from an n-gram delta.
+ * Use this to read the full profile of states which are not expanded (e.g. for an exact evaluation),
+ * so their memory usage stays at the size of the delta.
+ *
+ * @return pointer to current n-gram profile
+ */
+Context::ConstNgramPtr State::peekNgramProfile() const
+{
+    auto profile = std::atomic_load(&m_ngramProfile);
+    if (profile || !m_parentProfile) {
+        return profile;
+    }
+    return buildNgramProfile();
+}
+
+/**
+ * Build the n-gram profile of this state from the parent profile and the n-gram delta.
+ *
+ * @return built profile, whose most recent updates are the n-gram delta
+ */
+Context::NgramPtr State::buildNgramProfile() const
+{
+    auto profile = m_parentProfile->cloneShared();
+    profile->update(m_ngramUpdates);
+    return profile;
 }
 
 /**
@@ -101,8 +357,12 @@ Context::NgramPtr State::ngramProfile() const
  */
 void State::setNgramProfile(StringPtr text, Context::NgramPtr profile)
 {
+    m_positions = NgramPositionIndex(*text);
     m_text = DiffString(std::move(text));
     m_ngramProfile = std::move(profile);
+    m_parentProfile.reset();
+    m_ngramUpdates.clear();
+    m_ngramCountDelta = 0;
 }
 
 /**
@@ -113,4 +373,79 @@ void State::setNgramProfile(DiffString&& text, Context::NgramPtr profile)
 {
     m_text = std::move(text);
     m_ngramProfile = std::move(profile);
+    m_parentProfile.reset();
+    m_ngramUpdates.clear();
+    m_ngramCountDelta = 0;
+}
+
+/**
+ * Set the text of this state and describe its n-gram profile relative to a parent profile.
+ * The profile itself is only built when \link ngramProfile is called, which most successors
+ * never are. Until then, \link ngramCount, \link ngramFreq and \link ngramUpdates are answered
+ * from the parent profile and the delta.
+ *
+ * @param text raw (normalized) text as DiffString rvalue
+ * @param parentProfile n-gram profile of the parent state
+ * @param updates n-gram count updates from the parent text to <tt>text</tt>
+ */
+void State::setNgramDelta(DiffString&& text, Context::ConstNgramPtr parentProfile,
+        std::vector<NgramProfile::NgramUpdate> updates)
+{
+    m_text = std::move(text);
+    m_ngramProfile.reset();
+    m_parentProfile = std::move(parentProfile);
+    m_ngramUpdates = std::move(updates);
+    m_ngramCountDelta = 0;
+    for (auto const& update: m_ngramUpdates) {
+        m_ngramCountDelta += update.second;
+    }
+}
+
+/**
+ * @return n-gram profile of the parent state if this state was described by an n-gram delta
+ *         (see \link setNgramDelta), nullptr otherwise
+ */
+Context::ConstNgramPtr const& State::parentNgramProfile() const
+{
+    return m_parentProfile;
+}
+
+/**
+ * @return n-gram count updates which lead from the parent profile to the profile of this state
+ */
+std::vector<NgramProfile::NgramUpdate> const& State::ngramUpdates() const
+{
+    if (m_parentProfile) {
+        return m_ngramUpdates;
+    }
+    return m_ngramProfile->lastUpdates();
+}
+
+/**
+ * @return total n-gram count of this state's profile
+ */
+std::size_t State::ngramCount() const
+{
+    if (m_parentProfile) {
+        return static_cast<std::size_t>(static_cast<long>(m_parentProfile->n()) + m_ngramCountDelta);
+    }
+    return m_ngramProfile->n();
+}
+
+/**
+ * @param ngram n-gram
+ * @return count of <tt>ngram</tt> in this state's profile
+ */
+std::size_t State::ngramFreq(NgramProfile::Ngram ngram) const
+{
+    if (!m_parentProfile) {
+        return m_ngramProfile->freq(ngram);
+    }
+    auto freq = static_cast<long>(m_parentProfile->freq(ngram));
+    for (auto const& update: m_ngramUpdates) {
+        if (update.first == ngram) {
+            freq += update.second;
+        }
+    }
+    return static_cast<std::size_t>(std::max(0L, freq));
 }
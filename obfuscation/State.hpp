@@ -21,13 +21,17 @@
 #include "ComputeCostH.hpp"
 #include "util/NgramProfile.hpp"
 #include "util/DiffString.hpp"
+#include "util/NgramPositionIndex.hpp"
 
 #include <boost/optional.hpp>
 #include <functional>
 #include <cstddef>
+#include <istream>
 #include <memory>
+#include <ostream>
 #include <search/generic/Node.hpp>
 #include <utility>
+#include <vector>
 
 class State {
 public:
@@ -40,6 +44,27 @@ public:
          * Jensen-Shannon divergence of this state.
          */
         boost::optional<double> jsd;
+
+        /**
+         * Jensen-Shannon distance sqrt(2 * jsd) of this state, valid if <tt>jsd</tt> is set.
+         */
+        double jsDist = 0.0;
+
+        /**
+         * Partial sums from which <tt>jsd</tt> was calculated.
+         */
+        ComputeCostH::JsdSums jsdSums;
+
+        /**
+         * Source n-gram count at the time of the last exact JSD calculation on this path.
+         */
+        std::size_t jsdSyncN = 0;
+
+        /**
+         * Accumulated relative change of the source n-gram count since the last exact JSD calculation.
+         * Incremental JSD updates become less accurate the larger this value gets.
+         */
+        double jsdDrift = 0.0;
     };
 
     typedef std::shared_ptr<std::string> StringPtr;
@@ -50,43 +75,64 @@ public:
     explicit State(MetaData const& metaData, DiffString text);
     explicit State(MetaData const& metaData, StringPtr text, Context::NgramPtr ngramProfile);
 
-    std::string hashValue() const;
+    hashing::HashCode hashValue() const;
     bool operator==(State const& other) const;
 
-    DiffString text() const;
+    DiffString const& text() const;
+    std::size_t memoryUsage() const;
 
     void setText(StringPtr text, unsigned int flags = 0);
     Context::NgramPtr ngramProfile() const;
+    Context::ConstNgramPtr peekNgramProfile() const;
     void setNgramProfile(StringPtr text, Context::NgramPtr profile);
     void setNgramProfile(DiffString&& text, Context::NgramPtr profile);
+    void setNgramDelta(DiffString&& text, Context::ConstNgramPtr parentProfile,
+            std::vector<NgramProfile::NgramUpdate> updates);
+    Context::ConstNgramPtr const& parentNgramProfile() const;
+    std::vector<NgramProfile::NgramUpdate> const& ngramUpdates() const;
+    std::size_t ngramCount() const;
+    std::size_t ngramFreq(NgramProfile::Ngram ngram) const;
+    void releasePayload();
+    bool isReleased() const;
+    void save(std::ostream& os) const;
+    static State load(std::istream& is, State const& initialState);
+    NgramPositionIndex const& positionIndex() const;
+    void setPositionIndex(NgramPositionIndex positions);
 
     /**
      * Get a pointer to a mutable meta data DTO for this state.
      * The target DTO may be modified during state evaluation.
      */
-    inline std::shared_ptr<MetaData> mutableMetaData() const
+    inline std::shared_ptr<MetaData> const& mutableMetaData() const
     {
         return m_mutableMetaData;
     }
 
 private:
+    Context::NgramPtr buildNgramProfile() const;
+
     DiffString m_text;
-    Context::NgramPtr m_ngramProfile;
+
+    /**
+     * Materialized n-gram profile. States generated by operators start out with only a parent profile
+     * and the n-gram updates of their edit, from which the profile is built when it is first needed.
+     */
+    mutable Context::NgramPtr m_ngramProfile;
+    Context::ConstNgramPtr m_parentProfile;
+    std::vector<NgramProfile::NgramUpdate> m_ngramUpdates;
+    long m_ngramCountDelta = 0;
+    NgramPositionIndex m_positions;
     std::shared_ptr<MetaData> m_mutableMetaData = nullptr;
 };
 
 
-namespace {
-std::hash<std::string> stateHash;
-}
-
 namespace std {
 
 template<>
 struct hash<State> {
     std::size_t operator()(State const& state) const
     {
-        return stateHash(state.hashValue());
+        return static_cast<std::size_t>(state.hashValue());
     }
 };
 
@@ -18,14 +18,12 @@
 #define OBFUSCATION_SEARCH_ABSTRACTWORD_HPP
 
 #include "ObfuscationOperator.hpp"
+#include "util/WordDictionary.hpp"
 
 #include <string>
 #include <mutex>
 #include <deque>
 //#include <netspeak/NetspeakRS3.hpp>
-#include <boost/compute/detail/lru_cache.hpp>
-
-namespace bd = boost::compute::detail;
 
 /**
  * Abstract base class for word-based operators.
@@ -39,19 +37,11 @@ protected:
     typedef std::pair<StrPos, StrPos> WordBounds;
     typedef std::vector<WordBounds> WordBoundsList;
     typedef std::pair<WordBoundsList, WordBoundsList> WordBoundsListPair;
-    typedef std::unordered_map<std::string, std::vector<std::string>> Dictionary;
+    typedef WordDictionary Dictionary;
 
     static WordBoundsListPair parseWordBounds(FocusPoint const& focusPoint, std::size_t wordsBefore, std::size_t wordsAfter);
-    static inline bool isWordBoundary(char c);
-    static inline StrPos parseWordStart(std::string const& text, StrPos pos);
-    static inline StrPos parseWordEnd(std::string const& text, StrPos pos);
-    static std::shared_ptr<Dictionary const> loadDictionary(std::string const& dictFile, char separator = '\t');
-
-private:
-    static std::mutex s_dictMutex;
-    static std::unordered_map<std::string, std::shared_ptr<Dictionary>> s_dictionaries;
-    static std::mutex s_boundsCacheMutex;
-    static bd::lru_cache<std::string, WordBoundsListPair> s_cachedWordBounds;
+    static inline std::size_t parseWordStart(WordBoundaryIndex const& index, std::size_t pos);
+    static inline std::size_t parseWordEnd(WordBoundaryIndex const& index, std::size_t pos);
 };
 
 #endif //OBFUSCATION_SEARCH_ABSTRACTWORD_HPP
@@ -15,6 +15,7 @@
  */
 
 #include "CharMapOperator.hpp"
+#include "util/prng.hpp"
 
 std::unordered_map<char, std::vector<char>> const SentenceSplitAndRunOnOperator::s_characterTranslationMap = {
         {',', {';', '.'}},
@@ -34,11 +35,12 @@ std::unique_ptr<search::generic::Operator<State, Context>> SentenceSplitAndRunOn
     return std::make_unique<SentenceSplitAndRunOnOperator>(name(), cost(), description());
 }
 
-std::unordered_set<State> SentenceSplitAndRunOnOperator::applyImpl(const ObfuscationOperator::FocusPoint& focusPoint,
-                                                                   State const& state, Context& context) const
+void SentenceSplitAndRunOnOperator::applyImpl(const ObfuscationOperator::FocusPoint& focusPoint,
+                                              State const& state, Context& context, Successors& successors) const
 {
-    std::unordered_set<State> successors;
     auto const startPos = focusPoint.text->begin() + focusPoint.ngramOffset;
+    auto& generator = prng::threadGenerator(prng::deriveSeed(context.seed ^ state.hashValue(),
+            static_cast<std::uint64_t>(focusPoint.ngramOffset)));
 
     for (std::size_t i = 0; i < NgramProfile::ORDER; ++i) {
         auto const replPos = startPos + i;
@@ -51,13 +53,8 @@ std::unordered_set<State> SentenceSplitAndRunOnOperator::applyImpl(const Obfusca
             continue;
         }
         auto const& variants = mapping->second;
-        char const repl = variants[std::rand() % variants.size()];
+        char const repl = variants[generator() % variants.size()];
 
-        State successor(*state.mutableMetaData());
-        if (updateSuccessor(state, successor, focusPoint, replPos, replPos + 1, std::string(1, repl))) {
-            successors.emplace(std::move(successor));
-        }
+        proposeEdit(state, focusPoint, replPos, replPos + 1, boost::string_view(&repl, 1), successors);
     }
-
-    return successors;
 }
@@ -27,10 +27,9 @@ std::unique_ptr<search::generic::Operator<State, Context>> CharacterFlipOperator
 }
 
 
-std::unordered_set<State> CharacterFlipOperator::applyImpl(const ObfuscationOperator::FocusPoint& focusPoint,
-                                                           State const& state, Context& context) const
+void CharacterFlipOperator::applyImpl(const ObfuscationOperator::FocusPoint& focusPoint,
+                                      State const& state, Context& context, Successors& successors) const
 {
-    std::unordered_set<State> successors;
     auto const& text = *focusPoint.text;
     auto const origPos = text.begin() + focusPoint.ngramOffset;
 
@@ -41,19 +40,11 @@ std::unordered_set<State> CharacterFlipOperator::applyImpl(const ObfuscationOper
             break;
         }
 
-        std::string const orig = std::string(startPos, endPos);
-        std::string perm = orig;
-        std::swap(perm[0], perm[1]);
-
-        if (perm == orig) {
+        char const perm[] = {*(startPos + 1), *startPos};
+        if (perm[0] == perm[1]) {
             continue;
         }
 
-        State successor(*state.mutableMetaData());
-        if (updateSuccessor(state, successor, focusPoint, startPos, endPos, perm)) {
-            successors.emplace(std::move(successor));
-        }
+        proposeEdit(state, focusPoint, startPos, endPos, boost::string_view(perm, 2), successors);
     }
-
-    return successors;
 }
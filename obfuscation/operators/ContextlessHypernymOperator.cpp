@@ -15,15 +15,17 @@
  */
 
 #include "ContextlessHypernymOperator.hpp"
+#include "util/DictionaryRegistry.hpp"
 
 ContextlessHypernymOperator::ContextlessHypernymOperator(std::string const& name, double cost, std::string const& description)
-        : ContextlessSynonymOperator(name, cost, description)
+        : ContextlessSynonymOperator(name, cost, description, DictionaryRegistry::instance().get(DictionaryRegistry::HYPERNYMS))
 {
-    std::cout << "Loading hypernym dictionary..." << std::endl;
-    m_dict = AbstractWordOperator::loadDictionary("assets/hypernym-dictionary.tsv");
 }
 
+/**
+ * Clones share the dictionary handle of this operator.
+ */
 std::unique_ptr<search::generic::Operator<State, Context>> ContextlessHypernymOperator::clone() const
 {
-    return std::make_unique<ContextlessHypernymOperator>(name(), cost(), description());
+    return std::make_unique<ContextlessHypernymOperator>(*this);
 }
@@ -15,49 +15,51 @@
  */
 
 #include "ContextlessSynonymOperator.hpp"
-#include <boost/algorithm/string.hpp>
+#include "util/DictionaryRegistry.hpp"
 #include <iostream>
-#include <unordered_set>
 
 ContextlessSynonymOperator::ContextlessSynonymOperator(std::string const& name, double cost, std::string const& description)
+        : ContextlessSynonymOperator(name, cost, description, DictionaryRegistry::instance().get(DictionaryRegistry::SYNONYMS))
+{
+}
+
+/**
+ * @param dict dictionary of replacements for a word
+ */
+ContextlessSynonymOperator::ContextlessSynonymOperator(std::string const& name, double cost, std::string const& description,
+        std::shared_ptr<Dictionary const> dict)
         : NetspeakOperator(name, cost, description)
+        , m_dict(std::move(dict))
 {
-    std::cout << "Loading synonym dictionary..." << std::endl;
-    m_dict = AbstractWordOperator::loadDictionary("assets/synonym-dictionary.tsv");
 }
 
+/**
+ * Clones share the dictionary handle of this operator.
+ */
 std::unique_ptr<search::generic::Operator<State, Context>> ContextlessSynonymOperator::clone() const
 {
-    return std::make_unique<ContextlessSynonymOperator>(name(), cost(), description());
+    return std::make_unique<ContextlessSynonymOperator>(*this);
 }
 
-std::unordered_set<State> ContextlessSynonymOperator::applyImpl(const FocusPoint& focusPoint, State const& state, Context& context) const
+void ContextlessSynonymOperator::applyImpl(const FocusPoint& focusPoint, State const& state, Context& context,
+        Successors& successors) const
 {
     if (!m_dict) {
-        return {};
+        return;
     }
 
     auto const& text = *focusPoint.text;
-    auto const focusIt = text.begin() + focusPoint.ngramOffset;
 
     auto bounds = parseWordBounds(focusPoint, 0, 0).second[0];
-    std::string word = boost::to_lower_copy(std::string(bounds.first, bounds.second));
-
-    auto const orderOffset = NgramProfile::ORDER;
-    auto ngram = std::string(focusIt, focusIt + orderOffset);
+    boost::string_view const word(text.data() + (bounds.first - text.begin()),
+            static_cast<std::size_t>(bounds.second - bounds.first));
 
-    auto synonyms = m_dict->find(word);
-    if (synonyms == m_dict->end()) {
-        return {};
+    auto const synonyms = m_dict->find(word);
+    if (synonyms.empty()) {
+        return;
     }
 
-    std::unordered_set<State> successorStates;
-    for (auto const& synonym: synonyms->second) {
-        State successor(*state.mutableMetaData());
-        if (updateSuccessor(state, successor, focusPoint, bounds.first, bounds.second, synonym)) {
-            successorStates.emplace(std::move(successor));
-        }
+    for (auto const synonym: synonyms) {
+        proposeEdit(state, focusPoint, bounds.first, bounds.second, synonym, successors);
     }
-
-    return successorStates;
 }
@@ -26,7 +26,11 @@ public:
     std::unique_ptr<Operator> clone() const override;
 
 protected:
-    std::unordered_set<State> applyImpl(FocusPoint const& focusPoint, State const& state, Context& context) const override;
+    ContextlessSynonymOperator(std::string const& name, double cost, std::string const& description,
+            std::shared_ptr<Dictionary const> dict);
+
+    void applyImpl(FocusPoint const& focusPoint, State const& state, Context& context,
+            Successors& successors) const override;
     std::shared_ptr<Dictionary const> m_dict;
 };
 
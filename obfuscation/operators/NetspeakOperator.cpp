@@ -17,15 +17,20 @@
 #include "NetspeakOperator.hpp"
 //#include "util/netspeak.hpp"
 
-/**
- * Netspeak request cache mutex.
- */
-//std::mutex NetspeakOperator::s_netspeakCacheMutex{};
+std::uint32_t constexpr NetspeakOperator::NETSPEAK_MAX_RESULTS;
+std::chrono::milliseconds constexpr NetspeakOperator::NETSPEAK_TIMEOUT;
+std::size_t constexpr NetspeakOperator::NETSPEAK_CACHE_BYTES;
+std::size_t constexpr NetspeakOperator::NETSPEAK_WORKERS;
 
 /**
- * Netspeak request cache.
+ * Asynchronous Netspeak query layer with response cache.
  */
-//bd::lru_cache<std::string, NetspeakOperator::NetspeakResponse> NetspeakOperator::s_netspeakRequestCache(1000);
+//AsyncQueryCache<std::string, NetspeakOperator::NetspeakResponse> NetspeakOperator::s_netspeakQueries{
+//        &NetspeakOperator::netspeakSearch, NETSPEAK_CACHE_BYTES,
+//        [](std::string const& request, NetspeakResponse const& response) {
+//            return sizeof(std::string) + request.capacity() + sizeof(NetspeakResponse)
+//                    + (response ? response->SpaceUsed() : 0);
+//        }, NETSPEAK_WORKERS};
 
 NetspeakOperator::NetspeakOperator(std::string const& name, double cost, std::string const& description)
         : AbstractWordOperator(name, cost, description)
@@ -33,25 +38,53 @@ NetspeakOperator::NetspeakOperator(std::string const& name, double cost, std::st
 }
 
 /**
- * Perform a Netspeak request and cache the result.
+ * @return Netspeak query and response cache counters
+ */
+//AsyncQueryStats NetspeakOperator::netspeakStats()
+//{
+//    return s_netspeakQueries.stats();
+//}
+
+/**
+ * Perform a batch of Netspeak requests concurrently and cache the results.
+ * Identical requests from other threads are only run once. Requests that do not finish within
+ * <tt>NETSPEAK_TIMEOUT</tt> yield a nullptr response, but keep running and are cached for later.
  * This method is thread-safe.
  *
- * @param request Netspeak request to run
- * @return Netspeak answer
+ * @param requests Netspeak requests to run
+ * @return Netspeak answers in the order of the requests
  */
-//std::shared_ptr<netspeak::generated::Response> NetspeakOperator::netspeakRequest(std::string const& request, std::uint32_t maxResults)
+//std::vector<NetspeakOperator::NetspeakResponse> NetspeakOperator::netspeakRequests(std::vector<std::string> const& requests)
 //{
-//    std::lock_guard<std::mutex> lock(s_netspeakCacheMutex);
-//    auto responseOptional = s_netspeakRequestCache.get(request);
-//    if (responseOptional) {
-//        return responseOptional.get();
-//    }
-//
-//    netspeak::generated::Request req;
-//    req.set_query(request);
-//    req.set_max_phrase_count(maxResults);
-//    auto const response = netspeak_util::instance()->search(req);
+//    auto const results = s_netspeakQueries.queryBatch(requests);
+//    auto const deadline = std::chrono::steady_clock::now() + NETSPEAK_TIMEOUT;
 //
-//    s_netspeakRequestCache.insert(request, response);
-//    return response;
+//    std::vector<NetspeakResponse> responses;
+//    responses.reserve(results.size());
+//    for (auto const& result: results) {
+//        auto const remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+//                deadline - std::chrono::steady_clock::now());
+//        auto response = s_netspeakQueries.wait(result, std::max(remaining, std::chrono::milliseconds(0)));
+//        responses.push_back(response ? *response : nullptr);
+//    }
+//    return responses;
+//}
+
+/**
+ * Query the Netspeak index. Runs on the worker threads of the query layer.
+ *
+ * @param requests Netspeak requests to run
+ * @return Netspeak answers in the order of the requests
+ */
+//std::vector<NetspeakOperator::NetspeakResponse> NetspeakOperator::netspeakSearch(std::vector<std::string> const& requests)
+//{
+//    std::vector<NetspeakResponse> responses;
+//    responses.reserve(requests.size());
+//    for (auto const& request: requests) {
+//        netspeak::generated::Request req;
+//        req.set_query(request);
+//        req.set_max_phrase_count(NETSPEAK_MAX_RESULTS);
+//        responses.push_back(netspeak_util::instance()->search(req));
+//    }
+//    return responses;
 //}
@@ -18,6 +18,9 @@
 #define OBFUSCATION_SEARCH_NETSPEAKOPERATOR_HPP
 
 #include "AbstractWordOperator.hpp"
+#include "util/AsyncQueryCache.hpp"
+
+#include <chrono>
 
 /**
  * Abstract base class for Netspeak-based operators
@@ -26,12 +29,34 @@ class NetspeakOperator : public AbstractWordOperator {
 public:
     NetspeakOperator(std::string const& name, double cost, std::string const& description);
 
+    /**
+     * Maximum number of phrases to request per Netspeak query.
+     */
+    static std::uint32_t constexpr NETSPEAK_MAX_RESULTS = 5;
+
+    /**
+     * Maximum time to wait for the Netspeak queries of one operator application.
+     */
+    static std::chrono::milliseconds constexpr NETSPEAK_TIMEOUT{500};
+
+    /**
+     * Maximum size of the cached Netspeak responses in bytes.
+     */
+    static std::size_t constexpr NETSPEAK_CACHE_BYTES = 16 * 1024 * 1024;
+
+    /**
+     * Number of threads querying the Netspeak index.
+     */
+    static std::size_t constexpr NETSPEAK_WORKERS = 4;
+
+//    static AsyncQueryStats netspeakStats();
+
 protected:
-//    static std::shared_ptr<netspeak::generated::Response> netspeakRequest(std::string const& request, std::uint32_t maxResults);
+//    static std::vector<NetspeakResponse> netspeakRequests(std::vector<std::string> const& requests);
 
 private:
-//    static std::mutex s_netspeakCacheMutex;
-//    static bd::lru_cache<std::string, NetspeakResponse> s_netspeakRequestCache;
+//    static std::vector<NetspeakResponse> netspeakSearch(std::vector<std::string> const& requests);
+//    static AsyncQueryCache<std::string, NetspeakResponse> s_netspeakQueries;
 };
 
 #endif //OBFUSCATION_SEARCH_NETSPEAKOPERATOR_HPP
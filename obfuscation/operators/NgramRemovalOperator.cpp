@@ -28,15 +28,11 @@ std::unique_ptr<search::generic::Operator<State, Context>> NgramRemovalOperator:
     return std::make_unique<NgramRemovalOperator>(name(), cost(), description());
 }
 
-std::unordered_set<State> NgramRemovalOperator::applyImpl(FocusPoint const& focusPoint, State const& state, Context& context) const
+void NgramRemovalOperator::applyImpl(FocusPoint const& focusPoint, State const& state, Context& context,
+        Successors& successors) const
 {
     auto const& text = *focusPoint.text;
     auto const pos = text.begin() + focusPoint.ngramOffset;
 
-    State successor(*state.mutableMetaData());
-    if (updateSuccessor(state, successor, focusPoint, pos, pos + NgramProfile::ORDER, "")) {
-        return {std::move(successor)};
-    }
-
-    return {};
+    proposeEdit(state, focusPoint, pos, pos + NgramProfile::ORDER, boost::string_view(), successors);
 }
@@ -27,7 +27,8 @@ public:
     std::unique_ptr<Operator> clone() const override;
 
 protected:
-    std::unordered_set<State> applyImpl(FocusPoint const& focusPoint, State const& state, Context& context) const override;
+    void applyImpl(FocusPoint const& focusPoint, State const& state, Context& context,
+            Successors& successors) const override;
 };
 
 #endif //OBFUSCATION_SEARCH_NGRAMREMOVALOPERATOR_HPP
@@ -16,215 +16,248 @@
 
 #include "ObfuscationOperator.hpp"
 
-#include <algorithm>
-#include <random>
-#include <chrono>
+#include "util/prng.hpp"
 
-/**
- * Mutex for static cache access.
- */
-std::mutex ObfuscationOperator::s_cacheMutex{};
+#include <search/generic/PhaseTimer.hpp>
+
+#include <algorithm>
+#include <array>
+#include <functional>
 
 /**
- * Cached operator working data.
+ * Cached operator working data, weighted by the size of the copied source text and its word boundary index.
  */
-bd::lru_cache<std::string, ObfuscationOperator::CacheData> ObfuscationOperator::s_cachedData{200};
+ConcurrentCache<hashing::HashCode, ObfuscationOperator::CacheData> ObfuscationOperator::s_cachedData{
+        NGRAM_CACHE_BYTES, [](hashing::HashCode const&, CacheData const& data) {
+            return sizeof(CacheData) + 2 * sizeof(std::string) + data.sourceText->capacity()
+                    + data.ngramPositions->capacity() * sizeof(std::string::const_iterator)
+                    + data.wordBounds->memoryUsage();
+        }};
 
 ObfuscationOperator::ObfuscationOperator(std::string const& name, double cost, std::string const& description)
         : Operator(name, cost, description)
+        , m_seedSalt(std::hash<std::string>()(name))
 {
 }
 
+/**
+ * Select the n-grams of a state to be obfuscated once per expansion, before the operators are applied to it.
+ * The search calls this for each node it expands, so that concurrently running operators find the
+ * selection in the cache instead of each computing it on their own.
+ *
+ * @param state state to be expanded
+ * @param context search context
+ */
+void ObfuscationOperator::prepareExpansion(State const& state, Context const& context)
+{
+    getCachedNgramSelection(state, context);
+}
+
 /**
  * Select n-grams and cache them for the given state.
  * If a previous n-gram selection for this state is already cached,
- * the cached version is returned instead.
+ * the cached version is returned instead. The materialized text is indexed for word-based operators.
+ * States without any n-grams to obfuscate are cached with an empty selection.
  */
-boost::optional<ObfuscationOperator::CacheData>
-        ObfuscationOperator::getCachedNgramSelection(State const& state,Context const& context) const
+ObfuscationOperator::CacheData ObfuscationOperator::getCachedNgramSelection(State const& state, Context const& context)
 {
+    SEARCH_GENERIC_TIME_PHASE(kSelection);
     auto const hash = state.hashValue();
 
-    {
-        std::lock_guard<std::mutex> lock(s_cacheMutex);
-        auto cached = s_cachedData.get(hash);
-        if (cached) {
-            return cached;
-        }
+    auto cached = s_cachedData.get(hash);
+    if (cached) {
+        return cached.get();
     }
 
-    // random seed
-    long seed = std::chrono::system_clock::now().time_since_epoch().count();
+    auto& generator = prng::threadGenerator(prng::deriveSeed(context.seed, hash));
 
-    CacheData data{std::make_shared<std::vector<std::string::const_iterator>>(),
-                   std::make_shared<std::string>(state.text().string())};
+    CacheData data{std::make_shared<std::vector<std::string::const_iterator>>(), std::make_shared<std::string>(),
+            std::make_shared<WordBoundaryIndex>()};
 
     auto const sourceProfile = state.ngramProfile();
-    auto rankedNgrams = rankNgrams(sourceProfile, context.targetNgramProfile);
-//    std::shuffle(rankedNgrams.begin(), rankedNgrams.end(), std::default_random_engine(seed));
-    if (rankedNgrams.empty()) {
-        return {};
-    }
-
-    if (state.text().logSize() > 150) {
-        state.text().apply();
-    }
-
-    std::vector<NgramProfile::Ngram> selectedNgrams;
-    while (!rankedNgrams.empty() && selectedNgrams.size() < MAX_NGRAM_RANK) {
-        std::pop_heap(rankedNgrams.begin(), rankedNgrams.end());
-        selectedNgrams.emplace_back(rankedNgrams.back().ngram);
-        rankedNgrams.pop_back();
-    }
+    auto rankedNgrams = rankNgrams(sourceProfile, *context.targetTable);
+//    std::shuffle(rankedNgrams.begin(), rankedNgrams.end(), generator);
 
-    if (selectedNgrams.empty()) {
-        return {};
+    if (rankedNgrams.empty()) {
+        s_cachedData.insert(hash, data);
+        return data;
     }
+    *data.sourceText = state.text().string();
+    *data.wordBounds = WordBoundaryIndex(*data.sourceText);
 
     // determine n-gram positions in the text
-    std::vector<std::string::const_iterator> ngramPositions;
-    for (auto ngram: selectedNgrams) {
-        std::string ngramStr(ngram2Char(ngram), NgramProfile::ORDER);
-        std::size_t lastPos = 0;
-        std::size_t strPos = 0;
-
+    auto const& positionIndex = state.positionIndex();
+    for (auto const& rankedNgram: rankedNgrams) {
         std::vector<std::string::const_iterator> candidates;
-        while ((strPos = data.sourceText->find(ngramStr, lastPos)) != std::string::npos) {
-            lastPos = strPos + 1;
-            candidates.emplace_back(data.sourceText->begin() + strPos);
+        if (positionIndex.empty()) {
+            std::string ngramStr(ngram2Char(rankedNgram.ngram), NgramProfile::ORDER);
+            std::size_t lastPos = 0;
+            std::size_t strPos = 0;
+            while ((strPos = data.sourceText->find(ngramStr, lastPos)) != std::string::npos) {
+                lastPos = strPos + 1;
+                candidates.emplace_back(data.sourceText->begin() + strPos);
+            }
+        } else {
+            for (auto const offset: positionIndex.find(rankedNgram.ngram)) {
+                candidates.emplace_back(data.sourceText->begin() + offset);
+            }
         }
 
         // shuffle candidate positions randomly and take the first `MAX_OCCURRENCES`
-        std::shuffle(candidates.begin(), candidates.end(), std::default_random_engine(seed));
+        std::shuffle(candidates.begin(), candidates.end(), generator);
         if (candidates.size() > MAX_OCCURRENCES) {
             candidates.erase(candidates.begin() + MAX_OCCURRENCES, candidates.end());
         }
         std::copy(candidates.begin(), candidates.end(), std::back_inserter(*data.ngramPositions));
     }
 
-    std::lock_guard<std::mutex> lock(s_cacheMutex);
     s_cachedData.insert(hash, data);
-    return boost::optional<CacheData>(data);
+    return data;
 }
 
-std::unordered_set<State> ObfuscationOperator::apply(State const& state, Context& context) const
+void ObfuscationOperator::apply(State const& state, Context& context, Successors& successors) const
 {
-    auto dataOpt = getCachedNgramSelection(state, context);
-    if (!dataOpt) {
-        return {};
+    auto const data = getCachedNgramSelection(state, context);
+    if (data.ngramPositions->empty()) {
+        return;
     }
-    auto& data = dataOpt.get();
 
-    std::vector<State> successorStates;
     for (auto const& ngramPosIt: *data.ngramPositions) {
-        FocusPoint fp{ngramPosIt - data.sourceText->begin(), data.sourceText.get()};
-        auto states = applyImpl(fp, state, context);
-        std::copy(std::make_move_iterator(states.begin()),
-                  std::make_move_iterator(states.end()),
-                  std::back_inserter(successorStates));
+        FocusPoint fp{ngramPosIt - data.sourceText->begin(), data.sourceText.get(), data.wordBounds.get()};
+        applyImpl(fp, state, context, successors);
     }
 
-    if (successorStates.size() > MAX_SUCCESSORS) {
+    if (successors.size() > MAX_SUCCESSORS) {
         // reduce total number of successors
-        long seed = std::chrono::system_clock::now().time_since_epoch().count();
-        std::shuffle(successorStates.begin(), successorStates.end(), std::default_random_engine(seed));
-        successorStates.erase(successorStates.begin() + MAX_SUCCESSORS, successorStates.end());
+        successors.sample(MAX_SUCCESSORS, prng::threadGenerator(
+                prng::deriveSeed(context.seed ^ m_seedSalt, state.hashValue())));
     }
-
-    return {std::make_move_iterator(successorStates.begin()), std::make_move_iterator(successorStates.end())};
 }
 
 /**
  * Helper method for ranking n-grams according to their KLD impact.
  * N-grams with less than two occurrences or a rank of 0 are discarded.
+ * Only the <tt>MAX_NGRAM_RANK</tt> best n-grams are selected, which avoids ordering all of them.
  *
  * @param sourceProfile source n-gram profile
- * @param targetProfile target n-gram profile
- * @return heap-ordered vector of n-gram ranks
+ * @param targetTable target probability table
+ * @return up to <tt>MAX_NGRAM_RANK</tt> n-gram ranks in descending order
  */
 std::vector<ObfuscationOperator::NgramRank> ObfuscationOperator::rankNgrams(Context::ConstNgramPtr sourceProfile,
-                                                                            Context::ConstNgramPtr targetProfile) const
+                                                                            TargetTable const& targetTable)
 {
-    std::vector<NgramRank> ngrams;
-    ngrams.reserve(sourceProfile->size() / 2);
+    // keep the best MAX_NGRAM_RANK n-grams in a heap with the worst of them on top,
+    // breaking ties by n-gram so that the selection does not depend on the heap implementation
+    std::array<NgramRank, MAX_NGRAM_RANK> heap;
+    std::size_t heapSize = 0;
+    auto const byRankDescending = [](NgramRank const& lhs, NgramRank const& rhs) {
+        return rhs < lhs || (!(lhs < rhs) && lhs.ngram < rhs.ngram);
+    };
 
     double n = sourceProfile->n();
-    for (auto const& ngram: *sourceProfile) {
+    sourceProfile->forEach([&](NgramProfile::Ngram ngram, NgramProfile::Count count) {
 
         // we only need to rank n-grams which appear at least twice
-        if (ngram.second < 2) {
-            continue;
+        if (count < 2) {
+            return;
         }
 
-        double normQ = ngram.second / n;
-        double normP = targetProfile->normFreq(ngram.first);
+        double normQ = count / n;
+        double normP = targetTable.prob(ngram);
 
         // don't rank n-grams which are not part of the intersection between both texts
         if (normP == 0) {
-            continue;
+            return;
         }
 
         double rank = normP / normQ;
 
         // never consider n-grams whose reduction would make the texts more similar
         if (rank < 1.0) {
-            continue;
+            return;
         }
 
-        ngrams.emplace_back(ngram.first, rank);
-    }
+        NgramRank const candidate(ngram, static_cast<float>(rank));
+        if (heapSize < MAX_NGRAM_RANK) {
+            heap[heapSize++] = candidate;
+            std::push_heap(heap.begin(), heap.begin() + heapSize, byRankDescending);
+        } else if (byRankDescending(candidate, heap[0])) {
+            std::pop_heap(heap.begin(), heap.end(), byRankDescending);
+            heap.back() = candidate;
+            std::push_heap(heap.begin(), heap.end(), byRankDescending);
+        }
+    });
 
-    std::make_heap(ngrams.begin(), ngrams.end());
+    std::vector<NgramRank> ngrams(heap.begin(), heap.begin() + heapSize);
+    std::sort(ngrams.begin(), ngrams.end(), byRankDescending);
 
     return ngrams;
 }
 
 /**
- * Update a successor state (node) with a text edit.
+ * Propose a text edit and add the resulting successor state if the edit is accepted.
+ * The edit is checked on a window around the edited range, so rejected edits do not copy
+ * or allocate any text. Only accepted edits create a successor state, which stores the
+ * replacement as a diff on top of the original text.
  *
  * @param origState original state
- * @param successor successor which is to be updated
  * @param focusPoint operator focus point on the original text
  * @param editStart edit start position on the original text
  * @param editEnd edit end position on the original text
- * @param update replacement string to insert between edit positions
- * @return true on successful update, false if edit would re-introduce the original n-gram
+ * @param replacement replacement string to insert between edit positions
+ * @param successors successor buffer to add the new state to
+ * @return true if the edit was accepted, false if it would re-introduce the original n-gram
+ *         or the successor is a duplicate
  */
-bool ObfuscationOperator::updateSuccessor(State const& origState, State& successor,
-        ObfuscationOperator::FocusPoint const& focusPoint, ObfuscationOperator::StrPos const& editStart,
-        ObfuscationOperator::StrPos const& editEnd, std::string const& update) const
+bool ObfuscationOperator::proposeEdit(State const& origState, ObfuscationOperator::FocusPoint const& focusPoint,
+        ObfuscationOperator::StrPos const& editStart, ObfuscationOperator::StrPos const& editEnd,
+        boost::string_view replacement, Successors& successors) const
 {
     auto const& text = *focusPoint.text;
-    auto const focusPos = text.begin() + focusPoint.ngramOffset;
-    auto const& origNgram = std::string(focusPos, focusPos + NgramProfile::ORDER);
-
-    auto newText = std::make_shared<std::string>(text.begin(), editStart);
-    newText->append(update);
-    newText->append(editEnd, text.end());
+    auto const origNgram = text.data() + focusPoint.ngramOffset;
 
-    auto const newTextPos = newText->begin() + (editStart - text.begin());
-    auto const newBegin = std::max(newTextPos - NgramProfile::ORDER, newText->begin());
-    auto const newEnd = std::min(newTextPos + update.length() + NgramProfile::ORDER, newText->end());
+    // only the edited window is materialized, reusing a per-thread buffer
+    static thread_local std::string newWindow;
+    auto const oldBegin = std::max(editStart - NgramProfile::ORDER, text.begin());
+    auto const oldEnd = std::min(editEnd + NgramProfile::ORDER, text.end());
+    newWindow.assign(oldBegin, editStart);
+    newWindow.append(replacement.data(), replacement.size());
+    newWindow.append(editEnd, oldEnd);
 
-    // don't update successor if edit would re-introduce the same n-gram
-    if (std::string(newBegin, newEnd).find(origNgram) != std::string::npos) {
+    // don't accept edits which would re-introduce the same n-gram
+    if (newWindow.find(origNgram, 0, NgramProfile::ORDER) != std::string::npos) {
         return false;
     }
 
-    auto const oldBegin = std::max(editStart - NgramProfile::ORDER, text.begin());
-    auto const oldEnd = std::min(editEnd + NgramProfile::ORDER, text.end());
+    SEARCH_GENERIC_TIME_PHASE(kSuccessorConstruction);
+    State successor(*origState.mutableMetaData());
+    // the successor's n-gram profile is only built if it is expanded
+    auto ngramUpdates = NgramProfile::updatesFromStringRange(oldBegin, oldEnd, newWindow.cbegin(), newWindow.cend());
 
-    Context::NgramPtr newProfile(origState.ngramProfile()->clone().release());
-    newProfile->updateFromStringRange(oldBegin, oldEnd, newBegin, newEnd);
+    auto const editPos = static_cast<std::size_t>(editStart - text.begin());
+    auto newPositions = origState.positionIndex().edited(editPos, static_cast<std::size_t>(editEnd - editStart),
+            replacement.size(), static_cast<std::size_t>(oldBegin - text.begin()), newWindow);
 
     DiffString newDiff = origState.text();
     newDiff.edit(DiffString::Edit(
-            static_cast<uint32_t>(oldBegin - text.begin()),
-            static_cast<uint8_t>(oldEnd - oldBegin),
-            std::string(newBegin, newEnd)), *newText);
-    successor.setNgramProfile(std::move(newDiff), newProfile);
+            static_cast<uint32_t>(editPos),
+            static_cast<uint32_t>(editEnd - editStart),
+            replacement.to_string()));
+    if (newPositions.numDeltas() > NgramPositionIndex::MAX_DELTAS) {
+        newPositions = NgramPositionIndex(newDiff.string());
+    }
+    successor.setNgramDelta(std::move(newDiff), origState.ngramProfile(), std::move(ngramUpdates));
+    successor.setPositionIndex(std::move(newPositions));
+
+    return successors.push(std::move(successor));
+}
 
-    return true;
+/**
+ * @return hit, miss and eviction counters of the n-gram selection cache shared by all operators
+ */
+CacheStats ObfuscationOperator::ngramSelectionCacheStats()
+{
+    return s_cachedData.stats();
 }
 
 ObfuscationOperator::NgramRank::NgramRank(NgramProfile::Ngram ngram, float rank)
@@ -19,16 +19,17 @@
 
 #include "State.hpp"
 #include "Context.hpp"
+#include "util/ConcurrentCache.hpp"
+#include "util/WordBoundaryIndex.hpp"
 
 #include <search/generic/Operator.hpp>
+#include <cstdint>
 #include <mutex>
 #include <vector>
 #include <string>
 #include <utility>
 #include <boost/optional.hpp>
-#include <boost/compute/detail/lru_cache.hpp>
-
-namespace bd = boost::compute::detail;
+#include <boost/utility/string_view.hpp>
 
 /**
  * Pure virtual obfuscation operator base class.
@@ -36,9 +37,10 @@ namespace bd = boost::compute::detail;
 class ObfuscationOperator : public search::generic::Operator<State, Context> {
 public:
     typedef std::string::const_iterator StrPos;
+    typedef search::generic::SuccessorBuffer<State> Successors;
 
     ObfuscationOperator(std::string const& name, double cost, std::string const& description);
-    std::unordered_set<State> apply(State const& state, Context& context) const final;
+    void apply(State const& state, Context& context, Successors& successors) const final;
 
     /**
      * Maximum n-gram rank to consider for producing successors.
@@ -55,7 +57,17 @@ public:
      */
     static std::size_t constexpr MAX_SUCCESSORS = 6;
 
+    /**
+     * Maximum size of the cached n-gram selections in bytes.
+     */
+    static std::size_t constexpr NGRAM_CACHE_BYTES = 8 * 1024 * 1024;
+
+    static CacheStats ngramSelectionCacheStats();
+    static void prepareExpansion(State const& state, Context const& context);
+
 protected:
+    friend struct BenchmarkAccess;
+
     /**
      * Focus point inside a text to run an operator on.
      */
@@ -69,6 +81,11 @@ protected:
          * Source text.
          */
         std::string const* text = nullptr;
+
+        /**
+         * Word boundaries of the source text.
+         */
+        WordBoundaryIndex const* wordBounds = nullptr;
     };
 
     /**
@@ -77,13 +94,13 @@ protected:
      * @param focusPoint operator focus point inside the text
      * @param state current search node state
      * @param context search context
-     * @return generated successor states
+     * @param successors buffer to add the generated successor states to
      */
-    virtual std::unordered_set<State> applyImpl(FocusPoint const& focusPoint,
-            State const& state, Context& context) const = 0;
+    virtual void applyImpl(FocusPoint const& focusPoint, State const& state, Context& context,
+            Successors& successors) const = 0;
 
-    virtual bool updateSuccessor(State const& origState, State& successor, FocusPoint const& focusPoint,
-            StrPos const& editStart, StrPos const& editEnd, std::string const& update) const;
+    virtual bool proposeEdit(State const& origState, FocusPoint const& focusPoint, StrPos const& editStart,
+            StrPos const& editEnd, boost::string_view replacement, Successors& successors) const;
 
 private:
     /**
@@ -94,6 +111,7 @@ private:
         NgramProfile::Ngram ngram;
         float rank;
 
+        NgramRank() = default;
         NgramRank(NgramProfile::Ngram ngram, float rank);
         bool operator<(NgramRank rhs) const;
     };
@@ -105,13 +123,18 @@ private:
     {
         std::shared_ptr<std::vector<std::string::const_iterator>> ngramPositions;
         std::shared_ptr<std::string> sourceText;
+        std::shared_ptr<WordBoundaryIndex> wordBounds;
     };
 
-    boost::optional<CacheData> getCachedNgramSelection(State const& state, Context const& context) const;
-    std::vector<NgramRank> rankNgrams(Context::ConstNgramPtr sourceProfile,Context::ConstNgramPtr targetProfile) const;
+    static CacheData getCachedNgramSelection(State const& state, Context const& context);
+    static std::vector<NgramRank> rankNgrams(Context::ConstNgramPtr sourceProfile, TargetTable const& targetTable);
 
-    static std::mutex s_cacheMutex;
-    static bd::lru_cache<std::string, CacheData> s_cachedData;
+    static ConcurrentCache<hashing::HashCode, CacheData> s_cachedData;
+
+    /**
+     * Operator-specific value mixed into the seeds of random decisions.
+     */
+    std::uint64_t m_seedSalt;
 };
 
 #endif // OBFUSCATION_OPERATORS_OBFUSCATIONOPERATOR_HPP
@@ -27,11 +27,12 @@ std::unique_ptr<search::generic::Operator<State, Context>> WordRemovalOperator::
     return std::make_unique<WordRemovalOperator>(name(), cost(), description());
 }
 
-std::unordered_set<State> WordRemovalOperator::applyImpl(ObfuscationOperator::FocusPoint const& focusPoint,
-        State const& state, Context& context) const
+void WordRemovalOperator::applyImpl(ObfuscationOperator::FocusPoint const& focusPoint,
+        State const& state, Context& context, Successors& successors) const
 {
-    std::unordered_set<State> successorStates;
-
+    // build all queries first, so they run concurrently
+    std::vector<WordBoundsListPair> wordBounds;
+    std::vector<std::string> queries;
     for (int offset = -1; offset < 2; ++offset) {
         auto wordBoundsLists = parseWordBounds(focusPoint, 2 + offset, 2 - offset);
 
@@ -53,20 +54,25 @@ std::unordered_set<State> WordRemovalOperator::applyImpl(ObfuscationOperator::Fo
             }
             query.append(bounds.first, bounds.second).append(" ");
         }
+        queries.push_back(std::move(query));
+        wordBounds.push_back(std::move(wordBoundsLists));
+    }
 
-        // process response
-        auto const response = netspeakRequest(query, 5);
+    // process responses
+    auto const responses = netspeakRequests(queries);
+    for (std::size_t i = 0; i < responses.size(); ++i) {
+        auto const& response = responses[i];
+        if (!response) {
+            continue;
+        }
+        auto const& wordBoundsLists = wordBounds[i];
         auto& delBounds = wordBoundsLists.second[0];
 
         for (auto const& phrase: response->phrase()) {
             if (phrase.frequency() < 50000) {
                 continue;
             }
-            State successor(*state.mutableMetaData());
-            if (updateSuccessor(state, successor, focusPoint, delBounds.first, delBounds.second, "")) {
-                successorStates.emplace(std::move(successor));
-            }
+            proposeEdit(state, focusPoint, delBounds.first, delBounds.second, boost::string_view(), successors);
         }
     }
-    return successorStates;
 }
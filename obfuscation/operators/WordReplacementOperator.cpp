@@ -27,11 +27,12 @@ std::unique_ptr<search::generic::Operator<State, Context>> WordReplacementOperat
     return std::make_unique<WordReplacementOperator>(name(), cost(), description());
 }
 
-std::unordered_set<State> WordReplacementOperator::applyImpl(ObfuscationOperator::FocusPoint const& focusPoint,
-        State const& state, Context& context) const
+void WordReplacementOperator::applyImpl(ObfuscationOperator::FocusPoint const& focusPoint,
+        State const& state, Context& context, Successors& successors) const
 {
-    std::unordered_set<State> successorStates;
-
+    // build all queries first, so they run concurrently
+    std::vector<WordBoundsListPair> wordBounds;
+    std::vector<std::string> queries;
     for (int offset = -1; offset < 2; ++offset) {
         auto wordBoundsLists = parseWordBounds(focusPoint, 2 + offset, 2 - offset);
 
@@ -53,9 +54,18 @@ std::unordered_set<State> WordReplacementOperator::applyImpl(ObfuscationOperator
             }
             query.append(bounds.first, bounds.second).append(" ");
         }
+        queries.push_back(std::move(query));
+        wordBounds.push_back(std::move(wordBoundsLists));
+    }
 
-        // process response
-        auto const response = netspeakRequest(query, 5);
+    // process responses
+    auto const responses = netspeakRequests(queries);
+    for (std::size_t i = 0; i < responses.size(); ++i) {
+        auto const& response = responses[i];
+        if (!response) {
+            continue;
+        }
+        auto const& wordBoundsLists = wordBounds[i];
         auto& replBounds = wordBoundsLists.second[0];
 
         for (auto const& phrase: response->phrase()) {
@@ -63,12 +73,7 @@ std::unordered_set<State> WordReplacementOperator::applyImpl(ObfuscationOperator
                 continue;
             }
             std::string const replacementWord = phrase.word(wordBoundsLists.first.size()).text();
-            State successor(*state.mutableMetaData());
-            if (updateSuccessor(state, successor, focusPoint, replBounds.first, replBounds.second, replacementWord)) {
-                successorStates.emplace(std::move(successor));
-            }
+            proposeEdit(state, focusPoint, replBounds.first, replBounds.second, replacementWord, successors);
         }
     }
-
-    return successorStates;
 }
@@ -0,0 +1,308 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_UTIL_ASYNCQUERYCACHE_HPP
+#define OBFUSCATION_UTIL_ASYNCQUERYCACHE_HPP
+
+#include "ConcurrentCache.hpp"
+
+#include <boost/optional.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Usage counters of an \link AsyncQueryCache.
+ */
+struct AsyncQueryStats {
+    CacheStats cache;
+    std::size_t coalesced = 0;
+    std::size_t batches = 0;
+    std::size_t queries = 0;
+    std::size_t failures = 0;
+    std::size_t timeouts = 0;
+};
+
+/**
+ * Asynchronous query layer with a result cache in front of a slow backend (e.g. an index on disk).
+ *
+ * Queries are answered from a \link ConcurrentCache if possible. Otherwise they are queued and
+ * answered by a pool of worker threads, which pass up to <tt>maxBatchSize</tt> queued queries to
+ * the backend at once. Concurrent queries for the same key are coalesced into a single backend
+ * query and share its result. Callers either wait for a result with a timeout or keep the returned
+ * future and collect the results of several queries later, so they do not block on the backend
+ * one query at a time.
+ */
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class AsyncQueryCache {
+public:
+    /**
+     * Backend function answering a batch of queries. It must return one result per key, in order.
+     */
+    typedef std::function<std::vector<Value>(std::vector<Key> const&)> BatchQuery;
+    typedef typename ConcurrentCache<Key, Value, Hash>::Weigher Weigher;
+    typedef std::shared_future<Value> Result;
+
+    /**
+     * @param query backend query function
+     * @param cacheBytes maximum total size of cached results
+     * @param weigher function returning the size of a cached result in bytes
+     * @param numWorkers number of worker threads querying the backend
+     * @param maxBatchSize maximum number of keys per backend query
+     */
+    AsyncQueryCache(BatchQuery query, std::size_t cacheBytes, Weigher weigher, std::size_t numWorkers = 4,
+            std::size_t maxBatchSize = 16)
+            : m_query(std::move(query))
+            , m_cache(cacheBytes, std::move(weigher))
+            , m_maxBatchSize(maxBatchSize == 0 ? 1 : maxBatchSize)
+    {
+        for (std::size_t i = 0; i < (numWorkers == 0 ? 1 : numWorkers); ++i) {
+            m_workers.emplace_back(&AsyncQueryCache::work, this);
+        }
+    }
+
+    AsyncQueryCache(AsyncQueryCache const&) = delete;
+    AsyncQueryCache& operator=(AsyncQueryCache const&) = delete;
+
+    /**
+     * Stop all workers. Queries that have not been passed to the backend yet fail.
+     */
+    ~AsyncQueryCache()
+    {
+        std::deque<Key> pending;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            pending.swap(m_queue);
+        }
+        m_queueCondition.notify_all();
+        for (auto& worker: m_workers) {
+            worker.join();
+        }
+
+        for (auto const& key: pending) {
+            auto const it = m_inflight.find(key);
+            if (it != m_inflight.end()) {
+                it->second.set_exception(std::make_exception_ptr(std::runtime_error("Query cache shut down")));
+            }
+        }
+    }
+
+    /**
+     * Start a query or join an identical query in progress.
+     *
+     * @param key query key
+     * @return future result
+     */
+    Result query(Key const& key)
+    {
+        auto result = m_cache.get(key);
+        if (result) {
+            return readyResult(std::move(*result));
+        }
+
+        Result future;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            future = enqueue(key);
+        }
+        m_queueCondition.notify_one();
+        return future;
+    }
+
+    /**
+     * Start several queries at once, e.g. all queries of one node expansion.
+     *
+     * @param keys query keys
+     * @return future results in the order of the keys
+     */
+    std::vector<Result> queryBatch(std::vector<Key> const& keys)
+    {
+        std::vector<Result> results(keys.size());
+        std::vector<std::size_t> missing;
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            auto result = m_cache.get(keys[i]);
+            if (result) {
+                results[i] = readyResult(std::move(*result));
+            } else {
+                missing.push_back(i);
+            }
+        }
+        if (missing.empty()) {
+            return results;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto const i: missing) {
+                results[i] = enqueue(keys[i]);
+            }
+        }
+        m_queueCondition.notify_all();
+        return results;
+    }
+
+    /**
+     * Query a key and wait for the result.
+     *
+     * @param key query key
+     * @param timeout maximum time to wait
+     * @return result or none if the query failed or timed out
+     */
+    boost::optional<Value> get(Key const& key, std::chrono::milliseconds timeout)
+    {
+        return wait(query(key), timeout);
+    }
+
+    /**
+     * Wait for a future result. A query that times out keeps running and its result is still cached.
+     *
+     * @param result future result returned by \link query or \link queryBatch
+     * @param timeout maximum time to wait
+     * @return result or none if the query failed or timed out
+     */
+    boost::optional<Value> wait(Result const& result, std::chrono::milliseconds timeout)
+    {
+        if (result.wait_for(timeout) != std::future_status::ready) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_stats.timeouts;
+            return boost::none;
+        }
+        try {
+            return result.get();
+        } catch (std::exception const&) {
+            return boost::none;
+        }
+    }
+
+    /**
+     * @return usage counters
+     */
+    AsyncQueryStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto stats = m_stats;
+        stats.cache = m_cache.stats();
+        return stats;
+    }
+
+private:
+    static Result readyResult(Value value)
+    {
+        std::promise<Value> promise;
+        promise.set_value(std::move(value));
+        return promise.get_future().share();
+    }
+
+    /**
+     * Queue a key unless it is already in progress. Must be called with <tt>m_mutex</tt> held.
+     *
+     * @return future result
+     */
+    Result enqueue(Key const& key)
+    {
+        auto const it = m_futures.find(key);
+        if (it != m_futures.end()) {
+            ++m_stats.coalesced;
+            return it->second;
+        }
+
+        auto& promise = m_inflight[key];
+        auto future = promise.get_future().share();
+        m_futures.emplace(key, future);
+        m_queue.push_back(key);
+        return future;
+    }
+
+    void work()
+    {
+        std::vector<Key> batch;
+        while (true) {
+            batch.clear();
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_queueCondition.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+                if (m_stop) {
+                    return;
+                }
+                while (!m_queue.empty() && batch.size() < m_maxBatchSize) {
+                    batch.push_back(std::move(m_queue.front()));
+                    m_queue.pop_front();
+                }
+                ++m_stats.batches;
+                m_stats.queries += batch.size();
+            }
+
+            std::vector<Value> values;
+            std::exception_ptr error;
+            try {
+                values = m_query(batch);
+                if (values.size() != batch.size()) {
+                    throw std::runtime_error("Backend returned wrong number of results");
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            // cache before resolving, so that new queries find the result
+            if (!error) {
+                for (std::size_t i = 0; i < batch.size(); ++i) {
+                    m_cache.insert(batch[i], values[i]);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                auto const it = m_inflight.find(batch[i]);
+                if (error) {
+                    it->second.set_exception(error);
+                } else {
+                    it->second.set_value(std::move(values[i]));
+                }
+                m_inflight.erase(it);
+                m_futures.erase(batch[i]);
+            }
+            if (error) {
+                m_stats.failures += batch.size();
+            }
+        }
+    }
+
+    BatchQuery m_query;
+    ConcurrentCache<Key, Value, Hash> m_cache;
+    std::size_t m_maxBatchSize;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queueCondition;
+    std::deque<Key> m_queue;
+    std::unordered_map<Key, std::promise<Value>, Hash> m_inflight;
+    std::unordered_map<Key, Result, Hash> m_futures;
+    AsyncQueryStats m_stats;
+    bool m_stop = false;
+
+    std::vector<std::thread> m_workers;
+};
+
+#endif //OBFUSCATION_UTIL_ASYNCQUERYCACHE_HPP
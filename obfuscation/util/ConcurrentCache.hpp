@@ -0,0 +1,174 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_UTIL_CONCURRENTCACHE_HPP
+#define OBFUSCATION_UTIL_CONCURRENTCACHE_HPP
+
+#include <boost/optional.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * Usage counters of a \link ConcurrentCache.
+ */
+struct CacheStats {
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t evictions = 0;
+    std::size_t entries = 0;
+    std::size_t bytes = 0;
+};
+
+/**
+ * Thread-safe LRU cache with a byte budget.
+ *
+ * Keys are distributed over independently locked shards, so concurrent lookups
+ * of different keys rarely contend. Each shard evicts its least recently used
+ * entries once its share of the budget is exceeded. The size of an entry is
+ * determined by a weigher function.
+ */
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class ConcurrentCache {
+public:
+    typedef std::function<std::size_t(Key const&, Value const&)> Weigher;
+
+    /**
+     * @param budgetBytes maximum total size of all entries
+     * @param weigher function returning the size of an entry in bytes
+     * @param numShards number of independently locked shards
+     */
+    explicit ConcurrentCache(std::size_t budgetBytes, Weigher weigher, std::size_t numShards = 16)
+            : m_weigher(std::move(weigher))
+            , m_numShards(numShards == 0 ? 1 : numShards)
+            , m_shards(new Shard[m_numShards])
+            , m_shardBudget(budgetBytes / m_numShards)
+    {
+    }
+
+    /**
+     * Look up an entry and mark it as most recently used.
+     *
+     * @param key entry key
+     * @return copy of the cached value or none
+     */
+    boost::optional<Value> get(Key const& key)
+    {
+        auto& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto const it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            ++shard.misses;
+            return boost::none;
+        }
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        ++shard.hits;
+        return it->second->value;
+    }
+
+    /**
+     * Insert or replace an entry and evict least recently used entries if the budget is exceeded.
+     * An entry that is larger than the budget of its shard is not cached.
+     *
+     * @param key entry key
+     * @param value entry value
+     */
+    void insert(Key const& key, Value value)
+    {
+        auto const bytes = m_weigher(key, value);
+        auto& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto const it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.bytes -= it->second->bytes;
+            shard.entries.erase(it->second);
+            shard.index.erase(it);
+        }
+        if (bytes > m_shardBudget) {
+            return;
+        }
+
+        shard.entries.push_front(Entry{key, std::move(value), bytes});
+        shard.index.emplace(key, shard.entries.begin());
+        shard.bytes += bytes;
+
+        while (shard.bytes > m_shardBudget) {
+            auto const& victim = shard.entries.back();
+            shard.bytes -= victim.bytes;
+            shard.index.erase(victim.key);
+            shard.entries.pop_back();
+            ++shard.evictions;
+        }
+    }
+
+    /**
+     * @return counters summed over all shards
+     */
+    CacheStats stats() const
+    {
+        CacheStats stats;
+        for (std::size_t i = 0; i < m_numShards; ++i) {
+            auto& shard = m_shards[i];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            stats.hits += shard.hits;
+            stats.misses += shard.misses;
+            stats.evictions += shard.evictions;
+            stats.entries += shard.index.size();
+            stats.bytes += shard.bytes;
+        }
+        return stats;
+    }
+
+private:
+    struct Entry {
+        Key key;
+        Value value;
+        std::size_t bytes;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> entries;
+        std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index;
+        std::size_t bytes = 0;
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;
+    };
+
+    inline Shard& shardFor(Key const& key) const
+    {
+        // mix the hash, since std::hash of integers is the identity
+        auto h = static_cast<std::uint64_t>(Hash()(key));
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return m_shards[h % m_numShards];
+    }
+
+    Weigher m_weigher;
+    std::size_t m_numShards;
+    std::unique_ptr<Shard[]> m_shards;
+    std::size_t m_shardBudget;
+};
+
+#endif //OBFUSCATION_UTIL_CONCURRENTCACHE_HPP
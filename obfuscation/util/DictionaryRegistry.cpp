@@ -0,0 +1,205 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DictionaryRegistry.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+char const* const DictionaryRegistry::SYNONYMS = "synonyms";
+char const* const DictionaryRegistry::HYPERNYMS = "hypernyms";
+
+/**
+ * Configured dictionary and its currently loaded version.
+ */
+struct DictionaryRegistry::Entry {
+    std::string dictFile;
+    char separator;
+
+    /**
+     * Serializes loading, so that a dictionary is loaded only once when several threads need it at the same time.
+     */
+    std::mutex loadMutex;
+    bool loaded = false;
+
+    /**
+     * Current version, accessed with std::atomic_load() and std::atomic_store().
+     */
+    Handle dict;
+};
+
+/**
+ * @return registry of this process
+ */
+DictionaryRegistry& DictionaryRegistry::instance()
+{
+    static DictionaryRegistry registry;
+    return registry;
+}
+
+/**
+ * Configure the default dictionaries of the operators.
+ */
+DictionaryRegistry::DictionaryRegistry()
+{
+    configure(SYNONYMS, "assets/synonym-dictionary.tsv");
+    configure(HYPERNYMS, "assets/hypernym-dictionary.tsv");
+}
+
+/**
+ * Set the file of a dictionary. A dictionary that has been loaded before is replaced on its next use.
+ *
+ * @param name dictionary name
+ * @param dictFile path to the tab-separated source file
+ * @param separator entry separator inside the source file
+ */
+void DictionaryRegistry::configure(std::string const& name, std::string const& dictFile, char separator)
+{
+    auto entry = std::make_shared<Entry>();
+    entry->dictFile = dictFile;
+    entry->separator = separator;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries[name] = std::move(entry);
+}
+
+/**
+ * Load all configured dictionaries in parallel, one thread per dictionary.
+ *
+ * @return false if any dictionary could not be loaded
+ */
+bool DictionaryRegistry::preload()
+{
+    std::vector<std::shared_ptr<Entry>> entries;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto const& entry: m_entries) {
+            entries.push_back(entry.second);
+        }
+    }
+
+    std::vector<char> success(entries.size(), 0);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        threads.emplace_back([&entries, &success, i] {
+            std::lock_guard<std::mutex> lock(entries[i]->loadMutex);
+            if (!entries[i]->loaded) {
+                std::atomic_store(&entries[i]->dict, load(*entries[i]));
+                entries[i]->loaded = true;
+            }
+            success[i] = std::atomic_load(&entries[i]->dict) != nullptr;
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    return std::find(success.begin(), success.end(), 0) == success.end();
+}
+
+/**
+ * Get the current version of a dictionary, loading it if it has not been loaded yet.
+ * This method is thread-safe.
+ *
+ * @param name dictionary name
+ * @return immutable dictionary or nullptr if it is not configured or could not be loaded
+ */
+DictionaryRegistry::Handle DictionaryRegistry::get(std::string const& name)
+{
+    auto const e = entry(name);
+    if (!e) {
+        return nullptr;
+    }
+
+    auto dict = std::atomic_load(&e->dict);
+    if (dict) {
+        return dict;
+    }
+
+    std::lock_guard<std::mutex> lock(e->loadMutex);
+    if (!e->loaded) {
+        std::atomic_store(&e->dict, load(*e));
+        e->loaded = true;
+    }
+    return std::atomic_load(&e->dict);
+}
+
+/**
+ * Load a dictionary again from its file and swap it in atomically.
+ * If loading fails, the previous version is kept.
+ *
+ * @param name dictionary name
+ * @return whether the dictionary was reloaded
+ */
+bool DictionaryRegistry::reload(std::string const& name)
+{
+    auto const e = entry(name);
+    if (!e) {
+        return false;
+    }
+
+    auto dict = load(*e);
+    if (!dict) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(e->loadMutex);
+    std::atomic_store(&e->dict, std::move(dict));
+    e->loaded = true;
+    return true;
+}
+
+/**
+ * Reload all configured dictionaries (see \link reload).
+ *
+ * @return number of reloaded dictionaries
+ */
+std::size_t DictionaryRegistry::reloadAll()
+{
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto const& entry: m_entries) {
+            names.push_back(entry.first);
+        }
+    }
+
+    std::size_t numReloaded = 0;
+    for (auto const& name: names) {
+        numReloaded += reload(name) ? 1 : 0;
+    }
+    return numReloaded;
+}
+
+/**
+ * @return entry of a dictionary or nullptr if it is not configured
+ */
+std::shared_ptr<DictionaryRegistry::Entry> DictionaryRegistry::entry(std::string const& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto const it = m_entries.find(name);
+    return it != m_entries.end() ? it->second : nullptr;
+}
+
+/**
+ * Load the compiled dictionary of an entry, compiling it first if its cache file is missing or outdated.
+ */
+DictionaryRegistry::Handle DictionaryRegistry::load(Entry& entry)
+{
+    std::cout << "Loading dictionary '" << entry.dictFile << "'..." << std::endl;
+    return WordDictionary::load(entry.dictFile, entry.separator);
+}
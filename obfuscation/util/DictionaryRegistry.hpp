@@ -0,0 +1,65 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_UTIL_DICTIONARYREGISTRY_HPP
+#define OBFUSCATION_UTIL_DICTIONARYREGISTRY_HPP
+
+#include "WordDictionary.hpp"
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * Process-wide registry of the word dictionaries used by the operators.
+ *
+ * Dictionaries are configured by name and loaded once, either all at once in parallel by \link preload
+ * or on first use by \link get. Operators keep the immutable handle returned by \link get, so cloning an
+ * operator only copies the handle. \link reload replaces a dictionary atomically: operators created
+ * afterwards get the new version, while running searches keep the one they started with.
+ *
+ * The dictionaries themselves are memory-mapped from their compiled cache files (see WordDictionary),
+ * so all processes on a host that use the same dictionary share its pages.
+ */
+class DictionaryRegistry {
+public:
+    typedef std::shared_ptr<WordDictionary const> Handle;
+
+    static char const* const SYNONYMS;
+    static char const* const HYPERNYMS;
+
+    static DictionaryRegistry& instance();
+
+    void configure(std::string const& name, std::string const& dictFile, char separator = '\t');
+    bool preload();
+    Handle get(std::string const& name);
+    bool reload(std::string const& name);
+    std::size_t reloadAll();
+
+private:
+    struct Entry;
+
+    DictionaryRegistry();
+    std::shared_ptr<Entry> entry(std::string const& name);
+    static Handle load(Entry& entry);
+
+    std::mutex m_mutex;
+    std::map<std::string, std::shared_ptr<Entry>> m_entries;
+};
+
+#endif //OBFUSCATION_UTIL_DICTIONARYREGISTRY_HPP
@@ -15,14 +15,275 @@
  */
 
 #include "DiffString.hpp"
-#include <openssl/md5.h>
+#include "prng.hpp"
 
 #include <cassert>
+#include <search/generic/PhaseTimer.hpp>
+#include <search/generic/PoolAllocator.hpp>
+
+/**
+ * Hash algorithm used for all DiffStrings.
+ */
+hashing::Algorithm DiffString::s_hashAlgorithm = hashing::Algorithm::POLYNOMIAL;
+
+/**
+ * Immutable tree node. The text of a subtree is the text of its left subtree, followed by the node's
+ * own piece of its buffer, followed by the text of its right subtree.
+ */
+struct DiffString::Node
+{
+    typedef std::shared_ptr<Node const> Ptr;
+    typedef std::shared_ptr<std::string const> BufferPtr;
+
+    /**
+     * Maximum size of the pieces a source string is split into.
+     * Splitting a piece requires rehashing it, so this bounds the cost of an edit.
+     */
+    static std::size_t constexpr MAX_PIECE_SIZE = 128;
+
+    /**
+     * Approximate allocation size of a node including its shared pointer control block and pool allocator.
+     */
+    static std::size_t const ALLOCATION_SIZE;
+
+    Ptr left;
+    Ptr right;
+    BufferPtr buffer;
+    std::size_t offset;
+    std::size_t pieceLength;
+    hashing::HashCode pieceHash;
+
+    /**
+     * Length of the subtree text.
+     */
+    std::size_t length;
+
+    /**
+     * Polynomial hash of the subtree text.
+     */
+    hashing::HashCode hash;
+
+    /**
+     * Treap priority, which is greater than or equal to the priorities of both children.
+     */
+    std::uint32_t priority;
+
+    static Ptr make(Ptr left, BufferPtr buffer, std::size_t offset, std::size_t pieceLength,
+            hashing::HashCode pieceHash, Ptr right, std::uint32_t priority, std::size_t& allocated);
+    static Ptr makePiece(Ptr left, BufferPtr const& buffer, std::size_t offset, std::size_t pieceLength,
+            Ptr right, std::uint32_t priority, std::size_t& allocated);
+    static Ptr build(BufferPtr const& buffer, std::size_t begin, std::size_t end, std::size_t& allocated);
+    static std::pair<Ptr, Ptr> split(Ptr const& node, std::size_t pos, std::size_t& allocated);
+    static Ptr merge(Ptr const& left, Ptr const& right, std::size_t& allocated);
+    static void copy(Node const* node, std::size_t pos, std::size_t count, std::string& out);
+    static void collectEdits(Node const* node, std::string const* source, std::size_t& sourcePos,
+            std::vector<Edit>& out);
+    static Edit& editAt(std::size_t sourcePos, std::vector<Edit>& edits);
+    static std::uint32_t randomPriority();
+
+    static inline std::size_t lengthOf(Ptr const& node)
+    {
+        return node ? node->length : 0;
+    }
+
+    static inline hashing::HashCode hashOf(Ptr const& node)
+    {
+        return node ? node->hash : 0;
+    }
+};
+
+std::size_t const DiffString::Node::ALLOCATION_SIZE = sizeof(DiffString::Node) + 4 * sizeof(void*);
+
+/**
+ * Create a node from a piece with a known hash.
+ */
+DiffString::Node::Ptr DiffString::Node::make(Ptr left, BufferPtr buffer, std::size_t offset, std::size_t pieceLength,
+        hashing::HashCode pieceHash, Ptr right, std::uint32_t priority, std::size_t& allocated)
+{
+    auto node = std::allocate_shared<Node>(
+            search::generic::PoolAllocator<Node>(search::generic::CurrentPoolArena()));
+    node->length = lengthOf(left) + pieceLength + lengthOf(right);
+    node->hash = hashing::polynomialConcat(
+            hashing::polynomialConcat(hashOf(left), pieceHash, pieceLength), hashOf(right), lengthOf(right));
+    node->left = std::move(left);
+    node->right = std::move(right);
+    node->buffer = std::move(buffer);
+    node->offset = offset;
+    node->pieceLength = pieceLength;
+    node->pieceHash = pieceHash;
+    node->priority = priority;
+
+    allocated += ALLOCATION_SIZE;
+    return node;
+}
+
+/**
+ * Create a node from a piece and calculate the piece's hash.
+ */
+DiffString::Node::Ptr DiffString::Node::makePiece(Ptr left, BufferPtr const& buffer, std::size_t offset,
+        std::size_t pieceLength, Ptr right, std::uint32_t priority, std::size_t& allocated)
+{
+    auto const pieceHash = hashing::polynomialHash(buffer->data() + offset, pieceLength);
+    return make(std::move(left), buffer, offset, pieceLength, pieceHash, std::move(right), priority, allocated);
+}
+
+/**
+ * Build a perfectly balanced tree over a range of a buffer in O(range size).
+ * Priorities are the subtree heights, which is below any random priority,
+ * so that nodes created by later edits end up above the initial tree.
+ */
+DiffString::Node::Ptr DiffString::Node::build(BufferPtr const& buffer, std::size_t begin, std::size_t end,
+        std::size_t& allocated)
+{
+    if (begin >= end) {
+        return nullptr;
+    }
+
+    std::size_t const numPieces = (end - begin + MAX_PIECE_SIZE - 1) / MAX_PIECE_SIZE;
+    std::size_t const pieceBegin = begin + numPieces / 2 * MAX_PIECE_SIZE;
+    std::size_t const pieceEnd = std::min(pieceBegin + MAX_PIECE_SIZE, end);
+
+    auto left = build(buffer, begin, pieceBegin, allocated);
+    auto right = build(buffer, pieceEnd, end, allocated);
+    auto const priority = std::max(left ? left->priority : 0u, right ? right->priority : 0u) + 1;
+    return makePiece(std::move(left), buffer, pieceBegin, pieceEnd - pieceBegin, std::move(right),
+                     priority, allocated);
+}
+
+/**
+ * Split a tree into trees for the text before and after <tt>pos</tt>.
+ */
+std::pair<DiffString::Node::Ptr, DiffString::Node::Ptr> DiffString::Node::split(Ptr const& node, std::size_t pos,
+        std::size_t& allocated)
+{
+    if (!node || pos == 0) {
+        return {nullptr, node};
+    }
+    if (pos >= node->length) {
+        return {node, nullptr};
+    }
+
+    auto const leftLength = lengthOf(node->left);
+    if (pos <= leftLength) {
+        auto parts = split(node->left, pos, allocated);
+        return {std::move(parts.first), make(std::move(parts.second), node->buffer, node->offset, node->pieceLength,
+                                             node->pieceHash, node->right, node->priority, allocated)};
+    }
+
+    auto const pieceEnd = leftLength + node->pieceLength;
+    if (pos >= pieceEnd) {
+        auto parts = split(node->right, pos - pieceEnd, allocated);
+        return {make(node->left, node->buffer, node->offset, node->pieceLength, node->pieceHash,
+                     std::move(parts.first), node->priority, allocated), std::move(parts.second)};
+    }
+
+    // split inside this node's piece
+    auto const splitLength = pos - leftLength;
+    return {makePiece(node->left, node->buffer, node->offset, splitLength, nullptr, node->priority, allocated),
+            makePiece(nullptr, node->buffer, node->offset + splitLength, node->pieceLength - splitLength,
+                      node->right, node->priority, allocated)};
+}
+
+/**
+ * Concatenate two trees.
+ */
+DiffString::Node::Ptr DiffString::Node::merge(Ptr const& left, Ptr const& right, std::size_t& allocated)
+{
+    if (!left) {
+        return right;
+    }
+    if (!right) {
+        return left;
+    }
+
+    if (left->priority > right->priority) {
+        return make(left->left, left->buffer, left->offset, left->pieceLength, left->pieceHash,
+                    merge(left->right, right, allocated), left->priority, allocated);
+    }
+    return make(merge(left, right->left, allocated), right->buffer, right->offset, right->pieceLength,
+                right->pieceHash, right->right, right->priority, allocated);
+}
+
+/**
+ * Append <tt>count</tt> characters of a subtree's text starting at <tt>pos</tt> to a string.
+ */
+void DiffString::Node::copy(Node const* node, std::size_t pos, std::size_t count, std::string& out)
+{
+    while (node && count > 0) {
+        auto const leftLength = lengthOf(node->left);
+        if (pos < leftLength) {
+            auto const leftCount = std::min(count, leftLength - pos);
+            copy(node->left.get(), pos, leftCount, out);
+            pos += leftCount;
+            count -= leftCount;
+        }
+        if (count == 0) {
+            break;
+        }
+
+        pos -= leftLength;
+        if (pos < node->pieceLength) {
+            auto const pieceCount = std::min(count, node->pieceLength - pos);
+            out.append(*node->buffer, node->offset + pos, pieceCount);
+            pos += pieceCount;
+            count -= pieceCount;
+        }
+        pos -= node->pieceLength;
+        node = node->right.get();
+    }
+}
+
+/**
+ * Append the edits of a subtree against the source string to a list, in order.
+ * <tt>sourcePos</tt> is the position in the source string up to which edits have been collected.
+ */
+void DiffString::Node::collectEdits(Node const* node, std::string const* source, std::size_t& sourcePos,
+        std::vector<Edit>& out)
+{
+    while (node) {
+        collectEdits(node->left.get(), source, sourcePos, out);
+
+        if (node->buffer.get() == source) {
+            // pieces of the source string keep their order, so a gap is a deletion
+            if (node->offset > sourcePos) {
+                editAt(sourcePos, out).charsToDelete += node->offset - sourcePos;
+            }
+            sourcePos = node->offset + node->pieceLength;
+        } else {
+            editAt(sourcePos, out).insertion.append(*node->buffer, node->offset, node->pieceLength);
+        }
+        node = node->right.get();
+    }
+}
+
+/**
+ * Get the last edit of a list if it ends at <tt>sourcePos</tt>, so that adjacent insertions and deletions
+ * are merged into one edit, or append a new empty edit otherwise.
+ */
+DiffString::Edit& DiffString::Node::editAt(std::size_t sourcePos, std::vector<Edit>& edits)
+{
+    if (edits.empty() || edits.back().editPos + edits.back().charsToDelete != sourcePos) {
+        edits.emplace_back(static_cast<std::uint32_t>(sourcePos), 0, std::string());
+    }
+    return edits.back();
+}
+
+/**
+ * Priorities only need to be independent of the text, so a fixed seed keeps the tree shapes
+ * (and thus the timings) of repeated runs comparable.
+ *
+ * @return random priority for nodes created by edits
+ */
+std::uint32_t DiffString::Node::randomPriority()
+{
+    thread_local prng::SplitMix64 generator(0x2545f4914f6cdd1dULL);
+    // keep priorities above the heights used by build()
+    return static_cast<std::uint32_t>(generator() >> 32) | (1u << 16);
+}
 
 DiffString::DiffString(std::shared_ptr<std::string> originalString)
-    : m_sourceString(std::move(originalString))
 {
-    updateHash(*m_sourceString);
+    reset(std::move(originalString));
 }
 
 DiffString::DiffString(std::string const& string)
@@ -42,37 +303,96 @@ DiffString& DiffString::operator=(std::string&& string)
     return *this;
 }
 
-std::string DiffString::hashValue() const
+/**
+ * @return 64-bit hash of the current string
+ */
+hashing::HashCode DiffString::hashValue() const
 {
     return m_hashValue;
 }
 
-void DiffString::updateHash(std::string const& text)
+void DiffString::updateHash()
 {
-    m_hashValue = std::string(MD5_DIGEST_LENGTH, 0);
-    MD5(reinterpret_cast<const unsigned char*>(&text[0]),
-        text.size(), reinterpret_cast<unsigned char*>(&m_hashValue[0]));
-    m_hashValue.shrink_to_fit();
+    SEARCH_GENERIC_TIME_PHASE(kHashing);
+    switch (s_hashAlgorithm) {
+        case hashing::Algorithm::POLYNOMIAL:
+            m_hashValue = Node::hashOf(m_root);
+            break;
+        case hashing::Algorithm::XXHASH64:
+            if (m_numEdits == 0) {
+                m_hashValue = hashing::xxHash64(m_sourceString->data(), m_sourceString->size());
+            } else {
+                auto const text = string();
+                m_hashValue = hashing::xxHash64(text.data(), text.size());
+            }
+            break;
+    }
+}
+
+/**
+ * Set the hash algorithm for all DiffStrings.
+ * Must be called before the first DiffString is created, since hashes of different algorithms don't compare.
+ * Only polynomial hashes can be updated incrementally, xxHash64 digests need the full text after each edit.
+ *
+ * @param algorithm new hash algorithm
+ */
+void DiffString::setHashAlgorithm(hashing::Algorithm algorithm)
+{
+    s_hashAlgorithm = algorithm;
+}
+
+/**
+ * @return hash algorithm used for all DiffStrings
+ */
+hashing::Algorithm DiffString::hashAlgorithm()
+{
+    return s_hashAlgorithm;
 }
 
 bool DiffString::operator==(DiffString const& rhs) const
 {
+    if (m_root == rhs.m_root) {
+        return true;
+    }
+    if (m_hashValue != rhs.m_hashValue || size() != rhs.size()) {
+        return false;
+    }
     return string() == rhs.string();
 }
 
 /**
- * @return current string with applied edit history
+ * @return length of the current string
+ */
+std::size_t DiffString::size() const
+{
+    return Node::lengthOf(m_root);
+}
+
+/**
+ * @return current string with applied edits
  */
 std::string DiffString::string() const
 {
-    std::string edited = *m_sourceString;
-    for (auto const& edit: m_edits) {
-        assert(edit.editPos < edited.length() && edit.editPos + edit.charsToDelete <= edited.length());
-        edited.erase(edit.editPos, edit.charsToDelete);
-        edited.insert(edit.editPos, edit.insertion);
-    }
+    return substr(0, size());
+}
 
-    return edited;
+/**
+ * Get a part of the current string without materializing the full string.
+ * Runtime is O(log(size) + count).
+ *
+ * @param pos start position
+ * @param count maximum number of characters
+ * @return substring, shorter than <tt>count</tt> if <tt>pos + count</tt> exceeds the string size
+ */
+std::string DiffString::substr(std::size_t pos, std::size_t count) const
+{
+    std::string result;
+    if (pos < size()) {
+        count = std::min(count, size() - pos);
+        result.reserve(count);
+        Node::copy(m_root.get(), pos, count, result);
+    }
+    return result;
 }
 
 /**
@@ -84,11 +404,41 @@ std::shared_ptr<std::string> DiffString::source() const
 }
 
 /**
- * @return edit log size
+ * Reconstruct the edits that turn the source string into the current string.
+ * Edit positions refer to the source string. Edits are ordered by position and do not overlap,
+ * so they must be applied in reverse order to reproduce the current string from the source.
+ * Runtime is O(number of tree nodes).
+ *
+ * @return minimal list of edits against the source string
+ */
+std::vector<DiffString::Edit> DiffString::edits() const
+{
+    std::vector<Edit> result;
+    std::size_t sourcePos = 0;
+    Node::collectEdits(m_root.get(), m_sourceString.get(), sourcePos, result);
+    if (sourcePos < m_sourceString->size()) {
+        Node::editAt(sourcePos, result).charsToDelete += m_sourceString->size() - sourcePos;
+    }
+    return result;
+}
+
+/**
+ * @return number of edits since the source string was set
  */
 std::size_t DiffString::logSize() const
 {
-    return m_edits.size();
+    return m_numEdits;
+}
+
+/**
+ * Estimate the number of bytes owned by this string.
+ * The shared source string and tree nodes shared with the string this one was copied from are not included.
+ *
+ * @return estimated memory usage in bytes
+ */
+std::size_t DiffString::memoryUsage() const
+{
+    return sizeof(DiffString) + m_ownedBytes;
 }
 
 /**
@@ -119,15 +469,15 @@ void DiffString::reset(std::string&& newString)
 void DiffString::reset(std::shared_ptr<std::string> newString)
 {
     m_sourceString = std::move(newString);
-    m_edits.clear();
-    updateHash(*m_sourceString);
+    m_ownedBytes = 0;
+    m_root = Node::build(m_sourceString, 0, m_sourceString->size(), m_ownedBytes);
+    m_numEdits = 0;
+    updateHash();
 }
 
 /**
- * Add an edit to the string edit history.
- * WARNING: this method can be expensive, because it needs to calculate a temporary version of the full
- * text to calculate the hash. If you already have a full version of the new text,
- * use \link edit(DiffString::Edit const&, std::size_t, int) instead.
+ * Apply an edit in O(log(size) + edit size). Tree nodes not on the path to
+ * the edit position remain shared with copies of this string.
  *
  * No bounds checks are done. You are responsible for making sure edit positions point to valid
  * positions in the string.
@@ -136,34 +486,31 @@ void DiffString::reset(std::shared_ptr<std::string> newString)
  */
 void DiffString::edit(DiffString::Edit const& edit)
 {
-    m_edits.emplace_back(edit);
-    updateHash(string());
-}
+    assert(edit.editPos <= size() && edit.editPos + edit.charsToDelete <= size());
 
-/**
- * Add an edit to the string edit history and update the DiffString's hash value
- * from the given text.
- *
- * No bounds checks are done. You are responsible for making sure edit positions point to valid
- * positions in the string.
- *
- * @param edit new edit to apply
- * @param text new text for calculating the new hash
- * @param newHash text to calculate the hash value from
- */
-void DiffString::edit(DiffString::Edit const& edit, std::string const& text)
-{
-    m_edits.emplace_back(edit);
-    updateHash(text);
+    std::size_t allocated = 0;
+    auto const head = Node::split(m_root, edit.editPos, allocated);
+    auto const tail = Node::split(head.second, edit.charsToDelete, allocated);
+
+    Node::Ptr insertion;
+    if (!edit.insertion.empty()) {
+        auto buffer = std::allocate_shared<std::string const>(
+                search::generic::PoolAllocator<std::string>(search::generic::CurrentPoolArena()), edit.insertion);
+        allocated += sizeof(std::string) + buffer->capacity();
+        insertion = Node::makePiece(nullptr, buffer, 0, buffer->size(), nullptr, Node::randomPriority(), allocated);
+    }
+
+    m_root = Node::merge(Node::merge(head.first, insertion, allocated), tail.second, allocated);
+    m_ownedBytes = allocated;
+    ++m_numEdits;
+    updateHash();
 }
 
 /**
- * Apply all previous edits, generate a new source string from it and clear the edit history.
- * Use this to trade memory for performance if the edit history becomes too long.
+ * Apply all previous edits and generate a new source string from the result.
+ * Use this to trade memory for performance if the string has become fragmented by many edits.
  */
 void DiffString::apply()
 {
-    m_sourceString = std::make_shared<std::string>(string());
-    m_edits.clear();
-    m_edits.shrink_to_fit();
+    reset(std::make_shared<std::string>(string()));
 }
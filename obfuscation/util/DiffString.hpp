@@ -17,6 +17,8 @@
 #ifndef OBFUSCATION_SEARCH_DIFFSTRING_HPP
 #define OBFUSCATION_SEARCH_DIFFSTRING_HPP
 
+#include "hashing.hpp"
+
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -24,8 +26,12 @@
 #include <vector>
 
 /**
- * String representation that stores its edit history and re-applies it on the fly to the original
- * text instead of storing the full new text in order to save memory.
+ * Persistent string representation for search states.
+ *
+ * The text is stored as a randomized balanced tree (treap) of pieces referencing shared immutable buffers.
+ * Edits copy only the O(log n) nodes on the path to the edit position, so copies of a DiffString share
+ * all unchanged structure with each other. Each subtree caches its length and polynomial hash, so hashes
+ * are updated with every edit without materializing the full text.
  */
 class DiffString {
 public:
@@ -33,7 +39,7 @@ public:
      * String edit representation
      */
     struct Edit {
-        Edit(std::uint32_t editPos, std::uint8_t charsToDelete, std::string insertion)
+        Edit(std::uint32_t editPos, std::uint32_t charsToDelete, std::string insertion)
                 : editPos(editPos), charsToDelete(charsToDelete), insertion(std::move(insertion)) {}
         Edit(Edit const& other) = default;
         Edit(Edit&& other) = default;
@@ -48,7 +54,7 @@ public:
         /**
          * Number of characters to delete from editPos;
          */
-        std::uint8_t charsToDelete;
+        std::uint32_t charsToDelete;
 
         /**
          * New string to insert instead.
@@ -65,31 +71,43 @@ public:
     DiffString& operator=(std::string const& string);
     DiffString& operator=(std::string&& string);
 
-    std::string hashValue() const;
+    hashing::HashCode hashValue() const;
     bool operator==(DiffString const& rhs) const;
 
+    std::size_t size() const;
     std::string string() const;
+    std::string substr(std::size_t pos, std::size_t count) const;
     std::shared_ptr<std::string> source() const;
+    std::vector<Edit> edits() const;
     std::size_t logSize() const;
+    std::size_t memoryUsage() const;
     void reset(std::string const& newString);
     void reset(std::string&& newString);
     void reset(std::shared_ptr<std::string> newString);
     void edit(Edit const& edit);
-    void edit(Edit const& edit, std::string const& text);
     void apply();
 
+    static void setHashAlgorithm(hashing::Algorithm algorithm);
+    static hashing::Algorithm hashAlgorithm();
+
 private:
-    void updateHash(std::string const& text);
+    struct Node;
+
+    void updateHash();
+
+    static hashing::Algorithm s_hashAlgorithm;
 
     std::shared_ptr<std::string> m_sourceString;
-    std::vector<Edit> m_edits;
-    std::string m_hashValue;
-};
+    std::shared_ptr<Node const> m_root;
+    std::uint32_t m_numEdits = 0;
 
+    /**
+     * Bytes allocated by the last edit, which are not shared with the unedited string.
+     */
+    std::size_t m_ownedBytes = 0;
+    hashing::HashCode m_hashValue = 0;
+};
 
-namespace {
-std::hash<std::string> diffStringHash;
-}
 
 namespace std {
 
@@ -97,7 +115,7 @@ template<>
 struct hash<DiffString> {
     std::size_t operator()(DiffString const& state) const
     {
-        return diffStringHash(state.hashValue());
+        return static_cast<std::size_t>(state.hashValue());
     }
 };
 
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "NgramPositionIndex.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+std::size_t constexpr NgramPositionIndex::MAX_DELTAS;
+
+namespace {
+
+/**
+ * Read the raw n-gram starting at the given character without any normalization.
+ */
+inline NgramProfile::Ngram rawNgram(char const* chars)
+{
+    NgramWindow<NgramProfile::ORDER> window;
+    for (std::size_t i = 0; i < NgramProfile::ORDER; ++i) {
+        window.push(chars[i]);
+    }
+    return window.key();
+}
+
+/**
+ * Append the offsets of all occurrences of an n-gram in a sorted occurrence table.
+ */
+template<typename Occurrence>
+inline void appendOffsets(std::vector<Occurrence> const& occurrences, NgramProfile::Ngram ngram,
+        std::vector<std::size_t>& offsets)
+{
+    auto it = std::lower_bound(occurrences.begin(), occurrences.end(), Occurrence(ngram, 0));
+    for (; it != occurrences.end() && it->first == ngram; ++it) {
+        offsets.push_back(it->second);
+    }
+}
+
+}   // namespace
+
+/**
+ * Build an index over all n-gram occurrences of a text.
+ *
+ * @param text base text
+ */
+NgramPositionIndex::NgramPositionIndex(std::string const& text)
+{
+    assert(text.size() <= std::numeric_limits<Offset>::max());
+
+    auto base = std::make_shared<std::vector<Occurrence>>();
+    if (text.size() >= NgramProfile::ORDER) {
+        base->reserve(text.size() - (NgramProfile::ORDER - 1));
+        NgramWindow<NgramProfile::ORDER> window;
+        for (std::size_t i = 0; i < text.size(); ++i) {
+            window.push(text[i]);
+            if (i + 1 >= NgramProfile::ORDER) {
+                base->emplace_back(window.key(), static_cast<Offset>(i + 1 - NgramProfile::ORDER));
+            }
+        }
+        std::sort(base->begin(), base->end());
+    }
+    m_base = std::move(base);
+}
+
+/**
+ * Find all occurrences of an n-gram in the current text.
+ *
+ * @param ngram n-gram to search for
+ * @return sorted character offsets of all occurrences
+ */
+std::vector<std::size_t> NgramPositionIndex::find(Ngram ngram) const
+{
+    std::vector<Delta const*> chain;
+    for (auto delta = m_head.get(); delta; delta = delta->prev.get()) {
+        chain.push_back(delta);
+    }
+
+    std::vector<std::size_t> offsets;
+    if (m_base) {
+        appendOffsets(*m_base, ngram, offsets);
+    }
+
+    std::vector<std::size_t> mapped;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        auto const& delta = **it;
+        mapped.clear();
+
+        // occurrences ending before the edit are unchanged, those overlapping it are gone
+        auto pos = offsets.begin();
+        for (; pos != offsets.end() && *pos + NgramProfile::ORDER <= delta.editPos; ++pos) {
+            mapped.push_back(*pos);
+        }
+        appendOffsets(delta.added, ngram, mapped);
+        for (; pos != offsets.end(); ++pos) {
+            if (*pos >= delta.editPos + delta.charsDeleted) {
+                mapped.push_back(*pos + delta.charsInserted - delta.charsDeleted);
+            }
+        }
+        offsets.swap(mapped);
+    }
+
+    return offsets;
+}
+
+/**
+ * Derive the index of an edited text. The returned index shares all data with this one.
+ *
+ * <tt>window</tt> is an excerpt of the edited text starting at <tt>windowPos</tt>, which must contain
+ * the inserted characters and up to <tt>NgramProfile::ORDER - 1</tt> characters on either side of them.
+ *
+ * @param editPos position of the edit
+ * @param charsDeleted number of deleted characters
+ * @param charsInserted number of inserted characters
+ * @param windowPos position of <tt>window</tt> in the edited text
+ * @param window excerpt of the edited text around the edit
+ * @return edited index
+ */
+NgramPositionIndex NgramPositionIndex::edited(std::size_t editPos, std::size_t charsDeleted,
+        std::size_t charsInserted, std::size_t windowPos, std::string const& window) const
+{
+    auto delta = std::make_shared<Delta>();
+    delta->prev = m_head;
+    delta->length = numDeltas() + 1;
+    delta->editPos = static_cast<Offset>(editPos);
+    delta->charsDeleted = static_cast<Offset>(charsDeleted);
+    delta->charsInserted = static_cast<Offset>(charsInserted);
+
+    auto const first = std::max(windowPos, editPos + 1 < NgramProfile::ORDER ? 0 : editPos + 1 - NgramProfile::ORDER);
+    for (auto i = first; i < editPos + charsInserted && i + NgramProfile::ORDER <= windowPos + window.size(); ++i) {
+        delta->added.emplace_back(rawNgram(window.data() + (i - windowPos)), static_cast<Offset>(i));
+    }
+    std::sort(delta->added.begin(), delta->added.end());
+
+    NgramPositionIndex index;
+    index.m_base = m_base;
+    index.m_head = std::move(delta);
+    return index;
+}
+
+/**
+ * @return number of edits since the index was built
+ */
+std::size_t NgramPositionIndex::numDeltas() const
+{
+    return m_head ? m_head->length : 0;
+}
+
+/**
+ * @return true if the index was never built
+ */
+bool NgramPositionIndex::empty() const
+{
+    return !m_base;
+}
+
+/**
+ * Estimate the number of bytes owned by this index.
+ * Deltas are shared with all indexes derived from this one and only the last delta is included.
+ * The base table is only included if no edits were made since it was built.
+ *
+ * @return estimated memory usage in bytes
+ */
+std::size_t NgramPositionIndex::memoryUsage() const
+{
+    std::size_t bytes = sizeof(NgramPositionIndex);
+    if (m_head) {
+        bytes += sizeof(Delta) + 2 * sizeof(void*) + m_head->added.capacity() * sizeof(Occurrence);
+    } else if (m_base) {
+        bytes += m_base->capacity() * sizeof(Occurrence);
+    }
+    return bytes;
+}
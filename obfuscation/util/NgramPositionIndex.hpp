@@ -0,0 +1,86 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_UTIL_NGRAMPOSITIONINDEX_HPP
+#define OBFUSCATION_UTIL_NGRAMPOSITIONINDEX_HPP
+
+#include "NgramProfile.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Persistent index of the positions at which each n-gram occurs in a text.
+ *
+ * The index consists of a sorted table of all occurrences in a base text, which is shared between
+ * copies, and a chain of deltas describing the text edits made since. Each delta records the edited
+ * range and the occurrences created by the edit, so an edited index shares all previous deltas with
+ * the index it was derived from. Lookups map the base occurrences through all deltas of the chain.
+ * Once the chain reaches <tt>MAX_DELTAS</tt>, the index should be rebuilt from the current text.
+ *
+ * N-grams are indexed by their raw characters, so they match the output of ngram2Char()
+ * exactly as <tt>std::string::find()</tt> would.
+ */
+class NgramPositionIndex {
+public:
+    typedef NgramProfile::Ngram Ngram;
+    typedef std::uint32_t Offset;
+
+    /**
+     * Maximum number of deltas before the index should be rebuilt.
+     * Rebuilding sorts all occurrences of the text, while a lookup only walks the deltas for the
+     * occurrences of one n-gram, so the chain is kept long to rebuild rarely.
+     */
+    static std::size_t constexpr MAX_DELTAS = 256;
+
+    NgramPositionIndex() = default;
+    explicit NgramPositionIndex(std::string const& text);
+
+    std::vector<std::size_t> find(Ngram ngram) const;
+    NgramPositionIndex edited(std::size_t editPos, std::size_t charsDeleted, std::size_t charsInserted,
+            std::size_t windowPos, std::string const& window) const;
+    std::size_t numDeltas() const;
+    bool empty() const;
+    std::size_t memoryUsage() const;
+
+private:
+    typedef std::pair<Ngram, Offset> Occurrence;
+
+    struct Delta {
+        std::shared_ptr<Delta const> prev;
+        std::size_t length;
+        Offset editPos;
+        Offset charsDeleted;
+        Offset charsInserted;
+
+        /**
+         * Occurrences created by this edit, sorted by n-gram and offset.
+         */
+        std::vector<Occurrence> added;
+    };
+
+    /**
+     * Occurrences in the base text, sorted by n-gram and offset.
+     */
+    std::shared_ptr<std::vector<Occurrence> const> m_base;
+    std::shared_ptr<Delta const> m_head;
+};
+
+#endif //OBFUSCATION_UTIL_NGRAMPOSITIONINDEX_HPP
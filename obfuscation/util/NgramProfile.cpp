@@ -15,16 +15,285 @@
  */
 
 #include "NgramProfile.hpp"
+#include "TextNormalizer.hpp"
+#include "hashing.hpp"
 
 #include <boost/algorithm/string.hpp>
+#include <search/generic/PoolAllocator.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
-#include <boost/locale.hpp>
-#include <boost/regex.hpp>
 #include <boost/serialization/map.hpp>
 #include <boost/serialization/unordered_map.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+/**
+ * Magic bytes identifying a binary n-gram profile.
+ */
+char const BINARY_MAGIC[8] = {'N', 'G', 'R', 'M', 'P', 'R', 'O', 'F'};
+
+/**
+ * Current binary n-gram profile format version.
+ */
+std::uint32_t const BINARY_VERSION = 1;
+
+/**
+ * Header of a binary n-gram profile.
+ */
+struct BinaryHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t order;
+    std::uint64_t n;
+    std::uint64_t size;
+    std::uint64_t checksum;
+};
+
+static_assert(sizeof(BinaryHeader) == 40, "unexpected binary profile header padding");
+
+/**
+ * Minimum size of text chunks for streaming profile generation.
+ */
+std::size_t const GENERATOR_CHUNK_SIZE = 4 << 20;
+
+/**
+ * Open-addressing hash map for counting n-grams.
+ */
+class NgramCounter
+{
+public:
+    explicit NgramCounter(std::size_t capacity = 1 << 12)
+            : m_keys(capacity)
+            , m_counts(capacity)
+            , m_mask(capacity - 1)
+    {
+        assert((capacity & m_mask) == 0);
+    }
+
+    inline void add(NgramProfile::Ngram ngram, std::uint64_t count = 1)
+    {
+        auto pos = slot(ngram);
+        while (m_counts[pos] != 0 && m_keys[pos] != ngram) {
+            pos = (pos + 1) & m_mask;
+        }
+        if (m_counts[pos] == 0) {
+            m_keys[pos] = ngram;
+            if (++m_size * 2 > m_keys.size()) {
+                m_counts[pos] = count;
+                grow();
+                return;
+            }
+        }
+        m_counts[pos] += count;
+    }
+
+    template<typename Func>
+    void forEach(Func func) const
+    {
+        for (std::size_t i = 0; i < m_keys.size(); ++i) {
+            if (m_counts[i] != 0) {
+                func(m_keys[i], m_counts[i]);
+            }
+        }
+    }
+
+private:
+    inline std::size_t slot(NgramProfile::Ngram ngram) const
+    {
+        return static_cast<std::size_t>((ngram * 0x9E3779B97F4A7C15ull) >> 32) & m_mask;
+    }
+
+    void grow()
+    {
+        NgramCounter grown(m_keys.size() * 2);
+        forEach([&grown](NgramProfile::Ngram ngram, std::uint64_t count) {
+            grown.add(ngram, count);
+        });
+        *this = std::move(grown);
+    }
+
+    std::vector<NgramProfile::Ngram> m_keys;
+    std::vector<std::uint64_t> m_counts;
+    std::size_t m_mask;
+    std::size_t m_size = 0;
+};
+
+/**
+ * Result of counting a single chunk during streaming profile generation.
+ */
+struct ChunkSummary
+{
+    /**
+     * First ORDER - 1 characters of the normalized chunk.
+     */
+    std::string head;
+
+    /**
+     * Last ORDER - 1 characters of the normalized chunk.
+     */
+    std::string tail;
+
+    /**
+     * Length of the normalized chunk.
+     */
+    std::size_t length = 0;
+};
+
+/**
+ * Find the end of the next chunk in a streaming text buffer. A chunk ends after the first newline
+ * of a blank line found after <tt>minSize</tt> characters. If none is found within four times
+ * <tt>minSize</tt>, the chunk ends after the last newline or, failing that, at <tt>minSize</tt>.
+ *
+ * @param buffer text buffer
+ * @param minSize minimum chunk size
+ * @return chunk end or std::string::npos if more text is needed
+ */
+std::size_t findChunkBoundary(std::string const& buffer, std::size_t minSize)
+{
+    if (buffer.size() <= minSize) {
+        return std::string::npos;
+    }
+
+    for (auto pos = buffer.find('\n', minSize); pos != std::string::npos; pos = buffer.find('\n', pos + 1)) {
+        auto const next = pos + 1;
+        if (next < buffer.size() && (buffer[next] == '\n'
+                || (buffer[next] == '\r' && next + 1 < buffer.size() && buffer[next + 1] == '\n'))) {
+            return next;
+        }
+    }
+
+    if (buffer.size() < 4 * minSize) {
+        return std::string::npos;
+    }
+    auto const lastNewline = buffer.rfind('\n');
+    return lastNewline != std::string::npos && lastNewline >= minSize ? lastNewline + 1 : minSize;
+}
+
+/**
+ * Normalize a text chunk and count its n-grams.
+ *
+ * @param chunk raw text chunk, modified in place
+ * @param flags bit flags for profile generation
+ * @param counter counter to add n-grams to
+ * @return chunk boundary summary for stitching
+ */
+ChunkSummary countChunk(std::string& chunk, unsigned int flags, NgramCounter& counter)
+{
+    preprocessText(chunk, (flags & NgramProfile::STRIP_POS_ANNOTATIONS) != 0, !(flags & NgramProfile::SKIP_NORMALIZATION));
+
+    forEachNgram(chunk.data(), chunk.data() + chunk.size(), [&counter](NgramProfile::Ngram ngram) {
+        counter.add(ngram);
+    });
+
+    ChunkSummary summary;
+    auto const affixSize = std::min(chunk.size(), NgramProfile::ORDER - 1);
+    summary.head = chunk.substr(0, affixSize);
+    summary.tail = chunk.substr(chunk.size() - affixSize);
+    summary.length = chunk.size();
+    return summary;
+}
+
+/**
+ * Checksum of binary n-gram profile arrays.
+ */
+hashing::HashCode binaryChecksum(NgramProfile::Ngram const* keys, NgramProfile::Count const* counts, std::size_t size)
+{
+    auto const keysHash = hashing::xxHash64(reinterpret_cast<char const*>(keys), size * sizeof(NgramProfile::Ngram));
+    return hashing::xxHash64(reinterpret_cast<char const*>(counts), size * sizeof(NgramProfile::Count), keysHash);
+}
+
+/**
+ * Find an n-gram in a range of a sorted update overlay.
+ */
+template<typename It>
+inline It findUpdate(It begin, It end, NgramProfile::Ngram ngram)
+{
+    return std::lower_bound(begin, end, ngram, [](NgramProfile::NgramDelta const& delta, NgramProfile::Ngram key) {
+        return delta.first < key;
+    });
+}
+
+/**
+ * Find an n-gram in a sorted update overlay.
+ */
+template<typename Updates>
+inline auto findUpdate(Updates& updates, NgramProfile::Ngram ngram) -> decltype(updates.begin())
+{
+    return findUpdate(updates.begin(), updates.end(), ngram);
+}
+
+/**
+ * @return whether updates are sorted by n-gram, with each n-gram occurring once and a non-zero change
+ */
+inline bool isNetUpdates(std::vector<NgramProfile::NgramUpdate> const& updates)
+{
+    for (std::size_t i = 0; i < updates.size(); ++i) {
+        if (updates[i].second == 0 || (i > 0 && updates[i - 1].first >= updates[i].first)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Sort n-gram updates and sum up the changes of equal n-grams, dropping those which cancel out.
+ *
+ * @param begin first update
+ * @param end past the last update
+ * @return past the last net update
+ */
+template<typename It>
+It netUpdates(It begin, It end)
+{
+    std::sort(begin, end, [](NgramProfile::NgramUpdate const& a, NgramProfile::NgramUpdate const& b) {
+        return a.first < b.first;
+    });
+
+    auto out = begin;
+    for (auto it = begin; it != end;) {
+        auto const ngram = it->first;
+        int change = 0;
+        for (; it != end && it->first == ngram; ++it) {
+            change += it->second;
+        }
+        if (change != 0) {
+            *out++ = std::make_pair(ngram, change);
+        }
+    }
+    return out;
+}
+
+/**
+ * Call <tt>func</tt> with the key of each n-gram in a string range.
+ */
+template<typename Func>
+inline void forEachNgramInRange(NgramProfile::StrIt begin, NgramProfile::StrIt end, Func&& func)
+{
+    if (begin != end) {
+        forEachNgram(&*begin, &*begin + (end - begin), std::forward<Func>(func));
+    }
+}
+}
+
+std::size_t constexpr NgramProfile::CHUNK_SIZE;
+std::size_t constexpr NgramProfile::MAX_UPDATES;
 
 /**
  * Construct n-gram profile from serialization in given file.
@@ -49,13 +318,28 @@ std::size_t NgramProfile::n() const
  */
 std::size_t NgramProfile::freq(Ngram ngram) const
 {
-    auto pos = m_updates.find(ngram);
-    if (pos != m_updates.end()) {
-        return pos->second;
+    auto const updatePos = findUpdate(m_updates, ngram);
+    if (updatePos != m_updates.end() && updatePos->first == ngram) {
+        return updatePos->second;
     }
 
-    pos = m_ngrams->find(ngram);
-    return pos != m_ngrams->end() ? pos->second : static_cast<std::size_t>(0);
+    return storedFreq(ngram);
+}
+
+/**
+ * @return absolute n-gram frequency count for <tt>ngram</tt> in the storage, ignoring the update overlay
+ */
+NgramProfile::Count NgramProfile::storedFreq(Ngram ngram) const
+{
+    auto const& storage = *m_ngrams;
+    auto const chunkPos = std::upper_bound(storage.firstKeys.begin(), storage.firstKeys.end(), ngram);
+    if (chunkPos == storage.firstKeys.begin()) {
+        return 0;
+    }
+
+    auto const& chunk = storage.chunks[chunkPos - storage.firstKeys.begin() - 1];
+    auto const pos = ngramLowerBound(chunk.keys, chunk.size, ngram);
+    return pos != chunk.size && chunk.keys[pos] == ngram ? chunk.counts[pos] : 0;
 }
 
 /**
@@ -70,36 +354,59 @@ float NgramProfile::normFreq(Ngram ngram) const
  * Update a series of n-grams in this profile with relative (positive or negative) occurrence count changes.
  * If the n-gram didn't exist in the profile before, it will be inserted into it.
  *
+ * The changes of equal n-grams are summed up first (which is a no-op for the net updates returned by
+ * \link updatesFromStringRange), and the result is merged into the sorted update overlay in one pass
+ * from the back, so each overlay entry is moved at most once.
+ *
  * @param updates set of updates
  */
 void NgramProfile::update(std::vector<NgramUpdate> const& updates)
 {
-    m_lastNgramUpdates.clear();
+    m_lastNgramUpdates = updates;
+    if (!isNetUpdates(m_lastNgramUpdates)) {
+        m_lastNgramUpdates.erase(netUpdates(m_lastNgramUpdates.begin(), m_lastNgramUpdates.end()),
+                m_lastNgramUpdates.end());
+    }
 
-    for (auto const& update: updates) {
-        auto ngramPos = m_ngrams->find(update.first);
-        if (ngramPos != m_ngrams->end() && m_updates.find(update.first) == m_updates.end()) {
-            m_updates[update.first] = ngramPos->second;
+    // make room for the n-grams which are not in the overlay yet
+    std::size_t numInserted = 0;
+    auto searchPos = m_updates.begin();
+    for (auto const& update: m_lastNgramUpdates) {
+        searchPos = findUpdate(searchPos, m_updates.end(), update.first);
+        if (searchPos == m_updates.end() || searchPos->first != update.first) {
+            ++numInserted;
         }
-        auto updateVal = (m_updates[update.first] += update.second);
+    }
+    auto read = m_updates.size();
+    m_updates.resize(read + numInserted);
+    auto write = m_updates.size();
+
+    for (auto update = m_lastNgramUpdates.rbegin(); update != m_lastNgramUpdates.rend(); ++update) {
+        auto const pos = static_cast<std::size_t>(
+                findUpdate(m_updates.begin(), m_updates.begin() + read, update->first) - m_updates.begin());
+        auto const found = pos != read && m_updates[pos].first == update->first;
+        auto const tail = found ? pos + 1 : pos;
+        std::move_backward(m_updates.begin() + tail, m_updates.begin() + read, m_updates.begin() + write);
+        write -= read - tail;
+        read = pos;
+
+        auto const oldVal = static_cast<long>(found ? m_updates[pos].second : storedFreq(update->first));
+        auto const updateVal = oldVal + update->second;
         assert(updateVal >= 0);
+        m_updates[--write] = NgramDelta(update->first, static_cast<Count>(updateVal));
 
-        if (ngramPos == m_ngrams->end() && updateVal != 0) {
+        if (oldVal == 0 && updateVal != 0) {
             ++m_size;
-        } else if (ngramPos != m_ngrams->end() && updateVal == 0) {
+        } else if (oldVal != 0 && updateVal == 0) {
             assert(m_size > 0);
             --m_size;
         }
 
-        m_n += update.second;
-        m_lastNgramUpdates.push_back(update);
+        m_n += update->second;
     }
+    assert(read == write);
 
-    assert(m_n >= 0);
-    assert(m_size >= 0);
-
-    // TODO: define this threshold somewhere else
-    if (m_updates.size() > 150) {
+    if (m_updates.size() > MAX_UPDATES) {
         apply();
     }
 }
@@ -107,18 +414,69 @@ void NgramProfile::update(std::vector<NgramUpdate> const& updates)
 /**
  * Apply update history to n-gram map to trade memory for performance
  * and clear list of recent updates.
+ * Only the storage chunks touched by updates are copied, all other chunks remain shared with clones.
  */
 void NgramProfile::apply()
 {
-    auto tmp = m_ngrams;
-    m_ngrams = std::make_shared<NgramMap>(tmp->begin(), tmp->end());
-    for (auto const& ngramPair: m_updates) {
-        if (ngramPair.second == 0) {
-            m_ngrams->erase(ngramPair.first);
-        } else {
-            (*m_ngrams)[ngramPair.first] = ngramPair.second;
-        };
+    if (m_updates.empty()) {
+        return;
+    }
+
+    auto const& oldStorage = *m_ngrams;
+    auto storage = std::make_shared<Storage>();
+    storage->chunks.reserve(oldStorage.chunks.size() + 1);
+    storage->firstKeys.reserve(oldStorage.chunks.size() + 1);
+    m_ownedBytes = sizeof(Storage);
+
+    auto updatesIt = m_updates.cbegin();
+    auto const numChunks = std::max<std::size_t>(oldStorage.chunks.size(), 1);
+    for (std::size_t i = 0; i < numChunks; ++i) {
+        // updates before the second chunk belong to the first chunk, updates after the last chunk to the last one
+        auto const updatesEnd = i + 1 < numChunks
+                ? findUpdate(m_updates, oldStorage.firstKeys[i + 1]) : m_updates.cend();
+        if (updatesIt == updatesEnd) {
+            storage->chunks.push_back(oldStorage.chunks[i]);
+            storage->firstKeys.push_back(oldStorage.firstKeys[i]);
+            continue;
+        }
+
+        // merge chunk with its updates
+        Chunk const emptyChunk;
+        auto const& chunk = i < oldStorage.chunks.size() ? oldStorage.chunks[i] : emptyChunk;
+        std::vector<Ngram> keys;
+        std::vector<Count> counts;
+        keys.reserve(chunk.size + (updatesEnd - updatesIt));
+        counts.reserve(chunk.size + (updatesEnd - updatesIt));
+        std::size_t pos = 0;
+        while (pos < chunk.size || updatesIt != updatesEnd) {
+            if (updatesIt == updatesEnd || (pos < chunk.size && chunk.keys[pos] < updatesIt->first)) {
+                keys.push_back(chunk.keys[pos]);
+                counts.push_back(chunk.counts[pos]);
+                ++pos;
+                continue;
+            }
+            if (pos < chunk.size && chunk.keys[pos] == updatesIt->first) {
+                ++pos;
+            }
+            if (updatesIt->second != 0) {
+                keys.push_back(updatesIt->first);
+                counts.push_back(updatesIt->second);
+            }
+            ++updatesIt;
+        }
+
+        if (!keys.empty()) {
+            m_ownedBytes += keys.size() * (sizeof(Ngram) + sizeof(Count));
+            Ngram const* keysData = keys.data();
+            Count const* countsData = counts.data();
+            auto const size = keys.size();
+            auto const buffer = makeChunkBuffer(std::move(keys), std::move(counts));
+            appendChunks(*storage, keysData, countsData, size, buffer);
+        }
     }
+
+    m_ownedBytes += storage->chunks.capacity() * sizeof(Chunk) + storage->firstKeys.capacity() * sizeof(Ngram);
+    m_ngrams = std::move(storage);
     m_updates.clear();
 }
 
@@ -130,6 +488,19 @@ std::size_t NgramProfile::logSize() const
     return m_updates.size();
 }
 
+/**
+ * Estimate the number of bytes owned by this profile.
+ * Storage chunks shared with the profile this one was cloned from are not included.
+ *
+ * @return estimated memory usage in bytes
+ */
+std::size_t NgramProfile::memoryUsage() const
+{
+    return sizeof(NgramProfile) + m_ownedBytes
+           + m_updates.capacity() * sizeof(NgramDelta)
+           + m_lastNgramUpdates.capacity() * sizeof(NgramUpdate);
+}
+
 /**
  * Generate a vector of \link Ngram objects from a given string range.
  * The vector will be empty if the string range is smaller than \link NgramProfile::ORDER.
@@ -142,14 +513,15 @@ std::vector<NgramProfile::Ngram> ngramsFromStringRange(std::string::const_iterat
 {
     std::vector<NgramProfile::Ngram> ngrams;
 
-    if (end - begin < NgramProfile::ORDER) {
+    auto const size = static_cast<std::size_t>(end - begin);
+    if (size < NgramProfile::ORDER) {
         return ngrams;
     }
 
-    auto const textEnd = end - (NgramProfile::ORDER - 1);
-    for (auto it = begin; it != textEnd; ++it) {
-        ngrams.push_back(ngramFromStringRange(it, it + NgramProfile::ORDER));
-    }
+    ngrams.reserve(size - (NgramProfile::ORDER - 1));
+    forEachNgram(&*begin, &*begin + size, [&ngrams](NgramProfile::Ngram ngram) {
+        ngrams.push_back(ngram);
+    });
 
     return ngrams;
 }
@@ -172,33 +544,35 @@ void NgramProfile::clearRecentUpdates()
  */
 bool NgramProfile::generateFromString(std::shared_ptr<std::string> text, unsigned int flags)
 {
-    if (flags & STRIP_POS_ANNOTATIONS)
-        stripPosAnnotationsFromText(*text);
-
-    if (!(flags & SKIP_NORMALIZATION))
-        normalizeText(*text);
+    preprocessText(*text, (flags & STRIP_POS_ANNOTATIONS) != 0, !(flags & SKIP_NORMALIZATION));
 
     if (ORDER > text->size()) {
         std::cerr << "Order must be smaller or equal text size" << std::endl;
         return false;
     }
 
-    m_n = 0;
-    m_ngrams = std::make_shared<NgramMap>();
     m_updates.clear();
     m_lastNgramUpdates.clear();
 
-    // generate n-grams
-    auto const textEnd = text->end() - (ORDER - 1);
-    std::array<char, sizeof(Ngram)> ngramBuffer{};
-    for (auto it = text->begin(); it != textEnd; ++it) {
-        std::copy(it, it + ORDER, ngramBuffer.begin());
-        Ngram ngram = char2Ngram(ngramBuffer.data());
-        (*m_ngrams)[ngram] += 1;
-        ++m_n;
+    // generate n-grams the same way as incremental updates do, then count runs of the sorted list
+    auto ngrams = ngramsFromStringRange(text->cbegin(), text->cend());
+    std::sort(ngrams.begin(), ngrams.end());
+
+    std::vector<Ngram> keys;
+    std::vector<Count> counts;
+    for (auto const ngram: ngrams) {
+        if (keys.empty() || keys.back() != ngram) {
+            keys.push_back(ngram);
+            counts.push_back(0);
+        }
+        ++counts.back();
     }
+    keys.shrink_to_fit();
+    counts.shrink_to_fit();
 
-    m_size = m_ngrams->size();
+    m_n = ngrams.size();
+    m_size = keys.size();
+    m_ngrams = makeStorage(std::move(keys), std::move(counts));
 
     return true;
 }
@@ -218,29 +592,149 @@ bool NgramProfile::generate(std::string const& filename, unsigned int flags)
 /**
  * Generate an n-gram profile from the given text files.
  *
+ * The files are treated as one concatenated text, which is streamed in chunks. Chunks are only
+ * split at blank lines, so that normalization of each chunk yields the same result as normalizing
+ * the full text. Chunks are normalized and counted concurrently, n-grams spanning chunk boundaries
+ * are stitched afterwards. Memory usage is bounded by the number of chunks in flight.
+ *
  * @param filename input text files
  * @param flags bit flags for profile generation
  * @return true on success
  */
 bool NgramProfile::generate(std::vector<std::string> const& filenames, unsigned int flags)
 {
-    std::string fullText;
+    std::size_t const numThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t const maxChunksInFlight = 2 * numThreads;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::pair<std::size_t, std::string>> chunkQueue;
+    std::vector<ChunkSummary> summaries;
+    bool readerDone = false;
+
+    std::vector<NgramCounter> counters(numThreads);
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < numThreads; ++t) {
+        workers.emplace_back([&, t]() {
+            while (true) {
+                std::pair<std::size_t, std::string> chunk;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait(lock, [&] { return !chunkQueue.empty() || readerDone; });
+                    if (chunkQueue.empty()) {
+                        return;
+                    }
+                    chunk = std::move(chunkQueue.front());
+                    chunkQueue.pop_front();
+                }
+                condition.notify_all();
+
+                auto summary = countChunk(chunk.second, flags, counters[t]);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (summaries.size() <= chunk.first) {
+                    summaries.resize(chunk.first + 1);
+                }
+                summaries[chunk.first] = std::move(summary);
+            }
+        });
+    }
 
+    std::size_t numChunks = 0;
+    auto const pushChunk = [&](std::string&& chunk) {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&] { return chunkQueue.size() < maxChunksInFlight; });
+        chunkQueue.emplace_back(numChunks++, std::move(chunk));
+        lock.unlock();
+        condition.notify_all();
+    };
+
+    bool success = true;
+    std::string buffer;
+    std::vector<char> readBuffer(1 << 20);
     for (auto const& filename: filenames) {
         std::ifstream file;
-        file.open(filename);
+        file.open(filename, std::ios::binary);
         if (!file) {
             std::cerr << "Could not open file '" << filename << "'" << std::endl;
-            return false;
+            success = false;
+            break;
+        }
+
+        while (file.read(readBuffer.data(), readBuffer.size()) || file.gcount() > 0) {
+            buffer.append(readBuffer.data(), static_cast<std::size_t>(file.gcount()));
+            std::size_t split;
+            while ((split = findChunkBoundary(buffer, GENERATOR_CHUNK_SIZE)) != std::string::npos) {
+                pushChunk(buffer.substr(0, split));
+                buffer.erase(0, split);
+            }
+        }
+    }
+    if (success && !buffer.empty()) {
+        pushChunk(std::move(buffer));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        readerDone = true;
+    }
+    condition.notify_all();
+    for (auto& worker: workers) {
+        worker.join();
+    }
+    if (!success) {
+        return false;
+    }
+
+    // stitch n-grams spanning chunk boundaries
+    NgramCounter boundaryCounter;
+    std::string tail;
+    std::size_t textLength = 0;
+    for (auto const& summary: summaries) {
+        std::string boundary = tail + summary.head;
+        for (std::size_t i = 0; i < tail.size() && i + ORDER <= boundary.size(); ++i) {
+            boundaryCounter.add(ngramFromStringRange(boundary.cbegin() + i, boundary.cbegin() + i + ORDER));
+        }
+        tail += summary.tail;
+        if (tail.size() > ORDER - 1) {
+            tail.erase(0, tail.size() - (ORDER - 1));
         }
+        textLength += summary.length;
+    }
+
+    if (ORDER > textLength) {
+        std::cerr << "Order must be smaller or equal text size" << std::endl;
+        return false;
+    }
 
-        std::stringstream tmpBuffer;
-        tmpBuffer << file.rdbuf();
-        std::string text = tmpBuffer.str();
-        fullText.append(tmpBuffer.str());
+    // merge per-thread counts
+    counters.push_back(std::move(boundaryCounter));
+    std::vector<std::pair<Ngram, std::uint64_t>> merged;
+    for (auto const& counter: counters) {
+        counter.forEach([&merged](Ngram ngram, std::uint64_t count) {
+            merged.emplace_back(ngram, count);
+        });
+    }
+    std::sort(merged.begin(), merged.end());
+
+    std::vector<Ngram> keys;
+    std::vector<Count> counts;
+    for (auto const& entry: merged) {
+        if (keys.empty() || keys.back() != entry.first) {
+            keys.push_back(entry.first);
+            counts.push_back(0);
+        }
+        counts.back() += static_cast<Count>(entry.second);
     }
+    keys.shrink_to_fit();
+    counts.shrink_to_fit();
 
-    return generateFromString(std::make_shared<std::string>(std::move(fullText)), flags);
+    m_updates.clear();
+    m_lastNgramUpdates.clear();
+    m_n = textLength - (ORDER - 1);
+    m_size = keys.size();
+    m_ngrams = makeStorage(std::move(keys), std::move(counts));
+
+    return true;
 }
 
 /**
@@ -251,19 +745,112 @@ std::size_t NgramProfile::size() const
     return m_size;
 }
 
+/**
+ * @return shared empty n-gram storage for default-constructed profiles
+ */
+std::shared_ptr<NgramProfile::Storage const> NgramProfile::emptyStorage()
+{
+    static auto const storage = std::make_shared<Storage const>();
+    return storage;
+}
+
+/**
+ * Create a storage that owns the given n-gram arrays.
+ *
+ * @param keys sorted n-grams
+ * @param counts counts of each n-gram
+ * @return new storage
+ */
+std::shared_ptr<NgramProfile::Storage const> NgramProfile::makeStorage(std::vector<Ngram>&& keys, std::vector<Count>&& counts)
+{
+    assert(keys.size() == counts.size());
+    Ngram const* keysData = keys.data();
+    Count const* countsData = counts.data();
+    auto const size = keys.size();
+    auto buffer = makeChunkBuffer(std::move(keys), std::move(counts));
+    return makeStorage(keysData, countsData, size, std::move(buffer));
+}
+
+/**
+ * Create a storage referencing the given n-gram arrays.
+ *
+ * @param keys sorted n-grams
+ * @param counts counts of each n-gram
+ * @param size number of n-grams
+ * @param owner owner of the arrays, which is kept alive by the storage
+ * @return new storage
+ */
+std::shared_ptr<NgramProfile::Storage const> NgramProfile::makeStorage(Ngram const* keys, Count const* counts,
+        std::size_t size, std::shared_ptr<void const> owner)
+{
+    auto storage = std::make_shared<Storage>();
+    appendChunks(*storage, keys, counts, size, owner);
+    return storage;
+}
+
+/**
+ * Append chunks of at most \link CHUNK_SIZE n-grams referencing the given arrays to a storage under construction.
+ */
+void NgramProfile::appendChunks(Storage& storage, Ngram const* keys, Count const* counts, std::size_t size,
+        std::shared_ptr<void const> const& owner)
+{
+    for (std::size_t offset = 0; offset < size; offset += CHUNK_SIZE) {
+        Chunk chunk;
+        chunk.keys = keys + offset;
+        chunk.counts = counts + offset;
+        chunk.size = std::min(CHUNK_SIZE, size - offset);
+        chunk.owner = owner;
+        storage.firstKeys.push_back(chunk.keys[0]);
+        storage.chunks.push_back(std::move(chunk));
+    }
+}
+
+/**
+ * Move n-gram arrays into a shared buffer for storage chunks.
+ * The data pointers of the vectors remain valid.
+ */
+std::shared_ptr<void const> NgramProfile::makeChunkBuffer(std::vector<Ngram>&& keys, std::vector<Count>&& counts)
+{
+    return std::make_shared<std::pair<std::vector<Ngram>, std::vector<Count>> const>(std::move(keys), std::move(counts));
+}
+
 /**
  * @return cloned n-gram distribution
  */
 std::unique_ptr<NgramProfile> NgramProfile::clone() const
 {
     auto ptr = std::make_unique<NgramProfile>();
-    ptr->m_n = m_n;
-    ptr->m_ngrams = m_ngrams;
-    ptr->m_updates = m_updates;
-    ptr->m_size = m_size;
+    cloneInto(*ptr);
+    return ptr;
+}
+
+/**
+ * Clone this profile into the current pool arena of the calling thread, which belongs to the running
+ * search (see search::generic::CurrentPoolArena).
+ * This saves the separate allocations of the profile and its reference count,
+ * which otherwise add up for the successor states generated by operators.
+ *
+ * @return cloned n-gram distribution
+ */
+std::shared_ptr<NgramProfile> NgramProfile::cloneShared() const
+{
+    auto ptr = std::allocate_shared<NgramProfile>(
+            search::generic::PoolAllocator<NgramProfile>(search::generic::CurrentPoolArena()));
+    cloneInto(*ptr);
     return ptr;
 }
 
+/**
+ * Share storage and pending updates with another profile.
+ */
+void NgramProfile::cloneInto(NgramProfile& other) const
+{
+    other.m_n = m_n;
+    other.m_ngrams = m_ngrams;
+    other.m_updates = m_updates;
+    other.m_size = m_size;
+}
+
 /**
  * Serialize n-gram profile to file.
  *
@@ -273,58 +860,182 @@ void NgramProfile::save(std::string const& filename) const
 {
     std::ofstream ofs(filename);
     boost::archive::text_oarchive archive(ofs);
-    auto copy = clone();
-    copy->apply();
-    archive << copy->m_n << *(copy->m_ngrams);
+    NgramMap ngrams;
+    for (auto const& ngramPair: *this) {
+        ngrams.emplace_hint(ngrams.end(), ngramPair);
+    }
+    archive << m_n << ngrams;
+}
+
+/**
+ * Serialize n-gram profile to file in the binary profile format, which can be memory-mapped on load.
+ *
+ * The file consists of a fixed-size header (magic, format version, n-gram order, total n-gram count,
+ * number of unique n-grams and an xxHash64 checksum of the arrays), followed by the sorted n-gram array
+ * and the parallel count array. All values are stored in host byte order.
+ *
+ * @param filename output filename
+ * @throw std::runtime_error if the file cannot be written
+ */
+void NgramProfile::saveBinary(std::string const& filename) const
+{
+    std::vector<Ngram> keys;
+    std::vector<Count> counts;
+    keys.reserve(m_size);
+    counts.reserve(m_size);
+    for (auto const& ngramPair: *this) {
+        keys.push_back(ngramPair.first);
+        counts.push_back(static_cast<Count>(ngramPair.second));
+    }
+
+    BinaryHeader header;
+    std::copy(std::begin(BINARY_MAGIC), std::end(BINARY_MAGIC), header.magic);
+    header.version = BINARY_VERSION;
+    header.order = ORDER;
+    header.n = m_n;
+    header.size = keys.size();
+    header.checksum = binaryChecksum(keys.data(), counts.data(), keys.size());
+
+    std::ofstream ofs(filename, std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<char const*>(keys.data()), keys.size() * sizeof(Ngram));
+    ofs.write(reinterpret_cast<char const*>(counts.data()), counts.size() * sizeof(Count));
+    if (!ofs) {
+        throw std::runtime_error("Could not write profile '" + filename + "'");
+    }
 }
 
 /**
  * Load pre-computed n-gram profile serialization from file.
+ * The format (binary or text archive) is detected automatically.
+ * Binary profiles are memory-mapped and used in place.
  *
  * @param filename input profile file
+ * @param verifyChecksum whether to verify the checksum of binary profiles
  */
-void NgramProfile::load(std::string const& filename)
+void NgramProfile::load(std::string const& filename, bool verifyChecksum)
+{
+    char magic[sizeof(BINARY_MAGIC)] = {};
+    std::ifstream ifs(filename, std::ios::binary);
+    ifs.read(magic, sizeof(magic));
+
+    if (ifs && std::equal(std::begin(magic), std::end(magic), std::begin(BINARY_MAGIC))) {
+        ifs.close();
+        loadBinary(filename, verifyChecksum);
+    } else {
+        ifs.close();
+        loadText(filename);
+    }
+}
+
+/**
+ * Load n-gram profile from a text archive.
+ *
+ * @param filename input profile file
+ */
+void NgramProfile::loadText(std::string const& filename)
 {
-    m_ngrams = std::make_shared<NgramMap>();
     m_updates.clear();
     m_lastNgramUpdates.clear();
 
+    NgramMap ngrams;
     std::ifstream ifs(filename);
     boost::archive::text_iarchive archive(ifs);
-    archive >> m_n >> (*m_ngrams);
-    m_size = m_ngrams->size();
+    archive >> m_n >> ngrams;
+
+    std::vector<Ngram> keys;
+    std::vector<Count> counts;
+    keys.reserve(ngrams.size());
+    counts.reserve(ngrams.size());
+    for (auto const& ngramPair: ngrams) {
+        if (ngramPair.second != 0) {
+            keys.push_back(ngramPair.first);
+            counts.push_back(static_cast<Count>(ngramPair.second));
+        }
+    }
+    m_size = keys.size();
+    m_ngrams = makeStorage(std::move(keys), std::move(counts));
 }
 
 /**
- * @return const iterator to first element of the n-gram profile map
+ * Memory-map an n-gram profile in the binary profile format (see \link saveBinary).
+ *
+ * @param filename input profile file
+ * @param verifyChecksum whether to verify the checksum, which reads the whole file
+ * @throw std::runtime_error if the file cannot be mapped or is not a valid binary profile
+ */
+void NgramProfile::loadBinary(std::string const& filename, bool verifyChecksum)
+{
+    int const fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open profile '" + filename + "'");
+    }
+    struct stat fileStat = {};
+    if (::fstat(fd, &fileStat) != 0 || static_cast<std::size_t>(fileStat.st_size) < sizeof(BinaryHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Invalid binary profile '" + filename + "'");
+    }
+
+    auto const fileSize = static_cast<std::size_t>(fileStat.st_size);
+    void* const data = ::mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Could not map profile '" + filename + "'");
+    }
+    std::shared_ptr<void const> mapping(data, [fileSize](void const* ptr) {
+        ::munmap(const_cast<void*>(ptr), fileSize);
+    });
+
+    auto const& header = *static_cast<BinaryHeader const*>(data);
+    if (header.version != BINARY_VERSION || header.order != ORDER
+            || fileSize != sizeof(BinaryHeader) + header.size * (sizeof(Ngram) + sizeof(Count))) {
+        throw std::runtime_error("Unsupported or corrupt binary profile '" + filename + "'");
+    }
+
+    auto const keys = reinterpret_cast<Ngram const*>(static_cast<char const*>(data) + sizeof(BinaryHeader));
+    auto const counts = reinterpret_cast<Count const*>(keys + header.size);
+    if (verifyChecksum && binaryChecksum(keys, counts, header.size) != header.checksum) {
+        throw std::runtime_error("Checksum mismatch in binary profile '" + filename + "'");
+    }
+
+    m_updates.clear();
+    m_lastNgramUpdates.clear();
+    m_n = header.n;
+    m_size = header.size;
+    m_ngrams = makeStorage(keys, counts, header.size, std::move(mapping));
+}
+
+/**
+ * @return const iterator to first element of the n-gram profile
  */
 NgramProfile::Iterator NgramProfile::begin() const
 {
-    return {m_ngrams->cbegin(), m_ngrams->cend(), m_updates.cbegin(), m_updates.cend()};
+    return cbegin();
 }
 
 /**
- * @return const iterator pointing past the last element of the n-gram profile map
+ * @return const iterator pointing past the last element of the n-gram profile
  */
 NgramProfile::Iterator NgramProfile::end() const
 {
-    return {m_ngrams->cend(), m_ngrams->cend(), m_updates.cend(), m_updates.cend()};
+    return cend();
 }
 
 /**
- * @return const iterator to first element of the n-gram profile map
+ * @return const iterator to first element of the n-gram profile
  */
 NgramProfile::Iterator NgramProfile::cbegin() const
 {
-    return {m_ngrams->cbegin(), m_ngrams->cend(), m_updates.cbegin(), m_updates.cend()};
+    return Iterator(m_ngrams.get(), 0, m_updates.data(), m_updates.data() + m_updates.size());
 }
 
 /**
- * @return const iterator pointing past the last element of the n-gram profile map
+ * @return const iterator pointing past the last element of the n-gram profile
  */
 NgramProfile::Iterator NgramProfile::cend() const
 {
-    return {m_ngrams->cend(), m_ngrams->cend(), m_updates.cend(), m_updates.cend()};
+    return Iterator(m_ngrams.get(), m_ngrams->chunks.size(),
+            m_updates.data() + m_updates.size(), m_updates.data() + m_updates.size());
 }
 
 /**
@@ -341,19 +1052,49 @@ NgramProfile::Iterator NgramProfile::cend() const
 void NgramProfile::updateFromStringRange(NgramProfile::StrIt oldBegin, NgramProfile::StrIt oldEnd,
         NgramProfile::StrIt newBegin, NgramProfile::StrIt newEnd)
 {
-    std::vector<NgramProfile::NgramUpdate> updates;
+    update(updatesFromStringRange(oldBegin, oldEnd, newBegin, newEnd));
+}
 
-    auto oldNgrams = ngramsFromStringRange(oldBegin, oldEnd);
-    auto newNgrams = ngramsFromStringRange(newBegin, newEnd);
+/**
+ * Calculate the n-gram updates between two string ranges without applying them to a profile.
+ * See \link updateFromStringRange for the meaning of the ranges.
+ *
+ * The n-grams of both ranges are collected in a stack buffer, and n-grams occurring in both ranges
+ * cancel out there, so the result holds only the net change of each n-gram, sorted by n-gram.
+ *
+ * @param oldBegin iterator to first element of the unmodified text
+ * @param oldEnd iterator past the last element of the unmodified text
+ * @param newBegin iterator to first element of the updated text
+ * @param newEnd iterator past the last element of the updated text
+ * @return n-gram count updates
+ */
+std::vector<NgramProfile::NgramUpdate> NgramProfile::updatesFromStringRange(NgramProfile::StrIt oldBegin,
+        NgramProfile::StrIt oldEnd, NgramProfile::StrIt newBegin, NgramProfile::StrIt newEnd)
+{
+    auto const numNgrams = [](StrIt begin, StrIt end) {
+        auto const size = static_cast<std::size_t>(end - begin);
+        return size < ORDER ? 0 : size - (ORDER - 1);
+    };
+
+    // operator edits only touch a few dozen characters, larger ranges fall back to the heap
+    std::array<NgramUpdate, 128> stackBuffer;
+    std::vector<NgramUpdate> heapBuffer;
+    auto buffer = stackBuffer.data();
+    auto const size = numNgrams(oldBegin, oldEnd) + numNgrams(newBegin, newEnd);
+    if (size > stackBuffer.size()) {
+        heapBuffer.resize(size);
+        buffer = heapBuffer.data();
+    }
 
-    std::transform(oldNgrams.begin(), oldNgrams.end(), std::back_inserter(updates), [](NgramProfile::Ngram ngram) {
-        return std::make_pair(ngram, -1);
+    auto out = buffer;
+    forEachNgramInRange(oldBegin, oldEnd, [&out](Ngram ngram) {
+        *out++ = NgramUpdate(ngram, -1);
     });
-    std::transform(newNgrams.begin(), newNgrams.end(), std::back_inserter(updates), [](NgramProfile::Ngram ngram) {
-        return std::make_pair(ngram, 1);
+    forEachNgramInRange(newBegin, newEnd, [&out](Ngram ngram) {
+        *out++ = NgramUpdate(ngram, 1);
     });
 
-    update(updates);
+    return std::vector<NgramUpdate>(buffer, netUpdates(buffer, out));
 }
 
 /**
@@ -369,131 +1110,9 @@ NgramProfile::Ngram ngramFromStringRange(std::string::const_iterator begin, std:
     assert(end - begin == NgramProfile::ORDER);
     static_assert(NgramProfile::ORDER <= sizeof(NgramProfile::Ngram), "N-gram size range check failed");
 
-    std::array<char, sizeof(NgramProfile::Ngram)> charBuffer{};
-    std::copy(begin, end, charBuffer.begin());
-    std::replace(charBuffer.begin(), charBuffer.end(), '\n', ' ');
-    return char2Ngram(charBuffer.data());
-}
-
-struct NgramProfile::Iterator::Private {
-    Private(NgramMapIterator ngramsIt, NgramMapIterator ngramsEnd,
-            NgramMapIterator updatesIt, NgramMapIterator updatesEnd)
-            : ngramsIt(ngramsIt), ngramsEnd(ngramsEnd), updatesIt(updatesIt), updatesEnd(updatesEnd) {}
-    NgramMapIterator ngramsIt;
-    NgramMapIterator const ngramsEnd;
-    NgramMapIterator updatesIt;
-    NgramMapIterator const updatesEnd;
-};
-
-NgramProfile::Iterator::Iterator(NgramMapIterator ngramsIt, NgramMapIterator ngramsEnd,
-        NgramMapIterator updatesIt, NgramMapIterator updatesEnd)
-        : m_d(std::make_shared<Private>(ngramsIt, ngramsEnd, updatesIt, updatesEnd))
-{
-}
-
-NgramProfile::Iterator& NgramProfile::Iterator::operator++()
-{
-    do {
-        auto ngramsVal = m_d->ngramsIt != m_d->ngramsEnd ? m_d->ngramsIt->first : std::numeric_limits<Ngram>::max();
-        auto updatesVal = m_d->updatesIt != m_d->updatesEnd ? m_d->updatesIt->first : std::numeric_limits<Ngram>::max();
-
-        if (m_d->ngramsIt != m_d->ngramsEnd && (ngramsVal <= updatesVal || m_d->updatesIt == m_d->updatesEnd)) {
-            ++m_d->ngramsIt;
-        }
-        if (m_d->updatesIt != m_d->updatesEnd && (updatesVal <= ngramsVal || m_d->ngramsIt == m_d->ngramsEnd)) {
-            ++m_d->updatesIt;
-        }
-
-    } while (m_d->ngramsIt != m_d->ngramsEnd && m_d->updatesIt != m_d->updatesEnd &&
-            m_d->updatesIt->first == m_d->ngramsIt->first && m_d->updatesIt->second == 0);
-
-    return *this;
-}
-
-NgramProfile::Iterator NgramProfile::Iterator::operator++(int)
-{
-    auto oldVal = *this;
-    ++(*this);
-    return oldVal;
-}
-
-bool NgramProfile::Iterator::operator==(Iterator const& other) const
-{
-    return m_d->ngramsIt == other.m_d->ngramsIt && m_d->updatesIt == other.m_d->updatesIt;
-}
-
-bool NgramProfile::Iterator::operator!=(Iterator const& other) const
-{
-    return !(*this == other);
-}
-
-NgramProfile::NgramPair NgramProfile::Iterator::operator*() const
-{
-    if (m_d->updatesIt != m_d->updatesEnd
-        && (m_d->updatesIt->first <= m_d->ngramsIt->first || m_d->ngramsIt == m_d->ngramsEnd)) {
-        return *m_d->updatesIt;
+    NgramWindow<NgramProfile::ORDER> window;
+    for (auto it = begin; it != end; ++it) {
+        window.push(*it);
     }
-
-    assert(m_d->ngramsIt != m_d->ngramsEnd);
-    return *m_d->ngramsIt;
-}
-
-/**
- * Normalize characters in a text.
- *
- * @param text text to normalize
- */
-void normalizeText(std::string& text)
-{
-    // unicode folding / normalization
-    boost::locale::generator gen;
-    std::locale::global(gen("en_US.UTF-8"));
-    text = boost::locale::normalize(text);
-
-    // Remove UTF-8 BOM
-    if (text.size() > 3 && text.substr(0, 3) == "\xEF\xBB\xBF") {
-        text = text.substr(3);
-    }
-
-    // normalize quotes
-    boost::regex quoteRegex(u8"(?:''|``|\"|„|“|”|‘|’|«|»)");
-    text = boost::regex_replace(text, quoteRegex, "'");
-
-    // normalize dashes
-    boost::regex dashRegex(u8"(?:(?:‒|–|—|―)+|-{2,})");
-    text = boost::regex_replace(text, dashRegex, "--");
-
-    // normalize ellipses
-    boost::regex ellipsisRegex(u8"(?:…|\\.{3,})");
-    text = boost::regex_replace(text, ellipsisRegex, "...");
-
-    // normalize line endings
-    boost::regex whitespaceRegex("\\r\\n");
-    text = boost::regex_replace(text, whitespaceRegex, "\n");
-}
-
-/**
- * Strip part-of-speech annotations from text.
- *
- * @param text to strip POS tags from
- */
-void stripPosAnnotationsFromText(std::string& text)
-{
-    boost::regex wordPosRegex(R"(/[\w+\-\$\*]+(?=\s|$))");
-    text = boost::regex_replace(text, wordPosRegex, "");
-
-    boost::regex openQuotePosRegex(R"((?<=\s)(.{1,2})/``\s)");
-    text = boost::regex_replace(text, openQuotePosRegex, "$1");
-
-    boost::regex closeQuotePosRegex(R"(\s(.{1,2})/''(?=\s|$))");
-    text = boost::regex_replace(text, closeQuotePosRegex, "$1");
-
-    boost::regex openBracketPosRegex(R"((?<=\s)(.)/\((?:-\w\w)?\s)");
-    text = boost::regex_replace(text, openBracketPosRegex, "$1");
-
-    boost::regex closeBracketPosRegex(R"(\s(.)/\)(?:-\w\w)?(?=\s|$))");
-    text = boost::regex_replace(text, closeBracketPosRegex, "$1");
-
-    boost::regex punctPosRegex(R"(\s(.)/[\.,:'](?:-\w\w)?(?=\s|$))");
-    text = boost::regex_replace(text, punctPosRegex, "$1");
+    return window.key();
 }
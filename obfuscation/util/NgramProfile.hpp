@@ -24,13 +24,30 @@
 #include <vector>
 #include <memory>
 #include <iterator>
+#include <type_traits>
+
+#ifndef NGRAM_ORDER
+#define NGRAM_ORDER 3
+#endif
+
+/**
+ * Packed key type of character n-grams of the given order.
+ * Orders up to 4 fit into 32 bits, orders up to 8 into 64 bits.
+ */
+template<std::size_t Order>
+struct NgramKey {
+    static_assert(Order >= 1 && Order <= 8, "N-gram order must be between 1 and 8");
+    typedef typename std::conditional<Order <= 4, std::uint32_t, std::uint64_t>::type type;
+};
 
 class NgramProfile {
+    struct Storage;
+
 public:
     /**
-     * N-Gram order.
+     * N-Gram order, fixed at build time (CMake option NGRAM_ORDER).
      */
-    static std::size_t constexpr ORDER = 3;
+    static std::size_t constexpr ORDER = NGRAM_ORDER;
 
     /**
      * N-Gram profile generation bit flags.
@@ -40,26 +57,47 @@ public:
         STRIP_POS_ANNOTATIONS = 4      // strip POS tags from the text.
     };
 
-    typedef std::uint32_t Ngram;
+    typedef NgramKey<ORDER>::type Ngram;
+    typedef std::uint32_t Count;
     typedef std::pair<Ngram, std::size_t> NgramPair;
     typedef std::map<Ngram, std::size_t> NgramMap;
-    typedef NgramMap::const_iterator NgramMapIterator;
+    typedef std::pair<Ngram, Count> NgramDelta;
     typedef std::pair<Ngram, int> NgramUpdate;
     typedef std::string::const_iterator StrIt;
 
-    class Iterator: public std::iterator<std::forward_iterator_tag, NgramPair> {
+    /**
+     * Merge cursor over the sorted storage chunks and the sorted update overlay of a profile.
+     * Overlay entries take precedence over storage entries with the same key and deleted
+     * (zero-count) entries are skipped.
+     *
+     * The cursor is a plain value without heap state, so copies are cheap. For walks over a
+     * whole profile in hot loops, \link forEach is still faster.
+     */
+    class Iterator: public std::iterator<std::forward_iterator_tag, NgramPair, std::ptrdiff_t,
+            NgramPair const*, NgramPair const&> {
     public:
-        Iterator(NgramMapIterator ngramsIt, NgramMapIterator ngramsEnd,
-                NgramMapIterator updatesIt, NgramMapIterator updatesEnd);
-        Iterator& operator++();
-        Iterator operator++(int);
-        bool operator==(Iterator const& other) const;
-        bool operator!=(Iterator const& other) const;
-        NgramPair operator*() const;
+        Iterator() = default;
+        Iterator(Storage const* storage, std::size_t chunk, NgramDelta const* updatesIt, NgramDelta const* updatesEnd);
+        inline Iterator& operator++();
+        inline Iterator operator++(int);
+        inline bool operator==(Iterator const& other) const;
+        inline bool operator!=(Iterator const& other) const;
+        inline NgramPair const& operator*() const;
+        inline NgramPair const* operator->() const;
 
     private:
-        struct Private;
-        std::shared_ptr<Private> m_d;
+        inline bool hasKey() const;
+        inline bool atKey() const;
+        inline bool atUpdate() const;
+        inline void nextKey();
+        inline void settle();
+
+        Storage const* m_storage = nullptr;
+        std::size_t m_chunk = 0;
+        std::size_t m_pos = 0;
+        NgramDelta const* m_updatesIt = nullptr;
+        NgramDelta const* m_updatesEnd = nullptr;
+        NgramPair m_current;
     };
 
     NgramProfile() = default;
@@ -71,11 +109,14 @@ public:
 
     std::size_t size() const;
     std::unique_ptr<NgramProfile> clone() const;
+    std::shared_ptr<NgramProfile> cloneShared() const;
 
     void update(std::vector<NgramUpdate> const& updates);
     void updateFromStringRange(StrIt oldBegin, StrIt oldEnd, StrIt newBegin, StrIt newEnd);
+    static std::vector<NgramUpdate> updatesFromStringRange(StrIt oldBegin, StrIt oldEnd, StrIt newBegin, StrIt newEnd);
     void apply();
     std::size_t logSize() const;
+    std::size_t memoryUsage() const;
 
     /**
      * @return list of most recent n-gram updates
@@ -91,25 +132,267 @@ public:
     bool generate(std::string const& filename, unsigned int flags = 0);
     bool generate(std::vector<std::string> const& filenames, unsigned int flags = 0);
     void save(std::string const& filename) const;
-    void load(std::string const& filename);
+    void saveBinary(std::string const& filename) const;
+    void load(std::string const& filename, bool verifyChecksum = true);
 
     Iterator begin() const;
     Iterator end() const;
     Iterator cbegin() const;
     Iterator cend() const;
+
+    template<typename Func>
+    void forEach(Func&& func) const;
 private:
+    /**
+     * Number of n-grams per storage chunk.
+     */
+    static std::size_t constexpr CHUNK_SIZE = 64;
+
+    /**
+     * Maximum size of the update overlay before it is applied to the storage.
+     */
+    static std::size_t constexpr MAX_UPDATES = 64;
+
+    /**
+     * Immutable sorted run of n-grams with parallel counts.
+     * The arrays point into a buffer or a memory-mapped profile file kept alive by <tt>owner</tt>.
+     */
+    struct Chunk {
+        Ngram const* keys = nullptr;
+        Count const* counts = nullptr;
+        std::size_t size = 0;
+        std::shared_ptr<void const> owner;
+    };
+
+    /**
+     * Immutable n-gram storage as a sorted sequence of non-empty chunks.
+     * Storages are shared between cloned profiles and never modified after construction.
+     * Applying updates creates a new storage, which shares all chunks not touched by the updates.
+     */
+    struct Storage {
+        std::vector<Chunk> chunks;
+
+        /**
+         * First n-gram of each chunk.
+         */
+        std::vector<Ngram> firstKeys;
+    };
+
+    static std::shared_ptr<Storage const> emptyStorage();
+    static std::shared_ptr<Storage const> makeStorage(std::vector<Ngram>&& keys, std::vector<Count>&& counts);
+    static std::shared_ptr<Storage const> makeStorage(Ngram const* keys, Count const* counts, std::size_t size,
+            std::shared_ptr<void const> owner);
+    static void appendChunks(Storage& storage, Ngram const* keys, Count const* counts, std::size_t size,
+            std::shared_ptr<void const> const& owner);
+    static std::shared_ptr<void const> makeChunkBuffer(std::vector<Ngram>&& keys, std::vector<Count>&& counts);
+    Count storedFreq(Ngram ngram) const;
+    void cloneInto(NgramProfile& other) const;
+    void loadText(std::string const& filename);
+    void loadBinary(std::string const& filename, bool verifyChecksum);
+
     std::size_t m_n = 0;
     std::size_t m_size = 0;
-    std::shared_ptr<NgramMap> m_ngrams;
-    NgramMap m_updates;
+    std::shared_ptr<Storage const> m_ngrams = emptyStorage();
+
+    /**
+     * Bytes of storage created by the last apply(), which are not shared with the profile this one was cloned from.
+     */
+    std::size_t m_ownedBytes = 0;
+    /** Sorted overlay of absolute counts for n-grams changed since the last apply() (0 = deleted). */
+    std::vector<NgramDelta> m_updates;
     std::vector<NgramUpdate> m_lastNgramUpdates;
 };
 
 
+inline bool NgramProfile::Iterator::hasKey() const
+{
+    return m_chunk != m_storage->chunks.size();
+}
+
+inline bool NgramProfile::Iterator::atKey() const
+{
+    return hasKey() && (m_updatesIt == m_updatesEnd || m_storage->chunks[m_chunk].keys[m_pos] <= m_updatesIt->first);
+}
+
+inline bool NgramProfile::Iterator::atUpdate() const
+{
+    return m_updatesIt != m_updatesEnd && (!hasKey() || m_updatesIt->first <= m_storage->chunks[m_chunk].keys[m_pos]);
+}
+
+inline void NgramProfile::Iterator::nextKey()
+{
+    if (++m_pos == m_storage->chunks[m_chunk].size) {
+        ++m_chunk;
+        m_pos = 0;
+    }
+}
+
+/**
+ * Skip deleted overlay entries and load the current entry.
+ */
+inline void NgramProfile::Iterator::settle()
+{
+    while (atUpdate() && m_updatesIt->second == 0) {
+        if (atKey()) {
+            nextKey();
+        }
+        ++m_updatesIt;
+    }
+
+    if (atUpdate()) {
+        m_current = *m_updatesIt;
+    } else if (hasKey()) {
+        auto const& chunk = m_storage->chunks[m_chunk];
+        m_current = NgramPair(chunk.keys[m_pos], chunk.counts[m_pos]);
+    }
+}
+
+inline NgramProfile::Iterator::Iterator(Storage const* storage, std::size_t chunk, NgramDelta const* updatesIt,
+        NgramDelta const* updatesEnd)
+        : m_storage(storage)
+        , m_chunk(chunk)
+        , m_updatesIt(updatesIt)
+        , m_updatesEnd(updatesEnd)
+{
+    settle();
+}
+
+inline NgramProfile::Iterator& NgramProfile::Iterator::operator++()
+{
+    bool const atKey = this->atKey();
+    if (atUpdate()) {
+        ++m_updatesIt;
+    }
+    if (atKey) {
+        nextKey();
+    }
+    settle();
+    return *this;
+}
+
+inline NgramProfile::Iterator NgramProfile::Iterator::operator++(int)
+{
+    auto oldVal = *this;
+    ++(*this);
+    return oldVal;
+}
+
+inline bool NgramProfile::Iterator::operator==(Iterator const& other) const
+{
+    return m_chunk == other.m_chunk && m_pos == other.m_pos && m_updatesIt == other.m_updatesIt;
+}
+
+inline bool NgramProfile::Iterator::operator!=(Iterator const& other) const
+{
+    return !(*this == other);
+}
+
+inline NgramProfile::NgramPair const& NgramProfile::Iterator::operator*() const
+{
+    return m_current;
+}
+
+inline NgramProfile::NgramPair const* NgramProfile::Iterator::operator->() const
+{
+    return &m_current;
+}
+
+/**
+ * Call <tt>func(ngram, count)</tt> for each n-gram of this profile in ascending order.
+ * Walks the storage chunks and the update overlay directly, which is much cheaper than an \link Iterator
+ * for hot loops over a whole profile.
+ *
+ * @param func visitor
+ */
+template<typename Func>
+void NgramProfile::forEach(Func&& func) const
+{
+    auto update = m_updates.data();
+    auto const updatesEnd = update + m_updates.size();
+    for (auto const& chunk: m_ngrams->chunks) {
+        for (std::size_t i = 0; i < chunk.size; ++i) {
+            auto const key = chunk.keys[i];
+            for (; update != updatesEnd && update->first < key; ++update) {
+                if (update->second != 0) {
+                    func(update->first, update->second);
+                }
+            }
+            if (update != updatesEnd && update->first == key) {
+                if (update->second != 0) {
+                    func(key, update->second);
+                }
+                ++update;
+            } else {
+                func(key, chunk.counts[i]);
+            }
+        }
+    }
+    for (; update != updatesEnd; ++update) {
+        if (update->second != 0) {
+            func(update->first, update->second);
+        }
+    }
+}
+
+
 NgramProfile::Ngram ngramFromStringRange(std::string::const_iterator begin, std::string::const_iterator end);
 std::vector<NgramProfile::Ngram> ngramsFromStringRange(std::string::const_iterator begin, std::string::const_iterator end);
-void normalizeText(std::string& text);
-void stripPosAnnotationsFromText(std::string& text);
+
+
+/**
+ * Rolling window over the last <tt>Order</tt> characters of a text, packed into an n-gram key.
+ *
+ * Characters are shifted in at the top and drop out at the bottom, so the first character of the
+ * n-gram ends up in the lowest byte. On little-endian hosts this is the same layout as copying the
+ * characters into the key, which \link ngram2Char relies on.
+ */
+template<std::size_t Order>
+class NgramWindow {
+public:
+    typedef typename NgramKey<Order>::type Key;
+
+    /**
+     * Shift a character into the window, dropping the oldest one.
+     */
+    inline void push(char c)
+    {
+        m_key = static_cast<Key>((m_key >> 8u) | (static_cast<Key>(static_cast<unsigned char>(c)) << SHIFT));
+    }
+
+    /**
+     * @return key of the last <tt>Order</tt> characters
+     */
+    inline Key key() const
+    {
+        return m_key;
+    }
+
+private:
+    static unsigned int constexpr SHIFT = 8u * (Order - 1);
+    Key m_key = 0;
+};
+
+/**
+ * Call <tt>func</tt> with the key of each n-gram in a character range, in order of position.
+ * Nothing is called if the range is shorter than <tt>Order</tt>.
+ */
+template<std::size_t Order = NgramProfile::ORDER, typename Func>
+inline void forEachNgram(char const* begin, char const* end, Func&& func)
+{
+    if (static_cast<std::size_t>(end - begin) < Order) {
+        return;
+    }
+
+    NgramWindow<Order> window;
+    auto it = begin;
+    for (auto const first = begin + (Order - 1); it != first; ++it) {
+        window.push(*it);
+    }
+    for (; it != end; ++it) {
+        window.push(*it);
+        func(window.key());
+    }
+}
 
 
 /**
@@ -137,5 +420,27 @@ inline char const* ngram2Char(NgramProfile::Ngram const& ngram)
     return reinterpret_cast<char const*>(&ngram);
 }
 
+/**
+ * Branch-free binary search for the first n-gram in a sorted array that is not less than <tt>ngram</tt>.
+ *
+ * @param ngrams sorted n-gram array
+ * @param size number of n-grams
+ * @param ngram n-gram to search for
+ * @return position of the lower bound
+ */
+inline std::size_t ngramLowerBound(NgramProfile::Ngram const* ngrams, std::size_t size, NgramProfile::Ngram ngram)
+{
+    if (size == 0) {
+        return 0;
+    }
+
+    auto base = ngrams;
+    while (size > 1) {
+        auto const half = size / 2;
+        base = base[half] < ngram ? base + half : base;
+        size -= half;
+    }
+    return static_cast<std::size_t>(base - ngrams) + (*base < ngram);
+}
 
 #endif //OBFUSCATION_SEARCH_NGRAMPROFILE_HPP
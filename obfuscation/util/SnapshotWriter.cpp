@@ -0,0 +1,142 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SnapshotWriter.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <utility>
+
+/**
+ * @param filename output file
+ * @param format whether to write full texts or only edits against their source strings
+ */
+SnapshotWriter::SnapshotWriter(std::string filename, Format format)
+        : m_filename(std::move(filename))
+        , m_format(format)
+        , m_worker(&SnapshotWriter::work, this)
+{
+}
+
+/**
+ * Write the latest pending snapshot and stop the writer thread.
+ */
+SnapshotWriter::~SnapshotWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_pendingCondition.notify_one();
+    m_worker.join();
+}
+
+/**
+ * Queue a snapshot for writing, replacing a pending snapshot that has not been written yet.
+ * Does not block on file I/O.
+ *
+ * @param text snapshot text
+ */
+void SnapshotWriter::submit(DiffString text)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending) {
+            ++m_stats.coalesced;
+        }
+        m_pending = std::move(text);
+        ++m_numSubmitted;
+        ++m_stats.submitted;
+    }
+    m_pendingCondition.notify_one();
+}
+
+/**
+ * Wait until all snapshots submitted so far have been written or coalesced.
+ *
+ * @return whether the last snapshot was written successfully
+ */
+bool SnapshotWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto const numSubmitted = m_numSubmitted;
+    m_writtenCondition.wait(lock, [this, numSubmitted] { return m_numFinished >= numSubmitted; });
+    return !m_lastWriteFailed;
+}
+
+/**
+ * @return usage counters
+ */
+SnapshotWriterStats SnapshotWriter::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void SnapshotWriter::work()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_pendingCondition.wait(lock, [this] { return m_stop || m_pending; });
+        if (!m_pending) {
+            return;
+        }
+
+        auto text = std::move(*m_pending);
+        m_pending = boost::none;
+        auto const numSubmitted = m_numSubmitted;
+
+        lock.unlock();
+        bool const success = write(text);
+        lock.lock();
+
+        ++(success ? m_stats.written : m_stats.failures);
+        m_lastWriteFailed = !success;
+        m_numFinished = numSubmitted;
+        m_writtenCondition.notify_all();
+    }
+}
+
+/**
+ * Write a snapshot to a temporary file and move it over the output file.
+ *
+ * @param text snapshot text
+ * @return whether the snapshot was written successfully
+ */
+bool SnapshotWriter::write(DiffString const& text) const
+{
+    auto const tmpFile = m_filename + ".tmp";
+    {
+        std::ofstream ofs(tmpFile, std::ios::binary | std::ios::trunc);
+        if (!ofs) {
+            return false;
+        }
+        if (m_format == Format::EDITS) {
+            for (auto const& edit: text.edits()) {
+                ofs << edit.editPos << " " << edit.charsToDelete << " " << edit.insertion.size() << "\n"
+                    << edit.insertion << "\n";
+            }
+        } else {
+            ofs << text.string();
+        }
+        ofs.close();
+        if (!ofs) {
+            std::remove(tmpFile.c_str());
+            return false;
+        }
+    }
+    return std::rename(tmpFile.c_str(), m_filename.c_str()) == 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_UTIL_SNAPSHOTWRITER_HPP
+#define OBFUSCATION_UTIL_SNAPSHOTWRITER_HPP
+
+#include "DiffString.hpp"
+
+#include <boost/optional.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Usage counters of a \link SnapshotWriter.
+ */
+struct SnapshotWriterStats {
+    std::size_t submitted = 0;
+    std::size_t written = 0;
+    std::size_t coalesced = 0;
+    std::size_t failures = 0;
+};
+
+/**
+ * Writes snapshots of a text to a file from a background thread.
+ *
+ * Submitting a snapshot only copies a \link DiffString, which shares its tree with the submitted
+ * string, so the caller never materializes the text or touches the file. Snapshots submitted while
+ * another one is being written replace each other, so only the latest of a series of rapid
+ * improvements is written. Each snapshot is written to a temporary file, which then replaces the
+ * output file, so readers never see a partially written text.
+ *
+ * In <tt>EDITS</tt> format, only the edits against the source string of the snapshot are written
+ * (see \link DiffString::edits). Each edit is written as a line <tt>position deleted inserted</tt>
+ * followed by the <tt>inserted</tt> characters of the insertion and a newline.
+ */
+class SnapshotWriter {
+public:
+    enum class Format {
+        TEXT,
+        EDITS
+    };
+
+    explicit SnapshotWriter(std::string filename, Format format = Format::TEXT);
+    SnapshotWriter(SnapshotWriter const&) = delete;
+    SnapshotWriter& operator=(SnapshotWriter const&) = delete;
+    ~SnapshotWriter();
+
+    void submit(DiffString text);
+    bool flush();
+    SnapshotWriterStats stats() const;
+
+    /**
+     * @return name of the output file
+     */
+    inline std::string const& filename() const
+    {
+        return m_filename;
+    }
+
+private:
+    void work();
+    bool write(DiffString const& text) const;
+
+    std::string m_filename;
+    Format m_format;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_pendingCondition;
+    std::condition_variable m_writtenCondition;
+    boost::optional<DiffString> m_pending;
+    std::size_t m_numSubmitted = 0;
+    std::size_t m_numFinished = 0;
+    bool m_lastWriteFailed = false;
+    bool m_stop = false;
+    SnapshotWriterStats m_stats;
+
+    std::thread m_worker;
+};
+
+#endif //OBFUSCATION_UTIL_SNAPSHOTWRITER_HPP
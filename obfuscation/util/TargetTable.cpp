@@ -0,0 +1,85 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TargetTable.hpp"
+
+#include <algorithm>
+
+/**
+ * Build table from a target n-gram profile.
+ *
+ * @param profile target profile
+ */
+TargetTable::TargetTable(NgramProfile const& profile)
+{
+    m_ngrams.reserve(profile.size());
+    m_probs.reserve(profile.size());
+
+    double const norm = 1.0 / static_cast<double>(std::max<std::size_t>(1, profile.n()));
+    profile.forEach([this, norm](Ngram ngram, NgramProfile::Count count) {
+        m_ngrams.push_back(ngram);
+        m_probs.push_back(count * norm);
+    });
+
+    std::size_t numSlots = 16;
+    m_slotShift = 60;
+    while (numSlots < 2 * m_ngrams.size()) {
+        numSlots *= 2;
+        --m_slotShift;
+    }
+    m_slots.resize(numSlots);
+    for (std::size_t i = 0; i < m_ngrams.size(); ++i) {
+        auto pos = static_cast<std::size_t>((m_ngrams[i] * 0x9E3779B97F4A7C15ull) >> m_slotShift);
+        while (m_slots[pos].prob != 0.0) {
+            pos = (pos + 1) & (numSlots - 1);
+        }
+        m_slots[pos].ngram = m_ngrams[i];
+        m_slots[pos].prob = m_probs[i];
+    }
+}
+
+/**
+ * @return number of n-grams in this table
+ */
+std::size_t TargetTable::size() const
+{
+    return m_ngrams.size();
+}
+
+/**
+ * Find the position of the first n-gram not less than <tt>ngram</tt>, starting at position <tt>first</tt>.
+ * The search gallops forward from <tt>first</tt>, so walking the table with ascending n-grams
+ * costs only logarithmic time in the distance between consecutive matches.
+ *
+ * @param ngram n-gram to search for
+ * @param first start position
+ * @return position of the lower bound (size() if all n-grams are less than <tt>ngram</tt>)
+ */
+std::size_t TargetTable::lowerBound(Ngram ngram, std::size_t first) const
+{
+    auto const size = m_ngrams.size();
+    std::size_t step = 1;
+    while (first + step < size && m_ngrams[first + step] < ngram) {
+        first += step;
+        step *= 2;
+    }
+
+    auto const last = std::min(first + step + 1, size);
+    if (first >= last) {
+        return size;
+    }
+    return first + ngramLowerBound(m_ngrams.data() + first, last - first, ngram);
+}
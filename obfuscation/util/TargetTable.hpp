@@ -0,0 +1,93 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_SEARCH_TARGETTABLE_HPP
+#define OBFUSCATION_SEARCH_TARGETTABLE_HPP
+
+#include "NgramProfile.hpp"
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Frozen, read-only table of normalized target n-gram probabilities.
+ *
+ * The table is built once from the target profile of a search and can be shared
+ * between any number of concurrent searches against the same target.
+ *
+ * The n-grams are stored twice: as sorted arrays for merge walks over whole profiles,
+ * and in an open-addressing hash table for point lookups with \link prob.
+ */
+class TargetTable {
+public:
+    typedef NgramProfile::Ngram Ngram;
+
+    explicit TargetTable(NgramProfile const& profile);
+
+    std::size_t size() const;
+    std::size_t lowerBound(Ngram ngram, std::size_t first = 0) const;
+
+    /**
+     * @return normalized probability of <tt>ngram</tt> or 0 if it is not part of the table
+     */
+    inline double prob(Ngram ngram) const
+    {
+        auto pos = static_cast<std::size_t>((ngram * 0x9E3779B97F4A7C15ull) >> m_slotShift);
+        while (m_slots[pos].prob != 0.0) {
+            if (m_slots[pos].ngram == ngram) {
+                return m_slots[pos].prob;
+            }
+            pos = (pos + 1) & (m_slots.size() - 1);
+        }
+        return 0.0;
+    }
+
+    /**
+     * @return n-gram at position <tt>pos</tt>
+     */
+    inline Ngram ngramAt(std::size_t pos) const
+    {
+        return m_ngrams[pos];
+    }
+
+    /**
+     * @return normalized probability of the n-gram at position <tt>pos</tt>
+     */
+    inline double probAt(std::size_t pos) const
+    {
+        return m_probs[pos];
+    }
+
+private:
+    /**
+     * Hash table slot, empty if its probability is 0.
+     */
+    struct Slot {
+        Ngram ngram = 0;
+        double prob = 0.0;
+    };
+
+    std::vector<Ngram> m_ngrams;
+    std::vector<double> m_probs;
+
+    /**
+     * Hash table with a power-of-two size of at least twice the number of n-grams.
+     */
+    std::vector<Slot> m_slots;
+    unsigned int m_slotShift = 64;
+};
+
+#endif //OBFUSCATION_SEARCH_TARGETTABLE_HPP
@@ -0,0 +1,278 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TcpTransport.hpp"
+
+#include <boost/asio.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+
+namespace asio = boost::asio;
+using asio::ip::tcp;
+
+/**
+ * Sockets and threads of all connections, along with the queues of outgoing messages.
+ */
+struct TcpTransport::Connections {
+    struct Outgoing {
+        std::unique_ptr<tcp::socket> socket;
+        std::deque<std::string> queue;
+        std::thread writer;
+    };
+
+    asio::io_context ioContext;
+    std::vector<Outgoing> outgoing;
+    std::vector<std::unique_ptr<tcp::socket>> incoming;
+    std::vector<std::thread> readers;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stop = false;
+};
+
+/**
+ * Split an address of the form <tt>HOST:PORT</tt>.
+ */
+static std::pair<std::string, std::string> splitAddress(std::string const& address)
+{
+    auto const colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == address.size()) {
+        throw std::invalid_argument("Invalid address '" + address + "', expected HOST:PORT");
+    }
+    return {address.substr(0, colon), address.substr(colon + 1)};
+}
+
+/**
+ * Connect to all other processes and wait until all of them have connected.
+ *
+ * @param peers addresses of all processes as <tt>HOST:PORT</tt>, in the same order on every process
+ * @param rank index of this process in peers, whose port is listened on
+ * @param connectTimeout time to wait for the other processes to start
+ * @throw std::runtime_error if not all connections could be established in time
+ */
+TcpTransport::TcpTransport(std::vector<std::string> peers, std::size_t rank, std::chrono::seconds connectTimeout)
+        : m_peers(std::move(peers))
+        , m_rank(rank)
+        , m_connections(new Connections)
+{
+    if (m_rank >= m_peers.size()) {
+        throw std::invalid_argument("Rank " + std::to_string(m_rank) + " is not in the list of peers");
+    }
+    auto& connections = *m_connections;
+    connections.outgoing.resize(m_peers.size());
+    connections.incoming.resize(m_peers.size());
+    auto const deadline = std::chrono::steady_clock::now() + connectTimeout;
+
+    // accept in the background while connecting, since all processes start at about the same time
+    auto const port = static_cast<unsigned short>(std::stoul(splitAddress(m_peers[m_rank]).second));
+    tcp::acceptor acceptor(connections.ioContext, tcp::endpoint(tcp::v4(), port));
+    acceptor.non_blocking(true);
+    std::size_t numAccepted = 0;
+    std::thread acceptThread([&] {
+        while (numAccepted + 1 < m_peers.size() && std::chrono::steady_clock::now() < deadline) {
+            auto socket = std::make_unique<tcp::socket>(connections.ioContext);
+            boost::system::error_code error;
+            acceptor.accept(*socket, error);
+            if (error) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                continue;
+            }
+            socket->non_blocking(false);
+            socket->set_option(tcp::no_delay(true));
+            std::uint32_t peer = 0;
+            asio::read(*socket, asio::buffer(&peer, sizeof(peer)), error);
+            if (error || peer >= m_peers.size() || peer == m_rank || connections.incoming[peer]) {
+                continue;
+            }
+            connections.incoming[peer] = std::move(socket);
+            ++numAccepted;
+        }
+    });
+
+    tcp::resolver resolver(connections.ioContext);
+    for (std::size_t peer = 0; peer < m_peers.size(); ++peer) {
+        if (peer == m_rank) {
+            continue;
+        }
+        auto const address = splitAddress(m_peers[peer]);
+        auto socket = std::make_unique<tcp::socket>(connections.ioContext);
+        boost::system::error_code error;
+        do {
+            if (error) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            }
+            asio::connect(*socket, resolver.resolve(address.first, address.second, error), error);
+        } while (error && std::chrono::steady_clock::now() < deadline);
+        if (error) {
+            break;
+        }
+        socket->set_option(tcp::no_delay(true));
+        auto const self = static_cast<std::uint32_t>(m_rank);
+        asio::write(*socket, asio::buffer(&self, sizeof(self)));
+        connections.outgoing[peer].socket = std::move(socket);
+    }
+    acceptThread.join();
+
+    for (std::size_t peer = 0; peer < m_peers.size(); ++peer) {
+        if (peer != m_rank && (!connections.outgoing[peer].socket || !connections.incoming[peer])) {
+            throw std::runtime_error("Could not connect to process " + std::to_string(peer)
+                    + " at " + m_peers[peer]);
+        }
+    }
+    for (std::size_t peer = 0; peer < m_peers.size(); ++peer) {
+        if (peer != m_rank) {
+            connections.outgoing[peer].writer = std::thread(&TcpTransport::writeTo, this, peer);
+            connections.readers.emplace_back(&TcpTransport::readFrom, this, peer);
+        }
+    }
+}
+
+/**
+ * Send all queued messages and close the connections.
+ */
+TcpTransport::~TcpTransport()
+{
+    auto& connections = *m_connections;
+    {
+        std::lock_guard<std::mutex> lock(connections.mutex);
+        connections.stop = true;
+    }
+    connections.condition.notify_all();
+    for (auto& outgoing: connections.outgoing) {
+        if (outgoing.writer.joinable()) {
+            outgoing.writer.join();
+        }
+        if (outgoing.socket) {
+            boost::system::error_code error;
+            outgoing.socket->shutdown(tcp::socket::shutdown_both, error);
+        }
+    }
+    for (auto& incoming: connections.incoming) {
+        if (incoming) {
+            boost::system::error_code error;
+            incoming->shutdown(tcp::socket::shutdown_both, error);
+        }
+    }
+    for (auto& reader: connections.readers) {
+        reader.join();
+    }
+}
+
+std::size_t TcpTransport::rank() const
+{
+    return m_rank;
+}
+
+std::size_t TcpTransport::size() const
+{
+    return m_peers.size();
+}
+
+/**
+ * Queue a message for another process.
+ */
+void TcpTransport::send(std::size_t rank, std::string message)
+{
+    auto& connections = *m_connections;
+    m_backlog += message.size();
+    {
+        std::lock_guard<std::mutex> lock(connections.mutex);
+        connections.outgoing[rank].queue.push_back(std::move(message));
+    }
+    connections.condition.notify_all();
+}
+
+/**
+ * Take the oldest received message.
+ *
+ * @return false if no message has been received
+ */
+bool TcpTransport::receive(std::size_t& rank, std::string& message)
+{
+    std::lock_guard<std::mutex> lock(m_receivedMutex);
+    if (m_received.empty()) {
+        return false;
+    }
+    rank = m_received.front().first;
+    message = std::move(m_received.front().second);
+    m_received.pop_front();
+    return true;
+}
+
+/**
+ * @return number of bytes queued but not written yet
+ */
+std::size_t TcpTransport::backlog() const
+{
+    return m_backlog;
+}
+
+/**
+ * Write the queued messages of a connection until the transport is destroyed and the queue is empty.
+ * Messages to a process that has closed its connection are dropped.
+ */
+void TcpTransport::writeTo(std::size_t rank)
+{
+    auto& connections = *m_connections;
+    auto& outgoing = connections.outgoing[rank];
+    bool broken = false;
+    std::unique_lock<std::mutex> lock(connections.mutex);
+    while (true) {
+        connections.condition.wait(lock, [&] { return connections.stop || !outgoing.queue.empty(); });
+        if (outgoing.queue.empty()) {
+            return;
+        }
+        auto message = std::move(outgoing.queue.front());
+        outgoing.queue.pop_front();
+        lock.unlock();
+
+        if (!broken) {
+            auto const length = static_cast<std::uint32_t>(message.size());
+            std::vector<asio::const_buffer> buffers = {asio::buffer(&length, sizeof(length)), asio::buffer(message)};
+            boost::system::error_code error;
+            asio::write(*outgoing.socket, buffers, error);
+            broken = static_cast<bool>(error);
+        }
+        m_backlog -= message.size();
+        lock.lock();
+    }
+}
+
+/**
+ * Read messages from a connection until it is closed.
+ */
+void TcpTransport::readFrom(std::size_t rank)
+{
+    auto& socket = *m_connections->incoming[rank];
+    while (true) {
+        std::uint32_t length = 0;
+        boost::system::error_code error;
+        asio::read(socket, asio::buffer(&length, sizeof(length)), error);
+        if (error) {
+            return;
+        }
+        std::string message(length, '\0');
+        asio::read(socket, asio::buffer(&message[0], length), error);
+        if (error) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_receivedMutex);
+        m_received.emplace_back(rank, std::move(message));
+    }
+}
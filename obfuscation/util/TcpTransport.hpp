@@ -0,0 +1,70 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_UTIL_TCPTRANSPORT_HPP
+#define OBFUSCATION_UTIL_TCPTRANSPORT_HPP
+
+#include <search/generic/DistributedSearch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Transport of a distributed search over TCP (see search::generic::DistributedSearch).
+ *
+ * Each process opens one connection to every other process for sending, and accepts one connection
+ * from every other process for receiving, so messages between two processes arrive in order. Each
+ * connection is served by its own thread, which writes or reads length-prefixed messages. All
+ * processes must run on hosts with the same byte order.
+ */
+class TcpTransport : public search::generic::Transport {
+public:
+    TcpTransport(std::vector<std::string> peers, std::size_t rank,
+            std::chrono::seconds connectTimeout = std::chrono::seconds(60));
+    TcpTransport(TcpTransport const&) = delete;
+    TcpTransport& operator=(TcpTransport const&) = delete;
+    ~TcpTransport() override;
+
+    std::size_t rank() const override;
+    std::size_t size() const override;
+    void send(std::size_t rank, std::string message) override;
+    bool receive(std::size_t& rank, std::string& message) override;
+    std::size_t backlog() const override;
+
+private:
+    struct Connections;
+
+    void writeTo(std::size_t rank);
+    void readFrom(std::size_t rank);
+
+    std::vector<std::string> m_peers;
+    std::size_t m_rank;
+    std::unique_ptr<Connections> m_connections;
+
+    std::atomic_size_t m_backlog{0};
+
+    std::mutex m_receivedMutex;
+    std::deque<std::pair<std::size_t, std::string>> m_received;
+};
+
+#endif //OBFUSCATION_UTIL_TCPTRANSPORT_HPP
@@ -0,0 +1,703 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TextNormalizer.hpp"
+
+#include <boost/locale.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+/**
+ * Regex <tt>\\s</tt>.
+ */
+inline bool isSpace(int c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/**
+ * Regex <tt>\\w</tt>.
+ */
+inline bool isWord(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+}
+
+/**
+ * Regex lookahead <tt>(?=\\s|$)</tt> at position <tt>i</tt> of a window with <tt>n</tt> valid characters.
+ */
+inline bool isSpaceOrEnd(char const* w, std::size_t n, std::size_t i)
+{
+    return i >= n || isSpace(w[i]);
+}
+
+/**
+ * Three-byte UTF-8 sequence starting with <tt>E2 80</tt> (general punctuation block).
+ */
+inline bool isPunctuation(char const* w, std::size_t n, unsigned char last)
+{
+    return n >= 3 && w[0] == '\xE2' && w[1] == '\x80' && static_cast<unsigned char>(w[2]) == last;
+}
+
+/**
+ * Final pipeline stage, which writes the text back into a buffer. The output of all stages is never longer
+ * than their consumed input, so the sink may write into the buffer that is being read.
+ */
+class TextSink
+{
+public:
+    explicit TextSink(char* out)
+            : m_begin(out)
+            , m_out(out)
+    {
+    }
+
+    inline void put(char c)
+    {
+        *m_out++ = c;
+    }
+
+    /**
+     * Write a run of characters, which may overlap the output.
+     */
+    inline void append(char const* data, std::size_t size)
+    {
+        std::memmove(m_out, data, size);
+        m_out += size;
+    }
+
+    inline void finish()
+    {
+    }
+
+    std::size_t size() const
+    {
+        return static_cast<std::size_t>(m_out - m_begin);
+    }
+
+private:
+    char* const m_begin;
+    char* m_out;
+};
+
+/**
+ * Stage applying one rewriting rule in leftmost non-overlapping order, like regex_replace().
+ *
+ * The rule is applied to a sliding window of the next <tt>Rule::WINDOW</tt> input characters.
+ * It returns the number of consumed characters after writing their replacement, or 0 if
+ * nothing matched, in which case the first character is copied unchanged.
+ */
+template<typename Rule, typename Next>
+class RewriteStage
+{
+public:
+    explicit RewriteStage(Next& next)
+            : m_next(next)
+    {
+    }
+
+    inline void put(char c)
+    {
+        m_window[m_size++] = c;
+        if (m_size == Rule::WINDOW) {
+            step();
+        }
+    }
+
+    void finish()
+    {
+        while (m_size > 0) {
+            step();
+        }
+        m_next.finish();
+    }
+
+private:
+    inline void step()
+    {
+        auto consumed = m_rule.rewrite(m_window, m_size, m_prev, m_next);
+        if (consumed == 0) {
+            m_next.put(m_window[0]);
+            consumed = 1;
+        }
+        m_prev = static_cast<unsigned char>(m_window[consumed - 1]);
+        m_size -= consumed;
+        std::memmove(m_window, m_window + consumed, m_size);
+    }
+
+    Next& m_next;
+    Rule m_rule;
+    char m_window[Rule::WINDOW];
+    std::size_t m_size = 0;
+
+    /**
+     * Previous input character for lookbehinds, -1 at the beginning of the text.
+     */
+    int m_prev = -1;
+};
+
+/**
+ * Strip opening quote POS tags: <tt>(?<=\\s)(.{1,2})/``\\s</tt> => "$1".
+ */
+struct OpenQuotePosRule
+{
+    static constexpr std::size_t WINDOW = 6;
+
+    template<typename Next>
+    inline std::size_t rewrite(char const* w, std::size_t n, int prev, Next& next)
+    {
+        if (!isSpace(prev)) {
+            return 0;
+        }
+        for (std::size_t len = 2; len > 0; --len) {
+            if (n >= len + 4 && w[len] == '/' && w[len + 1] == '`' && w[len + 2] == '`' && isSpace(w[len + 3])) {
+                for (std::size_t i = 0; i < len; ++i) {
+                    next.put(w[i]);
+                }
+                return len + 4;
+            }
+        }
+        return 0;
+    }
+};
+
+/**
+ * Strip closing quote POS tags: <tt>\\s(.{1,2})/''(?=\\s|$)</tt> => "$1".
+ */
+struct CloseQuotePosRule
+{
+    static constexpr std::size_t WINDOW = 7;
+
+    template<typename Next>
+    inline std::size_t rewrite(char const* w, std::size_t n, int, Next& next)
+    {
+        if (!isSpace(w[0])) {
+            return 0;
+        }
+        for (std::size_t len = 2; len > 0; --len) {
+            if (n >= len + 4 && w[len + 1] == '/' && w[len + 2] == '\'' && w[len + 3] == '\''
+                    && isSpaceOrEnd(w, n, len + 4)) {
+                for (std::size_t i = 1; i <= len; ++i) {
+                    next.put(w[i]);
+                }
+                return len + 4;
+            }
+        }
+        return 0;
+    }
+};
+
+/**
+ * Strip opening bracket POS tags: <tt>(?<=\\s)(.)/\\((?:-\\w\\w)?\\s</tt> => "$1".
+ */
+struct OpenBracketPosRule
+{
+    static constexpr std::size_t WINDOW = 7;
+
+    template<typename Next>
+    inline std::size_t rewrite(char const* w, std::size_t n, int prev, Next& next)
+    {
+        if (!isSpace(prev) || n < 4 || w[1] != '/' || w[2] != '(') {
+            return 0;
+        }
+        std::size_t consumed = 0;
+        if (n >= 7 && w[3] == '-' && isWord(w[4]) && isWord(w[5]) && isSpace(w[6])) {
+            consumed = 7;
+        } else if (isSpace(w[3])) {
+            consumed = 4;
+        }
+        if (consumed > 0) {
+            next.put(w[0]);
+        }
+        return consumed;
+    }
+};
+
+/**
+ * Strip closing bracket and punctuation POS tags: <tt>\\s(.)/X(?:-\\w\\w)?(?=\\s|$)</tt> => "$1".
+ */
+template<bool (*IsTag)(char)>
+struct ClosingPosRule
+{
+    static constexpr std::size_t WINDOW = 8;
+
+    template<typename Next>
+    inline std::size_t rewrite(char const* w, std::size_t n, int, Next& next)
+    {
+        if (n < 4 || !isSpace(w[0]) || w[2] != '/' || !IsTag(w[3])) {
+            return 0;
+        }
+        std::size_t consumed = 0;
+        if (n >= 7 && w[4] == '-' && isWord(w[5]) && isWord(w[6]) && isSpaceOrEnd(w, n, 7)) {
+            consumed = 7;
+        } else if (isSpaceOrEnd(w, n, 4)) {
+            consumed = 4;
+        }
+        if (consumed > 0) {
+            next.put(w[1]);
+        }
+        return consumed;
+    }
+};
+
+inline bool isCloseBracketTag(char c)
+{
+    return c == ')';
+}
+
+inline bool isPunctTag(char c)
+{
+    return c == '.' || c == ',' || c == ':' || c == '\'';
+}
+
+/**
+ * Normalize quotes, dashes, ellipses and line endings:
+ * <ul>
+ *   <li><tt>(?:''|``|"|„|“|”|‘|’|«|»)</tt> => "'"</li>
+ *   <li><tt>(?:(?:‒|–|—|―)+|-{2,})</tt> => "--"</li>
+ *   <li><tt>(?:…|\\.{3,})</tt> => "..."</li>
+ *   <li><tt>\\r\\n</tt> => "\\n"</li>
+ * </ul>
+ * The patterns share no characters and none of the replacements creates a match for another pattern,
+ * so one scan gives the same result as replacing them one after another.
+ */
+struct NormalizeRule
+{
+    static constexpr std::size_t WINDOW = 3;
+
+    template<typename Next>
+    inline std::size_t rewrite(char const* w, std::size_t n, int, Next& next)
+    {
+        // continue a run of dashes or dots, whose replacement has already been written
+        switch (m_run) {
+            case Run::UNICODE_DASH:
+                if (isUnicodeDash(w, n)) {
+                    return 3;
+                }
+                break;
+            case Run::DASH:
+                if (w[0] == '-') {
+                    return 1;
+                }
+                break;
+            case Run::DOT:
+                if (w[0] == '.') {
+                    return 1;
+                }
+                break;
+            case Run::NONE:
+                break;
+        }
+        m_run = Run::NONE;
+
+        switch (w[0]) {
+            case '\'':
+            case '`':
+                if (n >= 2 && w[1] == w[0]) {
+                    next.put('\'');
+                    return 2;
+                }
+                return 0;
+            case '"':
+                next.put('\'');
+                return 1;
+            case '\xC2':
+                if (n >= 2 && (w[1] == '\xAB' || w[1] == '\xBB')) {
+                    next.put('\'');
+                    return 2;
+                }
+                return 0;
+            case '\xE2':
+                if (isPunctuation(w, n, 0x9E) || isPunctuation(w, n, 0x9C) || isPunctuation(w, n, 0x9D)
+                        || isPunctuation(w, n, 0x98) || isPunctuation(w, n, 0x99)) {
+                    next.put('\'');
+                    return 3;
+                }
+                if (isUnicodeDash(w, n)) {
+                    put(next, "--");
+                    m_run = Run::UNICODE_DASH;
+                    return 3;
+                }
+                if (isPunctuation(w, n, 0xA6)) {
+                    put(next, "...");
+                    return 3;
+                }
+                return 0;
+            case '-':
+                if (n >= 2 && w[1] == '-') {
+                    put(next, "--");
+                    m_run = Run::DASH;
+                    return 2;
+                }
+                return 0;
+            case '.':
+                if (n >= 3 && w[1] == '.' && w[2] == '.') {
+                    put(next, "...");
+                    m_run = Run::DOT;
+                    return 3;
+                }
+                return 0;
+            case '\r':
+                if (n >= 2 && w[1] == '\n') {
+                    next.put('\n');
+                    return 2;
+                }
+                return 0;
+            default:
+                return 0;
+        }
+    }
+
+private:
+    enum class Run { NONE, UNICODE_DASH, DASH, DOT };
+
+    static inline bool isUnicodeDash(char const* w, std::size_t n)
+    {
+        return isPunctuation(w, n, 0x92) || isPunctuation(w, n, 0x93)
+               || isPunctuation(w, n, 0x94) || isPunctuation(w, n, 0x95);
+    }
+
+    template<typename Next>
+    static inline void put(Next& next, char const* str)
+    {
+        for (; *str; ++str) {
+            next.put(*str);
+        }
+    }
+
+    Run m_run = Run::NONE;
+};
+
+/**
+ * UTF-8 byte order mark.
+ */
+char const BOM[] = "\xEF\xBB\xBF";
+
+/**
+ * Remove a UTF-8 BOM at the beginning of the text, unless it is the whole text.
+ */
+template<typename Next>
+class BomStage
+{
+public:
+    explicit BomStage(Next& next)
+            : m_next(next)
+    {
+    }
+
+    inline void put(char c)
+    {
+        if (m_pending < 0) {
+            m_next.put(c);
+            return;
+        }
+        if (m_pending == 3) {
+            // BOM followed by more text
+            m_pending = -1;
+            m_next.put(c);
+            return;
+        }
+        if (c == BOM[m_pending]) {
+            ++m_pending;
+            return;
+        }
+        flush();
+        m_next.put(c);
+    }
+
+    void finish()
+    {
+        if (m_pending > 0) {
+            flush();
+        }
+        m_next.finish();
+    }
+
+private:
+    void flush()
+    {
+        for (int i = 0; i < m_pending; ++i) {
+            m_next.put(BOM[i]);
+        }
+        m_pending = -1;
+    }
+
+    Next& m_next;
+
+    /**
+     * Number of buffered BOM bytes, -1 once the beginning of the text has been passed.
+     */
+    int m_pending = 0;
+};
+
+/**
+ * Minimum number of characters per thread for stripping word POS tags concurrently.
+ */
+std::size_t constexpr PARALLEL_STRIP_CHUNK_SIZE = 4 << 20;
+
+/**
+ * Regex <tt>[\\w+\\-\\$\\*]</tt>.
+ */
+inline bool isTagChar(char c)
+{
+    return isWord(c) || c == '+' || c == '-' || c == '$' || c == '*';
+}
+
+/**
+ * Strip word POS tags in place: <tt>/[\\w+\\-\\$\\*]+(?=\\s|$)</tt> => "".
+ *
+ * A tag contains no slash or whitespace, so it can only be the part of a token after its last slash.
+ * The text is scanned for slashes with memchr() and only the characters after each slash are looked at.
+ *
+ * @return new text size
+ */
+std::size_t stripWordPos(char* text, std::size_t size)
+{
+    TextSink sink(text);
+    std::size_t copied = 0;
+    std::size_t pos = 0;
+    char const* slash;
+    while ((slash = static_cast<char const*>(std::memchr(text + pos, '/', size - pos))) != nullptr) {
+        auto const tagBegin = static_cast<std::size_t>(slash - text);
+        pos = tagBegin + 1;
+        while (pos < size && isTagChar(text[pos])) {
+            ++pos;
+        }
+        if (pos > tagBegin + 1 && (pos == size || isSpace(text[pos]))) {
+            sink.append(text + copied, tagBegin - copied);
+            copied = pos;
+        }
+    }
+    sink.append(text + copied, size - copied);
+    return sink.size();
+}
+
+/**
+ * Strip word POS tags of a large text concurrently in chunks (see stripWordPos()).
+ * Chunks start at whitespace, which no tag or its lookahead can span.
+ *
+ * @return new text size
+ */
+std::size_t stripWordPosParallel(char* text, std::size_t size)
+{
+    auto const numChunks = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                                 size / PARALLEL_STRIP_CHUNK_SIZE);
+    if (numChunks <= 1) {
+        return stripWordPos(text, size);
+    }
+
+    std::vector<std::size_t> bounds{0};
+    for (std::size_t i = 1; i < numChunks; ++i) {
+        auto bound = std::max(bounds.back(), i * (size / numChunks));
+        while (bound < size && !isSpace(text[bound])) {
+            ++bound;
+        }
+        bounds.push_back(bound);
+    }
+    bounds.push_back(size);
+
+    std::vector<std::size_t> sizes(numChunks);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < numChunks; ++i) {
+        threads.emplace_back([&, i] {
+            sizes[i] = stripWordPos(text + bounds[i], bounds[i + 1] - bounds[i]);
+        });
+    }
+    sizes[0] = stripWordPos(text, bounds[1]);
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    TextSink sink(text + sizes[0]);
+    for (std::size_t i = 1; i < numChunks; ++i) {
+        sink.append(text + bounds[i], sizes[i]);
+    }
+    return sizes[0] + sink.size();
+}
+
+/**
+ * Apply one POS rule in place with the same result as a \link RewriteStage.
+ *
+ * Every POS rule matches a slash at most three characters after the start of the match, so the rule
+ * is only tried at those positions in front of each slash, which is found with memchr(). Tried positions
+ * never lie before the end of the previous match, so matches are leftmost and non-overlapping.
+ *
+ * @return new text size
+ */
+template<typename Rule>
+std::size_t rewriteAtSlashes(char* text, std::size_t size)
+{
+    Rule rule;
+    TextSink sink(text);
+    std::size_t copied = 0;
+    // std::min() takes references, which would require a definition of the static member
+    std::size_t const window = Rule::WINDOW;
+    std::size_t pos = 0;
+    char const* slash;
+    while ((slash = static_cast<char const*>(std::memchr(text + pos, '/', size - pos))) != nullptr) {
+        auto const slashPos = static_cast<std::size_t>(slash - text);
+        pos = slashPos + 1;
+        for (auto start = std::max(copied, slashPos < 3 ? 0 : slashPos - 3); start < slashPos; ++start) {
+            sink.append(text + copied, start - copied);
+            copied = start;
+            int const prev = start > 0 ? static_cast<unsigned char>(text[start - 1]) : -1;
+            auto const consumed = rule.rewrite(text + start, std::min(window, size - start), prev, sink);
+            if (consumed > 0) {
+                copied = start + consumed;
+                pos = copied;
+                break;
+            }
+        }
+    }
+    sink.append(text + copied, size - copied);
+    return sink.size();
+}
+
+/**
+ * Strip POS annotations in place by applying the POS rules one after another in the order of the former
+ * regexes. Word tags make up most of the annotations, so after the first rule only few slashes are left.
+ */
+void stripPos(std::string& text)
+{
+    auto size = stripWordPosParallel(&text[0], text.size());
+    size = rewriteAtSlashes<OpenQuotePosRule>(&text[0], size);
+    size = rewriteAtSlashes<CloseQuotePosRule>(&text[0], size);
+    size = rewriteAtSlashes<OpenBracketPosRule>(&text[0], size);
+    size = rewriteAtSlashes<ClosingPosRule<isCloseBracketTag>>(&text[0], size);
+    size = rewriteAtSlashes<ClosingPosRule<isPunctTag>>(&text[0], size);
+    text.resize(size);
+}
+
+/**
+ * Stage cascade for character normalization in front of <tt>Next</tt>.
+ */
+template<typename Next>
+struct NormalizePipeline
+{
+    explicit NormalizePipeline(Next& next)
+            : normalize(next)
+            , bom(normalize)
+    {
+    }
+
+    RewriteStage<NormalizeRule, Next> normalize;
+    BomStage<decltype(normalize)> bom;
+
+    inline void put(char c)
+    {
+        bom.put(c);
+    }
+
+    void finish()
+    {
+        bom.finish();
+    }
+};
+
+/**
+ * Feed a text in place through a pipeline ending in the given \link TextSink.
+ */
+template<typename Pipeline>
+void rewrite(std::string& text, Pipeline& pipeline, TextSink const& sink)
+{
+    char const* data = text.data();
+    auto const size = text.size();
+    for (std::size_t i = 0; i < size; ++i) {
+        pipeline.put(data[i]);
+    }
+    pipeline.finish();
+    text.resize(sink.size());
+}
+
+/**
+ * @return true if the text contains only ASCII characters
+ */
+bool isAscii(std::string const& text)
+{
+    return std::all_of(text.cbegin(), text.cend(), [](char c) { return static_cast<unsigned char>(c) < 0x80; });
+}
+
+/**
+ * Unicode normalization locale, generated once on first use.
+ * The global locale is set as well for consistency with code relying on it.
+ */
+std::locale const& normalizationLocale()
+{
+    static std::locale const locale = [] {
+        boost::locale::generator gen;
+        std::locale loc = gen("en_US.UTF-8");
+        std::locale::global(loc);
+        return loc;
+    }();
+    return locale;
+}
+
+}
+
+/**
+ * Normalize characters in a text.
+ *
+ * @param text text to normalize
+ */
+void normalizeText(std::string& text)
+{
+    preprocessText(text, false, true);
+}
+
+/**
+ * Strip part-of-speech annotations from text.
+ *
+ * @param text to strip POS tags from
+ */
+void stripPosAnnotationsFromText(std::string& text)
+{
+    preprocessText(text, true, false);
+}
+
+/**
+ * Strip part-of-speech annotations from a text and/or normalize its characters.
+ * Equivalent to calling stripPosAnnotationsFromText() and normalizeText() one after another.
+ *
+ * @param text text to process in place
+ * @param stripPosAnnotations whether to strip POS annotations
+ * @param normalize whether to normalize characters
+ */
+void preprocessText(std::string& text, bool stripPosAnnotations, bool normalize)
+{
+    if (normalize) {
+        normalizationLocale();
+    }
+    if (text.empty() || !(stripPosAnnotations || normalize)) {
+        return;
+    }
+
+    if (stripPosAnnotations) {
+        stripPos(text);
+    }
+
+    if (normalize && !text.empty()) {
+        if (!isAscii(text)) {
+            text = boost::locale::normalize(text, boost::locale::norm_default, normalizationLocale());
+        }
+        TextSink normalizeSink(&text[0]);
+        NormalizePipeline<TextSink> pipeline(normalizeSink);
+        rewrite(text, pipeline, normalizeSink);
+    }
+}
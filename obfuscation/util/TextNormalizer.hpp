@@ -0,0 +1,35 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_SEARCH_TEXTNORMALIZER_HPP
+#define OBFUSCATION_SEARCH_TEXTNORMALIZER_HPP
+
+#include <string>
+
+/*
+ * Text preprocessing for n-gram profiles.
+ *
+ * All rewriting happens in place. POS annotations are stripped rule by rule in scans that jump
+ * from slash to slash, large texts in parallel. Characters are normalized in a single scan through
+ * a cascade of small state machines, one per rewriting rule, each of which sees the output of the
+ * previous one. Only Unicode normalization of non-ASCII texts requires a separate pass.
+ */
+
+void normalizeText(std::string& text);
+void stripPosAnnotationsFromText(std::string& text);
+void preprocessText(std::string& text, bool stripPosAnnotations, bool normalize);
+
+#endif //OBFUSCATION_SEARCH_TEXTNORMALIZER_HPP
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WordBoundaryIndex.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+
+namespace {
+/**
+ * Word character flags of all byte values.
+ */
+std::array<bool, 256> const s_wordChars = [] {
+    std::array<bool, 256> table{};
+    for (std::size_t c = 0; c < table.size(); ++c) {
+        table[c] = !WordBoundaryIndex::isBoundaryChar(static_cast<char>(c));
+    }
+    return table;
+}();
+
+inline unsigned countTrailingZeros(std::uint64_t bits)
+{
+    return static_cast<unsigned>(__builtin_ctzll(bits));
+}
+
+inline unsigned countLeadingZeros(std::uint64_t bits)
+{
+    return static_cast<unsigned>(__builtin_clzll(bits));
+}
+}
+
+/**
+ * Index the word characters of a text.
+ *
+ * @param text text to index
+ */
+WordBoundaryIndex::WordBoundaryIndex(std::string const& text)
+        : m_blocks((text.size() + 63) / 64, 0)
+        , m_size(text.size())
+{
+    auto const data = reinterpret_cast<unsigned char const*>(text.data());
+    for (std::size_t block = 0; block < m_blocks.size(); ++block) {
+        auto const begin = block * 64;
+        auto const end = std::min(begin + 64, m_size);
+        std::uint64_t bits = 0;
+        for (std::size_t i = begin; i < end; ++i) {
+            bits |= static_cast<std::uint64_t>(s_wordChars[data[i]]) << (i - begin);
+        }
+        m_blocks[block] = bits;
+    }
+}
+
+/**
+ * Check if a character is a word boundary, i.e. whitespace or punctuation.
+ *
+ * @param c character
+ * @return true if character is a non-word character
+ */
+bool WordBoundaryIndex::isBoundaryChar(char c)
+{
+    auto const uc = static_cast<unsigned char>(c);
+    return std::isspace(uc) || std::ispunct(uc);
+}
+
+/**
+ * @return length of the indexed text
+ */
+std::size_t WordBoundaryIndex::size() const
+{
+    return m_size;
+}
+
+/**
+ * @param pos position in the text, must be less than size()
+ * @return whether the character at <tt>pos</tt> is a word character
+ */
+bool WordBoundaryIndex::isWordChar(std::size_t pos) const
+{
+    return (m_blocks[pos / 64] >> (pos % 64)) & 1u;
+}
+
+/**
+ * @param pos start position
+ * @return position of the first word character at or after <tt>pos</tt>, or size() if there is none
+ */
+std::size_t WordBoundaryIndex::nextWordChar(std::size_t pos) const
+{
+    return next<true>(pos);
+}
+
+/**
+ * @param pos start position, must be less than size()
+ * @return position of the last word character at or before <tt>pos</tt>, or npos if there is none
+ */
+std::size_t WordBoundaryIndex::prevWordChar(std::size_t pos) const
+{
+    return prev<true>(pos);
+}
+
+/**
+ * @param pos start position
+ * @return position of the first non-word character at or after <tt>pos</tt>, or size() if there is none
+ */
+std::size_t WordBoundaryIndex::nextBoundary(std::size_t pos) const
+{
+    return next<false>(pos);
+}
+
+/**
+ * @param pos start position, must be less than size()
+ * @return position of the last non-word character at or before <tt>pos</tt>, or npos if there is none
+ */
+std::size_t WordBoundaryIndex::prevBoundary(std::size_t pos) const
+{
+    return prev<false>(pos);
+}
+
+/**
+ * @return approximate number of bytes owned by this index
+ */
+std::size_t WordBoundaryIndex::memoryUsage() const
+{
+    return sizeof(*this) + m_blocks.capacity() * sizeof(std::uint64_t);
+}
+
+template<bool WordChars>
+std::size_t WordBoundaryIndex::next(std::size_t pos) const
+{
+    if (pos >= m_size) {
+        return m_size;
+    }
+    auto block = pos / 64;
+    auto bits = (WordChars ? m_blocks[block] : ~m_blocks[block]) & (~std::uint64_t(0) << (pos % 64));
+    while (bits == 0) {
+        if (++block == m_blocks.size()) {
+            return m_size;
+        }
+        bits = WordChars ? m_blocks[block] : ~m_blocks[block];
+    }
+    // inverted padding bits may point past the end
+    return std::min(block * 64 + countTrailingZeros(bits), m_size);
+}
+
+template<bool WordChars>
+std::size_t WordBoundaryIndex::prev(std::size_t pos) const
+{
+    auto block = pos / 64;
+    auto const shift = 63 - pos % 64;
+    auto bits = ((WordChars ? m_blocks[block] : ~m_blocks[block]) << shift) >> shift;
+    while (bits == 0) {
+        if (block == 0) {
+            return npos;
+        }
+        bits = WordChars ? m_blocks[--block] : ~m_blocks[--block];
+    }
+    return block * 64 + 63 - countLeadingZeros(bits);
+}
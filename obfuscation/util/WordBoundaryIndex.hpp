@@ -0,0 +1,66 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_UTIL_WORDBOUNDARYINDEX_HPP
+#define OBFUSCATION_UTIL_WORDBOUNDARYINDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Bitmap of the word characters of a text, i.e. all characters which are neither whitespace nor
+ * punctuation, for looking up word boundaries around a position.
+ *
+ * The index takes one bit per character and is built once per materialized text. Lookups scan the
+ * bitmap 64 characters at a time, so finding the start or end of a word takes one or two machine
+ * words for all but very long runs of word or non-word characters.
+ */
+class WordBoundaryIndex {
+public:
+    /**
+     * Returned by backward lookups that find nothing.
+     */
+    static std::size_t constexpr npos = static_cast<std::size_t>(-1);
+
+    WordBoundaryIndex() = default;
+    explicit WordBoundaryIndex(std::string const& text);
+
+    static bool isBoundaryChar(char c);
+
+    std::size_t size() const;
+    bool isWordChar(std::size_t pos) const;
+    std::size_t nextWordChar(std::size_t pos) const;
+    std::size_t prevWordChar(std::size_t pos) const;
+    std::size_t nextBoundary(std::size_t pos) const;
+    std::size_t prevBoundary(std::size_t pos) const;
+    std::size_t memoryUsage() const;
+
+private:
+    template<bool WordChars>
+    std::size_t next(std::size_t pos) const;
+    template<bool WordChars>
+    std::size_t prev(std::size_t pos) const;
+
+    /**
+     * One bit per character, set for word characters. Padding bits of the last block are clear.
+     */
+    std::vector<std::uint64_t> m_blocks;
+    std::size_t m_size = 0;
+};
+
+#endif //OBFUSCATION_UTIL_WORDBOUNDARYINDEX_HPP
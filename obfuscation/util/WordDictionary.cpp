@@ -0,0 +1,513 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WordDictionary.hpp"
+#include "hashing.hpp"
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Header of a compiled dictionary.
+ */
+struct WordDictionary::Header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t numKeys;
+    std::uint32_t numBuckets;
+    std::uint32_t numValues;
+    std::uint32_t poolSize;
+    std::uint32_t maxKeyLength;
+    std::uint64_t sourceSize;
+    std::int64_t sourceMtime;
+    std::uint64_t checksum;
+};
+
+/**
+ * Dictionary entry in the slot of its key.
+ */
+struct WordDictionary::Entry
+{
+    StringRef key;
+    std::uint32_t valuesBegin;
+    std::uint32_t valuesCount;
+};
+
+namespace {
+
+/**
+ * Magic bytes identifying a compiled dictionary.
+ */
+char const DICT_MAGIC[8] = {'W', 'O', 'R', 'D', 'D', 'I', 'C', 'T'};
+
+/**
+ * Current compiled dictionary format version.
+ */
+std::uint32_t const DICT_VERSION = 1;
+
+/**
+ * Keys longer than this are skipped, so that lookups can lower-case words in a fixed buffer.
+ */
+std::size_t const MAX_KEY_LENGTH = 255;
+
+/**
+ * Average number of keys per bucket of the perfect hash.
+ */
+std::uint32_t const KEYS_PER_BUCKET = 4;
+
+/**
+ * Maximum number of displacements to try for a single bucket.
+ */
+std::uint32_t const MAX_DISPLACEMENT = 1u << 26;
+
+inline char toLowerAscii(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+inline std::uint64_t keyHash(char const* data, std::size_t size)
+{
+    return hashing::xxHash64(data, size);
+}
+
+inline std::uint32_t bucketOf(std::uint64_t hash, std::uint32_t numBuckets)
+{
+    return static_cast<std::uint32_t>((hash >> 32) % numBuckets);
+}
+
+/**
+ * Slot of a key hash for a bucket displacement (splitmix64 finalizer over the displaced hash).
+ */
+inline std::uint32_t slotOf(std::uint64_t hash, std::uint32_t displacement, std::uint32_t numKeys)
+{
+    std::uint64_t x = hash ^ (displacement * 0x9E3779B97F4A7C15ULL);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return static_cast<std::uint32_t>(x % numKeys);
+}
+
+template<typename T>
+inline void appendBytes(std::vector<char>& blob, T const* data, std::size_t count)
+{
+    auto const bytes = reinterpret_cast<char const*>(data);
+    blob.insert(blob.end(), bytes, bytes + count * sizeof(T));
+}
+
+}   // namespace
+
+static_assert(sizeof(WordDictionary::StringRef) == 8, "unexpected dictionary string reference padding");
+
+WordDictionary::Alternatives::Iterator::Iterator(StringRef const* ref, char const* pool)
+        : m_ref(ref)
+        , m_pool(pool)
+{
+}
+
+boost::string_view WordDictionary::Alternatives::Iterator::operator*() const
+{
+    return boost::string_view(m_pool + m_ref->offset, m_ref->length);
+}
+
+WordDictionary::Alternatives::Iterator& WordDictionary::Alternatives::Iterator::operator++()
+{
+    ++m_ref;
+    return *this;
+}
+
+bool WordDictionary::Alternatives::Iterator::operator==(Iterator const& other) const
+{
+    return m_ref == other.m_ref;
+}
+
+bool WordDictionary::Alternatives::Iterator::operator!=(Iterator const& other) const
+{
+    return m_ref != other.m_ref;
+}
+
+WordDictionary::Alternatives::Alternatives(StringRef const* begin, StringRef const* end, char const* pool)
+        : m_begin(begin)
+        , m_end(end)
+        , m_pool(pool)
+{
+}
+
+WordDictionary::Alternatives::Iterator WordDictionary::Alternatives::begin() const
+{
+    return Iterator(m_begin, m_pool);
+}
+
+WordDictionary::Alternatives::Iterator WordDictionary::Alternatives::end() const
+{
+    return Iterator(m_end, m_pool);
+}
+
+std::size_t WordDictionary::Alternatives::size() const
+{
+    return static_cast<std::size_t>(m_end - m_begin);
+}
+
+bool WordDictionary::Alternatives::empty() const
+{
+    return m_begin == m_end;
+}
+
+boost::string_view WordDictionary::Alternatives::operator[](std::size_t index) const
+{
+    return *Iterator(m_begin + index, m_pool);
+}
+
+/**
+ * Load a dictionary from a tab-separated word list. The first word of each line is the key, all
+ * following words are its alternatives. Keys are case-insensitive, later lines replace earlier ones
+ * with the same key.
+ *
+ * The compiled dictionary is cached in <tt>dictFile + ".dict"</tt>, which is memory-mapped
+ * on subsequent loads unless the source file has changed since.
+ *
+ * @param dictFile path to input file
+ * @param separator entry separator inside the input file
+ * @return dictionary or nullptr if the input file could not be read
+ */
+std::shared_ptr<WordDictionary const> WordDictionary::load(std::string const& dictFile, char separator)
+{
+    struct stat sourceStat = {};
+    if (::stat(dictFile.c_str(), &sourceStat) != 0) {
+        std::cerr << "Could not open file '" << dictFile << "'" << std::endl;
+        return nullptr;
+    }
+
+    auto const compiledFile = dictFile + ".dict";
+    auto const sourceSize = static_cast<std::uint64_t>(sourceStat.st_size);
+    auto const sourceMtime = static_cast<std::int64_t>(sourceStat.st_mtime);
+    auto dict = map(compiledFile, sourceSize, sourceMtime);
+    if (dict) {
+        return dict;
+    }
+
+    dict = compile(dictFile, separator);
+    if (!dict) {
+        return nullptr;
+    }
+
+    // record the source in the header to detect stale compiled dictionaries
+    auto& header = *const_cast<Header*>(dict->m_header);
+    header.sourceSize = sourceSize;
+    header.sourceMtime = sourceMtime;
+    if (!dict->save(compiledFile)) {
+        std::cerr << "Could not cache compiled dictionary '" << compiledFile << "'" << std::endl;
+    }
+    return dict;
+}
+
+/**
+ * Compile a dictionary from a tab-separated word list into memory (see \link load).
+ *
+ * @param dictFile path to input file
+ * @param separator entry separator inside the input file
+ * @return dictionary or nullptr if the input file could not be read
+ */
+std::shared_ptr<WordDictionary const> WordDictionary::compile(std::string const& dictFile, char separator)
+{
+    std::ifstream stream(dictFile);
+    if (!stream) {
+        std::cerr << "Could not open file '" << dictFile << "'" << std::endl;
+        return nullptr;
+    }
+
+    std::map<std::string, std::vector<std::string>> words;
+    std::string line;
+    while (std::getline(stream, line)) {
+        std::deque<std::string> tokens;
+        boost::split(tokens, line, [separator](char c) { return c == separator; });
+
+        if (tokens.size() < 2) {
+            continue;
+        }
+
+        std::string key = tokens[0];
+        std::transform(key.begin(), key.end(), key.begin(), toLowerAscii);
+        if (key.size() > MAX_KEY_LENGTH) {
+            continue;
+        }
+        tokens.pop_front();
+        words[key] = {std::make_move_iterator(tokens.begin()), std::make_move_iterator(tokens.end())};
+    }
+
+    // intern all strings
+    std::string pool;
+    std::unordered_map<std::string, StringRef> interned;
+    auto const intern = [&pool, &interned](std::string const& str) {
+        auto const it = interned.find(str);
+        if (it != interned.end()) {
+            return it->second;
+        }
+        StringRef const ref{static_cast<std::uint32_t>(pool.size()), static_cast<std::uint32_t>(str.size())};
+        pool.append(str);
+        interned.emplace(str, ref);
+        return ref;
+    };
+
+    auto const numKeys = static_cast<std::uint32_t>(words.size());
+    auto const numBuckets = std::max<std::uint32_t>(1, numKeys / KEYS_PER_BUCKET);
+
+    std::vector<std::uint64_t> hashes;
+    std::vector<std::vector<std::uint32_t>> buckets(numBuckets);
+    std::vector<Entry> keyEntries;
+    std::vector<StringRef> values;
+    hashes.reserve(numKeys);
+    keyEntries.reserve(numKeys);
+    for (auto const& word: words) {
+        buckets[bucketOf(keyHash(word.first.data(), word.first.size()), numBuckets)].push_back(
+                static_cast<std::uint32_t>(hashes.size()));
+        hashes.push_back(keyHash(word.first.data(), word.first.size()));
+        keyEntries.push_back(Entry{intern(word.first), static_cast<std::uint32_t>(values.size()),
+                                   static_cast<std::uint32_t>(word.second.size())});
+        for (auto const& value: word.second) {
+            values.push_back(intern(value));
+        }
+    }
+
+    // place the largest buckets first while most slots are still free
+    std::vector<std::uint32_t> bucketOrder(numBuckets);
+    for (std::uint32_t i = 0; i < numBuckets; ++i) {
+        bucketOrder[i] = i;
+    }
+    std::stable_sort(bucketOrder.begin(), bucketOrder.end(), [&buckets](std::uint32_t a, std::uint32_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    std::vector<std::uint32_t> displacements(numBuckets, 0);
+    std::vector<Entry> entries(numKeys);
+    std::vector<bool> occupied(numKeys, false);
+    std::vector<std::uint32_t> slots;
+    for (auto const bucket: bucketOrder) {
+        auto const& keys = buckets[bucket];
+        if (keys.empty()) {
+            break;
+        }
+
+        std::uint32_t displacement = 0;
+        for (;; ++displacement) {
+            if (displacement == MAX_DISPLACEMENT) {
+                std::cerr << "Could not build perfect hash for dictionary '" << dictFile << "'" << std::endl;
+                return nullptr;
+            }
+            slots.clear();
+            bool placed = true;
+            for (auto const key: keys) {
+                auto const slot = slotOf(hashes[key], displacement, numKeys);
+                if (occupied[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+                    placed = false;
+                    break;
+                }
+                slots.push_back(slot);
+            }
+            if (placed) {
+                break;
+            }
+        }
+
+        displacements[bucket] = displacement;
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            occupied[slots[i]] = true;
+            entries[slots[i]] = keyEntries[keys[i]];
+        }
+    }
+
+    Header header = {};
+    std::copy(std::begin(DICT_MAGIC), std::end(DICT_MAGIC), header.magic);
+    header.version = DICT_VERSION;
+    header.numKeys = numKeys;
+    header.numBuckets = numBuckets;
+    header.numValues = static_cast<std::uint32_t>(values.size());
+    header.poolSize = static_cast<std::uint32_t>(pool.size());
+    header.maxKeyLength = static_cast<std::uint32_t>(MAX_KEY_LENGTH);
+
+    auto blob = std::make_shared<std::vector<char>>();
+    appendBytes(*blob, &header, 1);
+    appendBytes(*blob, displacements.data(), displacements.size());
+    appendBytes(*blob, entries.data(), entries.size());
+    appendBytes(*blob, values.data(), values.size());
+    appendBytes(*blob, pool.data(), pool.size());
+    reinterpret_cast<Header*>(blob->data())->checksum =
+            hashing::xxHash64(blob->data() + sizeof(Header), blob->size() - sizeof(Header));
+
+    std::shared_ptr<WordDictionary> dict(new WordDictionary());
+    auto const size = blob->size();
+    void const* const data = blob->data();
+    if (!dict->attach(std::shared_ptr<void const>(std::move(blob), data), size)) {
+        return nullptr;
+    }
+    return dict;
+}
+
+/**
+ * Memory-map a compiled dictionary.
+ *
+ * @param filename compiled dictionary file
+ * @param sourceSize expected size of the source file
+ * @param sourceMtime expected modification time of the source file
+ * @return dictionary or nullptr if the file does not exist, is stale or invalid
+ */
+std::shared_ptr<WordDictionary const> WordDictionary::map(std::string const& filename, std::uint64_t sourceSize,
+        std::int64_t sourceMtime)
+{
+    int const fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat fileStat = {};
+    if (::fstat(fd, &fileStat) != 0 || static_cast<std::size_t>(fileStat.st_size) < sizeof(Header)) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    auto const fileSize = static_cast<std::size_t>(fileStat.st_size);
+    void* const data = ::mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    std::shared_ptr<void const> mapping(data, [fileSize](void const* ptr) {
+        ::munmap(const_cast<void*>(ptr), fileSize);
+    });
+
+    auto const& header = *static_cast<Header const*>(data);
+    if (header.sourceSize != sourceSize || header.sourceMtime != sourceMtime) {
+        return nullptr;
+    }
+
+    std::shared_ptr<WordDictionary> dict(new WordDictionary());
+    if (!dict->attach(std::move(mapping), fileSize)) {
+        std::cerr << "Ignoring corrupt compiled dictionary '" << filename << "'" << std::endl;
+        return nullptr;
+    }
+    return dict;
+}
+
+/**
+ * Validate a compiled dictionary blob and set up the table pointers into it.
+ *
+ * @param data blob data
+ * @param size blob size in bytes
+ * @return whether the blob is a valid compiled dictionary
+ */
+bool WordDictionary::attach(std::shared_ptr<void const> data, std::size_t size)
+{
+    auto const bytes = static_cast<char const*>(data.get());
+    auto const header = reinterpret_cast<Header const*>(bytes);
+    if (size < sizeof(Header) || !std::equal(std::begin(DICT_MAGIC), std::end(DICT_MAGIC), header->magic)
+            || header->version != DICT_VERSION || header->numBuckets == 0) {
+        return false;
+    }
+
+    std::size_t const expectedSize = sizeof(Header)
+            + header->numBuckets * sizeof(std::uint32_t)
+            + header->numKeys * sizeof(Entry)
+            + header->numValues * sizeof(StringRef)
+            + header->poolSize;
+    if (size != expectedSize
+            || hashing::xxHash64(bytes + sizeof(Header), size - sizeof(Header)) != header->checksum) {
+        return false;
+    }
+
+    m_data = std::move(data);
+    m_size = size;
+    m_header = header;
+    m_displacements = reinterpret_cast<std::uint32_t const*>(bytes + sizeof(Header));
+    m_entries = reinterpret_cast<Entry const*>(m_displacements + header->numBuckets);
+    m_values = reinterpret_cast<StringRef const*>(m_entries + header->numKeys);
+    m_pool = reinterpret_cast<char const*>(m_values + header->numValues);
+    return true;
+}
+
+/**
+ * Look up the alternatives of a word. This method does not allocate.
+ *
+ * @param word word to look up (case-insensitive)
+ * @return alternatives of the word, empty if the word is not in the dictionary
+ */
+WordDictionary::Alternatives WordDictionary::find(boost::string_view word) const
+{
+    if (m_header->numKeys == 0 || word.size() > m_header->maxKeyLength || word.size() > MAX_KEY_LENGTH) {
+        return {};
+    }
+
+    std::array<char, MAX_KEY_LENGTH> key;
+    std::transform(word.begin(), word.end(), key.begin(), toLowerAscii);
+
+    auto const hash = keyHash(key.data(), word.size());
+    auto const displacement = m_displacements[bucketOf(hash, m_header->numBuckets)];
+    auto const& entry = m_entries[slotOf(hash, displacement, m_header->numKeys)];
+    if (entry.key.length != word.size() || std::memcmp(m_pool + entry.key.offset, key.data(), word.size()) != 0) {
+        return {};
+    }
+    return Alternatives(m_values + entry.valuesBegin, m_values + entry.valuesBegin + entry.valuesCount, m_pool);
+}
+
+/**
+ * @return number of keys
+ */
+std::size_t WordDictionary::size() const
+{
+    return m_header->numKeys;
+}
+
+/**
+ * @return size of the compiled dictionary blob in bytes
+ */
+std::size_t WordDictionary::blobSize() const
+{
+    return m_size;
+}
+
+/**
+ * Save the compiled dictionary blob. The file is replaced atomically.
+ *
+ * @param filename output filename
+ * @return whether the file was written
+ */
+bool WordDictionary::save(std::string const& filename) const
+{
+    auto const tmpFile = filename + ".tmp";
+    {
+        std::ofstream ofs(tmpFile, std::ios::binary | std::ios::trunc);
+        ofs.write(static_cast<char const*>(m_data.get()), m_size);
+        if (!ofs) {
+            std::remove(tmpFile.c_str());
+            return false;
+        }
+    }
+    return std::rename(tmpFile.c_str(), filename.c_str()) == 0;
+}
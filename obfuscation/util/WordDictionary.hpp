@@ -0,0 +1,106 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_UTIL_WORDDICTIONARY_HPP
+#define OBFUSCATION_UTIL_WORDDICTIONARY_HPP
+
+#include <boost/utility/string_view.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+
+/**
+ * Immutable dictionary mapping words to lists of alternative words.
+ *
+ * The dictionary is compiled from a tab-separated word list into a single contiguous blob: a minimal
+ * perfect hash (hash and displace) over all keys, an entry table, a table of value references and a
+ * pool of interned strings. Compiled dictionaries are cached next to their source file and memory-mapped
+ * on load, so processes using the same dictionary share its pages.
+ *
+ * Lookups are case-insensitive for ASCII characters and do not allocate.
+ */
+class WordDictionary {
+public:
+    /**
+     * Reference to a string in the string pool.
+     */
+    struct StringRef {
+        std::uint32_t offset;
+        std::uint32_t length;
+    };
+
+    /**
+     * Range of alternative words for a key.
+     */
+    class Alternatives {
+    public:
+        class Iterator: public std::iterator<std::forward_iterator_tag, boost::string_view> {
+        public:
+            Iterator(StringRef const* ref, char const* pool);
+            boost::string_view operator*() const;
+            Iterator& operator++();
+            bool operator==(Iterator const& other) const;
+            bool operator!=(Iterator const& other) const;
+
+        private:
+            StringRef const* m_ref;
+            char const* m_pool;
+        };
+
+        Alternatives() = default;
+        Alternatives(StringRef const* begin, StringRef const* end, char const* pool);
+
+        Iterator begin() const;
+        Iterator end() const;
+        std::size_t size() const;
+        bool empty() const;
+        boost::string_view operator[](std::size_t index) const;
+
+    private:
+        StringRef const* m_begin = nullptr;
+        StringRef const* m_end = nullptr;
+        char const* m_pool = nullptr;
+    };
+
+    static std::shared_ptr<WordDictionary const> load(std::string const& dictFile, char separator = '\t');
+    static std::shared_ptr<WordDictionary const> compile(std::string const& dictFile, char separator = '\t');
+
+    Alternatives find(boost::string_view word) const;
+    std::size_t size() const;
+    std::size_t blobSize() const;
+    bool save(std::string const& filename) const;
+
+private:
+    struct Header;
+    struct Entry;
+
+    WordDictionary() = default;
+    bool attach(std::shared_ptr<void const> data, std::size_t size);
+    static std::shared_ptr<WordDictionary const> map(std::string const& filename, std::uint64_t sourceSize,
+            std::int64_t sourceMtime);
+
+    std::shared_ptr<void const> m_data;
+    std::size_t m_size = 0;
+    Header const* m_header = nullptr;
+    std::uint32_t const* m_displacements = nullptr;
+    Entry const* m_entries = nullptr;
+    StringRef const* m_values = nullptr;
+    char const* m_pool = nullptr;
+};
+
+#endif //OBFUSCATION_UTIL_WORDDICTIONARY_HPP
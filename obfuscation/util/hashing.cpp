@@ -0,0 +1,248 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hashing.hpp"
+
+#include <cstring>
+
+namespace hashing
+{
+
+namespace {
+
+std::uint64_t constexpr PRIME64_1 = 0x9E3779B185EBCA87ull;
+std::uint64_t constexpr PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+std::uint64_t constexpr PRIME64_3 = 0x165667B19E3779F9ull;
+std::uint64_t constexpr PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+std::uint64_t constexpr PRIME64_5 = 0x27D4EB2F165667C5ull;
+
+inline std::uint64_t rotl(std::uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline std::uint64_t read64(char const* p)
+{
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint32_t read32(char const* p)
+{
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint64_t round(std::uint64_t acc, std::uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl(acc, 31);
+    return acc * PRIME64_1;
+}
+
+inline std::uint64_t mergeRound(std::uint64_t acc, std::uint64_t val)
+{
+    acc ^= round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+/**
+ * Modulus of the polynomial hash (Mersenne prime 2^61 - 1).
+ */
+std::uint64_t constexpr POLY_MOD = (1ull << 61) - 1;
+
+/**
+ * Fixed polynomial base, so hashes are stable across runs.
+ */
+std::uint64_t constexpr POLY_BASE = 0x0C6A4A7935BD1E99ull;
+
+inline std::uint64_t mulMod(std::uint64_t a, std::uint64_t b)
+{
+    auto const product = static_cast<unsigned __int128>(a) * b;
+    std::uint64_t result = (static_cast<std::uint64_t>(product) & POLY_MOD)
+            + static_cast<std::uint64_t>(product >> 61);
+    result = (result & POLY_MOD) + (result >> 61);
+    return result >= POLY_MOD ? result - POLY_MOD : result;
+}
+
+inline std::uint64_t addMod(std::uint64_t a, std::uint64_t b)
+{
+    std::uint64_t const result = a + b;
+    return result >= POLY_MOD ? result - POLY_MOD : result;
+}
+
+inline std::uint64_t powMod(std::uint64_t base, std::size_t exp)
+{
+    std::uint64_t result = 1;
+    while (exp > 0) {
+        if (exp & 1u) {
+            result = mulMod(result, base);
+        }
+        base = mulMod(base, base);
+        exp >>= 1u;
+    }
+    return result;
+}
+
+/**
+ * Map a character to a non-zero polynomial coefficient, so that leading NUL characters are not ignored.
+ */
+inline std::uint64_t coefficient(char c)
+{
+    return static_cast<unsigned char>(c) + 1u;
+}
+
+}   // namespace
+
+/**
+ * Parse the name of a hash algorithm.
+ *
+ * @param name algorithm name ("polynomial" or "xxhash64")
+ * @param algorithm parsed algorithm
+ * @return false if the name is unknown
+ */
+bool parseAlgorithm(std::string const& name, Algorithm& algorithm)
+{
+    if (name == "polynomial") {
+        algorithm = Algorithm::POLYNOMIAL;
+        return true;
+    }
+    if (name == "xxhash64") {
+        algorithm = Algorithm::XXHASH64;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Calculate the xxHash64 digest of a memory range.
+ *
+ * @param data input data
+ * @param size input size in bytes
+ * @param seed hash seed
+ * @return 64-bit digest
+ */
+HashCode xxHash64(char const* data, std::size_t size, std::uint64_t seed)
+{
+    char const* p = data;
+    char const* const end = data + size;
+    std::uint64_t h;
+
+    if (size >= 32) {
+        char const* const limit = end - 32;
+        std::uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        std::uint64_t v2 = seed + PRIME64_2;
+        std::uint64_t v3 = seed;
+        std::uint64_t v4 = seed - PRIME64_1;
+        do {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+
+    h += static_cast<std::uint64_t>(size);
+
+    while (p + 8 <= end) {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<std::uint64_t>(read32(p)) * PRIME64_1;
+        h = rotl(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= static_cast<unsigned char>(*p) * PRIME64_5;
+        h = rotl(h, 11) * PRIME64_1;
+        ++p;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+/**
+ * Calculate the polynomial hash sum(c[i] * B^(size - 1 - i)) mod 2^61 - 1 of a memory range.
+ *
+ * @param data input data
+ * @param size input size in bytes
+ * @return 61-bit hash
+ */
+HashCode polynomialHash(char const* data, std::size_t size)
+{
+    std::uint64_t h = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+        h = addMod(mulMod(h, POLY_BASE), coefficient(data[i]));
+    }
+    return h;
+}
+
+/**
+ * Update a polynomial hash after replacing <tt>length</tt> characters at <tt>pos</tt> with
+ * the same number of new characters. Runtime is O(length + log(size)).
+ *
+ * @param hash polynomial hash of the old text
+ * @param size size of the text (same before and after the replacement)
+ * @param pos replacement position
+ * @param oldData replaced characters
+ * @param newData new characters
+ * @param length number of replaced characters
+ * @return polynomial hash of the new text
+ */
+HashCode polynomialReplace(HashCode hash, std::size_t size, std::size_t pos,
+        char const* oldData, char const* newData, std::size_t length)
+{
+    std::uint64_t delta = 0;
+    for (std::size_t i = 0; i < length; ++i) {
+        auto const diff = POLY_MOD + coefficient(newData[i]) - coefficient(oldData[i]);
+        delta = addMod(mulMod(delta, POLY_BASE), diff >= POLY_MOD ? diff - POLY_MOD : diff);
+    }
+    return addMod(hash, mulMod(delta, powMod(POLY_BASE, size - pos - length)));
+}
+
+/**
+ * Combine the polynomial hashes of two texts into the polynomial hash of their concatenation.
+ * Runtime is O(log(rightSize)).
+ *
+ * @param left polynomial hash of the left text
+ * @param right polynomial hash of the right text
+ * @param rightSize size of the right text
+ * @return polynomial hash of the concatenated text
+ */
+HashCode polynomialConcat(HashCode left, HashCode right, std::size_t rightSize)
+{
+    return addMod(mulMod(left, powMod(POLY_BASE, rightSize)), right);
+}
+
+}   // namespace hashing
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_SEARCH_HASHING_HPP
+#define OBFUSCATION_SEARCH_HASHING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Fast non-cryptographic 64-bit text hashes for state identification.
+ */
+namespace hashing
+{
+
+typedef std::uint64_t HashCode;
+
+/**
+ * Available text hash algorithms.
+ */
+enum class Algorithm {
+    /**
+     * Polynomial hash modulo 2^61 - 1, can be updated in O(edit size) for length-preserving edits.
+     */
+    POLYNOMIAL,
+
+    /**
+     * xxHash64 digest, always recalculated over the full text.
+     */
+    XXHASH64
+};
+
+bool parseAlgorithm(std::string const& name, Algorithm& algorithm);
+
+HashCode xxHash64(char const* data, std::size_t size, std::uint64_t seed = 0);
+
+HashCode polynomialHash(char const* data, std::size_t size);
+HashCode polynomialReplace(HashCode hash, std::size_t size, std::size_t pos,
+        char const* oldData, char const* newData, std::size_t length);
+HashCode polynomialConcat(HashCode left, HashCode right, std::size_t rightSize);
+
+}   // namespace hashing
+
+#endif //OBFUSCATION_SEARCH_HASHING_HPP
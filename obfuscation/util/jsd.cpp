@@ -0,0 +1,335 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jsd.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JSD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace jsd
+{
+
+namespace {
+
+/*
+ * All kernels use the same log2 approximation, so results differ only in summation order:
+ * x = 2^e * m with m in [sqrt(0.5), sqrt(2)), ln(m) = 2 atanh(s) with s = (m - 1) / (m + 1).
+ * With |s| <= 0.1716, the atanh series truncated after s^21 is accurate to double precision.
+ */
+double constexpr LOG2E = 1.4426950408889634074;
+double constexpr SQRT2 = 1.4142135623730950488;
+double constexpr EXP_MAGIC = 4503599627370496.0;    // 2^52
+std::uint64_t constexpr MANTISSA_MASK = 0x000FFFFFFFFFFFFFull;
+std::uint64_t constexpr ONE_BITS = 0x3FF0000000000000ull;
+double constexpr C[] = {1.0 / 21.0, 1.0 / 19.0, 1.0 / 17.0, 1.0 / 15.0, 1.0 / 13.0, 1.0 / 11.0,
+                        1.0 / 9.0, 1.0 / 7.0, 1.0 / 5.0, 1.0 / 3.0, 1.0};
+
+/**
+ * Kahan-compensated accumulator.
+ */
+struct Kahan
+{
+    double sum = 0.0;
+    double c = 0.0;
+
+    inline void add(double x)
+    {
+        double const y = x - c;
+        double const t = sum + y;
+        c = (t - sum) - y;
+        sum = t;
+    }
+
+    inline double value() const
+    {
+        return sum - c;
+    }
+};
+
+/**
+ * Scalar log2 for x = 0 or positive normal x.
+ * Returns a finite value for x = 0, so that 0 * log2(0) = 0.
+ */
+inline double log2Scalar(double x)
+{
+    std::uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    auto e = static_cast<double>(static_cast<std::int64_t>(bits >> 52) - 1023);
+    bits = (bits & MANTISSA_MASK) | ONE_BITS;
+    double m;
+    std::memcpy(&m, &bits, sizeof(m));
+    if (m > SQRT2) {
+        m *= 0.5;
+        e += 1.0;
+    }
+
+    double const s = (m - 1.0) / (m + 1.0);
+    double const z = s * s;
+    double poly = C[0];
+    for (std::size_t i = 1; i < sizeof(C) / sizeof(C[0]); ++i) {
+        poly = poly * z + C[i];
+    }
+    return e + 2.0 * s * poly * LOG2E;
+}
+
+inline void accumulateScalar(double const* p, double const* q, std::size_t n, Kahan& sumP, Kahan& sumQ, Kahan& sumR)
+{
+    for (std::size_t i = 0; i < n; ++i) {
+        double const s = p[i] + q[i];
+        if (s <= 0.0) {
+            continue;
+        }
+        double const inv = 2.0 / s;
+        double const a = p[i] * inv;
+        double const b = q[i] * inv;
+        sumP.add(p[i] * log2Scalar(a));
+        sumQ.add(q[i] * log2Scalar(b));
+        sumR.add(0.5 * a * q[i]);
+    }
+}
+
+Sums kernelScalar(double const* p, double const* q, std::size_t n)
+{
+    Kahan sumP, sumQ, sumR;
+    accumulateScalar(p, q, n, sumP, sumQ, sumR);
+    Sums sums;
+    sums.p = sumP.value();
+    sums.q = sumQ.value();
+    sums.r = sumR.value();
+    return sums;
+}
+
+#ifdef JSD_X86
+
+/**
+ * Fold vector accumulator lanes and the scalar tail into the final sums.
+ */
+inline Sums reduceLanes(double const* lanes, std::size_t width, double const* p, double const* q, std::size_t n)
+{
+    // lanes layout: [sumP, cP, sumQ, cQ, sumR, cR] x width
+    Kahan sumP, sumQ, sumR;
+    for (std::size_t i = 0; i < width; ++i) {
+        sumP.add(lanes[i]);
+        sumP.add(-lanes[width + i]);
+        sumQ.add(lanes[2 * width + i]);
+        sumQ.add(-lanes[3 * width + i]);
+        sumR.add(lanes[4 * width + i]);
+        sumR.add(-lanes[5 * width + i]);
+    }
+    accumulateScalar(p, q, n, sumP, sumQ, sumR);
+
+    Sums sums;
+    sums.p = sumP.value();
+    sums.q = sumQ.value();
+    sums.r = sumR.value();
+    return sums;
+}
+
+__attribute__((target("avx2")))
+inline __m256d log2Avx2(__m256d x)
+{
+    __m256i const bits = _mm256_castpd_si256(x);
+    __m256i const magic = _mm256_castpd_si256(_mm256_set1_pd(EXP_MAGIC));
+    __m256d e = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), magic)),
+                              _mm256_set1_pd(EXP_MAGIC + 1023.0));
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(
+            _mm256_and_si256(bits, _mm256_set1_epi64x(MANTISSA_MASK)), _mm256_set1_epi64x(ONE_BITS)));
+
+    __m256d const one = _mm256_set1_pd(1.0);
+    __m256d const big = _mm256_cmp_pd(m, _mm256_set1_pd(SQRT2), _CMP_GT_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+    e = _mm256_add_pd(e, _mm256_and_pd(big, one));
+
+    __m256d const s = _mm256_div_pd(_mm256_sub_pd(m, one), _mm256_add_pd(m, one));
+    __m256d const z = _mm256_mul_pd(s, s);
+    __m256d poly = _mm256_set1_pd(C[0]);
+    for (std::size_t i = 1; i < sizeof(C) / sizeof(C[0]); ++i) {
+        poly = _mm256_add_pd(_mm256_mul_pd(poly, z), _mm256_set1_pd(C[i]));
+    }
+    __m256d const ln = _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(2.0), s), poly);
+    return _mm256_add_pd(e, _mm256_mul_pd(ln, _mm256_set1_pd(LOG2E)));
+}
+
+__attribute__((target("avx2")))
+inline void kahanAvx2(__m256d& sum, __m256d& c, __m256d x)
+{
+    __m256d const y = _mm256_sub_pd(x, c);
+    __m256d const t = _mm256_add_pd(sum, y);
+    c = _mm256_sub_pd(_mm256_sub_pd(t, sum), y);
+    sum = t;
+}
+
+__attribute__((target("avx2")))
+Sums kernelAvx2(double const* p, double const* q, std::size_t n)
+{
+    std::size_t constexpr WIDTH = 4;
+    __m256d sumP = _mm256_setzero_pd(), cP = _mm256_setzero_pd();
+    __m256d sumQ = _mm256_setzero_pd(), cQ = _mm256_setzero_pd();
+    __m256d sumR = _mm256_setzero_pd(), cR = _mm256_setzero_pd();
+    __m256d const zero = _mm256_setzero_pd();
+    __m256d const one = _mm256_set1_pd(1.0);
+    __m256d const two = _mm256_set1_pd(2.0);
+    __m256d const half = _mm256_set1_pd(0.5);
+
+    std::size_t i = 0;
+    for (; i + WIDTH <= n; i += WIDTH) {
+        __m256d const vp = _mm256_loadu_pd(p + i);
+        __m256d const vq = _mm256_loadu_pd(q + i);
+        __m256d const s = _mm256_add_pd(vp, vq);
+        __m256d const valid = _mm256_cmp_pd(s, zero, _CMP_GT_OQ);
+        __m256d const inv = _mm256_div_pd(two, _mm256_blendv_pd(one, s, valid));
+        __m256d const a = _mm256_mul_pd(vp, inv);
+        __m256d const b = _mm256_mul_pd(vq, inv);
+
+        kahanAvx2(sumP, cP, _mm256_mul_pd(vp, log2Avx2(a)));
+        kahanAvx2(sumQ, cQ, _mm256_mul_pd(vq, log2Avx2(b)));
+        kahanAvx2(sumR, cR, _mm256_mul_pd(_mm256_mul_pd(half, a), vq));
+    }
+
+    alignas(32) double lanes[6 * WIDTH];
+    _mm256_store_pd(lanes, sumP);
+    _mm256_store_pd(lanes + WIDTH, cP);
+    _mm256_store_pd(lanes + 2 * WIDTH, sumQ);
+    _mm256_store_pd(lanes + 3 * WIDTH, cQ);
+    _mm256_store_pd(lanes + 4 * WIDTH, sumR);
+    _mm256_store_pd(lanes + 5 * WIDTH, cR);
+    return reduceLanes(lanes, WIDTH, p + i, q + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline __m512d log2Avx512(__m512d x)
+{
+    __m512i const bits = _mm512_castpd_si512(x);
+    __m512i const magic = _mm512_castpd_si512(_mm512_set1_pd(EXP_MAGIC));
+    // all lanes are shifted, the zero source only replaces the undefined one of _mm512_srli_epi64
+    __m512i const exponent = _mm512_mask_srli_epi64(_mm512_setzero_si512(), 0xFF, bits, 52);
+    __m512d e = _mm512_sub_pd(_mm512_castsi512_pd(_mm512_or_si512(exponent, magic)),
+                              _mm512_set1_pd(EXP_MAGIC + 1023.0));
+    __m512d m = _mm512_castsi512_pd(_mm512_or_si512(
+            _mm512_and_si512(bits, _mm512_set1_epi64(MANTISSA_MASK)), _mm512_set1_epi64(ONE_BITS)));
+
+    __m512d const one = _mm512_set1_pd(1.0);
+    __mmask8 const big = _mm512_cmp_pd_mask(m, _mm512_set1_pd(SQRT2), _CMP_GT_OQ);
+    m = _mm512_mask_mul_pd(m, big, m, _mm512_set1_pd(0.5));
+    e = _mm512_mask_add_pd(e, big, e, one);
+
+    __m512d const s = _mm512_div_pd(_mm512_sub_pd(m, one), _mm512_add_pd(m, one));
+    __m512d const z = _mm512_mul_pd(s, s);
+    __m512d poly = _mm512_set1_pd(C[0]);
+    for (std::size_t i = 1; i < sizeof(C) / sizeof(C[0]); ++i) {
+        poly = _mm512_add_pd(_mm512_mul_pd(poly, z), _mm512_set1_pd(C[i]));
+    }
+    __m512d const ln = _mm512_mul_pd(_mm512_mul_pd(_mm512_set1_pd(2.0), s), poly);
+    return _mm512_add_pd(e, _mm512_mul_pd(ln, _mm512_set1_pd(LOG2E)));
+}
+
+__attribute__((target("avx512f")))
+inline void kahanAvx512(__m512d& sum, __m512d& c, __m512d x)
+{
+    __m512d const y = _mm512_sub_pd(x, c);
+    __m512d const t = _mm512_add_pd(sum, y);
+    c = _mm512_sub_pd(_mm512_sub_pd(t, sum), y);
+    sum = t;
+}
+
+__attribute__((target("avx512f")))
+Sums kernelAvx512(double const* p, double const* q, std::size_t n)
+{
+    std::size_t constexpr WIDTH = 8;
+    __m512d sumP = _mm512_setzero_pd(), cP = _mm512_setzero_pd();
+    __m512d sumQ = _mm512_setzero_pd(), cQ = _mm512_setzero_pd();
+    __m512d sumR = _mm512_setzero_pd(), cR = _mm512_setzero_pd();
+    __m512d const zero = _mm512_setzero_pd();
+    __m512d const one = _mm512_set1_pd(1.0);
+    __m512d const two = _mm512_set1_pd(2.0);
+    __m512d const half = _mm512_set1_pd(0.5);
+
+    std::size_t i = 0;
+    for (; i + WIDTH <= n; i += WIDTH) {
+        __m512d const vp = _mm512_loadu_pd(p + i);
+        __m512d const vq = _mm512_loadu_pd(q + i);
+        __m512d const s = _mm512_add_pd(vp, vq);
+        __mmask8 const valid = _mm512_cmp_pd_mask(s, zero, _CMP_GT_OQ);
+        __m512d const inv = _mm512_div_pd(two, _mm512_mask_blend_pd(valid, one, s));
+        __m512d const a = _mm512_mul_pd(vp, inv);
+        __m512d const b = _mm512_mul_pd(vq, inv);
+
+        kahanAvx512(sumP, cP, _mm512_mul_pd(vp, log2Avx512(a)));
+        kahanAvx512(sumQ, cQ, _mm512_mul_pd(vq, log2Avx512(b)));
+        kahanAvx512(sumR, cR, _mm512_mul_pd(_mm512_mul_pd(half, a), vq));
+    }
+
+    alignas(64) double lanes[6 * WIDTH];
+    _mm512_store_pd(lanes, sumP);
+    _mm512_store_pd(lanes + WIDTH, cP);
+    _mm512_store_pd(lanes + 2 * WIDTH, sumQ);
+    _mm512_store_pd(lanes + 3 * WIDTH, cQ);
+    _mm512_store_pd(lanes + 4 * WIDTH, sumR);
+    _mm512_store_pd(lanes + 5 * WIDTH, cR);
+    return reduceLanes(lanes, WIDTH, p + i, q + i, n - i);
+}
+
+#endif  // JSD_X86
+
+typedef Sums (*Kernel)(double const*, double const*, std::size_t);
+
+struct Dispatch
+{
+    Kernel kernel;
+    char const* name;
+};
+
+/**
+ * Select the best kernel supported by the executing CPU.
+ */
+Dispatch selectKernel()
+{
+#ifdef JSD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return {kernelAvx512, "avx512"};
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return {kernelAvx2, "avx2"};
+    }
+#endif
+    return {kernelScalar, "scalar"};
+}
+
+Dispatch const& dispatch()
+{
+    static Dispatch const selected = selectKernel();
+    return selected;
+}
+
+}   // namespace
+
+Sums accumulate(double const* p, double const* q, std::size_t n)
+{
+    return dispatch().kernel(p, q, n);
+}
+
+char const* kernelName()
+{
+    return dispatch().name;
+}
+
+}   // namespace jsd
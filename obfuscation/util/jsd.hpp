@@ -0,0 +1,80 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_SEARCH_JSD_HPP
+#define OBFUSCATION_SEARCH_JSD_HPP
+
+#include <cstddef>
+
+/**
+ * Vectorized Jensen-Shannon divergence kernels.
+ *
+ * The kernels operate on two aligned arrays of normalized n-gram probabilities p (target)
+ * and q (source), where an n-gram missing from one of the distributions has probability 0.
+ * The best kernel for the executing CPU (AVX-512, AVX2 or scalar) is selected at runtime.
+ */
+namespace jsd
+{
+
+/**
+ * Partial sums of a JSD calculation, which are needed to update it incrementally.
+ */
+struct Sums
+{
+    /**
+     * Sum of the target summands p * log2(p / m) with m = (p + q) / 2.
+     */
+    double p = 0.0;
+
+    /**
+     * Sum of the source summands q * log2(q / m).
+     */
+    double q = 0.0;
+
+    /**
+     * Sum of p * q / (p + q), used for first-order corrections
+     * when the total source n-gram count changes.
+     */
+    double r = 0.0;
+
+    /**
+     * @return Jensen-Shannon divergence
+     */
+    inline double jsd() const
+    {
+        return 0.5 * (p + q);
+    }
+};
+
+/**
+ * Calculate the partial JSD sums of <tt>n</tt> aligned probability pairs.
+ * The summation is compensated (Kahan), so chunks of arbitrary size can be passed.
+ *
+ * @param p target probabilities
+ * @param q source probabilities
+ * @param n number of elements
+ * @return partial sums
+ */
+Sums accumulate(double const* p, double const* q, std::size_t n);
+
+/**
+ * @return name of the selected kernel ("avx512", "avx2" or "scalar")
+ */
+char const* kernelName();
+
+}   // namespace jsd
+
+#endif //OBFUSCATION_SEARCH_JSD_HPP
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2017-2019 Janek Bevendorff, Webis Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBFUSCATION_UTIL_PRNG_HPP
+#define OBFUSCATION_UTIL_PRNG_HPP
+
+#include <cstdint>
+#include <limits>
+
+/**
+ * Cheap seeded pseudo-random number generation for reproducible searches.
+ */
+namespace prng
+{
+
+/**
+ * SplitMix64 generator (Steele et al., 2014), which satisfies the UniformRandomBitGenerator
+ * requirements. Its state is a single 64-bit word, so seeding it is free.
+ */
+class SplitMix64
+{
+public:
+    typedef std::uint64_t result_type;
+
+    explicit SplitMix64(std::uint64_t seed = 0)
+            : m_state(seed) {}
+
+    inline void seed(std::uint64_t seed)
+    {
+        m_state = seed;
+    }
+
+    inline result_type operator()()
+    {
+        std::uint64_t z = (m_state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    static constexpr result_type min()
+    {
+        return 0;
+    }
+
+    static constexpr result_type max()
+    {
+        return std::numeric_limits<result_type>::max();
+    }
+
+private:
+    std::uint64_t m_state;
+};
+
+/**
+ * Derive a seed from a base seed and a value (e.g. a state hash), so that decisions made for
+ * different values are independent, but reproducible for the same base seed.
+ *
+ * @param seed base seed
+ * @param value value to combine with the seed
+ * @return derived seed
+ */
+inline std::uint64_t deriveSeed(std::uint64_t seed, std::uint64_t value)
+{
+    SplitMix64 generator(seed ^ (value * 0xc2b2ae3d27d4eb4fULL));
+    return generator();
+}
+
+/**
+ * Get the calling thread's generator, reseeded with the given seed.
+ *
+ * Random decisions of the search are seeded from the search seed and the state they are made for
+ * instead of drawing from a running per-thread sequence, so their outcome does not depend on which
+ * worker thread happens to make them.
+ *
+ * @param seed seed for the next decision
+ * @return thread-local generator
+ */
+inline SplitMix64& threadGenerator(std::uint64_t seed)
+{
+    static thread_local SplitMix64 generator;
+    generator.seed(seed);
+    return generator;
+}
+
+}
+
+#endif //OBFUSCATION_UTIL_PRNG_HPP
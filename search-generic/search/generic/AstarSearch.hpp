@@ -3,28 +3,65 @@
 #ifndef SEARCH_GENERIC_ASTAR_SEARCH_HPP
 #define SEARCH_GENERIC_ASTAR_SEARCH_HPP
 
-#ifdef PROFILING_ENABLED
-#include <iostream>
-#include <google/profiler.h>
-#endif
-
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <string>
 #include <thread>
 #include <vector>
-#include <thread>
-#include <future>
-#include "thread_pool/thread_pool.hpp"
+#include "search/generic/BloomFilter.hpp"
+#include "search/generic/Checkpoint.hpp"
+#include "search/generic/Executor.hpp"
+#include "search/generic/Metrics.hpp"
 #include "search/generic/Operator.hpp"
+#include "search/generic/OperatorScheduler.hpp"
+#include "search/generic/PhaseTimer.hpp"
+#include "search/generic/PoolAllocator.hpp"
+#include "search/generic/Profiler.hpp"
+#include "search/generic/PrunedParents.hpp"
+#include "search/generic/SearchStrategy.hpp"
 #include "search/generic/Status.hpp"
 
 namespace search {
 namespace generic {
 
+class Transport;
+
 // Options for a call to AstarSearch.
 struct Options {
 
     Options()
-            : status_update_interval(100), free_memory_limit_in_mbytes(1000)
+            : status_update_interval(100),
+              free_memory_limit_in_mbytes(1000),
+              job_memory_limit_in_mbytes(0),
+              memory_check_interval_in_millis(1000),
+              time_limit_in_millis(0),
+              expansion_limit(0),
+              beam_width(0),
+              memory_budget_in_bytes(0),
+              prune_fraction(0.05),
+              min_open_size(10),
+              expansion_batch_size(1),
+              compute_cost_h_in_workers(false),
+              compact_closed_list(false),
+              adaptive_operator_scheduling(false),
+              operator_exploration_rate(0.1),
+              operator_warmup_applications(50),
+              random_seed(0),
+              metrics_interval_in_millis(1000),
+              profile_search(false),
+              checkpoint_interval_in_millis(10 * 60 * 1000),
+              search_strategy(SearchStrategy::kAstar),
+              heuristic_weight(2),
+              anytime_weight_step(0.5),
+              restart_interval(10000),
+              restart_noise(0.01),
+              search_threads(0),
+              transport_batch_size(64),
+              transport_max_backlog_in_bytes(64 * 1024 * 1024),
+              executor(nullptr)
     {
     }
 
@@ -32,62 +69,473 @@ struct Options {
     // (status_update_interval defines this n)
     std::size_t status_update_interval;
 
-    // Abort computation if the systems free memory falls below this limit.
+    // Abort computation if the memory available to the process falls below
+    // this limit. Since the available memory is shared by all jobs on the host
+    // (or in the cgroup), this is a last resort for the process as a whole.
     std::size_t free_memory_limit_in_mbytes;
+
+    // Abort computation if the accounted memory of this search, i.e. the
+    // estimated memory of the nodes in OPEN and CLOSED including their states,
+    // exceeds this limit (0 means unbounded). Unlike the free memory limit, it
+    // is not affected by other searches running concurrently.
+    std::size_t job_memory_limit_in_mbytes;
+
+    // The memory of the process is sampled at most once per interval, no
+    // matter how often the status is updated.
+    std::size_t memory_check_interval_in_millis;
+
+    // Abort computation once it has run for time_limit_in_millis, or once
+    // expansion_limit nodes have been taken from OPEN and checked for being a
+    // goal (0 means unbounded). The search then ends with the best node found
+    // so far and sets Status::aborted_by_budget.
+    std::size_t time_limit_in_millis;
+    std::size_t expansion_limit;
+
+    // Maximum number of nodes in OPEN (0 means unbounded). When exceeded, the
+    // nodes with the highest cost f are pruned from OPEN.
+    std::size_t beam_width;
+
+    // Maximum estimated number of bytes held by OPEN and CLOSED (0 means
+    // unbounded). The estimate uses Status::compute_memory if it is set.
+    std::size_t memory_budget_in_bytes;
+
+    // Fraction of OPEN that is pruned at once when a bound is exceeded.
+    // Small values keep pruning incremental at the cost of more frequent
+    // O(n) pruning passes.
+    double prune_fraction;
+
+    // OPEN is never pruned below this size. If CLOSED alone exceeds the memory
+    // budget, it is reduced to the ancestors of the nodes in OPEN instead.
+    std::size_t min_open_size;
+
+    // Number of best nodes popped from OPEN and expanded concurrently per
+    // iteration. Values larger than 1 trade strict best-first order for
+    // parallelism, and the cost h of successors is then computed by the
+    // worker threads, so Status::compute_cost_h must be thread-safe.
+    std::size_t expansion_batch_size;
+
+    // Compute the cost h of successors within the operator tasks instead of on
+    // the search thread, which requires Status::compute_cost_h to be
+    // thread-safe. Always enabled if expansion_batch_size is larger than 1.
+    bool compute_cost_h_in_workers;
+
+    // Store only hashcodes and costs in CLOSED and release the payload of each
+    // expanded state via Status::release_state, if set. Expanded nodes are
+    // then only kept as path records by their descendants. Pruned nodes are
+    // not backed up to their parents, because a released state cannot be
+    // expanded again, and reopened states are regenerated by their new parent.
+    bool compact_closed_list;
+
+    // Skip operators adaptively based on their gain in cost h per microsecond
+    // of runtime so far (see OperatorScheduler). Each operator is still applied
+    // with at least operator_exploration_rate probability, and always during
+    // its first operator_warmup_applications applications.
+    bool adaptive_operator_scheduling;
+    double operator_exploration_rate;
+    std::size_t operator_warmup_applications;
+
+    // Seed of the random decisions made by the search itself, i.e. by the
+    // adaptive operator scheduling. Problem-specific randomness (e.g. in the
+    // operators) should be seeded from the same value via the context.
+    std::uint64_t random_seed;
+
+    // If set, snapshots of the status are written to this sink every
+    // metrics_interval_in_millis and once when the search ends. The label
+    // tells apart the snapshots of searches sharing a sink, and names the
+    // profiles of the search (see Profiler).
+    std::shared_ptr<MetricsSink> metrics_sink;
+    std::size_t metrics_interval_in_millis;
+    std::string metrics_label;
+
+    // Open a profiling window for the whole search (see Profiler). Windows
+    // can also be requested while the search runs via
+    // Profiler::RequestWindow.
+    bool profile_search;
+
+    // If set and Status::save_state is set, a checkpoint of OPEN and CLOSED is
+    // written to this file every checkpoint_interval_in_millis, and once more
+    // when the search ends without a goal state. The search thread only takes
+    // a frontier (see TakeFrontier), which a background thread writes.
+    std::string checkpoint_filename;
+    std::size_t checkpoint_interval_in_millis;
+
+    // If set, the search resumes from this checkpoint file instead of starting
+    // at the current node of the status, which must still be the initial node
+    // of the checkpointed search. Requires Status::load_state.
+    std::string resume_filename;
+
+    // Order in which nodes are expanded (see SearchStrategy). heuristic_weight
+    // is the weight w of the cost h in kWeightedAstar and the initial one in
+    // kAnytime, where it is decreased by anytime_weight_step after each goal.
+    // In kGreedyRestarts, the search restarts after restart_interval expansions
+    // without a new lowest cost h (0 means never), and the cost h in priorities
+    // is perturbed by a random factor in [1, 1 + restart_noise) per restart.
+    SearchStrategy search_strategy;
+    float heuristic_weight;
+    float anytime_weight_step;
+    std::size_t restart_interval;
+    float restart_noise;
+
+    // Number of worker threads of HdaSearch, each of which owns a partition of
+    // the states (0 means one per hardware thread). AstarSearch ignores it.
+    std::size_t search_threads;
+
+    // Connects the processes of a DistributedSearch, which sends successors to
+    // other processes in batches of transport_batch_size nodes, and stops
+    // expanding while more than transport_max_backlog_in_bytes are queued.
+    // The other search functions ignore these options.
+    std::shared_ptr<Transport> transport;
+    std::size_t transport_batch_size;
+    std::size_t transport_max_backlog_in_bytes;
+
+    // Executor to run operator tasks on. May be shared by concurrent searches.
+    // If not set, each search creates its own executor.
+    std::shared_ptr<Executor> executor;
 };
 
-// Applies a number of operators to a given node/state and returns the
-// generated new nodes/states. The returned nodes/states may contain
-// duplicates, therefore duplicate detection and removal must be handled
-// by the caller, i.e. within the AstarSearch function.
+// Size of the blocks the nodes of a search are carved out of.
+static constexpr std::size_t kNodeArenaBlockSize = 1024 * 1024;
+
+// Size of the blocks the state payloads of a search are carved out of (see
+// CurrentPoolArena).
+static constexpr std::size_t kPayloadArenaBlockSize = 64 * 1024;
+
+// Initial capacity of the filter of states seen by a search.
+static constexpr std::size_t kKnownStatesFilterCapacity = 64 * 1024;
+
+// Result of probing OPEN and CLOSED for a new successor before its cost h is
+// computed (see GenerateSuccessorNodes).
+enum class SuccessorProbe {
+    kNew,        // Neither in OPEN nor in CLOSED, cost h must be computed.
+    kImproved,   // Known with a higher cost g, cost h must be computed, since it
+                 // may depend on cost g and on state data set by compute_cost_h.
+    kDuplicate   // Known with a lower or equal cost g, can be dropped.
+};
+
+// Returns the estimated number of bytes a node occupies in OPEN or CLOSED.
+template<typename State, typename Context>
+std::size_t EstimateNodeMemory(const Status<State, Context>& status, const Node<State>& node)
+{
+    // Node, shared pointer control block, hash map entry, and heap entry.
+    static constexpr std::size_t kListOverhead = 96;
+    const auto state_bytes = status.compute_memory ? status.compute_memory(node.state()) : sizeof(State);
+    return sizeof(Node<State>) - sizeof(State) + state_bytes + kListOverhead;
+}
+
+// Returns the estimated number of bytes of an entry in a compact CLOSED list,
+// including the path record of its node without the released state payload.
+template<typename State>
+std::size_t EstimateCompactEntryMemory()
+{
+    // Node, shared pointer control block, and hash map entry.
+    static constexpr std::size_t kEntryOverhead = 80;
+    return sizeof(Node<State>) + kEntryOverhead;
+}
+
+// Returns the score of a node taken from OPEN, by which the search selects the
+// best node found so far. Lower is better. It is the cost h, unless the status
+// measures the progress of states (see Status::compute_progress).
+template<typename State, typename Context>
+double BestNodeScore(const Status<State, Context>& status, const Node<State>& node, const Context& context)
+{
+    return status.compute_progress ? -status.compute_progress(node, context) : node.costH();
+}
+
+// Returns true if the search that started at t0 has used up its time or its
+// expansion budget (see Options::time_limit_in_millis), and sets
+// Status::aborted_by_budget then.
+template<typename State, typename Context>
+bool ExceedsSearchBudget(Status<State, Context>& status, const Options& options,
+                         const std::chrono::high_resolution_clock::time_point& t0)
+{
+    if (options.expansion_limit != 0 && status.num_goal_checks >= options.expansion_limit) {
+        status.aborted_by_budget = true;
+    }
+    if (options.time_limit_in_millis != 0 && std::chrono::high_resolution_clock::now() - t0
+            >= std::chrono::milliseconds(options.time_limit_in_millis)) {
+        status.aborted_by_budget = true;
+    }
+    return status.aborted_by_budget;
+}
+
+// Prunes OPEN (and CLOSED as a last resort) until the beam width and the memory
+// budget are met. memory_in_bytes holds the estimated memory of both lists.
+// The costs of pruned nodes are backed up to their parents in pruned_parents,
+// which moves them back to OPEN when they become promising again.
+template<typename State, typename Context>
+void EnforceSearchBounds(Status<State, Context>& status, const Options& options,
+                         OpenList<State>& open, ClosedList<State>& closed,
+                         PrunedParents<State>& pruned_parents, std::size_t& memory_in_bytes)
+{
+    const auto over_beam = [&] {
+        return options.beam_width != 0 && open.size() > options.beam_width;
+    };
+    const auto over_budget = [&] {
+        return options.memory_budget_in_bytes != 0 && memory_in_bytes > options.memory_budget_in_bytes;
+    };
+
+    while ((over_beam() || over_budget()) && open.size() > options.min_open_size) {
+        auto count = static_cast<std::size_t>(open.size() * options.prune_fraction);
+        count = std::max<std::size_t>(count, 1);
+        if (over_beam() && !over_budget()) {
+            count = std::max(count, open.size() - options.beam_width);
+        }
+        count = std::min(count, open.size() - options.min_open_size);
+
+        for (const auto& pruned : open.pruneWorst(count)) {
+            memory_in_bytes -= std::min(memory_in_bytes, EstimateNodeMemory(status, *pruned));
+            pruned_parents.backup(pruned, open, closed);
+        }
+        status.num_pruned_states += count;
+    }
+
+    if (over_budget()) {
+        // The backed-up parents are about to leave CLOSED.
+        pruned_parents.clear();
+    }
+    if (over_budget() && closed.compact()) {
+        const auto size_before = closed.size();
+        closed.clear(open.begin(), open.end());
+        const auto num_removed = size_before - closed.size();
+        memory_in_bytes -= std::min(memory_in_bytes, num_removed * EstimateCompactEntryMemory<State>());
+        status.num_pruned_states += num_removed;
+    } else if (over_budget()) {
+        std::size_t closed_bytes = 0;
+        for (const auto& entry : closed) {
+            closed_bytes += EstimateNodeMemory(status, *entry.second);
+        }
+        const auto size_before = closed.size();
+        closed.clear(open.begin(), open.end());
+        for (const auto& entry : closed) {
+            closed_bytes -= std::min(closed_bytes, EstimateNodeMemory(status, *entry.second));
+        }
+        memory_in_bytes -= std::min(memory_in_bytes, closed_bytes);
+        status.num_pruned_states += size_before - closed.size();
+    }
+}
+
+// Rebuilds OPEN and CLOSED from a frontier and restores the counters of the
+// status. Returns the estimated memory of both lists. A full CLOSED list only
+// gets back the ancestors of the nodes in OPEN, since a frontier has no other
+// nodes. The other expanded states may be expanded again, as if CLOSED had been
+// reduced to meet the memory budget. The pending backups of pruned parents are
+// restored to pruned_parents, so OPEN must have its final weights already.
+template<typename State, typename Context>
+std::size_t RestoreFrontier(Status<State, Context>& status, Frontier<State>&& frontier,
+                            HashCode initial_hashcode, OpenList<State>& open, ClosedList<State>& closed,
+                            PrunedParents<State>& pruned_parents, const std::shared_ptr<PoolArena>& node_arena)
+{
+    typedef FrontierNode<State> Record;
+    if (frontier.initial_hashcode != initial_hashcode) {
+        throw std::runtime_error("Checkpoint was written for a different initial state");
+    }
+    if (frontier.operator_stats.size() != status.operator_stats.size()) {
+        throw std::runtime_error("Checkpoint was written for a different set of operators");
+    }
+
+    std::size_t memory_in_bytes = 0;
+    std::vector<std::shared_ptr<Node<State>>> nodes;
+    nodes.reserve(frontier.nodes.size());
+    for (auto& record : frontier.nodes) {
+        const auto parent = record.parent == Record::kNoParent ? nullptr : nodes[record.parent];
+        auto node = std::allocate_shared<Node<State>>(PoolAllocator<Node<State>>(node_arena),
+                std::move(record.state), parent, record.opcode, record.cost_g, record.cost_h);
+        if (record.flags & Record::kOpen) {
+            open.pushOrUpdate(node);
+            memory_in_bytes += EstimateNodeMemory(status, *node);
+        } else if (closed.compact()) {
+            if (status.release_state) {
+                node->releaseState(status.release_state);
+            }
+            if (record.flags & Record::kClosed) {
+                closed.put(record.hashcode, node);
+                memory_in_bytes += EstimateCompactEntryMemory<State>();
+            }
+        } else if (record.flags & Record::kClosed) {
+            closed.put(record.hashcode, node);
+            memory_in_bytes += EstimateNodeMemory(status, *node);
+        }
+        nodes.push_back(std::move(node));
+    }
+    if (closed.compact()) {
+        for (const auto& entry : frontier.closed) {
+            if (closed.putEntry(entry.hashcode, entry.cost_g, entry.cost_h)) {
+                memory_in_bytes += EstimateCompactEntryMemory<State>();
+            }
+        }
+    } else {
+        for (const auto& backup : frontier.pruned_parents) {
+            if (frontier.nodes[backup.node].flags & Record::kClosed) {
+                pruned_parents.restore(nodes[backup.node], backup.cost_h, open);
+            }
+        }
+    }
+
+    status.num_goal_checks = frontier.num_goal_checks;
+    status.num_duplicated_states = frontier.num_duplicated_states;
+    status.num_reopened_states = frontier.num_reopened_states;
+    status.num_pruned_states = frontier.num_pruned_states;
+    status.operator_stats = frontier.operator_stats;
+    return memory_in_bytes;
+}
+
+// Applies a number of operators to each of the given nodes/states and returns
+// the generated new nodes/states. Each pair of node and operator is processed
+// as one task by the executor. If compute_cost_h is set, the cost h of each new
+// node is computed within the task that generated it, thus it must be safe to
+// call concurrently. The returned nodes/states are ordered by parent node and
+// operator. They may contain duplicates, therefore duplicate detection and
+// removal must be handled by the caller, i.e. within the AstarSearch function.
+// If node_arena is set, the new nodes and their control blocks are allocated
+// from it, which must then be a synchronized arena. If prepare_expansion is
+// set, it is called once for each of the given nodes before any operator task
+// starts. If scheduler is set, it decides which pairs of node and operator are
+// processed, and skipped pairs are counted in the operator statistics. If
+// probe is set, it is called concurrently for each new node before its cost h
+// is computed. Duplicates are then dropped, and the cost h is only computed
+// for the remaining nodes. If compute_cost_h_batch is set as well, the new nodes of
+// each task, which are siblings, are passed to it at once instead of one by
+// one to compute_cost_h.
 template<typename State, typename Context>
 std::vector<std::shared_ptr<search::generic::Node<State>>> GenerateSuccessorNodes(
-        tp::ThreadPool& thread_pool,
-        const std::shared_ptr<search::generic::Node<State>>& node, Context& context,
+        Executor& executor,
+        const std::vector<std::shared_ptr<search::generic::Node<State>>>& nodes, Context& context,
         const std::vector<std::unique_ptr<search::generic::Operator<State, Context>>>& operators,
-        std::vector<OperatorStats>& operator_stats)
+        std::vector<OperatorStats>& operator_stats,
+        const std::function<double(const Node<State>&, const Context&)>& compute_cost_h = nullptr,
+        const std::shared_ptr<PoolArena>& node_arena = nullptr,
+        const std::function<void(const Node<State>&, Context&)>& prepare_expansion = nullptr,
+        OperatorScheduler* scheduler = nullptr,
+        const std::function<SuccessorProbe(const Node<State>&)>& probe = nullptr,
+        const std::function<void(const Node<State>* const*, std::size_t, const Context&, double*)>&
+                compute_cost_h_batch = nullptr)
 {
+    typedef std::shared_ptr<search::generic::Node<State>> SharedNode;
     assert(operators.size() == operator_stats.size());
-    std::vector<std::shared_ptr<search::generic::Node<State>>> new_nodes;
-
-    const auto node_r = std::ref(node);
-    const auto context_r = std::ref(context);
-    const auto operators_r = std::ref(operators);
-    const auto operator_stats_r = std::ref(operator_stats);
 
-    std::vector<std::future<std::unordered_set<State>>> futures;
-
-    for (std::size_t i = 0; i < operators.size(); ++i) {
-        auto task = std::packaged_task<std::unordered_set<State>()>([i, &node_r, &context_r, &operator_stats_r, &operators_r]() {
-            const auto t0 = std::chrono::high_resolution_clock::now();
-            const auto new_states = operators_r.get()[i]->apply(node_r.get()->state(), context_r);
-            const auto t1 = std::chrono::high_resolution_clock::now();
+    std::vector<std::size_t> tasks;
+    tasks.reserve(nodes.size() * operators.size());
+    for (std::size_t task = 0; task < nodes.size() * operators.size(); ++task) {
+        const auto i = task % operators.size();
+        if (!scheduler || scheduler->shouldApply(i)) {
+            tasks.push_back(task);
+        } else {
+            ++operator_stats[i].num_skipped_applications;
+        }
+    }
 
-            std::vector<OperatorStats>& stats = operator_stats_r;
-            stats[i].runtime_in_micros += std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
-            stats[i].num_generated_states += new_states.size();
-            ++stats[i].num_applications;
+    // Tasks allocate payloads from the current arena of the calling thread.
+    const auto payload_arena = CurrentPoolArena();
 
-            return new_states;
+    if (prepare_expansion) {
+        executor.parallelFor(nodes.size(), [&](std::size_t i) {
+            const ScopedPoolArena payload_scope(payload_arena);
+            SEARCH_GENERIC_TIME_PHASE(kPrepareExpansion);
+            prepare_expansion(*nodes[i], context);
         });
-        auto future = task.get_future();
-
-        thread_pool.post(task);
-        futures.emplace_back(std::move(future));
     }
 
-    std::size_t i = 0;
-    for (auto& future: futures) {
-        for (const auto& state : future.get()) {
-            new_nodes.push_back(std::make_shared<Node<State>>(state, node, i, operators[i]->cost()));
+    std::vector<std::vector<SharedNode>> results(nodes.size() * operators.size());
+    executor.parallelFor(tasks.size(), [&](std::size_t k) {
+        const ScopedPoolArena payload_scope(payload_arena);
+        const auto task = tasks[k];
+        const auto& node = nodes[task / operators.size()];
+        const auto i = task % operators.size();
+
+        // Each worker thread reuses its buffers for all of its tasks.
+        static thread_local SuccessorBuffer<State> new_states;
+        static thread_local std::vector<Node<State>*> evaluated_nodes;
+        static thread_local std::vector<double> costs;
+        new_states.clear();
+        evaluated_nodes.clear();
+
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        {
+            SEARCH_GENERIC_TIME_PHASE(kOperators);
+            operators[i]->apply(node->state(), context, new_states);
+        }
+        const auto t1 = std::chrono::high_resolution_clock::now();
+
+        operator_stats[i].runtime_in_micros += std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+        operator_stats[i].num_generated_states += new_states.size();
+        ++operator_stats[i].num_applications;
+
+        auto& new_nodes = results[task];
+        new_nodes.reserve(new_states.size());
+        for (auto& state : new_states) {
+            if (node_arena) {
+                new_nodes.push_back(std::allocate_shared<Node<State>>(
+                        PoolAllocator<Node<State>>(node_arena), std::move(state), node, i, operators[i]->cost()));
+            } else {
+                new_nodes.push_back(std::make_shared<Node<State>>(std::move(state), node, i, operators[i]->cost()));
+            }
+            auto probed = SuccessorProbe::kNew;
+            if (probe) {
+                SEARCH_GENERIC_TIME_PHASE(kDuplicateDetection);
+                probed = probe(*new_nodes.back());
+            }
+            if (probed == SuccessorProbe::kDuplicate) {
+                new_nodes.pop_back();
+            } else if (compute_cost_h) {
+                evaluated_nodes.push_back(new_nodes.back().get());
+            }
+        }
+        new_states.clear();
+
+        if (!evaluated_nodes.empty()) {
+            SEARCH_GENERIC_TIME_PHASE(kCostH);
+            costs.resize(evaluated_nodes.size());
+            if (compute_cost_h_batch) {
+                compute_cost_h_batch(evaluated_nodes.data(), evaluated_nodes.size(), context, costs.data());
+            } else {
+                for (std::size_t j = 0; j < evaluated_nodes.size(); ++j) {
+                    costs[j] = compute_cost_h(*evaluated_nodes[j], context);
+                }
+            }
+            for (std::size_t j = 0; j < evaluated_nodes.size(); ++j) {
+                evaluated_nodes[j]->setCostH(static_cast<float>(costs[j]));
+            }
         }
+    });
 
-        ++i;
+    std::size_t num_new_nodes = 0;
+    for (const auto& result : results) {
+        num_new_nodes += result.size();
+    }
+    std::vector<SharedNode> new_nodes;
+    new_nodes.reserve(num_new_nodes);
+    for (auto& result : results) {
+        std::move(result.begin(), result.end(), std::back_inserter(new_nodes));
     }
 
     return new_nodes;
 }
 
+// Applies a number of operators to a given node/state and returns the
+// generated new nodes/states (see above). The cost h is not computed.
+template<typename State, typename Context>
+std::vector<std::shared_ptr<search::generic::Node<State>>> GenerateSuccessorNodes(
+        Executor& executor,
+        const std::shared_ptr<search::generic::Node<State>>& node, Context& context,
+        const std::vector<std::unique_ptr<search::generic::Operator<State, Context>>>& operators,
+        std::vector<OperatorStats>& operator_stats)
+{
+    const std::vector<std::shared_ptr<search::generic::Node<State>>> nodes = {node};
+    return GenerateSuccessorNodes(executor, nodes, context, operators, operator_stats);
+}
+
+// Adds the decrease in cost h from the parent of a new node to the node to the
+// gain of the operator that generated it.
+template<typename State>
+void RecordOperatorGain(std::vector<OperatorStats>& operator_stats, const Node<State>& node)
+{
+    const auto parent = node.parent();
+    if (parent && node.costH() < parent->costH() && node.opcode() < operator_stats.size()) {
+        operator_stats[node.opcode()].gain_in_millionths +=
+                static_cast<std::uint64_t>(std::llround(1e6 * (parent->costH() - node.costH())));
+    }
+}
+
 // A function that does nothing and can be used as the callback parameter
 // for the AstarSearch function if no callback is needed.
 template<typename State, typename Context>
@@ -134,84 +582,390 @@ void AstarSearch(const std::shared_ptr<search::generic::Status<State, Context>>&
 
         const auto t0 = std::chrono::high_resolution_clock::now();
 
-#ifdef PROFILING_ENABLED
-        const auto filename = "search-generic-AstarSearch.prof";
-        ProfilerStart(filename);
-#endif
+        auto& profiler = Profiler::Instance();
+        if (options.profile_search) {
+            profiler.BeginSearchWindow(status.get(), options.metrics_label);
+        }
+
+        status->startPhaseTiming();
 
         OpenList<State> open(status->compute_hash);
-        ClosedList<State> closed(status->compute_hash);
+        ClosedList<State> closed(status->compute_hash, options.compact_closed_list);
+        PrunedParents<State> pruned_parents;
+
+        // Nodes are pooled per search. Chunks of pruned nodes are recycled for
+        // new ones, and the arena is released in bulk together with the last
+        // node, i.e. when the search ends and OPEN and CLOSED are destroyed.
+        const auto node_arena = std::make_shared<PoolArena>(kNodeArenaBlockSize, true);
+        // So are the payloads of the states, which would otherwise stay in the
+        // arenas of long-lived threads after the search.
+        const ScopedPoolArena payload_arena(std::make_shared<PoolArena>(kPayloadArenaBlockSize, true));
 
         const auto initial_node_and_context = status->getCurrentNodeAndContext();
         auto node = std::make_shared<Node<State>>(initial_node_and_context.first);
         auto context = initial_node_and_context.second;
 
-        node->setCostH(static_cast<float>(status->compute_cost_h(*node, context)));
-        open.pushOrUpdate(node);
+        const auto initial_hashcode = status->compute_hash(node->state());
+
+        const auto strategy = options.search_strategy;
+        float weight = 1;
+        if (strategy == SearchStrategy::kWeightedAstar || strategy == SearchStrategy::kAnytime) {
+            weight = std::max(1.0f, options.heuristic_weight);
+            open.setWeights(1, weight);
+        } else if (strategy == SearchStrategy::kGreedyRestarts) {
+            open.setWeights(0, 1);
+        }
+
+        // The cheapest goal found so far by an anytime search.
+        std::shared_ptr<Node<State>> best_goal;
+
+        // The lowest cost h popped so far by a greedy search, and the number
+        // of nodes popped since then.
+        float best_cost_h = std::numeric_limits<float>::infinity();
+        std::size_t num_stale_expansions = 0;
+
+        // The best node popped so far (see BestNodeScore), which the search
+        // ends with if it finds no goal. It is kept intact in a compact CLOSED
+        // list until a better one is found.
+        auto best_node = node;
+        double best_score = std::numeric_limits<double>::infinity();
+        std::shared_ptr<Node<State>> retained_best_node;
+
+        // All states ever inserted into OPEN, so that most new successors are
+        // recognized as such without probing OPEN and CLOSED.
+        BloomFilter known_states(kKnownStatesFilterCapacity);
+
+        std::size_t memory_in_bytes = 0;
+        if (!options.resume_filename.empty()) {
+            assert(status->load_state);
+            memory_in_bytes = RestoreFrontier(*status, ReadCheckpoint<State>(options.resume_filename,
+                    status->load_state), initial_hashcode, open, closed, pruned_parents, node_arena);
+            known_states.reset(std::max(kKnownStatesFilterCapacity, 2 * (open.size() + closed.size())));
+            const auto insert = [&known_states](HashCode hash) { known_states.insert(hash); };
+            open.forEachHash(insert);
+            closed.forEachHash(insert);
+        } else {
+            node->setCostH(static_cast<float>(status->compute_cost_h(*node, context)));
+            open.pushOrUpdate(node);
+            memory_in_bytes = EstimateNodeMemory(*status, *node);
+            known_states.insert(initial_hashcode);
+        }
 
-        tp::ThreadPool thread_pool;
+        std::unique_ptr<CheckpointWriter<State>> checkpoint_writer;
+        if (!options.checkpoint_filename.empty() && status->save_state) {
+            checkpoint_writer.reset(new CheckpointWriter<State>(options.checkpoint_filename, status->save_state));
+        }
+        const auto checkpoint_interval = std::chrono::milliseconds(options.checkpoint_interval_in_millis);
+        auto next_checkpoint_time = std::chrono::steady_clock::now() + checkpoint_interval;
 
-        while (!open.empty()) {
-            node = open.pop();
-            closed.put(node);
+        const auto executor = options.executor ? options.executor : std::make_shared<Executor>();
 
-            status->size_of_open = open.size();
-            status->size_of_closed = closed.size();
+        const auto batch_size = std::max<std::size_t>(1, options.expansion_batch_size);
+        const bool compute_cost_h_in_workers = options.compute_cost_h_in_workers || batch_size > 1;
+        std::vector<std::shared_ptr<Node<State>>> batch;
+        batch.reserve(batch_size);
+        std::vector<std::shared_ptr<Node<State>>> newly_closed;
+        newly_closed.reserve(batch_size);
 
-            if (status->num_goal_checks % options.status_update_interval == 0) {
-                status->setCurrentNodeAndContext(*node, context);
-                status->recordMemoryUsage();
+        const auto memory_check_interval = std::chrono::milliseconds(options.memory_check_interval_in_millis);
+        const auto job_memory_limit_in_bytes = options.job_memory_limit_in_mbytes * 1024 * 1024;
 
-                status->recordRuntime(t0);
-                callback(*status);
+        const auto metrics_interval = std::chrono::milliseconds(options.metrics_interval_in_millis);
+        auto next_metrics_time = std::chrono::steady_clock::now();
 
-                const auto free_memory_limit_in_kbytes = options.free_memory_limit_in_mbytes * 1024;
-                if (status->free_memory_in_kbytes < free_memory_limit_in_kbytes) {
-                    status->aborted_by_memguard = true;
+        std::unique_ptr<OperatorScheduler> scheduler;
+        if (options.adaptive_operator_scheduling) {
+            scheduler.reset(new OperatorScheduler(options.operator_exploration_rate,
+                                                  options.operator_warmup_applications,
+                                                  options.random_seed));
+        }
+
+        // Probes OPEN and CLOSED from the worker threads, which is safe since
+        // both lists are not modified while the successors are generated.
+        const std::function<SuccessorProbe(const Node<State>&)> probe = [&](const Node<State>& new_node) {
+            if (!known_states.mayContain(status->compute_hash(new_node.state()))) {
+                return SuccessorProbe::kNew;
+            }
+            float known_cost_g = 0;
+            float known_cost_h = 0;
+            if (!closed.getCosts(new_node.state(), known_cost_g, known_cost_h)) {
+                const auto open_node = open.get(new_node.state());
+                if (!open_node) {
+                    return SuccessorProbe::kNew;
                 }
+                known_cost_g = open_node->costG();
+            }
+            if (new_node.costG() < known_cost_g) {
+                return SuccessorProbe::kImproved;
             }
+            ++status->num_duplicated_states;
+            return SuccessorProbe::kDuplicate;
+        };
+
+        bool done = false;
+        while (!done && (!open.empty() || !pruned_parents.empty())) {
+            batch.clear();
+            newly_closed.clear();
+            while (batch.size() < batch_size && (!open.empty() || !pruned_parents.empty())) {
+                {
+                    SEARCH_GENERIC_TIME_PHASE(kOpenClosed);
+                    pruned_parents.reopen(open, closed);
+                    if (open.empty()) {
+                        break;
+                    }
+                    node = open.pop();
+                    if (best_goal && node->costF() >= best_goal->costG()) {
+                        // Cannot lead to a cheaper goal, assuming h is admissible.
+                        memory_in_bytes -= std::min(memory_in_bytes, EstimateNodeMemory(*status, *node));
+                        ++status->num_pruned_states;
+                        continue;
+                    }
+                    if (!closed.put(node)) {
+                        memory_in_bytes -= std::min(memory_in_bytes, EstimateNodeMemory(*status, *node));
+                    } else if (closed.compact()) {
+                        newly_closed.push_back(node);
+                    }
+                }
+
+                status->size_of_open = open.size();
+                status->size_of_closed = closed.size();
+                status->estimated_memory_in_bytes = memory_in_bytes;
+
+                if (status->num_goal_checks % options.status_update_interval == 0) {
+                    status->setCurrentNodeAndContext(*node, context);
+                    status->recordMemoryUsage(memory_check_interval);
+
+                    status->recordRuntime(t0);
+                    callback(*status);
+
+                    const auto free_memory_limit_in_kbytes = options.free_memory_limit_in_mbytes * 1024;
+                    if (status->free_memory_in_kbytes < free_memory_limit_in_kbytes) {
+                        status->aborted_by_memguard = true;
+                    }
+                }
+                if (job_memory_limit_in_bytes != 0 && memory_in_bytes > job_memory_limit_in_bytes) {
+                    status->aborted_by_memguard = true;
+                }
+
+                // The clock is only read every 64 goal checks.
+                if (options.metrics_sink && status->num_goal_checks % 64 == 0) {
+                    const auto now = std::chrono::steady_clock::now();
+                    if (now >= next_metrics_time) {
+                        next_metrics_time = now + metrics_interval;
+                        status->recordRuntime(t0);
+                        options.metrics_sink->write(
+                                status->takeMetricsSnapshot(*node, context, options.metrics_label));
+                    }
+                }
+
+                profiler.Poll(status.get(), options.metrics_label);
 
-            ++status->num_goal_checks;
-            if (status->is_goal_state(*node, context)) {
-                status->has_goal_state = true;
+                ++status->num_goal_checks;
+                bool is_goal_state;
+                {
+                    SEARCH_GENERIC_TIME_PHASE(kGoalCheck);
+                    is_goal_state = status->is_goal_state(*node, context);
+                }
+                if (is_goal_state) {
+                    status->has_goal_state = true;
+                    ++status->num_goal_states;
+                    if (strategy != SearchStrategy::kAnytime) {
+                        done = true;
+                        break;
+                    }
+                    if (!best_goal || node->costG() < best_goal->costG()) {
+                        best_goal = node;
+                        status->setCurrentNodeAndContext(*node, context);
+                        status->recordRuntime(t0);
+                        callback(*status);
+                    }
+                    if (weight <= 1) {
+                        done = true;
+                        break;
+                    }
+                    // Goals are not expanded, since their successors cannot be
+                    // cheaper goals.
+                    weight = std::max(1.0f, weight - options.anytime_weight_step);
+                    open.setWeights(1, weight);
+                    pruned_parents.reprioritize(open);
+                    continue;
+                }
+                if (!best_goal && status->is_acceptable_state && status->is_acceptable_state(*node, context)) {
+                    status->has_acceptable_state = true;
+                    done = true;
+                    break;
+                }
+
+                if (status->aborted_by_memguard || status->aborted_by_caller
+                        || ExceedsSearchBudget(*status, options, t0)) {
+                    done = true;
+                    break;
+                }
+
+                if (node->costH() < best_cost_h) {
+                    best_cost_h = node->costH();
+                    num_stale_expansions = 0;
+                } else {
+                    ++num_stale_expansions;
+                }
+                const auto score = BestNodeScore(*status, *node, context);
+                if (score < best_score) {
+                    best_score = score;
+                    best_node = node;
+                }
+
+                batch.push_back(node);
+            }
+            if (done) {
                 break;
             }
 
-            if (status->aborted_by_memguard || status->aborted_by_caller) {
-                break;
+            if (scheduler) {
+                scheduler->update(status->operator_stats);
+            }
+            const auto new_nodes = GenerateSuccessorNodes(*executor, batch, context,
+                    status->operators, status->operator_stats,
+                    compute_cost_h_in_workers ? status->compute_cost_h : nullptr, node_arena,
+                    status->prepare_expansion, scheduler.get(), probe, status->compute_cost_h_batch);
+            for (const auto& parent : batch) {
+                status->recordBranching(std::count_if(new_nodes.begin(), new_nodes.end(),
+                        [&parent](const std::shared_ptr<Node<State>>& n) { return n->parent() == parent; }));
             }
 
-            const auto new_nodes = GenerateSuccessorNodes(thread_pool, node, context,
-                    status->operators, status->operator_stats);
-            status->recordBranching(new_nodes.size());
+            // Merge all successors of the batch into OPEN and CLOSED.
             for (const auto& new_node : new_nodes) {
-                if (closed.contains(new_node->state())) {
-                    auto closedNode = closed.get(new_node->state());
-                    if (new_node->costG() < closedNode->costG()) {
-                        closed.pop(closedNode);
-                        open.pushOrUpdate(new_node);
+                SEARCH_GENERIC_TIME_PHASE(kOpenClosed);
+                float closed_cost_g = 0;
+                float closed_cost_h = 0;
+                if (closed.getCosts(new_node->state(), closed_cost_g, closed_cost_h)) {
+                    if (new_node->costG() < closed_cost_g) {
+                        const auto closed_bytes = closed.compact()
+                                ? EstimateCompactEntryMemory<State>()
+                                : EstimateNodeMemory(*status, *closed.get(new_node->state()));
+                        closed.pop(new_node->state());
+                        memory_in_bytes -= std::min(memory_in_bytes, closed_bytes);
+                        if (!compute_cost_h_in_workers) {
+                            SEARCH_GENERIC_TIME_PHASE(kCostH);
+                            new_node->setCostH(status->compute_cost_h(*new_node, context));
+                        }
+                        if (open.pushOrUpdate(new_node)) {
+                            memory_in_bytes += EstimateNodeMemory(*status, *new_node);
+                        }
+                        RecordOperatorGain(status->operator_stats, *new_node);
                         ++status->num_reopened_states;
                     } else {
                         ++status->num_duplicated_states;
                     }
-                } else {
-                    new_node->setCostH(status->compute_cost_h(*new_node, context));
-                    if (!open.pushOrUpdate(new_node)) {
+                } else if (const auto open_node = open.get(new_node->state())) {
+                    if (new_node->costG() < open_node->costG()) {
+                        if (!compute_cost_h_in_workers) {
+                            SEARCH_GENERIC_TIME_PHASE(kCostH);
+                            new_node->setCostH(status->compute_cost_h(*new_node, context));
+                        }
+                        open.pushOrUpdate(new_node);
+                    } else {
                         ++status->num_duplicated_states;
-                    } else if (open.size() > 40000) {
-                        // TODO: don't hardcode this
-                        open.clear(10);
-                        closed.clear(open.begin(), open.end());
                     }
+                } else {
+                    // Successors that were not dropped by the probe got their
+                    // cost h computed in the workers already.
+                    if (!compute_cost_h_in_workers) {
+                        SEARCH_GENERIC_TIME_PHASE(kCostH);
+                        new_node->setCostH(status->compute_cost_h(*new_node, context));
+                    }
+                    open.pushOrUpdate(new_node);
+                    known_states.insert(status->compute_hash(new_node->state()));
+                    memory_in_bytes += EstimateNodeMemory(*status, *new_node);
+                    RecordOperatorGain(status->operator_stats, *new_node);
                 }
             }
+
+            // Rebuild the filter once it is full, which also drops the states
+            // that have been pruned since the last rebuild.
+            if (known_states.size() > known_states.capacity()) {
+                SEARCH_GENERIC_TIME_PHASE(kDuplicateDetection);
+                known_states.reset(2 * (open.size() + closed.size()));
+                const auto insert = [&known_states](HashCode hash) { known_states.insert(hash); };
+                open.forEachHash(insert);
+                closed.forEachHash(insert);
+            }
+
+            // Expanded nodes in a compact CLOSED list are only needed as path
+            // records. The last one is kept intact if the search is about to
+            // end, since it becomes the current node of the status, and so is
+            // the best node until it is superseded.
+            const auto release_closed_node = [&](const std::shared_ptr<Node<State>>& closed_node) {
+                memory_in_bytes -= std::min(memory_in_bytes, EstimateNodeMemory(*status, *closed_node));
+                memory_in_bytes += EstimateCompactEntryMemory<State>();
+                if (status->release_state) {
+                    closed_node->releaseState(status->release_state);
+                }
+            };
+            if (retained_best_node && retained_best_node != best_node) {
+                release_closed_node(retained_best_node);
+                retained_best_node.reset();
+            }
+            for (const auto& closed_node : newly_closed) {
+                if ((closed_node == node && open.empty() && pruned_parents.empty()) || closed_node == best_goal) {
+                    continue;
+                }
+                if (closed_node == best_node) {
+                    retained_best_node = closed_node;
+                    continue;
+                }
+                release_closed_node(closed_node);
+            }
+
+            {
+                SEARCH_GENERIC_TIME_PHASE(kPruning);
+                EnforceSearchBounds(*status, options, open, closed, pruned_parents, memory_in_bytes);
+            }
+
+            if (strategy == SearchStrategy::kGreedyRestarts && options.restart_interval != 0
+                    && num_stale_expansions >= options.restart_interval) {
+                SEARCH_GENERIC_TIME_PHASE(kOpenClosed);
+                ++status->num_restarts;
+                num_stale_expansions = 0;
+                open.clear();
+                closed.clear();
+                pruned_parents.clear();
+                // The best node is no longer in CLOSED, so it stays intact.
+                retained_best_node.reset();
+                open.setTieBreaking(options.restart_noise, options.random_seed + status->num_restarts);
+                // The initial node may have been released in a compact CLOSED list.
+                const auto initial_node = std::make_shared<Node<State>>(initial_node_and_context.first);
+                initial_node->setCostH(static_cast<float>(status->compute_cost_h(*initial_node, context)));
+                open.pushOrUpdate(initial_node);
+                memory_in_bytes = EstimateNodeMemory(*status, *initial_node);
+                known_states.reset(kKnownStatesFilterCapacity);
+                known_states.insert(initial_hashcode);
+            }
+
+            if (checkpoint_writer && std::chrono::steady_clock::now() >= next_checkpoint_time) {
+                SEARCH_GENERIC_TIME_PHASE(kCheckpoint);
+                checkpoint_writer->submit(TakeFrontier(*status, initial_hashcode, open, closed, pruned_parents));
+                next_checkpoint_time = std::chrono::steady_clock::now() + checkpoint_interval;
+            }
         }
 
-#ifdef PROFILING_ENABLED
-        ProfilerStop();
-        std::cout << "Now you can display the profiled data via\n"
-                  << "google-pprof --evince <executable> " << filename << std::endl;
-#endif
+        // If the search was aborted, the nodes popped in the last iteration have
+        // not been expanded yet, so they are written as part of OPEN.
+        if (checkpoint_writer && (status->aborted_by_caller || status->aborted_by_memguard)) {
+            SEARCH_GENERIC_TIME_PHASE(kCheckpoint);
+            batch.push_back(node);
+            checkpoint_writer->submit(TakeFrontier(*status, initial_hashcode, open, closed, pruned_parents, batch));
+        }
+        if (checkpoint_writer && !checkpoint_writer->flush()) {
+            status->error_message = "Could not write checkpoint '" + options.checkpoint_filename + "'";
+        }
+
+        // An anytime search ends with the cheapest goal, even if it was aborted.
+        // Without a goal or an acceptable state, it ends with the best node.
+        if (best_goal) {
+            node = best_goal;
+        } else if (!status->has_goal_state && !status->has_acceptable_state) {
+            node = best_node;
+        }
 
         status->open_list = std::move(open);
         status->closed_list = std::move(closed);
@@ -221,12 +975,18 @@ void AstarSearch(const std::shared_ptr<search::generic::Status<State, Context>>&
         status->recordMemoryUsage();
 
         status->recordRuntime(t0);
+        if (options.metrics_sink) {
+            auto snapshot = status->takeMetricsSnapshot(*node, context, options.metrics_label);
+            snapshot.finished = true;
+            options.metrics_sink->write(snapshot);
+        }
     } catch (std::exception& error) {
         status->error_message = error.what();
     } catch (...) {
         status->error_message = "Caught something not derived from std::exception";
     }
 
+    Profiler::Instance().EndSearch(status.get());
     status->finished = true;
     status->notifyOne();
 }
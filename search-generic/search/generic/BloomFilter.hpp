@@ -0,0 +1,97 @@
+// BloomFilter.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_BLOOM_FILTER_HPP
+#define SEARCH_GENERIC_BLOOM_FILTER_HPP
+
+#include <cstdint>
+#include <vector>
+#include "search/generic/Node.hpp"
+
+namespace search {
+namespace generic {
+
+// A Bloom filter over state hash codes, used to tell cheaply that a state has
+// never been seen, i.e. is neither in OPEN nor in CLOSED.
+//
+// Queries may return false positives, but never false negatives. Entries
+// cannot be removed, so states that left both lists (e.g. by pruning) remain
+// false positives until the filter is rebuilt. Concurrent queries are safe as
+// long as no thread inserts at the same time.
+class BloomFilter {
+public:
+    // Creates a filter for the given number of entries, which yields less
+    // than 3% false positives with 8 bits and 4 probes per entry.
+    explicit BloomFilter(std::size_t capacity = 0)
+    {
+        reset(capacity);
+    }
+
+    // Removes all entries and resizes the filter for the given capacity.
+    void reset(std::size_t capacity)
+    {
+        std::size_t num_words = kMinWords;
+        while (num_words * 64 < capacity * kBitsPerEntry) {
+            num_words *= 2;
+        }
+        words_.assign(num_words, 0);
+        mask_ = num_words * 64 - 1;
+        capacity_ = capacity;
+        size_ = 0;
+    }
+
+    void insert(HashCode hash)
+    {
+        auto h1 = hash;
+        const auto h2 = Mix(hash) | 1;
+        for (std::size_t i = 0; i < kNumProbes; ++i, h1 += h2) {
+            words_[(h1 & mask_) / 64] |= std::uint64_t(1) << (h1 % 64);
+        }
+        ++size_;
+    }
+
+    bool mayContain(HashCode hash) const
+    {
+        auto h1 = hash;
+        const auto h2 = Mix(hash) | 1;
+        for (std::size_t i = 0; i < kNumProbes; ++i, h1 += h2) {
+            if ((words_[(h1 & mask_) / 64] & (std::uint64_t(1) << (h1 % 64))) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Returns the number of insertions since the last reset.
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+private:
+    static constexpr std::size_t kBitsPerEntry = 8;
+    static constexpr std::size_t kNumProbes = 4;
+    static constexpr std::size_t kMinWords = 1024;
+
+    static HashCode Mix(HashCode hash)
+    {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    std::vector<std::uint64_t> words_;
+    HashCode mask_ = 0;
+    std::size_t capacity_ = 0;
+    std::size_t size_ = 0;
+};
+
+}  // namespace generic
+}  // namespace search
+
+#endif  // SEARCH_GENERIC_BLOOM_FILTER_HPP
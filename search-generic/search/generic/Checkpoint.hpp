@@ -0,0 +1,467 @@
+// Checkpoint.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_CHECKPOINT_HPP
+#define SEARCH_GENERIC_CHECKPOINT_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "search/generic/ClosedList.hpp"
+#include "search/generic/Node.hpp"
+#include "search/generic/OpenList.hpp"
+#include "search/generic/PrunedParents.hpp"
+#include "search/generic/Status.hpp"
+
+namespace search {
+namespace generic {
+
+// A node of a Frontier. Parents precede their children, so a parent is
+// referenced by its index in Frontier::nodes.
+template<typename State>
+struct FrontierNode {
+    static constexpr std::uint32_t kNoParent = 0xffffffff;
+
+    // Flags telling in which list the node is. A node in neither list is only
+    // a path record of its descendants.
+    static constexpr std::uint8_t kOpen = 1;
+    static constexpr std::uint8_t kClosed = 2;
+
+    // Only valid if the node is in OPEN or CLOSED, since the states of path
+    // records may have been released.
+    HashCode hashcode;
+    std::uint32_t parent;
+    float cost_g;
+    float cost_h;
+    std::uint8_t opcode;
+    std::uint8_t flags;
+    State state;
+};
+
+template<typename State>
+constexpr std::uint32_t FrontierNode<State>::kNoParent;
+
+template<typename State>
+constexpr std::uint8_t FrontierNode<State>::kOpen;
+
+template<typename State>
+constexpr std::uint8_t FrontierNode<State>::kClosed;
+
+// An expanded state of which only the hashcode and costs are kept.
+struct FrontierEntry {
+    HashCode hashcode;
+    float cost_g;
+    float cost_h;
+};
+
+// A parent in CLOSED whose pruned children have backed up their cost f to it
+// (see PrunedParents). The node is referenced by its index in Frontier::nodes,
+// which holds its cost g, so the backed-up cost f is cost g + cost h.
+struct FrontierBackup {
+    std::uint32_t node;
+    float cost_h;
+};
+
+// A copy of everything needed to resume a search: the nodes in OPEN along
+// with their ancestors, the hashcodes and costs of all other states in CLOSED,
+// the pending backups of pruned parents, and the counters of the status. A frontier shares no mutable data with the
+// search it was taken from, so it can be written by another thread while the
+// search goes on (see CheckpointWriter).
+template<typename State>
+struct Frontier {
+    HashCode initial_hashcode = 0;
+    std::vector<FrontierNode<State>> nodes;
+    std::vector<FrontierEntry> closed;
+    std::vector<FrontierBackup> pruned_parents;
+    std::uint64_t num_goal_checks = 0;
+    std::uint64_t num_duplicated_states = 0;
+    std::uint64_t num_reopened_states = 0;
+    std::uint64_t num_pruned_states = 0;
+    std::vector<OperatorStats> operator_stats;
+};
+
+// Takes a frontier of a search between two iterations, i.e. while no operator
+// tasks are running. The states are copied, which is cheap if they share their
+// payload with the originals (as e.g. persistent strings do). The remaining
+// work of a checkpoint, i.e. serializing the states and writing the file, is
+// left to the thread that writes the frontier.
+//
+// Nodes that have been popped from OPEN but not expanded yet can be given as
+// unexpanded, so that they are written as part of OPEN.
+//
+// The parents with pending backups are recorded along with their ancestors,
+// so that their pruned subtrees are regenerated after the search is resumed.
+template<typename State, typename Context>
+Frontier<State> TakeFrontier(const Status<State, Context>& status, HashCode initial_hashcode,
+                             const OpenList<State>& open, const ClosedList<State>& closed,
+                             const PrunedParents<State>& pruned_parents,
+                             const std::vector<std::shared_ptr<Node<State>>>& unexpanded =
+                                     std::vector<std::shared_ptr<Node<State>>>())
+{
+    typedef FrontierNode<State> Record;
+
+    // The states of path records in a compact list may have been released, so
+    // their hashcodes are looked up by node identity.
+    std::unordered_map<const Node<State>*, HashCode> closed_hashcodes;
+    if (closed.compact()) {
+        closed.forEachEntry([&closed_hashcodes](HashCode hashcode, float, float, const Node<State>* node) {
+            if (node != nullptr) {
+                closed_hashcodes.emplace(node, hashcode);
+            }
+        });
+    } else {
+        for (const auto& entry : closed) {
+            closed_hashcodes.emplace(entry.second.get(), entry.first);
+        }
+    }
+
+    Frontier<State> frontier;
+    frontier.initial_hashcode = initial_hashcode;
+    frontier.nodes.reserve(open.size());
+    std::unordered_map<const Node<State>*, std::uint32_t> indices;
+    std::vector<const Node<State>*> chain;
+    const auto record_chain = [&](const Node<State>* open_node, bool in_open) {
+        // Walk up to the first ancestor that is already recorded and record
+        // the chain below it from the top down.
+        chain.clear();
+        for (auto n = open_node; n != nullptr && indices.count(n) == 0; n = n->parent().get()) {
+            chain.push_back(n);
+        }
+        for (auto n = chain.rbegin(); n != chain.rend(); ++n) {
+            const auto parent = (*n)->parent().get();
+            Record record = {0, parent ? indices.at(parent) : Record::kNoParent,
+                             (*n)->costG(), (*n)->costH(), (*n)->opcode(), 0, (*n)->state()};
+            if (*n == open_node && in_open) {
+                record.hashcode = status.compute_hash((*n)->state());
+                record.flags = Record::kOpen;
+            } else {
+                const auto hashcode = closed_hashcodes.find(*n);
+                if (hashcode != closed_hashcodes.end()) {
+                    record.hashcode = hashcode->second;
+                    record.flags = Record::kClosed;
+                }
+            }
+            indices.emplace(*n, static_cast<std::uint32_t>(frontier.nodes.size()));
+            frontier.nodes.push_back(std::move(record));
+        }
+    };
+    // Unexpanded nodes come first, since they may also be ancestors of nodes
+    // in OPEN if they have been reopened.
+    for (const auto& node : unexpanded) {
+        record_chain(node.get(), true);
+    }
+    for (const auto& node : open) {
+        record_chain(node.get(), true);
+    }
+    // A parent that has left CLOSED meanwhile is skipped, as in
+    // PrunedParents::reopen().
+    pruned_parents.forEach([&](const std::shared_ptr<Node<State>>& parent, float cost_h) {
+        if (closed_hashcodes.count(parent.get()) != 0) {
+            record_chain(parent.get(), false);
+            frontier.pruned_parents.push_back({indices.at(parent.get()), cost_h});
+        }
+    });
+
+    const auto add_entry = [&frontier, &indices](HashCode hashcode, float cost_g, float cost_h,
+                                                 const Node<State>* node) {
+        if (node == nullptr || indices.count(node) == 0) {
+            frontier.closed.push_back({hashcode, cost_g, cost_h});
+        }
+    };
+    if (closed.compact()) {
+        closed.forEachEntry(add_entry);
+    } else {
+        for (const auto& entry : closed) {
+            add_entry(entry.first, entry.second->costG(), entry.second->costH(), entry.second.get());
+        }
+    }
+
+    frontier.num_goal_checks = status.num_goal_checks;
+    frontier.num_duplicated_states = status.num_duplicated_states;
+    frontier.num_reopened_states = status.num_reopened_states;
+    frontier.num_pruned_states = status.num_pruned_states;
+    frontier.operator_stats = status.operator_stats;
+    return frontier;
+}
+
+// Binary checkpoint format. All values are stored in host byte order.
+//
+// Header (see CheckpointHeader).
+// Operator stats: 5 x uint64 per operator (see OperatorStats).
+// Nodes: hashcode (uint64), parent (uint32), cost g and h (float), opcode and
+//        flags (uint8), followed by the state as written by save_state.
+// Closed entries: hashcode (uint64), cost g and h (float).
+// Pruned parents: node index (uint32), backed-up cost h (float).
+struct CheckpointHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t num_operators;
+    std::uint64_t initial_hashcode;
+    std::uint64_t num_nodes;
+    std::uint64_t num_closed;
+    std::uint64_t num_pruned_parents;
+    std::uint64_t num_goal_checks;
+    std::uint64_t num_duplicated_states;
+    std::uint64_t num_reopened_states;
+    std::uint64_t num_pruned_states;
+};
+
+static constexpr char kCheckpointMagic[8] = {'S', 'G', 'C', 'H', 'K', 'P', 'N', 'T'};
+static constexpr std::uint32_t kCheckpointVersion = 2;
+
+template<typename T>
+void WriteCheckpointValue(std::ostream& os, const T& value)
+{
+    os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+T ReadCheckpointValue(std::istream& is)
+{
+    T value;
+    if (!is.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+        throw std::runtime_error("Unexpected end of checkpoint");
+    }
+    return value;
+}
+
+// Writes a frontier to a stream. Each state is written by save_state.
+template<typename State>
+void WriteFrontier(std::ostream& os, const Frontier<State>& frontier,
+                   const std::function<void(const State&, std::ostream&)>& save_state)
+{
+    CheckpointHeader header;
+    std::copy(std::begin(kCheckpointMagic), std::end(kCheckpointMagic), header.magic);
+    header.version = kCheckpointVersion;
+    header.num_operators = static_cast<std::uint32_t>(frontier.operator_stats.size());
+    header.initial_hashcode = frontier.initial_hashcode;
+    header.num_nodes = frontier.nodes.size();
+    header.num_closed = frontier.closed.size();
+    header.num_pruned_parents = frontier.pruned_parents.size();
+    header.num_goal_checks = frontier.num_goal_checks;
+    header.num_duplicated_states = frontier.num_duplicated_states;
+    header.num_reopened_states = frontier.num_reopened_states;
+    header.num_pruned_states = frontier.num_pruned_states;
+    WriteCheckpointValue(os, header);
+
+    for (const auto& stats : frontier.operator_stats) {
+        WriteCheckpointValue<std::uint64_t>(os, stats.num_applications);
+        WriteCheckpointValue<std::uint64_t>(os, stats.num_skipped_applications);
+        WriteCheckpointValue<std::uint64_t>(os, stats.num_generated_states);
+        WriteCheckpointValue<std::uint64_t>(os, stats.runtime_in_micros);
+        WriteCheckpointValue<std::uint64_t>(os, stats.gain_in_millionths);
+    }
+    for (const auto& record : frontier.nodes) {
+        WriteCheckpointValue(os, record.hashcode);
+        WriteCheckpointValue(os, record.parent);
+        WriteCheckpointValue(os, record.cost_g);
+        WriteCheckpointValue(os, record.cost_h);
+        WriteCheckpointValue(os, record.opcode);
+        WriteCheckpointValue(os, record.flags);
+        save_state(record.state, os);
+    }
+    for (const auto& entry : frontier.closed) {
+        WriteCheckpointValue(os, entry.hashcode);
+        WriteCheckpointValue(os, entry.cost_g);
+        WriteCheckpointValue(os, entry.cost_h);
+    }
+    for (const auto& backup : frontier.pruned_parents) {
+        WriteCheckpointValue(os, backup.node);
+        WriteCheckpointValue(os, backup.cost_h);
+    }
+}
+
+// Reads a frontier written by WriteFrontier. Each state is read by load_state.
+// Throws std::runtime_error if the checkpoint is malformed.
+template<typename State>
+Frontier<State> ReadFrontier(std::istream& is, const std::function<State(std::istream&)>& load_state)
+{
+    const auto header = ReadCheckpointValue<CheckpointHeader>(is);
+    if (!std::equal(std::begin(kCheckpointMagic), std::end(kCheckpointMagic), header.magic)
+            || header.version != kCheckpointVersion) {
+        throw std::runtime_error("Not a checkpoint or unsupported checkpoint version");
+    }
+
+    Frontier<State> frontier;
+    frontier.initial_hashcode = header.initial_hashcode;
+    frontier.num_goal_checks = header.num_goal_checks;
+    frontier.num_duplicated_states = header.num_duplicated_states;
+    frontier.num_reopened_states = header.num_reopened_states;
+    frontier.num_pruned_states = header.num_pruned_states;
+
+    frontier.operator_stats.resize(header.num_operators);
+    for (auto& stats : frontier.operator_stats) {
+        stats.num_applications = ReadCheckpointValue<std::uint64_t>(is);
+        stats.num_skipped_applications = ReadCheckpointValue<std::uint64_t>(is);
+        stats.num_generated_states = ReadCheckpointValue<std::uint64_t>(is);
+        stats.runtime_in_micros = ReadCheckpointValue<std::uint64_t>(is);
+        stats.gain_in_millionths = ReadCheckpointValue<std::uint64_t>(is);
+    }
+
+    frontier.nodes.reserve(header.num_nodes);
+    for (std::uint64_t i = 0; i < header.num_nodes; ++i) {
+        const auto hashcode = ReadCheckpointValue<HashCode>(is);
+        const auto parent = ReadCheckpointValue<std::uint32_t>(is);
+        const auto cost_g = ReadCheckpointValue<float>(is);
+        const auto cost_h = ReadCheckpointValue<float>(is);
+        const auto opcode = ReadCheckpointValue<std::uint8_t>(is);
+        const auto flags = ReadCheckpointValue<std::uint8_t>(is);
+        if (parent != FrontierNode<State>::kNoParent && parent >= i) {
+            throw std::runtime_error("Checkpoint node precedes its parent");
+        }
+        frontier.nodes.push_back({hashcode, parent, cost_g, cost_h, opcode, flags, load_state(is)});
+    }
+
+    frontier.closed.reserve(header.num_closed);
+    for (std::uint64_t i = 0; i < header.num_closed; ++i) {
+        const auto hashcode = ReadCheckpointValue<HashCode>(is);
+        const auto cost_g = ReadCheckpointValue<float>(is);
+        const auto cost_h = ReadCheckpointValue<float>(is);
+        frontier.closed.push_back({hashcode, cost_g, cost_h});
+    }
+
+    frontier.pruned_parents.reserve(header.num_pruned_parents);
+    for (std::uint64_t i = 0; i < header.num_pruned_parents; ++i) {
+        const auto node = ReadCheckpointValue<std::uint32_t>(is);
+        const auto cost_h = ReadCheckpointValue<float>(is);
+        if (node >= frontier.nodes.size()) {
+            throw std::runtime_error("Checkpoint backup refers to an unknown node");
+        }
+        frontier.pruned_parents.push_back({node, cost_h});
+    }
+    return frontier;
+}
+
+// Reads a frontier from a checkpoint file (see ReadFrontier).
+template<typename State>
+Frontier<State> ReadCheckpoint(const std::string& filename,
+                               const std::function<State(std::istream&)>& load_state)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Could not open checkpoint '" + filename + "'");
+    }
+    return ReadFrontier(ifs, load_state);
+}
+
+// Writes frontiers to a checkpoint file from a background thread, so that the
+// search only pays for taking the frontier. A frontier submitted while another
+// one is being written replaces a pending one that has not been written yet.
+// Each checkpoint is written to a temporary file, which then replaces the
+// checkpoint file, so a preempted process always leaves a complete checkpoint.
+template<typename State>
+class CheckpointWriter {
+public:
+    CheckpointWriter(std::string filename, std::function<void(const State&, std::ostream&)> save_state)
+            : filename_(std::move(filename)),
+              save_state_(std::move(save_state)),
+              worker_(&CheckpointWriter::work, this)
+    {
+    }
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    // Writes the pending frontier, if any, before the writer thread stops.
+    ~CheckpointWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        pending_condition_.notify_one();
+        worker_.join();
+    }
+
+    void submit(Frontier<State>&& frontier)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.reset(new Frontier<State>(std::move(frontier)));
+            ++num_submitted_;
+        }
+        pending_condition_.notify_one();
+    }
+
+    // Waits until all frontiers submitted so far have been written or replaced.
+    // Returns whether the last checkpoint was written successfully.
+    bool flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const auto num_submitted = num_submitted_;
+        written_condition_.wait(lock, [this, num_submitted] { return num_finished_ >= num_submitted; });
+        return !last_write_failed_;
+    }
+
+private:
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            pending_condition_.wait(lock, [this] { return stop_ || pending_; });
+            if (!pending_) {
+                return;
+            }
+            const std::unique_ptr<Frontier<State>> frontier = std::move(pending_);
+            const auto num_submitted = num_submitted_;
+
+            lock.unlock();
+            const bool success = write(*frontier);
+            lock.lock();
+
+            last_write_failed_ = !success;
+            num_finished_ = num_submitted;
+            written_condition_.notify_all();
+        }
+    }
+
+    bool write(const Frontier<State>& frontier) const
+    {
+        const auto tmp_filename = filename_ + ".tmp";
+        try {
+            std::ofstream ofs(tmp_filename, std::ios::binary | std::ios::trunc);
+            WriteFrontier(ofs, frontier, save_state_);
+            ofs.close();
+            if (!ofs) {
+                std::remove(tmp_filename.c_str());
+                return false;
+            }
+        } catch (...) {
+            std::remove(tmp_filename.c_str());
+            return false;
+        }
+        return std::rename(tmp_filename.c_str(), filename_.c_str()) == 0;
+    }
+
+    std::string filename_;
+    std::function<void(const State&, std::ostream&)> save_state_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable pending_condition_;
+    std::condition_variable written_condition_;
+    std::unique_ptr<Frontier<State>> pending_;
+    std::size_t num_submitted_ = 0;
+    std::size_t num_finished_ = 0;
+    bool last_write_failed_ = false;
+    bool stop_ = false;
+
+    std::thread worker_;
+};
+
+}  // namespace generic
+}  // namespace search
+
+#endif  // SEARCH_GENERIC_CHECKPOINT_HPP
@@ -5,6 +5,7 @@
 
 #include <functional>
 #include <memory>
+#include <unordered_map>
 #include <unordered_set>
 #include "search/generic/Node.hpp"
 
@@ -21,14 +22,26 @@ namespace generic {
 // 1. Put a node/state into the list.
 // 2. Check if a given state (!) is contained.
 //
-// Note: If memory usage is really an issue it would be sufficient to store
-// only a state's hashcode in the list rather than the entire node. However,
-// in this case you are not able to derive graph information anymore.
+// If memory usage is really an issue a compact list can be used, which stores
+// only a state's hashcode and costs rather than the entire node. Graph
+// information must then be derived from the parent pointers of the nodes
+// still in OPEN, which serve as path records (see Node::releaseState). A
+// compact list has no nodes to return from get() or to iterate over.
 template<typename State>
 class ClosedList {
 
     typedef std::shared_ptr<search::generic::Node<State>> SharedNode;
-    typedef std::unordered_map<std::string, SharedNode> Map;
+    typedef std::unordered_map<HashCode, SharedNode> Map;
+
+    // The node is only used to identify path records in clear(), it is never
+    // dereferenced, since the entry does not keep it alive.
+    struct CompactEntry {
+        float cost_g;
+        float cost_h;
+        const Node<State>* node;
+    };
+
+    typedef std::unordered_map<HashCode, CompactEntry> CompactMap;
 
 public:
     // A default instance is not usable due to the empty compute_hash_ member.
@@ -44,11 +57,16 @@ public:
 
     ClosedList& operator=(const ClosedList&) = delete;
 
-    explicit ClosedList(std::function<std::string(const State&)> compute_hash)
-            : compute_hash_(compute_hash)
+    explicit ClosedList(std::function<HashCode(const State&)> compute_hash, bool compact = false)
+            : compute_hash_(compute_hash), compact_(compact)
     {
     }
 
+    bool compact() const
+    {
+        return compact_;
+    }
+
     typename Map::const_iterator begin() const
     {
         return nodes_.begin();
@@ -61,20 +79,49 @@ public:
 
     bool put(const SharedNode& node)
     {
-        const auto hashcode = compute_hash_(node->state());
+        return put(compute_hash_(node->state()), node);
+    }
+
+    // Puts a node under the given hashcode, which need not be computable from
+    // its state, e.g. for a path record restored from a checkpoint.
+    bool put(HashCode hashcode, const SharedNode& node)
+    {
+        if (compact_) {
+            const CompactEntry entry = {node->costG(), node->costH(), node.get()};
+            return entries_.insert(std::make_pair(hashcode, entry)).second;
+        }
         return nodes_.insert(std::make_pair(hashcode, node)).second;
     }
 
+    // Puts the costs of a state into a compact list. The node, if any, is
+    // the path record of the state (see clear()).
+    bool putEntry(HashCode hashcode, float cost_g, float cost_h, const Node<State>* node = nullptr)
+    {
+        assert(compact_);
+        const CompactEntry entry = {cost_g, cost_h, node};
+        return entries_.insert(std::make_pair(hashcode, entry)).second;
+    }
+
     void pop(const SharedNode& node)
     {
-        auto pos = nodes_.find(compute_hash_(node->state()));
-        if (pos != nodes_.end()) {
-            nodes_.erase(pos);
+        pop(node->state());
+    }
+
+    void pop(const State& state)
+    {
+        if (compact_) {
+            entries_.erase(compute_hash_(state));
+        } else {
+            nodes_.erase(compute_hash_(state));
         }
     }
 
+    // Always returns nullptr for a compact list.
     SharedNode get(const State& state) const
     {
+        if (compact_) {
+            return nullptr;
+        }
         auto node = nodes_.find(compute_hash_(state));
         if (node == nodes_.end()) {
             return nullptr;
@@ -83,30 +130,78 @@ public:
         return node->second;
     }
 
+    // Provides the costs g and h of the given state when it was closed.
+    // Returns false if the state is not contained.
+    bool getCosts(const State& state, float& cost_g, float& cost_h) const
+    {
+        const auto hashcode = compute_hash_(state);
+        if (compact_) {
+            const auto entry = entries_.find(hashcode);
+            if (entry == entries_.end()) {
+                return false;
+            }
+            cost_g = entry->second.cost_g;
+            cost_h = entry->second.cost_h;
+            return true;
+        }
+        const auto node = nodes_.find(hashcode);
+        if (node == nodes_.end()) {
+            return false;
+        }
+        cost_g = node->second->costG();
+        cost_h = node->second->costH();
+        return true;
+    }
+
     bool contains(const State& state) const
     {
-        return nodes_.find(compute_hash_(state)) != nodes_.end();
+        const auto hashcode = compute_hash_(state);
+        return compact_ ? entries_.count(hashcode) != 0 : nodes_.count(hashcode) != 0;
+    }
+
+    // Calls f with the hash code of each contained state.
+    template<typename Function>
+    void forEachHash(Function f) const
+    {
+        for (const auto& entry : nodes_) {
+            f(entry.first);
+        }
+        for (const auto& entry : entries_) {
+            f(entry.first);
+        }
+    }
+
+    // Calls f with the hash code, the costs g and h, and the path record node
+    // of each entry of a compact list. The node must not be dereferenced.
+    template<typename Function>
+    void forEachEntry(Function f) const
+    {
+        for (const auto& entry : entries_) {
+            f(entry.first, entry.second.cost_g, entry.second.cost_h, entry.second.node);
+        }
     }
 
     std::size_t size() const
     {
-        return nodes_.size();
+        return compact_ ? entries_.size() : nodes_.size();
     }
 
     bool empty() const
     {
-        return nodes_.empty();
+        return size() == 0;
     }
 
     void clear()
     {
         nodes_.clear();
+        entries_.clear();
     }
 
     /**
      * Clear the CLOSED list, but keep parents of the SharedNodes in the given range.
      * The top-level nodes directly pointed at by the iterator range will not be kept as they
-     * are expected to be on OPEN.
+     * are expected to be on OPEN. Ancestor chains are walked only up to the first node that
+     * was already visited, so prefixes shared by many nodes are hashed once.
      *
      * @param keepBegin iterator to beginning of SharedNode range to retain
      * @param keepEnd iterator past the end of the SharedNode range
@@ -114,25 +209,62 @@ public:
     template<typename SharedNodeIterator>
     void clear(SharedNodeIterator keepBegin, SharedNodeIterator keepEnd)
     {
+        if (compact_) {
+            clearCompact(keepBegin, keepEnd);
+            return;
+        }
+
         Map newMap;
+        std::unordered_set<const Node<State>*> visited;
 
         for (SharedNodeIterator i = keepBegin; i != keepEnd; ++i) {
             if (*i == nullptr) {
                 continue;
             }
 
-            SharedNode keepNode = (*i)->parent();
-            do {
+            for (SharedNode keepNode = (*i)->parent(); keepNode != nullptr; keepNode = keepNode->parent()) {
+                if (!visited.insert(keepNode.get()).second) {
+                    break;
+                }
                 newMap.insert(std::make_pair(compute_hash_(keepNode->state()), keepNode));
-            } while ((keepNode = keepNode->parent()) != nullptr);
+            }
         }
 
-        nodes_ = newMap;
+        nodes_ = std::move(newMap);
     }
 
 private:
-    std::function<std::string(const State&)> compute_hash_;
+    // The states of path records may have been released, so entries are kept
+    // by node identity rather than by recomputing hashcodes.
+    template<typename SharedNodeIterator>
+    void clearCompact(SharedNodeIterator keepBegin, SharedNodeIterator keepEnd)
+    {
+        std::unordered_set<const Node<State>*> keep;
+        for (SharedNodeIterator i = keepBegin; i != keepEnd; ++i) {
+            if (*i == nullptr) {
+                continue;
+            }
+
+            for (auto keepNode = (*i)->parent().get(); keepNode != nullptr; keepNode = keepNode->parent().get()) {
+                if (!keep.insert(keepNode).second) {
+                    break;
+                }
+            }
+        }
+
+        for (auto entry = entries_.begin(); entry != entries_.end();) {
+            if (keep.count(entry->second.node) == 0) {
+                entry = entries_.erase(entry);
+            } else {
+                ++entry;
+            }
+        }
+    }
+
+    std::function<HashCode(const State&)> compute_hash_;
+    bool compact_ = false;
     Map nodes_;
+    CompactMap entries_;
 };
 
 }  // namespace generic
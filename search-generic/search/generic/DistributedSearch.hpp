@@ -0,0 +1,495 @@
+// DistributedSearch.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_DISTRIBUTED_SEARCH_HPP
+#define SEARCH_GENERIC_DISTRIBUTED_SEARCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "search/generic/AstarSearch.hpp"
+#include "search/generic/Checkpoint.hpp"
+#include "search/generic/HdaSearch.hpp"
+
+namespace search {
+namespace generic {
+
+// Exchanges messages between the processes (ranks) of a DistributedSearch.
+// Each rank runs the same search on its own host, and messages between two
+// ranks must be delivered in the order they were sent. A transport is only
+// used by the search thread of its rank.
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    // The index of this process in [0, size()).
+    virtual std::size_t rank() const = 0;
+
+    virtual std::size_t size() const = 0;
+
+    // Queues a message for sending without blocking.
+    virtual void send(std::size_t rank, std::string message) = 0;
+
+    // Takes the next received message, if any, without blocking.
+    virtual bool receive(std::size_t& rank, std::string& message) = 0;
+
+    // Number of bytes queued by send but not written yet.
+    virtual std::size_t backlog() const = 0;
+};
+
+// Types of the messages of a DistributedSearch. Each message starts with its
+// type, followed by:
+enum class DistributedMessage : std::uint8_t {
+    kNodes = 1,   // The number of nodes and the nodes (see WriteRemoteNode).
+    kProbe = 2,   // The number of a termination wave.
+    kReport = 3,  // The wave, the idle flag, and the sent and received counts.
+    kStop = 4     // Whether a goal is attached, and if so the goal node.
+};
+
+// Writes a node to be sent to another rank. The state is written by
+// save_state, i.e. usually as a delta against the initial state, which every
+// rank has. The parent is not sent, since it stays on the sending rank.
+template<typename State, typename Context>
+void WriteRemoteNode(const Status<State, Context>& status, const Node<State>& node, std::ostream& os)
+{
+    WriteCheckpointValue<float>(os, node.costG());
+    WriteCheckpointValue<float>(os, node.costH());
+    WriteCheckpointValue<std::uint32_t>(os, static_cast<std::uint32_t>(node.depth()));
+    WriteCheckpointValue<std::uint8_t>(os, node.opcode());
+    status.save_state(node.state(), os);
+}
+
+template<typename State, typename Context>
+std::shared_ptr<Node<State>> ReadRemoteNode(const Status<State, Context>& status, std::istream& is,
+                                            const std::shared_ptr<PoolArena>& node_arena)
+{
+    const auto cost_g = ReadCheckpointValue<float>(is);
+    const auto cost_h = ReadCheckpointValue<float>(is);
+    const auto depth = ReadCheckpointValue<std::uint32_t>(is);
+    const auto opcode = ReadCheckpointValue<std::uint8_t>(is);
+    return std::allocate_shared<Node<State>>(PoolAllocator<Node<State>>(node_arena),
+            status.load_state(is), depth, opcode, cost_g, cost_h);
+}
+
+// The termination report of a rank (see DistributedSearch).
+struct DistributedReport {
+    bool idle = false;
+    std::uint64_t num_sent = 0;
+    std::uint64_t num_received = 0;
+
+    bool operator==(const DistributedReport& other) const
+    {
+        return idle == other.idle && num_sent == other.num_sent && num_received == other.num_received;
+    }
+};
+
+// A function that runs HDA* across processes, which usually run on separate
+// hosts (see Options::transport). It takes the same arguments as AstarSearch
+// and runs on each rank with the same initial node and context.
+//
+// Each rank owns the states whose hashcode maps to it (see HdaOwner) with its
+// own OPEN and CLOSED lists, so the frontier is bounded by the memory of all
+// ranks together. Successors of other ranks are evaluated by the sender and
+// sent in batches of Options::transport_batch_size nodes. While more than
+// Options::transport_max_backlog_in_bytes are queued for sending, a rank only
+// receives, which throttles ranks that produce faster than their peers can
+// take. Nodes arrive without their parents, so the path of a goal can only be
+// followed back to the rank it was received on.
+//
+// Rank 0 detects termination by waves of probes: Each rank reports whether it
+// is idle (OPEN is empty and all nodes are sent) and how many nodes it has
+// sent and received. If two consecutive waves yield the same reports, all of
+// them idle, and as many nodes sent as received in total, no node is in
+// flight, and the search space is exhausted. A goal, an abort, or the end of
+// the search is broadcast to all ranks, which then stop. The goal is attached,
+// so that each rank ends with the goal as its current node. Otherwise, the
+// current node is the best expanded node of the rank (see BestNodeScore), or the
+// acceptable state that ended the search (see Status::is_acceptable_state) on
+// the rank that found it. Time and expansion budgets apply per rank.
+//
+// Requires Status::save_state and Status::load_state. Status counters and the
+// callback are local to each rank. Search strategies only select the priority
+// of the nodes in OPEN (see HdaSearch), and checkpoints are not supported.
+template<typename State, typename Context>
+void DistributedSearch(const std::shared_ptr<search::generic::Status<State, Context>>& status,
+                       std::function<void(const search::generic::Status<State, Context>&)> callback,
+                       const Options& options = Options())
+{
+    try {
+        assert(status->operators.size() == status->operator_stats.size());
+        assert(status->init_memory_in_kbytes != 0);
+        assert(status->compute_hash);
+        assert(status->compute_cost_h);
+        assert(status->is_goal_state);
+
+        if (!options.transport) {
+            throw std::runtime_error("DistributedSearch requires a transport");
+        }
+        if (!status->save_state || !status->load_state) {
+            throw std::runtime_error("DistributedSearch requires save_state and load_state");
+        }
+        if (!options.checkpoint_filename.empty() || !options.resume_filename.empty()) {
+            throw std::runtime_error("DistributedSearch does not support checkpoints");
+        }
+
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        status->startPhaseTiming();
+        if (options.profile_search) {
+            Profiler::Instance().BeginSearchWindow(status.get(), options.metrics_label);
+        }
+
+        auto& transport = *options.transport;
+        const auto self = transport.rank();
+        const auto num_ranks = transport.size();
+
+        HdaWorker<State> worker(status->compute_hash, options.compact_closed_list);
+        auto& open = worker.open;
+        auto& closed = worker.closed;
+        const auto strategy = options.search_strategy;
+        if (strategy == SearchStrategy::kWeightedAstar || strategy == SearchStrategy::kAnytime) {
+            open.setWeights(1, std::max(1.0f, options.heuristic_weight));
+        } else if (strategy == SearchStrategy::kGreedyRestarts) {
+            open.setWeights(0, 1);
+        }
+
+        const auto node_arena = std::make_shared<PoolArena>(kNodeArenaBlockSize, true);
+        const ScopedPoolArena payload_arena(std::make_shared<PoolArena>(kPayloadArenaBlockSize, true));
+
+        const auto initial_node_and_context = status->getCurrentNodeAndContext();
+        auto node = std::make_shared<Node<State>>(initial_node_and_context.first);
+        auto context = initial_node_and_context.second;
+        node->setCostH(static_cast<float>(status->compute_cost_h(*node, context)));
+        if (HdaOwner(status->compute_hash(node->state()), num_ranks) == self) {
+            open.pushOrUpdate(node);
+            worker.memory_in_bytes = EstimateNodeMemory(*status, *node);
+        }
+        auto best = node;
+        auto best_score = std::numeric_limits<double>::infinity();
+        // The best node, if it has been expanded into a compact CLOSED list.
+        // Its state is only released once it is superseded, since it is the
+        // result of a search that ends without a goal.
+        std::shared_ptr<Node<State>> retained_best_node;
+
+        const auto executor = options.executor ? options.executor : std::make_shared<Executor>();
+
+        std::unique_ptr<OperatorScheduler> scheduler;
+        if (options.adaptive_operator_scheduling) {
+            scheduler.reset(new OperatorScheduler(options.operator_exploration_rate,
+                                                  options.operator_warmup_applications,
+                                                  options.random_seed + self));
+        }
+
+        const auto batch_size = std::max<std::size_t>(1, options.transport_batch_size);
+        std::vector<std::ostringstream> outboxes(num_ranks);
+        std::vector<std::uint32_t> outbox_sizes(num_ranks, 0);
+        DistributedReport report;
+
+        const auto flush = [&](std::size_t rank) {
+            if (outbox_sizes[rank] == 0) {
+                return;
+            }
+            std::ostringstream message;
+            WriteCheckpointValue(message, DistributedMessage::kNodes);
+            WriteCheckpointValue(message, outbox_sizes[rank]);
+            message << outboxes[rank].str();
+            transport.send(rank, message.str());
+            report.num_sent += outbox_sizes[rank];
+            outboxes[rank].str(std::string());
+            outbox_sizes[rank] = 0;
+        };
+        const auto flush_all = [&] {
+            for (std::size_t rank = 0; rank < num_ranks; ++rank) {
+                flush(rank);
+            }
+        };
+        const auto broadcast = [&](const std::string& message) {
+            for (std::size_t rank = 0; rank < num_ranks; ++rank) {
+                if (rank != self) {
+                    transport.send(rank, message);
+                }
+            }
+        };
+        const auto broadcast_stop = [&](const Node<State>* goal) {
+            std::ostringstream message;
+            WriteCheckpointValue(message, DistributedMessage::kStop);
+            WriteCheckpointValue<std::uint8_t>(message, goal != nullptr);
+            if (goal) {
+                WriteRemoteNode(*status, *goal, message);
+            }
+            broadcast(message.str());
+        };
+
+        // The termination waves of rank 0.
+        std::uint64_t wave = 0;
+        bool wave_running = false;
+        std::vector<DistributedReport> reports(num_ranks);
+        std::vector<DistributedReport> previous_reports;
+        std::size_t num_reports = 0;
+        const auto wave_interval = std::chrono::milliseconds(10);
+        auto next_wave_time = std::chrono::steady_clock::now();
+
+        const auto flush_interval = std::chrono::milliseconds(5);
+        auto next_flush_time = std::chrono::steady_clock::now() + flush_interval;
+
+        const auto memory_check_interval = std::chrono::milliseconds(options.memory_check_interval_in_millis);
+        const auto job_memory_limit_in_bytes = options.job_memory_limit_in_mbytes * 1024 * 1024;
+        const auto metrics_interval = std::chrono::milliseconds(options.metrics_interval_in_millis);
+        auto next_metrics_time = std::chrono::steady_clock::now();
+
+        std::shared_ptr<Node<State>> goal;
+        bool idle = false;
+        bool stopped = false;
+        std::vector<std::shared_ptr<Node<State>>> batch(1);
+        while (!stopped) {
+            std::size_t from = 0;
+            std::string message;
+            while (!stopped && transport.receive(from, message)) {
+                std::istringstream is(message);
+                switch (ReadCheckpointValue<DistributedMessage>(is)) {
+                    case DistributedMessage::kNodes: {
+                        const auto count = ReadCheckpointValue<std::uint32_t>(is);
+                        for (std::uint32_t i = 0; i < count; ++i) {
+                            MergeHdaSuccessor(*status, worker, ReadRemoteNode(*status, is, node_arena),
+                                              context, false);
+                        }
+                        report.num_received += count;
+                        break;
+                    }
+                    case DistributedMessage::kProbe: {
+                        std::ostringstream reply;
+                        WriteCheckpointValue(reply, DistributedMessage::kReport);
+                        WriteCheckpointValue(reply, ReadCheckpointValue<std::uint64_t>(is));
+                        WriteCheckpointValue<std::uint8_t>(reply, open.empty() && idle);
+                        WriteCheckpointValue(reply, report.num_sent);
+                        WriteCheckpointValue(reply, report.num_received);
+                        transport.send(from, reply.str());
+                        break;
+                    }
+                    case DistributedMessage::kReport: {
+                        if (ReadCheckpointValue<std::uint64_t>(is) == wave && from < num_ranks) {
+                            reports[from].idle = ReadCheckpointValue<std::uint8_t>(is) != 0;
+                            reports[from].num_sent = ReadCheckpointValue<std::uint64_t>(is);
+                            reports[from].num_received = ReadCheckpointValue<std::uint64_t>(is);
+                            ++num_reports;
+                        }
+                        break;
+                    }
+                    case DistributedMessage::kStop: {
+                        if (ReadCheckpointValue<std::uint8_t>(is) != 0) {
+                            goal = ReadRemoteNode(*status, is, node_arena);
+                            status->has_goal_state = true;
+                        }
+                        stopped = true;
+                        break;
+                    }
+                    default:
+                        throw std::runtime_error("Received a malformed message");
+                }
+            }
+            if (stopped) {
+                break;
+            }
+
+            if (status->aborted_by_memguard || status->aborted_by_caller || ExceedsSearchBudget(*status, options, t0)) {
+                broadcast_stop(nullptr);
+                break;
+            }
+
+            {
+                SEARCH_GENERIC_TIME_PHASE(kOpenClosed);
+                worker.pruned_parents.reopen(open, closed);
+            }
+
+            // Nodes are only counted as sent once they are handed to the
+            // transport, so idle ranks must not keep any.
+            if (open.empty()) {
+                flush_all();
+                idle = true;
+            }
+
+            if (self == 0) {
+                const auto now = std::chrono::steady_clock::now();
+                if (!wave_running && now >= next_wave_time) {
+                    ++wave;
+                    wave_running = true;
+                    num_reports = 1;
+                    reports[0] = DistributedReport{open.empty() && idle, report.num_sent, report.num_received};
+                    std::ostringstream probe;
+                    WriteCheckpointValue(probe, DistributedMessage::kProbe);
+                    WriteCheckpointValue(probe, wave);
+                    broadcast(probe.str());
+                }
+                if (wave_running && num_reports == num_ranks) {
+                    wave_running = false;
+                    next_wave_time = now + wave_interval;
+                    std::uint64_t num_sent = 0;
+                    std::uint64_t num_received = 0;
+                    bool all_idle = true;
+                    for (const auto& rank_report : reports) {
+                        num_sent += rank_report.num_sent;
+                        num_received += rank_report.num_received;
+                        all_idle = all_idle && rank_report.idle;
+                    }
+                    if (all_idle && num_sent == num_received && reports == previous_reports) {
+                        broadcast_stop(nullptr);
+                        break;
+                    }
+                    previous_reports = reports;
+                }
+            }
+
+            if (open.empty() || transport.backlog() > options.transport_max_backlog_in_bytes) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            idle = false;
+
+            node = open.pop();
+            {
+                SEARCH_GENERIC_TIME_PHASE(kOpenClosed);
+                if (!closed.put(node)) {
+                    worker.memory_in_bytes -= std::min(worker.memory_in_bytes, EstimateNodeMemory(*status, *node));
+                }
+            }
+            const auto score = BestNodeScore(*status, *node, context);
+            if (score < best_score) {
+                best_score = score;
+                best = node;
+                if (retained_best_node && status->release_state) {
+                    retained_best_node->releaseState(status->release_state);
+                }
+                retained_best_node.reset();
+            }
+
+            status->size_of_open = open.size();
+            status->size_of_closed = closed.size();
+            status->estimated_memory_in_bytes = worker.memory_in_bytes;
+
+            if (status->num_goal_checks % options.status_update_interval == 0) {
+                status->setCurrentNodeAndContext(*node, context);
+                status->recordMemoryUsage(memory_check_interval);
+                status->recordRuntime(t0);
+                callback(*status);
+                if (status->free_memory_in_kbytes < options.free_memory_limit_in_mbytes * 1024) {
+                    status->aborted_by_memguard = true;
+                }
+            }
+            if (job_memory_limit_in_bytes != 0 && worker.memory_in_bytes > job_memory_limit_in_bytes) {
+                status->aborted_by_memguard = true;
+            }
+            if (options.metrics_sink && status->num_goal_checks % 64 == 0) {
+                const auto now = std::chrono::steady_clock::now();
+                if (now >= next_metrics_time) {
+                    next_metrics_time = now + metrics_interval;
+                    status->recordRuntime(t0);
+                    options.metrics_sink->write(status->takeMetricsSnapshot(*node, context, options.metrics_label));
+                }
+            }
+            Profiler::Instance().Poll(status.get(), options.metrics_label);
+
+            ++status->num_goal_checks;
+            bool is_goal_state;
+            {
+                SEARCH_GENERIC_TIME_PHASE(kGoalCheck);
+                is_goal_state = status->is_goal_state(*node, context);
+            }
+            if (is_goal_state) {
+                goal = node;
+                status->has_goal_state = true;
+                broadcast_stop(goal.get());
+                break;
+            }
+            if (status->is_acceptable_state && status->is_acceptable_state(*node, context)) {
+                best = node;
+                status->has_acceptable_state = true;
+                broadcast_stop(nullptr);
+                break;
+            }
+
+            // The cost h of all successors is computed here, since the parent
+            // of a node is not available on the rank it is sent to.
+            if (scheduler) {
+                scheduler->update(status->operator_stats);
+            }
+            batch.front() = node;
+            const auto new_nodes = GenerateSuccessorNodes<State, Context>(*executor, batch, context,
+                    status->operators, status->operator_stats, status->compute_cost_h, node_arena,
+                    status->prepare_expansion, scheduler.get(), nullptr, status->compute_cost_h_batch);
+            status->recordBranching(new_nodes.size());
+
+            for (const auto& new_node : new_nodes) {
+                const auto owner = HdaOwner(status->compute_hash(new_node->state()), num_ranks);
+                if (owner == self) {
+                    MergeHdaSuccessor(*status, worker, new_node, context, false);
+                    continue;
+                }
+                WriteRemoteNode(*status, *new_node, outboxes[owner]);
+                if (++outbox_sizes[owner] >= batch_size) {
+                    flush(owner);
+                }
+            }
+            if (std::chrono::steady_clock::now() >= next_flush_time) {
+                flush_all();
+                next_flush_time = std::chrono::steady_clock::now() + flush_interval;
+            }
+
+            if (closed.compact()) {
+                worker.memory_in_bytes -= std::min(worker.memory_in_bytes, EstimateNodeMemory(*status, *node));
+                worker.memory_in_bytes += EstimateCompactEntryMemory<State>();
+                if (node == best) {
+                    retained_best_node = node;
+                } else if (status->release_state) {
+                    node->releaseState(status->release_state);
+                }
+            }
+
+            {
+                SEARCH_GENERIC_TIME_PHASE(kPruning);
+                EnforceSearchBounds(*status, options, open, closed, worker.pruned_parents, worker.memory_in_bytes);
+            }
+        }
+
+        node = goal ? goal : best;
+        status->size_of_open = open.size();
+        status->size_of_closed = closed.size();
+        status->estimated_memory_in_bytes = worker.memory_in_bytes;
+        status->setCurrentNodeAndContext(*node, context);
+        status->recordMemoryUsage();
+
+        status->recordRuntime(t0);
+        if (options.metrics_sink) {
+            auto snapshot = status->takeMetricsSnapshot(*node, context, options.metrics_label);
+            snapshot.finished = true;
+            options.metrics_sink->write(snapshot);
+        }
+    } catch (std::exception& error) {
+        status->error_message = error.what();
+    } catch (...) {
+        status->error_message = "Caught something not derived from std::exception";
+    }
+
+    Profiler::Instance().EndSearch(status.get());
+    status->finished = true;
+    status->notifyOne();
+}
+
+// A function that runs the DistributedSearch function asynchroniously (see
+// AstarSearchAsync).
+template<typename State, typename Context>
+void DistributedSearchAsync(const std::shared_ptr<search::generic::Status<State, Context>>& status,
+                            std::function<void(const search::generic::Status<State, Context>&)> callback,
+                            const Options& options = Options())
+{
+    std::thread thread(DistributedSearch<State, Context>, status, callback, options);
+    thread.detach();
+}
+
+}  // namespace generic
+}  // namespace search
+
+#endif  // SEARCH_GENERIC_DISTRIBUTED_SEARCH_HPP
@@ -0,0 +1,213 @@
+// Executor.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_EXECUTOR_HPP
+#define SEARCH_GENERIC_EXECUTOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "thread_pool/thread_pool.hpp"
+
+namespace search {
+namespace generic {
+
+// A synchronization primitive that blocks waiting threads until countDown
+// has been called a given number of times. Unlike futures, a latch does not
+// allocate shared state per task.
+class CountdownLatch {
+public:
+    explicit CountdownLatch(std::size_t count)
+            : count_(count)
+    {
+    }
+
+    CountdownLatch(const CountdownLatch&) = delete;
+
+    CountdownLatch& operator=(const CountdownLatch&) = delete;
+
+    void countDown(std::size_t n = 1)
+    {
+        if (count_.fetch_sub(n, std::memory_order_acq_rel) == n) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            condition_.notify_all();
+        }
+    }
+
+    bool done() const
+    {
+        return count_.load(std::memory_order_acquire) == 0;
+    }
+
+    void wait()
+    {
+        if (done()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this] { return done(); });
+    }
+
+private:
+    std::atomic_size_t count_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+};
+
+// A thread pool wrapper that runs batches of indexed tasks. An executor is
+// meant to be created once and shared by any number of concurrent searches
+// (see Options::executor), so that threads are not spawned per search.
+//
+// Concurrent searches can also be given shares of one executor (see share),
+// which run their batches on the same threads, but with separate limits on
+// the number of threads used at a time. This way, a host-level scheduler can
+// divide the threads between searches of different priority.
+//
+// Note: The calling thread of parallelFor takes part in processing its batch,
+// hence a batch always makes progress even if all pool threads are busy with
+// other batches. However, parallelFor must not be called from a pool thread.
+class Executor {
+public:
+    // A thread count of 0 means one thread per hardware thread.
+    explicit Executor(std::size_t num_threads = 0)
+            : pool_(std::make_shared<Pool>(num_threads != 0 ? num_threads
+                                                            : std::max(1u, std::thread::hardware_concurrency()))),
+              max_threads_(pool_->num_threads)
+    {
+    }
+
+    Executor(const Executor&) = delete;
+
+    Executor& operator=(const Executor&) = delete;
+
+    // Returns the number of threads of the pool, which is shared by all
+    // shares of an executor.
+    std::size_t numThreads() const
+    {
+        return pool_->num_threads;
+    }
+
+    // Returns the maximum number of pool threads that help with a batch.
+    std::size_t maxThreads() const
+    {
+        return max_threads_.load(std::memory_order_relaxed);
+    }
+
+    // Sets the maximum number of pool threads that help with a batch. Batches
+    // that are already being processed are not affected.
+    void setMaxThreads(std::size_t max_threads)
+    {
+        max_threads_.store(std::min(max_threads, pool_->num_threads), std::memory_order_relaxed);
+    }
+
+    // Returns a new executor that uses the threads of this one, but at most
+    // max_threads of them per batch. The pool is kept alive by all shares.
+    std::shared_ptr<Executor> share(std::size_t max_threads) const
+    {
+        return std::shared_ptr<Executor>(new Executor(pool_, std::min(max_threads, pool_->num_threads)));
+    }
+
+    // Calls task(i) for each i in [0, num_tasks) and blocks until all calls
+    // have been completed. The first exception thrown by a task is rethrown.
+    template<typename Task>
+    void parallelFor(std::size_t num_tasks, const Task& task)
+    {
+        if (num_tasks == 0) {
+            return;
+        }
+
+        auto batch = std::make_shared<Batch>(num_tasks, &task, &Batch::template Invoke<Task>);
+        const auto num_helpers = std::min(num_tasks - 1, maxThreads());
+        for (std::size_t i = 0; i < num_helpers; ++i) {
+            // A helper holds the batch alive, since it may start after all
+            // tasks have been processed and parallelFor has returned.
+            if (!pool_->thread_pool.tryPost([batch] { batch->process(); })) {
+                break;
+            }
+        }
+        batch->process();
+        batch->done.wait();
+
+        if (batch->error) {
+            std::rethrow_exception(batch->error);
+        }
+    }
+
+private:
+    struct Batch {
+        typedef void (*Invoker)(const void*, std::size_t);
+
+        template<typename Task>
+        static void Invoke(const void* task, std::size_t index)
+        {
+            (*static_cast<const Task*>(task))(index);
+        }
+
+        Batch(std::size_t num_tasks, const void* task, Invoker invoke)
+                : next(0), num_tasks(num_tasks), task(task), invoke(invoke), done(num_tasks)
+        {
+        }
+
+        // Claims and runs tasks until none is left. The task pointer is
+        // only dereferenced for claimed indices, which keeps it valid.
+        void process()
+        {
+            std::size_t index;
+            while ((index = next.fetch_add(1, std::memory_order_relaxed)) < num_tasks) {
+                try {
+                    invoke(task, index);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+                done.countDown();
+            }
+        }
+
+        std::atomic_size_t next;
+        const std::size_t num_tasks;
+        const void* const task;
+        const Invoker invoke;
+        CountdownLatch done;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    // The threads of an executor and all of its shares.
+    struct Pool {
+        explicit Pool(std::size_t num_threads)
+                : num_threads(num_threads), thread_pool(MakeOptions(num_threads))
+        {
+        }
+
+        const std::size_t num_threads;
+        tp::ThreadPool thread_pool;
+    };
+
+    Executor(std::shared_ptr<Pool> pool, std::size_t max_threads)
+            : pool_(std::move(pool)), max_threads_(max_threads)
+    {
+    }
+
+    static tp::ThreadPoolOptions MakeOptions(std::size_t num_threads)
+    {
+        tp::ThreadPoolOptions options;
+        options.setThreadCount(num_threads);
+        return options;
+    }
+
+    const std::shared_ptr<Pool> pool_;
+    std::atomic_size_t max_threads_;
+};
+
+}  // namespace generic
+}  // namespace search
+
+#endif  // SEARCH_GENERIC_EXECUTOR_HPP
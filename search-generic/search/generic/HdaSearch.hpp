@@ -0,0 +1,540 @@
+// HdaSearch.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_HDA_SEARCH_HPP
+#define SEARCH_GENERIC_HDA_SEARCH_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "search/generic/AstarSearch.hpp"
+#include "thread_pool/mpmc_bounded_queue.hpp"
+
+namespace search {
+namespace generic {
+
+// Capacity of the queue of successors sent to a worker of HdaSearch. Must be
+// a power of 2. A sender whose target queue is full merges its own queue
+// until there is space again, which bounds the nodes in flight.
+static constexpr std::size_t kHdaInboxCapacity = 16 * 1024;
+
+// Returns the worker that owns a state with the given hashcode. The hashcode
+// is mixed first, since the low bits of weak state hashes may be correlated.
+inline std::size_t HdaOwner(HashCode hashcode, std::size_t num_workers)
+{
+    hashcode ^= hashcode >> 33;
+    hashcode *= 0xff51afd7ed558ccdULL;
+    hashcode ^= hashcode >> 33;
+    return hashcode % num_workers;
+}
+
+// The partition of a worker of HdaSearch, i.e. OPEN and CLOSED for the states
+// it owns, plus the queue of successors sent to it by the other workers. The
+// lists are only accessed by the worker's own thread.
+template<typename State>
+struct HdaWorker {
+    HdaWorker(const std::function<HashCode(const State&)>& compute_hash, bool compact_closed_list)
+            : open(compute_hash), closed(compute_hash, compact_closed_list), inbox(kHdaInboxCapacity)
+    {
+    }
+
+    OpenList<State> open;
+    ClosedList<State> closed;
+    PrunedParents<State> pruned_parents;
+    tp::MPMCBoundedQueue<std::shared_ptr<Node<State>>> inbox;
+    std::size_t memory_in_bytes = 0;
+
+    // Copies of the sizes above for the status updates of other workers.
+    std::atomic_size_t size_of_open{0};
+    std::atomic_size_t size_of_closed{0};
+    std::atomic_size_t estimated_memory_in_bytes{0};
+};
+
+// State shared by all workers of HdaSearch.
+//
+// Termination is detected by counting messages: A worker counts itself as
+// idle while its OPEN and its queue are empty, and it only leaves the idle
+// state after it took a message from its queue, which is counted as received
+// once it has been merged. Hence, if all workers are idle and the number of
+// sent and received messages has been equal and unchanged while reading the
+// idle count, there was no message in flight, and no worker can become busy
+// again.
+template<typename State>
+struct HdaShared {
+    std::atomic_bool done{false};
+    std::atomic_size_t num_idle{0};
+    std::atomic_uint_fast64_t num_sent{0};
+    std::atomic_uint_fast64_t num_received{0};
+
+    // The goal state found first, or otherwise the acceptable state found
+    // first, or otherwise the best node that was expanded (see BestNodeScore).
+    std::mutex result_mutex;
+    std::shared_ptr<Node<State>> goal;
+    std::shared_ptr<Node<State>> acceptable;
+    std::shared_ptr<Node<State>> best;
+    std::atomic<double> best_score{std::numeric_limits<double>::infinity()};
+    // The best node, once its expansion into a compact CLOSED list is done.
+    // Its state is released by the worker that supersedes it rather than by
+    // its own worker, so that a search without a goal ends with an intact
+    // best node.
+    std::shared_ptr<Node<State>> retained_best;
+
+    // Serializes status updates and callbacks.
+    std::mutex status_mutex;
+    std::chrono::steady_clock::time_point next_metrics_time;
+
+    bool terminated(std::size_t num_workers) const
+    {
+        const auto sent = num_sent.load();
+        const auto received = num_received.load();
+        return sent == received && num_idle.load() == num_workers
+               && num_sent.load() == sent && num_received.load() == received;
+    }
+};
+
+// Merges a successor into the partition of the worker that owns it. If
+// compute_cost_h is set, the cost h is computed for successors that are not
+// dropped as duplicates, otherwise the cost h of the node is kept.
+template<typename State, typename Context>
+void MergeHdaSuccessor(Status<State, Context>& status, HdaWorker<State>& worker,
+                       const std::shared_ptr<Node<State>>& new_node, const Context& context,
+                       bool compute_cost_h = true)
+{
+    SEARCH_GENERIC_TIME_PHASE(kOpenClosed);
+    auto& open = worker.open;
+    auto& closed = worker.closed;
+    float closed_cost_g = 0;
+    float closed_cost_h = 0;
+    if (closed.getCosts(new_node->state(), closed_cost_g, closed_cost_h)) {
+        if (new_node->costG() < closed_cost_g) {
+            const auto closed_bytes = closed.compact()
+                    ? EstimateCompactEntryMemory<State>()
+                    : EstimateNodeMemory(status, *closed.get(new_node->state()));
+            closed.pop(new_node->state());
+            worker.memory_in_bytes -= std::min(worker.memory_in_bytes, closed_bytes);
+            if (compute_cost_h) {
+                SEARCH_GENERIC_TIME_PHASE(kCostH);
+                new_node->setCostH(static_cast<float>(status.compute_cost_h(*new_node, context)));
+            }
+            if (open.pushOrUpdate(new_node)) {
+                worker.memory_in_bytes += EstimateNodeMemory(status, *new_node);
+            }
+            RecordOperatorGain(status.operator_stats, *new_node);
+            ++status.num_reopened_states;
+        } else {
+            ++status.num_duplicated_states;
+        }
+    } else if (const auto open_node = open.get(new_node->state())) {
+        if (new_node->costG() < open_node->costG()) {
+            if (compute_cost_h) {
+                SEARCH_GENERIC_TIME_PHASE(kCostH);
+                new_node->setCostH(static_cast<float>(status.compute_cost_h(*new_node, context)));
+            }
+            open.pushOrUpdate(new_node);
+        } else {
+            ++status.num_duplicated_states;
+        }
+    } else {
+        if (compute_cost_h) {
+            SEARCH_GENERIC_TIME_PHASE(kCostH);
+            new_node->setCostH(static_cast<float>(status.compute_cost_h(*new_node, context)));
+        }
+        open.pushOrUpdate(new_node);
+        worker.memory_in_bytes += EstimateNodeMemory(status, *new_node);
+        RecordOperatorGain(status.operator_stats, *new_node);
+    }
+}
+
+// Merges all successors in the queue of a worker. Returns false if the queue
+// was empty.
+template<typename State, typename Context>
+bool DrainHdaInbox(Status<State, Context>& status, HdaWorker<State>& worker, HdaShared<State>& shared,
+                   const Context& context, bool& idle)
+{
+    std::shared_ptr<Node<State>> new_node;
+    bool received = false;
+    while (worker.inbox.pop(new_node)) {
+        if (idle) {
+            idle = false;
+            --shared.num_idle;
+        }
+        MergeHdaSuccessor(status, worker, new_node, context);
+        new_node.reset();
+        ++shared.num_received;
+        received = true;
+    }
+    return received;
+}
+
+// Sums up the sizes of the partitions of all workers in the status.
+template<typename State, typename Context>
+void CollectHdaSizes(Status<State, Context>& status, const std::vector<std::unique_ptr<HdaWorker<State>>>& workers)
+{
+    std::size_t size_of_open = 0;
+    std::size_t size_of_closed = 0;
+    std::size_t memory_in_bytes = 0;
+    for (const auto& worker : workers) {
+        size_of_open += worker->size_of_open;
+        size_of_closed += worker->size_of_closed;
+        memory_in_bytes += worker->estimated_memory_in_bytes;
+    }
+    status.size_of_open = size_of_open;
+    status.size_of_closed = size_of_closed;
+    status.estimated_memory_in_bytes = memory_in_bytes;
+}
+
+// Updates the status from a worker every 64 goal checks, and invokes the
+// callback if the update interval has been reached.
+template<typename State, typename Context>
+void UpdateHdaStatus(Status<State, Context>& status,
+                     const std::function<void(const Status<State, Context>&)>& callback,
+                     const Options& options, const std::vector<std::unique_ptr<HdaWorker<State>>>& workers,
+                     HdaShared<State>& shared, const Node<State>& node, const Context& context,
+                     const std::chrono::high_resolution_clock::time_point& t0, bool invoke_callback)
+{
+    std::lock_guard<std::mutex> lock(shared.status_mutex);
+    CollectHdaSizes(status, workers);
+
+    const auto job_memory_limit_in_bytes = options.job_memory_limit_in_mbytes * 1024 * 1024;
+    if (job_memory_limit_in_bytes != 0 && status.estimated_memory_in_bytes > job_memory_limit_in_bytes) {
+        status.aborted_by_memguard = true;
+    }
+
+    if (invoke_callback) {
+        status.setCurrentNodeAndContext(node, context);
+        status.recordMemoryUsage(std::chrono::milliseconds(options.memory_check_interval_in_millis));
+        status.recordRuntime(t0);
+        callback(status);
+        if (status.free_memory_in_kbytes < options.free_memory_limit_in_mbytes * 1024) {
+            status.aborted_by_memguard = true;
+        }
+    }
+
+    Profiler::Instance().Poll(&status, options.metrics_label);
+
+    if (options.metrics_sink) {
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= shared.next_metrics_time) {
+            shared.next_metrics_time = now + std::chrono::milliseconds(options.metrics_interval_in_millis);
+            status.recordRuntime(t0);
+            options.metrics_sink->write(status.takeMetricsSnapshot(node, context, options.metrics_label));
+        }
+    }
+}
+
+// The loop of a worker of HdaSearch, which expands the nodes of its own
+// partition in best-first order and sends each successor to its owner.
+template<typename State, typename Context>
+void RunHdaWorker(std::size_t self, Status<State, Context>& status,
+                  const std::function<void(const Status<State, Context>&)>& callback,
+                  const Options& options, const Options& partition_options,
+                  const std::vector<std::unique_ptr<HdaWorker<State>>>& workers,
+                  HdaShared<State>& shared, Context& context, Executor& executor,
+                  const std::shared_ptr<PoolArena>& node_arena,
+                  const std::chrono::high_resolution_clock::time_point& t0)
+{
+    auto& worker = *workers[self];
+    auto& open = worker.open;
+    auto& closed = worker.closed;
+
+    std::unique_ptr<OperatorScheduler> scheduler;
+    if (options.adaptive_operator_scheduling) {
+        scheduler.reset(new OperatorScheduler(options.operator_exploration_rate,
+                                              options.operator_warmup_applications,
+                                              options.random_seed + self));
+    }
+
+    const auto publish_sizes = [&worker] {
+        worker.size_of_open = worker.open.size();
+        worker.size_of_closed = worker.closed.size();
+        worker.estimated_memory_in_bytes = worker.memory_in_bytes;
+    };
+
+    bool idle = false;
+    std::size_t num_idle_rounds = 0;
+    std::vector<std::shared_ptr<Node<State>>> batch(1);
+    while (!shared.done) {
+        DrainHdaInbox(status, worker, shared, context, idle);
+        {
+            SEARCH_GENERIC_TIME_PHASE(kOpenClosed);
+            worker.pruned_parents.reopen(open, closed);
+        }
+
+        if (open.empty()) {
+            publish_sizes();
+            if (!idle) {
+                idle = true;
+                ++shared.num_idle;
+            }
+            if (shared.terminated(workers.size())) {
+                shared.done = true;
+                break;
+            }
+            // Spin shortly before backing off, since new successors usually
+            // arrive within microseconds.
+            if (++num_idle_rounds < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            continue;
+        }
+        num_idle_rounds = 0;
+
+        auto& node = batch.front();
+        {
+            SEARCH_GENERIC_TIME_PHASE(kOpenClosed);
+            node = open.pop();
+            if (!closed.put(node)) {
+                worker.memory_in_bytes -= std::min(worker.memory_in_bytes, EstimateNodeMemory(status, *node));
+            }
+        }
+        publish_sizes();
+
+        const auto score = BestNodeScore(status, *node, context);
+        if (score < shared.best_score) {
+            std::lock_guard<std::mutex> lock(shared.result_mutex);
+            if (score < shared.best_score) {
+                shared.best_score = score;
+                shared.best = node;
+                if (shared.retained_best && status.release_state) {
+                    shared.retained_best->releaseState(status.release_state);
+                }
+                shared.retained_best.reset();
+            }
+        }
+
+        const auto num_goal_checks = status.num_goal_checks++;
+        if (num_goal_checks % options.status_update_interval == 0) {
+            UpdateHdaStatus(status, callback, options, workers, shared, *node, context, t0, true);
+        } else if (num_goal_checks % 64 == 0) {
+            UpdateHdaStatus(status, callback, options, workers, shared, *node, context, t0, false);
+        }
+
+        bool is_goal_state;
+        {
+            SEARCH_GENERIC_TIME_PHASE(kGoalCheck);
+            is_goal_state = status.is_goal_state(*node, context);
+        }
+        if (is_goal_state) {
+            std::lock_guard<std::mutex> lock(shared.result_mutex);
+            if (!shared.goal) {
+                shared.goal = node;
+                status.has_goal_state = true;
+                ++status.num_goal_states;
+            }
+            shared.done = true;
+            break;
+        }
+        if (status.is_acceptable_state && status.is_acceptable_state(*node, context)) {
+            std::lock_guard<std::mutex> lock(shared.result_mutex);
+            if (!shared.goal && !shared.acceptable) {
+                shared.acceptable = node;
+                status.has_acceptable_state = true;
+            }
+            shared.done = true;
+            break;
+        }
+        if (status.aborted_by_memguard || status.aborted_by_caller || ExceedsSearchBudget(status, options, t0)) {
+            shared.done = true;
+            break;
+        }
+
+        if (scheduler) {
+            scheduler->update(status.operator_stats);
+        }
+        const auto new_nodes = GenerateSuccessorNodes<State, Context>(executor, batch, context,
+                status.operators, status.operator_stats, nullptr, node_arena,
+                status.prepare_expansion, scheduler.get());
+        status.recordBranching(new_nodes.size());
+
+        for (const auto& new_node : new_nodes) {
+            const auto owner = HdaOwner(status.compute_hash(new_node->state()), workers.size());
+            if (owner == self) {
+                MergeHdaSuccessor(status, worker, new_node, context);
+                continue;
+            }
+            ++shared.num_sent;
+            while (!workers[owner]->inbox.push(new_node) && !shared.done) {
+                // The owner is busy, which may be waiting for space in our
+                // queue, so make some space meanwhile.
+                if (!DrainHdaInbox(status, worker, shared, context, idle)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        if (closed.compact()) {
+            worker.memory_in_bytes -= std::min(worker.memory_in_bytes, EstimateNodeMemory(status, *node));
+            worker.memory_in_bytes += EstimateCompactEntryMemory<State>();
+            bool retained;
+            {
+                std::lock_guard<std::mutex> lock(shared.result_mutex);
+                retained = node == shared.best;
+                if (retained) {
+                    shared.retained_best = node;
+                }
+            }
+            if (!retained && status.release_state) {
+                node->releaseState(status.release_state);
+            }
+        }
+
+        {
+            SEARCH_GENERIC_TIME_PHASE(kPruning);
+            EnforceSearchBounds(status, partition_options, open, closed, worker.pruned_parents,
+                                worker.memory_in_bytes);
+        }
+    }
+    publish_sizes();
+}
+
+// A function that runs a hash-distributed A* search (HDA*) with a number of
+// worker threads (see Options::search_threads). It takes the same arguments
+// as AstarSearch and can be used in its place.
+//
+// Each worker owns the states whose hashcode maps to it (see HdaOwner), and
+// keeps its own OPEN and CLOSED lists for them. A worker repeatedly expands
+// the best node of its OPEN list and sends each successor to the queue of its
+// owner, where duplicates are detected and the cost h of new states is
+// computed. Nodes are thus expanded in best-first order per partition, but
+// not globally, similar to an expansion batch of one node per worker.
+//
+// The search ends with the first goal state found by any worker, when all
+// workers run out of nodes, or when it is aborted. The current node of the
+// status is then the goal state, or the best expanded node (see BestNodeScore).
+// The beam width and the memory budget apply to each partition in equal
+// shares. Search strategies only select the priority of the nodes in OPEN,
+// i.e. an anytime search stops at its first goal, and a greedy search is not
+// restarted. Checkpoints are not supported, and the OPEN and CLOSED lists of
+// the status are left empty.
+//
+// Status::compute_cost_h, Status::prepare_expansion, and the operators are
+// called concurrently from all workers, and must be thread-safe. The callback
+// is called from the worker that reached the update interval, but never
+// concurrently.
+template<typename State, typename Context>
+void HdaSearch(const std::shared_ptr<search::generic::Status<State, Context>>& status,
+               std::function<void(const search::generic::Status<State, Context>&)> callback,
+               const Options& options = Options())
+{
+    try {
+        assert(status->operators.size() == status->operator_stats.size());
+        assert(status->init_memory_in_kbytes != 0);
+        assert(status->compute_hash);
+        assert(status->compute_cost_h);
+        assert(status->is_goal_state);
+
+        if (!options.checkpoint_filename.empty() || !options.resume_filename.empty()) {
+            throw std::runtime_error("HdaSearch does not support checkpoints");
+        }
+
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        status->startPhaseTiming();
+        if (options.profile_search) {
+            Profiler::Instance().BeginSearchWindow(status.get(), options.metrics_label);
+        }
+
+        const auto num_workers = options.search_threads != 0
+                ? options.search_threads : std::max(1u, std::thread::hardware_concurrency());
+
+        Options partition_options = options;
+        partition_options.beam_width = (options.beam_width + num_workers - 1) / num_workers;
+        partition_options.memory_budget_in_bytes = (options.memory_budget_in_bytes + num_workers - 1) / num_workers;
+
+        std::vector<std::unique_ptr<HdaWorker<State>>> workers;
+        for (std::size_t i = 0; i < num_workers; ++i) {
+            workers.emplace_back(new HdaWorker<State>(status->compute_hash, options.compact_closed_list));
+            const auto strategy = options.search_strategy;
+            if (strategy == SearchStrategy::kWeightedAstar || strategy == SearchStrategy::kAnytime) {
+                workers.back()->open.setWeights(1, std::max(1.0f, options.heuristic_weight));
+            } else if (strategy == SearchStrategy::kGreedyRestarts) {
+                workers.back()->open.setWeights(0, 1);
+            }
+        }
+
+        // Nodes travel between workers, so they share a synchronized arena,
+        // and so do the payloads of their states.
+        const auto node_arena = std::make_shared<PoolArena>(kNodeArenaBlockSize, true);
+        const auto payload_arena = std::make_shared<PoolArena>(kPayloadArenaBlockSize, true);
+        const ScopedPoolArena payload_scope(payload_arena);
+
+        const auto initial_node_and_context = status->getCurrentNodeAndContext();
+        auto initial_node = std::make_shared<Node<State>>(initial_node_and_context.first);
+        auto context = initial_node_and_context.second;
+        initial_node->setCostH(static_cast<float>(status->compute_cost_h(*initial_node, context)));
+        auto& initial_worker = *workers[HdaOwner(status->compute_hash(initial_node->state()), num_workers)];
+        initial_worker.open.pushOrUpdate(initial_node);
+        initial_worker.memory_in_bytes = EstimateNodeMemory(*status, *initial_node);
+
+        const auto executor = options.executor ? options.executor : std::make_shared<Executor>();
+
+        HdaShared<State> shared;
+        shared.best = initial_node;
+        shared.next_metrics_time = std::chrono::steady_clock::now();
+
+        std::mutex error_mutex;
+        std::string error_message;
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < num_workers; ++i) {
+            threads.emplace_back([&, i] {
+                const ScopedPoolArena worker_payload_scope(payload_arena);
+                try {
+                    RunHdaWorker(i, *status, callback, options, partition_options, workers, shared,
+                                 context, *executor, node_arena, t0);
+                } catch (std::exception& error) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    error_message = error.what();
+                    shared.done = true;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        if (!error_message.empty()) {
+            throw std::runtime_error(error_message);
+        }
+
+        const auto& node = shared.goal ? shared.goal : shared.acceptable ? shared.acceptable : shared.best;
+        CollectHdaSizes(*status, workers);
+        status->setCurrentNodeAndContext(*node, context);
+        status->recordMemoryUsage();
+
+        status->recordRuntime(t0);
+        if (options.metrics_sink) {
+            auto snapshot = status->takeMetricsSnapshot(*node, context, options.metrics_label);
+            snapshot.finished = true;
+            options.metrics_sink->write(snapshot);
+        }
+    } catch (std::exception& error) {
+        status->error_message = error.what();
+    } catch (...) {
+        status->error_message = "Caught something not derived from std::exception";
+    }
+
+    Profiler::Instance().EndSearch(status.get());
+    status->finished = true;
+    status->notifyOne();
+}
+
+// A function that runs the HdaSearch function asynchroniously (see
+// AstarSearchAsync).
+template<typename State, typename Context>
+void HdaSearchAsync(const std::shared_ptr<search::generic::Status<State, Context>>& status,
+                    std::function<void(const search::generic::Status<State, Context>&)> callback,
+                    const Options& options = Options())
+{
+    std::thread thread(HdaSearch<State, Context>, status, callback, options);
+    thread.detach();
+}
+
+}  // namespace generic
+}  // namespace search
+
+#endif  // SEARCH_GENERIC_HDA_SEARCH_HPP
@@ -0,0 +1,218 @@
+// MemoryGuard.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_MEMORY_GUARD_HPP
+#define SEARCH_GENERIC_MEMORY_GUARD_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <initializer_list>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+
+namespace search {
+namespace generic {
+
+// Reads a small file (e.g. from /proc or /sys) into the buffer with a single
+// system call and returns the number of bytes read, or 0 on failure. The
+// buffer is always null-terminated.
+inline std::size_t ReadSmallFile(const char* path, char* buffer, std::size_t size)
+{
+    buffer[0] = '\0';
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    const auto count = ::read(fd, buffer, size - 1);
+    ::close(fd);
+    if (count <= 0) {
+        return 0;
+    }
+    buffer[count] = '\0';
+    return static_cast<std::size_t>(count);
+}
+
+// Returns the value that follows the given key in a file like /proc/meminfo,
+// or 0 if the key is missing.
+inline std::uint64_t FindValue(const char* text, const char* key)
+{
+    const char* position = std::strstr(text, key);
+    return position ? std::strtoull(position + std::strlen(key), nullptr, 10) : 0;
+}
+
+// Returns the resident set size of the current process in bytes, which is
+// read from /proc/self/statm instead of the much longer /proc/self/status.
+inline std::uint64_t GetResidentMemoryInBytes()
+{
+    char buffer[128];
+    if (ReadSmallFile("/proc/self/statm", buffer, sizeof(buffer)) == 0) {
+        return 0;
+    }
+    char* end = nullptr;
+    std::strtoull(buffer, &end, 10);  // Skips the total program size.
+    return std::strtoull(end, nullptr, 10) * static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+}
+
+// Returns the memory available to the process in bytes. This is the minimum
+// of the memory available on the host and the memory left in the cgroup of
+// the process, so that a search running in a container sees the limit of its
+// container rather than that of the host.
+//
+// The cgroup files are located once. Both cgroup v2 (memory.max and
+// memory.current) and cgroup v1 (memory.limit_in_bytes and
+// memory.usage_in_bytes) are supported.
+class MemoryProbe {
+public:
+    static const MemoryProbe& Instance()
+    {
+        static const MemoryProbe instance;
+        return instance;
+    }
+
+    std::uint64_t availableInBytes() const
+    {
+        char buffer[4096];
+        std::uint64_t available = std::numeric_limits<std::uint64_t>::max();
+        if (ReadSmallFile("/proc/meminfo", buffer, sizeof(buffer)) != 0) {
+            const auto kbytes = std::strstr(buffer, "MemAvailable:")
+                    ? FindValue(buffer, "MemAvailable:")
+                    : FindValue(buffer, "MemFree:") + FindValue(buffer, "Buffers:") + FindValue(buffer, "Cached:");
+            available = kbytes * 1024;
+        }
+        if (!limit_path_.empty() && !usage_path_.empty()) {
+            const auto limit = ReadNumber(limit_path_);
+            const auto usage = ReadNumber(usage_path_);
+            if (limit != 0 && limit != kUnlimited) {
+                available = std::min(available, limit > usage ? limit - usage : 0);
+            }
+        }
+        return available;
+    }
+
+private:
+    static constexpr std::uint64_t kUnlimited = std::numeric_limits<std::uint64_t>::max();
+
+    MemoryProbe()
+    {
+        char buffer[4096];
+        if (ReadSmallFile("/proc/self/cgroup", buffer, sizeof(buffer)) == 0) {
+            return;
+        }
+        // Lines have the format "hierarchy-ID:controller-list:cgroup-path".
+        for (char* line = std::strtok(buffer, "\n"); line; line = std::strtok(nullptr, "\n")) {
+            const std::string entry(line);
+            const auto first = entry.find(':');
+            const auto second = entry.find(':', first + 1);
+            if (first == std::string::npos || second == std::string::npos) {
+                continue;
+            }
+            const auto controllers = entry.substr(first + 1, second - first - 1);
+            const auto path = entry.substr(second + 1);
+            if (controllers.empty() && TrySetPaths("/sys/fs/cgroup", path, "memory.max", "memory.current")) {
+                return;
+            }
+            if (controllers.find("memory") != std::string::npos &&
+                TrySetPaths("/sys/fs/cgroup/memory", path, "memory.limit_in_bytes", "memory.usage_in_bytes")) {
+                return;
+            }
+        }
+    }
+
+    // Falls back to the root of the cgroup mount, which is the cgroup of the
+    // process itself within a cgroup namespace (i.e. in most containers).
+    bool TrySetPaths(const std::string& root, const std::string& path,
+                     const char* limit_file, const char* usage_file)
+    {
+        for (const auto& directory : { root + path, root }) {
+            const auto prefix = directory.back() == '/' ? directory : directory + '/';
+            if (::access((prefix + limit_file).c_str(), R_OK) == 0) {
+                limit_path_ = prefix + limit_file;
+                usage_path_ = prefix + usage_file;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static std::uint64_t ReadNumber(const std::string& path)
+    {
+        char buffer[64];
+        if (ReadSmallFile(path.c_str(), buffer, sizeof(buffer)) == 0) {
+            return 0;
+        }
+        // cgroup v2 writes "max" if there is no limit.
+        return buffer[0] == 'm' ? kUnlimited : std::strtoull(buffer, nullptr, 10);
+    }
+
+    std::string limit_path_;
+    std::string usage_path_;
+};
+
+// Caches readings of the memory of the process and of the memory available
+// to it, so that they are taken at most once per interval, no matter how
+// often a search asks for them. Readings are shared by all searches of the
+// process, since they describe the process as a whole.
+//
+// Note: Such readings cannot tell apart the memory of concurrent searches in
+// the same process. Limits per search are therefore checked against the
+// accounted memory of its OPEN and CLOSED lists (see Options).
+class MemoryGuard {
+public:
+    static MemoryGuard& Instance()
+    {
+        static MemoryGuard instance;
+        return instance;
+    }
+
+    // Takes new readings if the last ones are older than the given interval.
+    void refresh(std::chrono::milliseconds interval)
+    {
+        const auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        const auto last = last_refresh_.load(std::memory_order_relaxed);
+        const auto interval_in_ticks = std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval).count();
+        if (last != 0 && now - last < interval_in_ticks) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            return;  // Another search takes the readings right now.
+        }
+        resident_bytes_ = GetResidentMemoryInBytes();
+        available_bytes_ = MemoryProbe::Instance().availableInBytes();
+        last_refresh_.store(now, std::memory_order_relaxed);
+    }
+
+    std::uint64_t residentBytes() const
+    {
+        return resident_bytes_;
+    }
+
+    std::uint64_t availableBytes() const
+    {
+        return available_bytes_;
+    }
+
+private:
+    MemoryGuard()
+            : resident_bytes_(0),
+              available_bytes_(std::numeric_limits<std::uint64_t>::max()),
+              last_refresh_(0)
+    {
+    }
+
+    std::mutex mutex_;
+    std::atomic_uint_fast64_t resident_bytes_;
+    std::atomic_uint_fast64_t available_bytes_;
+    std::atomic<std::chrono::steady_clock::rep> last_refresh_;
+};
+
+}  // namespace generic
+}  // namespace search
+
+#endif  // SEARCH_GENERIC_MEMORY_GUARD_HPP
@@ -0,0 +1,355 @@
+// Metrics.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_METRICS_HPP
+#define SEARCH_GENERIC_METRICS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace search {
+namespace generic {
+
+// Per-operator part of a MetricsSnapshot (see OperatorStats).
+struct OperatorMetrics {
+    std::string name;
+    std::uint64_t num_applications = 0;
+    std::uint64_t num_skipped_applications = 0;
+    std::uint64_t num_generated_states = 0;
+    std::uint64_t runtime_in_micros = 0;
+    double gain = 0.0;
+};
+
+// Per-phase part of a MetricsSnapshot (see PhaseTimers).
+struct PhaseMetrics {
+    std::string name;
+    std::uint64_t count = 0;
+    double seconds = 0.0;
+};
+
+// A point-in-time copy of the values of a Status, which is written to a
+// MetricsSink while a search runs (see Options::metrics_sink).
+struct MetricsSnapshot {
+    std::string label;
+    bool finished = false;
+    bool has_goal_state = false;
+    std::uint64_t runtime_in_millis = 0;
+    std::uint64_t size_of_open = 0;
+    std::uint64_t size_of_closed = 0;
+    std::uint64_t num_goal_checks = 0;
+    std::uint64_t num_generated_states = 0;
+    std::uint64_t num_duplicated_states = 0;
+    std::uint64_t num_reopened_states = 0;
+    std::uint64_t num_pruned_states = 0;
+    std::uint64_t num_goal_states = 0;
+    std::uint64_t num_restarts = 0;
+    std::uint64_t used_memory_in_kbytes = 0;
+    std::uint64_t free_memory_in_kbytes = 0;
+    std::uint64_t estimated_memory_in_bytes = 0;
+    std::uint64_t depth = 0;
+    double cost_g = 0.0;
+    double cost_h = 0.0;
+    std::vector<OperatorMetrics> operators;
+    std::vector<PhaseMetrics> phases;
+
+    // Problem-specific values, e.g. the progress towards a goal. Names must
+    // be valid metric names, i.e. consist of [a-z0-9_] only.
+    std::vector<std::pair<std::string, double>> values;
+
+    double StatesPerSecond() const
+    {
+        return PerSecond(size_of_open + size_of_closed + num_duplicated_states);
+    }
+
+    double ClosedStatesPerSecond() const
+    {
+        return PerSecond(size_of_closed);
+    }
+
+    // Fraction of generated states that were already known.
+    double DuplicateRate() const
+    {
+        return Fraction(num_duplicated_states, num_generated_states);
+    }
+
+    // Fraction of generated states that improved the cost of a known state.
+    double ReopenRate() const
+    {
+        return Fraction(num_reopened_states, num_generated_states);
+    }
+
+private:
+    double PerSecond(std::uint64_t count) const
+    {
+        return runtime_in_millis == 0 ? 0.0 : 1000.0 * count / runtime_in_millis;
+    }
+
+    static double Fraction(std::uint64_t count, std::uint64_t total)
+    {
+        return total == 0 ? 0.0 : static_cast<double>(count) / total;
+    }
+};
+
+// Destination of metrics snapshots. A sink may be shared by several searches
+// running at the same time, so implementations must be thread-safe.
+class MetricsSink {
+public:
+    virtual ~MetricsSink() = default;
+
+    virtual void write(const MetricsSnapshot& snapshot) = 0;
+};
+
+// Writes each snapshot as one JSON object per line.
+class JsonLinesMetricsSink : public MetricsSink {
+public:
+    // The stream must outlive the sink.
+    explicit JsonLinesMetricsSink(std::ostream& out)
+            : out_(&out)
+    {
+    }
+
+    explicit JsonLinesMetricsSink(const std::string& filename)
+            : file_(new std::ofstream(filename, std::ios::app)), out_(file_.get())
+    {
+        if (!*file_) {
+            throw std::runtime_error("Could not open metrics file '" + filename + "'");
+        }
+    }
+
+    void write(const MetricsSnapshot& s) override
+    {
+        std::ostringstream line;
+        line << std::setprecision(9)
+             << "{\"label\":" << Quote(s.label)
+             << ",\"finished\":" << (s.finished ? "true" : "false")
+             << ",\"has_goal_state\":" << (s.has_goal_state ? "true" : "false")
+             << ",\"runtime_in_millis\":" << s.runtime_in_millis
+             << ",\"size_of_open\":" << s.size_of_open
+             << ",\"size_of_closed\":" << s.size_of_closed
+             << ",\"num_goal_checks\":" << s.num_goal_checks
+             << ",\"num_generated_states\":" << s.num_generated_states
+             << ",\"num_duplicated_states\":" << s.num_duplicated_states
+             << ",\"num_reopened_states\":" << s.num_reopened_states
+             << ",\"num_pruned_states\":" << s.num_pruned_states
+             << ",\"num_goal_states\":" << s.num_goal_states
+             << ",\"num_restarts\":" << s.num_restarts
+             << ",\"states_per_second\":" << s.StatesPerSecond()
+             << ",\"closed_states_per_second\":" << s.ClosedStatesPerSecond()
+             << ",\"duplicate_rate\":" << s.DuplicateRate()
+             << ",\"reopen_rate\":" << s.ReopenRate()
+             << ",\"used_memory_in_kbytes\":" << s.used_memory_in_kbytes
+             << ",\"free_memory_in_kbytes\":" << s.free_memory_in_kbytes
+             << ",\"estimated_memory_in_bytes\":" << s.estimated_memory_in_bytes
+             << ",\"depth\":" << s.depth
+             << ",\"cost_g\":" << s.cost_g
+             << ",\"cost_h\":" << s.cost_h
+             << ",\"operators\":[";
+        for (std::size_t i = 0; i < s.operators.size(); ++i) {
+            const auto& op = s.operators[i];
+            line << (i == 0 ? "" : ",")
+                 << "{\"name\":" << Quote(op.name)
+                 << ",\"num_applications\":" << op.num_applications
+                 << ",\"num_skipped_applications\":" << op.num_skipped_applications
+                 << ",\"num_generated_states\":" << op.num_generated_states
+                 << ",\"runtime_in_micros\":" << op.runtime_in_micros
+                 << ",\"gain\":" << op.gain << "}";
+        }
+        line << "],\"phases\":[";
+        for (std::size_t i = 0; i < s.phases.size(); ++i) {
+            const auto& phase = s.phases[i];
+            line << (i == 0 ? "" : ",")
+                 << "{\"name\":" << Quote(phase.name)
+                 << ",\"count\":" << phase.count
+                 << ",\"seconds\":" << phase.seconds << "}";
+        }
+        line << "]";
+        for (const auto& value : s.values) {
+            line << "," << Quote(value.first) << ":" << value.second;
+        }
+        line << "}\n";
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        *out_ << line.str() << std::flush;
+    }
+
+private:
+    static std::string Quote(const std::string& string)
+    {
+        std::string quoted = "\"";
+        for (const char c : string) {
+            if (c == '"' || c == '\\') {
+                quoted += '\\';
+                quoted += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                quoted += escaped;
+            } else {
+                quoted += c;
+            }
+        }
+        return quoted + "\"";
+    }
+
+    std::unique_ptr<std::ofstream> file_;
+    std::ostream* out_;
+    std::mutex mutex_;
+};
+
+// Maintains a file in the Prometheus text exposition format, e.g. for the
+// textfile collector of the node exporter. The file holds the latest snapshot
+// of each label and is replaced atomically on each write.
+class PrometheusMetricsSink : public MetricsSink {
+public:
+    explicit PrometheusMetricsSink(std::string filename)
+            : filename_(std::move(filename))
+    {
+    }
+
+    void write(const MetricsSnapshot& snapshot) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        snapshots_[snapshot.label] = snapshot;
+
+        const auto tmp_filename = filename_ + ".tmp";
+        {
+            std::ofstream out(tmp_filename, std::ios::trunc);
+            if (!out) {
+                return;  // Metrics are best-effort.
+            }
+            WriteAll(out);
+        }
+        std::rename(tmp_filename.c_str(), filename_.c_str());
+    }
+
+private:
+    typedef std::map<std::string, MetricsSnapshot> Snapshots;
+
+    template<typename Getter>
+    void WriteGauge(std::ostream& out, const std::string& name, const Getter& get) const
+    {
+        out << "# TYPE search_" << name << " gauge\n";
+        for (const auto& entry : snapshots_) {
+            out << "search_" << name << "{label=" << Quote(entry.first) << "} " << get(entry.second) << "\n";
+        }
+    }
+
+    template<typename Getter>
+    void WriteOperatorGauge(std::ostream& out, const std::string& name, const Getter& get) const
+    {
+        out << "# TYPE search_operator_" << name << " gauge\n";
+        for (const auto& entry : snapshots_) {
+            for (const auto& op : entry.second.operators) {
+                out << "search_operator_" << name << "{label=" << Quote(entry.first)
+                    << ",operator=" << Quote(op.name) << "} " << get(op) << "\n";
+            }
+        }
+    }
+
+    template<typename Getter>
+    void WritePhaseGauge(std::ostream& out, const std::string& name, const Getter& get) const
+    {
+        out << "# TYPE search_phase_" << name << " gauge\n";
+        for (const auto& entry : snapshots_) {
+            for (const auto& phase : entry.second.phases) {
+                out << "search_phase_" << name << "{label=" << Quote(entry.first)
+                    << ",phase=" << Quote(phase.name) << "} " << get(phase) << "\n";
+            }
+        }
+    }
+
+    void WriteAll(std::ostream& out) const
+    {
+        out << std::setprecision(9);
+        typedef const MetricsSnapshot& S;
+        WriteGauge(out, "finished", [](S s) { return s.finished ? 1 : 0; });
+        WriteGauge(out, "has_goal_state", [](S s) { return s.has_goal_state ? 1 : 0; });
+        WriteGauge(out, "runtime_seconds", [](S s) { return s.runtime_in_millis / 1000.0; });
+        WriteGauge(out, "open_states", [](S s) { return s.size_of_open; });
+        WriteGauge(out, "closed_states", [](S s) { return s.size_of_closed; });
+        WriteGauge(out, "goal_checks", [](S s) { return s.num_goal_checks; });
+        WriteGauge(out, "generated_states", [](S s) { return s.num_generated_states; });
+        WriteGauge(out, "duplicated_states", [](S s) { return s.num_duplicated_states; });
+        WriteGauge(out, "reopened_states", [](S s) { return s.num_reopened_states; });
+        WriteGauge(out, "pruned_states", [](S s) { return s.num_pruned_states; });
+        WriteGauge(out, "goal_states", [](S s) { return s.num_goal_states; });
+        WriteGauge(out, "restarts", [](S s) { return s.num_restarts; });
+        WriteGauge(out, "states_per_second", [](S s) { return s.StatesPerSecond(); });
+        WriteGauge(out, "closed_states_per_second", [](S s) { return s.ClosedStatesPerSecond(); });
+        WriteGauge(out, "duplicate_rate", [](S s) { return s.DuplicateRate(); });
+        WriteGauge(out, "reopen_rate", [](S s) { return s.ReopenRate(); });
+        WriteGauge(out, "used_memory_bytes", [](S s) { return s.used_memory_in_kbytes * 1024; });
+        WriteGauge(out, "free_memory_bytes", [](S s) { return s.free_memory_in_kbytes * 1024; });
+        WriteGauge(out, "estimated_memory_bytes", [](S s) { return s.estimated_memory_in_bytes; });
+        WriteGauge(out, "depth", [](S s) { return s.depth; });
+        WriteGauge(out, "cost_g", [](S s) { return s.cost_g; });
+        WriteGauge(out, "cost_h", [](S s) { return s.cost_h; });
+
+        typedef const OperatorMetrics& O;
+        WriteOperatorGauge(out, "applications", [](O op) { return op.num_applications; });
+        WriteOperatorGauge(out, "skipped_applications", [](O op) { return op.num_skipped_applications; });
+        WriteOperatorGauge(out, "generated_states", [](O op) { return op.num_generated_states; });
+        WriteOperatorGauge(out, "runtime_seconds", [](O op) { return op.runtime_in_micros / 1e6; });
+        WriteOperatorGauge(out, "gain", [](O op) { return op.gain; });
+
+        typedef const PhaseMetrics& P;
+        WritePhaseGauge(out, "calls", [](P phase) { return phase.count; });
+        WritePhaseGauge(out, "seconds", [](P phase) { return phase.seconds; });
+
+        // Problem-specific values, in the order of their first appearance.
+        std::vector<std::string> names;
+        for (const auto& entry : snapshots_) {
+            for (const auto& value : entry.second.values) {
+                if (std::find(names.begin(), names.end(), value.first) == names.end()) {
+                    names.push_back(value.first);
+                }
+            }
+        }
+        for (const auto& name : names) {
+            out << "# TYPE search_" << name << " gauge\n";
+            for (const auto& entry : snapshots_) {
+                for (const auto& value : entry.second.values) {
+                    if (value.first == name) {
+                        out << "search_" << name << "{label=" << Quote(entry.first) << "} " << value.second << "\n";
+                    }
+                }
+            }
+        }
+    }
+
+    static std::string Quote(const std::string& string)
+    {
+        std::string quoted = "\"";
+        for (const char c : string) {
+            if (c == '"' || c == '\\') {
+                quoted += '\\';
+                quoted += c;
+            } else if (c == '\n') {
+                quoted += "\\n";
+            } else {
+                quoted += c;
+            }
+        }
+        return quoted + "\"";
+    }
+
+    const std::string filename_;
+    Snapshots snapshots_;
+    std::mutex mutex_;
+};
+
+}  // namespace generic
+}  // namespace search
+
+#endif  // SEARCH_GENERIC_METRICS_HPP
@@ -5,6 +5,7 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <ostream>
@@ -14,6 +15,9 @@
 namespace search {
 namespace generic {
 
+// Type of state hash values, which identify states in OPEN and CLOSED.
+typedef std::uint64_t HashCode;
+
 // A class that represents a node in the heuristic search space/graph.
 // A node keeps a single state plus metadata to drive the A* search algorithm.
 // The metadata contains:
@@ -26,16 +30,19 @@ namespace generic {
 // Once a node is created it cannot be modified to avoid inconsistencies.
 // An exception is the value for cost h that may be updated running A*.
 // For more information take a look at the details of A* search.
+// Another exception is the state of an expanded node in a search with a
+// compact CLOSED list. The node is then only kept as a path record by its
+// descendants, and the bulk of its state's payload may be released.
 template<typename State>
 class Node {
 public:
     Node()
-            : costG_(0), costH_(0), opcode_(0)
+            : costG_(0), costH_(0), depth_(0), opcode_(0)
     {
     }
 
     Node(const State& state)
-            : state_(state), costG_(0), costH_(0), opcode_(0)
+            : state_(state), costG_(0), costH_(0), depth_(0), opcode_(0)
     {
     }
 
@@ -44,11 +51,46 @@ public:
             : state_(state),
               costG_(parent->costG() + opcost),
               costH_(0),
+              depth_(parent->depth_ + 1),
+              opcode_(opcode),
+              parent_(parent)
+    {
+    }
+
+    Node(State&& state, const std::shared_ptr<Node<State>>& parent,
+         std::uint8_t opcode, float opcost)
+            : state_(std::move(state)),
+              costG_(parent->costG() + opcost),
+              costH_(0),
+              depth_(parent->depth_ + 1),
+              opcode_(opcode),
+              parent_(parent)
+    {
+    }
+
+    // Restores a node with known costs, e.g. from a checkpoint.
+    Node(State&& state, const std::shared_ptr<Node<State>>& parent,
+         std::uint8_t opcode, float cost_g, float cost_h)
+            : state_(std::move(state)),
+              costG_(cost_g),
+              costH_(cost_h),
+              depth_(parent ? parent->depth_ + 1 : 0),
               opcode_(opcode),
               parent_(parent)
     {
     }
 
+    // Restores a node received from another process, where its parent is not
+    // available.
+    Node(State&& state, std::uint32_t depth, std::uint8_t opcode, float cost_g, float cost_h)
+            : state_(std::move(state)),
+              costG_(cost_g),
+              costH_(cost_h),
+              depth_(depth),
+              opcode_(opcode)
+    {
+    }
+
     const std::shared_ptr<Node<State>> parent() const
     {
         return parent_;
@@ -84,15 +126,16 @@ public:
         costH_ = cost;
     }
 
+    // Applies the given function to the state to release its payload.
+    void releaseState(const std::function<void(State&)>& release_state)
+    {
+        release_state(state_);
+    }
+
+    // The depth is the number of ancestors, which is stored on construction.
     std::size_t depth() const
     {
-        std::size_t depth = 0;
-        auto parent = parent_;
-        while (parent) {
-            parent = parent->parent_;
-            ++depth;
-        }
-        return depth;
+        return depth_;
     }
 
     void clear()
@@ -100,6 +143,7 @@ public:
         state_ = State();
         costG_ = 0;
         costH_ = 0;
+        depth_ = 0;
         opcode_ = 0;
         parent_.reset();
     }
@@ -153,6 +197,7 @@ public:
     std::vector<std::uint8_t> getOpcodesStartingFromRoot() const
     {
         std::vector<std::uint8_t> opcodes = {opcode()};
+        opcodes.reserve(depth_ + 1);
         Node<State> *parent = this->parent().get();
         while (parent) {
             opcodes.push_back(parent->opcode());
@@ -168,6 +213,7 @@ private:
     State state_;
     float costG_;
     float costH_;
+    std::uint32_t depth_;
     std::uint8_t opcode_;
     std::shared_ptr<Node<State>> parent_;
 };
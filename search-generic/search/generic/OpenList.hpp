@@ -3,13 +3,17 @@
 #ifndef SEARCH_GENERIC_OPEN_LIST_HPP
 #define SEARCH_GENERIC_OPEN_LIST_HPP
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
+#include <iterator>
 #include <memory>
-#include <queue>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "search/generic/Node.hpp"
+#include "search/generic/PoolAllocator.hpp"
 #include "search/generic/debug.hpp"
 
 namespace search {
@@ -24,31 +28,102 @@ namespace generic {
 // 1. Pop (remove and return) the node with the lowest cost f from the list.
 // 2. Push (insert) or update a node into/in the list.
 // 3. Check if a given state (!) is contained.
-template<typename State>
+//
+// Ties in cost f are broken in favor of the lower cost h, i.e. of the node
+// that is estimated to be closer to a goal.
+//
+// By default nodes are ordered by their cost f = g + h. Search strategies
+// other than A* may weight both costs differently (see setWeights), and h
+// may be perturbed by a random factor per state (see setTieBreaking). Both
+// only change the priorities within OPEN, the costs of the nodes are kept.
+//
+// The Allocator template parameter selects the allocator for the entries of
+// the internal hash map. By default, entries are carved out of a PoolArena.
+template<typename State, template<typename> class Allocator = PoolAllocator>
 class OpenList {
 
     typedef std::shared_ptr<search::generic::Node<State>> SharedNode;
-    typedef std::unordered_map<std::string, SharedNode> NodeMap;
-    typedef std::vector<SharedNode> NodeHeap;
 
-    // Q: Why NodeHeap and std::make_heap instead of std::priority_queue?
+    // Q: Why an indexed heap instead of std::priority_queue?
     // A: Running the A* algorithm requires to update a nodes cost g value
     //    while it is already inserted in OPEN. After this update operation
-    //    the priority queue needs to be resorted. However, the interface of
+    //    the node needs to move up in the queue. However, the interface of
     //    std::priority_queue does not allow access to nodes other than 'top'
-    //    for good reason. Therefore, this implementation manages the queue
-    //    manually by storing all nodes in a vector (NodeHeap) that is indexed
-    //    by a map (NodeMap) to random-access individual nodes/states by its
-    //    hash value, and to be able to reorder the queue via std::make_heap.
+    //    for good reason. Therefore, this implementation manages a d-ary heap
+    //    (HeapEntry) manually, whose entries point to a map (NodeMap) that
+    //    random-accesses individual nodes/states by their hash value. Each map
+    //    entry stores its current heap position, which allows to restore the
+    //    heap property after a cost change in O(log n) (decrease-key).
+
+    struct Slot {
+        SharedNode node;
+        std::size_t heap_pos;
+    };
+
+    typedef std::pair<const HashCode, Slot> MapValue;
+    typedef std::unordered_map<HashCode, Slot, std::hash<HashCode>, std::equal_to<HashCode>,
+            Allocator<MapValue>> NodeMap;
+
+    // Heap entries cache the sort keys of their nodes to keep sift operations
+    // within the contiguous heap array. cost_f is the weighted priority.
+    struct HeapEntry {
+        float cost_f;
+        float cost_h;
+        MapValue* entry;
+    };
+
+    typedef std::vector<HeapEntry> NodeHeap;
+
+    // Arity of the heap. A 4-ary heap halves the tree height of a binary heap
+    // and keeps all children of a node within one or two cache lines.
+    static constexpr std::size_t kArity = 4;
+
+public:
+    // Iterates over the nodes in heap order (not sorted).
+    class const_iterator : public std::iterator<std::forward_iterator_tag, const SharedNode> {
+    public:
+        explicit const_iterator(typename NodeHeap::const_iterator pos)
+                : pos_(pos)
+        {
+        }
+
+        const SharedNode& operator*() const
+        {
+            return pos_->entry->second.node;
+        }
+
+        const SharedNode* operator->() const
+        {
+            return &pos_->entry->second.node;
+        }
+
+        const_iterator& operator++()
+        {
+            ++pos_;
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator old = *this;
+            ++pos_;
+            return old;
+        }
+
+        bool operator==(const const_iterator& other) const
+        {
+            return pos_ == other.pos_;
+        }
 
-    struct HigherCost {
-        bool operator()(const SharedNode& lhs, const SharedNode& rhs) const
+        bool operator!=(const const_iterator& other) const
         {
-            return lhs->costF() > rhs->costF();
+            return pos_ != other.pos_;
         }
+
+    private:
+        typename NodeHeap::const_iterator pos_;
     };
 
-public:
     // A default instance is not usable due to the empty compute_hash_ member.
     OpenList() = default;
 
@@ -62,28 +137,33 @@ public:
 
     OpenList& operator=(const OpenList&) = delete;
 
-    explicit OpenList(std::function<std::string(const State&)> compute_hash)
+    explicit OpenList(std::function<HashCode(const State&)> compute_hash)
             : compute_hash_(compute_hash)
     {
     }
 
-    typename NodeHeap::const_iterator begin() const
+    OpenList(std::function<HashCode(const State&)> compute_hash, const Allocator<MapValue>& allocator)
+            : compute_hash_(compute_hash), nodes_map_(0, std::hash<HashCode>(), std::equal_to<HashCode>(), allocator)
+    {
+    }
+
+    const_iterator begin() const
     {
-        return nodes_heap_.begin();
+        return const_iterator(nodes_heap_.begin());
     }
 
-    typename NodeHeap::const_iterator end() const
+    const_iterator end() const
     {
-        return nodes_heap_.end();
+        return const_iterator(nodes_heap_.end());
     }
 
     // Removes and returns the top node from the list.
     SharedNode pop()
     {
-        std::pop_heap(nodes_heap_.begin(), nodes_heap_.end(), higher_cost_);
-        SharedNode popped_node = nodes_heap_.back();
-        nodes_heap_.pop_back();
-        nodes_map_.erase(compute_hash_(popped_node->state()));
+        MapValue* top = nodes_heap_.front().entry;
+        SharedNode popped_node = std::move(top->second.node);
+        RemoveTop();
+        nodes_map_.erase(top->first);
         return popped_node;
     }
 
@@ -94,13 +174,23 @@ public:
     bool pushOrUpdate(const SharedNode& node)
     {
         const auto hashcode = compute_hash_(node->state());
-        auto insert_result = nodes_map_.insert(std::make_pair(hashcode, node));
+        auto insert_result = nodes_map_.emplace(hashcode, Slot{node, nodes_heap_.size()});
+        MapValue& entry = *insert_result.first;
         if (insert_result.second) {
-            nodes_heap_.emplace_back(node);
-            std::push_heap(nodes_heap_.begin(), nodes_heap_.end(), higher_cost_);
-        } else if (insert_result.first->second->costG() > node->costG()) {
-            *insert_result.first->second = *node;
-            std::make_heap(nodes_heap_.begin(), nodes_heap_.end(), higher_cost_);
+            nodes_heap_.push_back(HeapEntry{Priority(hashcode, *node), node->costH(), &entry});
+            SiftUp(nodes_heap_.size() - 1);
+        } else if (entry.second.node->costG() > node->costG()) {
+            *entry.second.node = *node;
+            const auto pos = entry.second.heap_pos;
+            const auto priority = Priority(hashcode, *node);
+            const bool higher = Less(HeapEntry{priority, node->costH(), &entry}, nodes_heap_[pos]);
+            nodes_heap_[pos].cost_f = priority;
+            nodes_heap_[pos].cost_h = node->costH();
+            if (higher) {
+                SiftUp(pos);
+            } else {
+                SiftDown(pos);
+            }
         }
         return insert_result.second;
     }
@@ -110,6 +200,102 @@ public:
         return nodes_map_.find(compute_hash_(state)) != nodes_map_.end();
     }
 
+    // Calls f with the hash code of each contained state.
+    template<typename Function>
+    void forEachHash(Function f) const
+    {
+        for (const auto& entry : nodes_map_) {
+            f(entry.first);
+        }
+    }
+
+    SharedNode get(const State& state) const
+    {
+        auto pos = nodes_map_.find(compute_hash_(state));
+        if (pos == nodes_map_.end()) {
+            return nullptr;
+        }
+
+        return pos->second.node;
+    }
+
+    // Restores the heap order after the cost of a node in the list has been
+    // changed externally. Returns false if the node's state is not in the list.
+    bool updateCost(const SharedNode& node)
+    {
+        auto pos = nodes_map_.find(compute_hash_(node->state()));
+        if (pos == nodes_map_.end()) {
+            return false;
+        }
+
+        const auto heap_pos = pos->second.heap_pos;
+        const HeapEntry updated{Priority(pos->first, *node), node->costH(), &*pos};
+        const bool higher = Less(updated, nodes_heap_[heap_pos]);
+        nodes_heap_[heap_pos] = updated;
+        if (higher) {
+            SiftUp(heap_pos);
+        } else {
+            SiftDown(heap_pos);
+        }
+        return true;
+    }
+
+    // Sets the priority of a node to weight_g * g + weight_h * h and reorders
+    // the list in O(n).
+    void setWeights(float weight_g, float weight_h)
+    {
+        weight_g_ = weight_g;
+        weight_h_ = weight_h;
+        Reprioritize();
+    }
+
+    // Perturbs the cost h in the priority of each node by a factor in
+    // [1, 1 + noise), which is derived from the node's hashcode and the seed.
+    // A noise of 0 disables the perturbation. Reorders the list in O(n).
+    void setTieBreaking(float noise, std::uint64_t seed)
+    {
+        noise_ = noise;
+        noise_seed_ = seed;
+        Reprioritize();
+    }
+
+    // Returns the priority of the top node, i.e. the lowest in the list. The
+    // list must not be empty.
+    float topPriority() const
+    {
+        return nodes_heap_.front().cost_f;
+    }
+
+    // Returns the priority that the given node would have in the list if its
+    // cost h were the given one.
+    float priority(const Node<State>& node, float cost_h) const
+    {
+        return Priority(compute_hash_(node.state()), node.costG(), cost_h);
+    }
+
+    // Removes and returns up to count nodes with the highest priority (ties are
+    // broken in favor of removing the higher cost h). Runs in O(n).
+    std::vector<SharedNode> pruneWorst(std::size_t count)
+    {
+        count = std::min(count, nodes_heap_.size());
+        std::vector<SharedNode> pruned;
+        if (count == 0) {
+            return pruned;
+        }
+
+        const auto keep = nodes_heap_.size() - count;
+        std::nth_element(nodes_heap_.begin(), nodes_heap_.begin() + keep, nodes_heap_.end(), &OpenList::Less);
+        pruned.reserve(count);
+        for (auto i = keep; i < nodes_heap_.size(); ++i) {
+            MapValue* entry = nodes_heap_[i].entry;
+            pruned.emplace_back(std::move(entry->second.node));
+            nodes_map_.erase(entry->first);
+        }
+        nodes_heap_.resize(keep);
+        MakeHeap();
+        return pruned;
+    }
+
     std::size_t size() const
     {
         return nodes_heap_.size();
@@ -131,23 +317,125 @@ public:
             return;
         }
 
-        NodeHeap newHeap;
-        NodeMap newMap;
-        for (std::size_t i = 0; i < keepNodes; ++i) {
-            const auto node = pop();
-            newHeap.emplace_back(node);
-            newMap.insert(std::make_pair(compute_hash_(node->state()), node));
+        std::vector<SharedNode> kept;
+        for (std::size_t i = 0; i < keepNodes && !nodes_heap_.empty(); ++i) {
+            kept.emplace_back(pop());
+        }
+
+        nodes_heap_.clear();
+        nodes_map_.clear();
+        for (const auto& node : kept) {
+            pushOrUpdate(node);
         }
-        std::make_heap(newHeap.begin(), newHeap.end(), higher_cost_);
-        nodes_heap_ = newHeap;
-        nodes_map_ = newMap;
     }
 
 private:
-    std::function<std::string(const State&)> compute_hash_;
-    HigherCost higher_cost_;
+    float Priority(HashCode hashcode, const Node<State>& node) const
+    {
+        return Priority(hashcode, node.costG(), node.costH());
+    }
+
+    float Priority(HashCode hashcode, float cost_g, float cost_h) const
+    {
+        if (noise_ != 0) {
+            // SplitMix64 finalizer, whose top 24 bits give a uniform float in [0, 1).
+            auto z = hashcode ^ noise_seed_;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            z ^= z >> 31;
+            cost_h *= 1 + noise_ * (static_cast<float>(z >> 40) / (1 << 24));
+        }
+        return weight_g_ * cost_g + weight_h_ * cost_h;
+    }
+
+    void Reprioritize()
+    {
+        for (auto& heap_entry : nodes_heap_) {
+            heap_entry.cost_f = Priority(heap_entry.entry->first, *heap_entry.entry->second.node);
+        }
+        MakeHeap();
+    }
+
+    static bool Less(const HeapEntry& lhs, const HeapEntry& rhs)
+    {
+        return lhs.cost_f < rhs.cost_f || (lhs.cost_f == rhs.cost_f && lhs.cost_h < rhs.cost_h);
+    }
+
+    void Place(std::size_t pos, const HeapEntry& heap_entry)
+    {
+        nodes_heap_[pos] = heap_entry;
+        heap_entry.entry->second.heap_pos = pos;
+    }
+
+    void SiftUp(std::size_t pos)
+    {
+        const HeapEntry moving = nodes_heap_[pos];
+        while (pos > 0) {
+            const auto parent = (pos - 1) / kArity;
+            if (!Less(moving, nodes_heap_[parent])) {
+                break;
+            }
+            Place(pos, nodes_heap_[parent]);
+            pos = parent;
+        }
+        Place(pos, moving);
+    }
+
+    void SiftDown(std::size_t pos)
+    {
+        const HeapEntry moving = nodes_heap_[pos];
+        const auto size = nodes_heap_.size();
+        while (true) {
+            const auto first_child = pos * kArity + 1;
+            if (first_child >= size) {
+                break;
+            }
+            const auto last_child = std::min(first_child + kArity, size);
+            auto best = first_child;
+            for (auto child = first_child + 1; child < last_child; ++child) {
+                if (Less(nodes_heap_[child], nodes_heap_[best])) {
+                    best = child;
+                }
+            }
+            if (!Less(nodes_heap_[best], moving)) {
+                break;
+            }
+            Place(pos, nodes_heap_[best]);
+            pos = best;
+        }
+        Place(pos, moving);
+    }
+
+    void MakeHeap()
+    {
+        for (std::size_t pos = 0; pos < nodes_heap_.size(); ++pos) {
+            nodes_heap_[pos].entry->second.heap_pos = pos;
+        }
+        if (nodes_heap_.size() < 2) {
+            return;
+        }
+        for (auto pos = (nodes_heap_.size() - 2) / kArity + 1; pos-- > 0;) {
+            SiftDown(pos);
+        }
+    }
+
+    void RemoveTop()
+    {
+        const HeapEntry last = nodes_heap_.back();
+        nodes_heap_.pop_back();
+        if (!nodes_heap_.empty()) {
+            nodes_heap_.front() = last;
+            SiftDown(0);
+        }
+    }
+
+    std::function<HashCode(const State&)> compute_hash_;
     NodeHeap nodes_heap_;
     NodeMap nodes_map_;
+    float weight_g_ = 1;
+    float weight_h_ = 1;
+    float noise_ = 0;
+    std::uint64_t noise_seed_ = 0;
 };
 
 }  // namespace generic
@@ -6,8 +6,8 @@
 #include <cstdio>
 #include <memory>
 #include <string>
-#include <unordered_set>
 #include <utility>
+#include "search/generic/SuccessorBuffer.hpp"
 
 namespace search {
 namespace generic {
@@ -30,16 +30,18 @@ public:
 
     virtual ~Operator() = default;
 
-    // Generates and returns a set of successor states from a given state.
-    // The context object can be used to gain access to data/information that
-    // is shared between all states, e.g. a global dictionary.
+    // Generates a set of successor states from a given state and adds them to
+    // the (empty) successor buffer. The context object can be used to gain
+    // access to data/information that is shared between all states, e.g. a
+    // global dictionary.
     //
-    // We use std::unordered_set instead of std::vector in order to enforce the
-    // set criterion because it turned out during development that unsound/lazy
+    // We use a buffer that enforces the set criterion instead of a plain
+    // std::vector because it turned out during development that unsound/lazy
     // implementations of operators have the potential to generate lots of
-    // duplicate states. We want to avoid that in the first place.
-    virtual std::unordered_set<State> apply(const State& state,
-                                            Context& context) const = 0;
+    // duplicate states. We want to avoid that in the first place. The caller
+    // reuses the buffer for many applications to avoid allocations.
+    virtual void apply(const State& state, Context& context,
+                       SuccessorBuffer<State>& successors) const = 0;
 
     // Creates and returns a deep copy of the operator.
     // The purpose is that in multithreaded scenarios multiple users want to use
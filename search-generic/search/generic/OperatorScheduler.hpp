@@ -0,0 +1,90 @@
+// OperatorScheduler.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_OPERATOR_SCHEDULER_HPP
+#define SEARCH_GENERIC_OPERATOR_SCHEDULER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "search/generic/Status.hpp"
+
+namespace search {
+namespace generic {
+
+// Decides which operators are applied to a node, based on the gain each
+// operator achieved per microsecond of runtime so far (see OperatorStats).
+//
+// The scheduler works like a bandit with a minimum exploration rate: each
+// operator is applied with a probability proportional to its yield relative
+// to the best operator, but never less than the exploration rate. The best
+// operator is always applied, as is every operator that has not completed its
+// warm-up applications yet. Thus expensive but unproductive operators are
+// throttled without ever being switched off completely, and the scheduler
+// only budgets compute time without changing which states are reachable.
+//
+// Decisions are drawn from a seeded generator on the search thread, so a
+// search is reproducible for a given seed and sequence of operator statistics.
+class OperatorScheduler {
+public:
+    OperatorScheduler(double exploration_rate, std::size_t warmup_applications,
+                      std::uint64_t seed = 0)
+            : exploration_rate_(std::min(1.0, std::max(0.0, exploration_rate))),
+              warmup_applications_(warmup_applications),
+              generator_(seed)
+    {
+    }
+
+    // Recomputes the application probability of each operator from its
+    // current statistics. Called once before each batch of expansions.
+    void update(const std::vector<OperatorStats>& operator_stats)
+    {
+        yields_.assign(operator_stats.size(), 0.0);
+        probabilities_.assign(operator_stats.size(), 1.0);
+
+        double best_yield = 0.0;
+        for (std::size_t i = 0; i < operator_stats.size(); ++i) {
+            const auto runtime = std::max<std::uint64_t>(1, operator_stats[i].runtime_in_micros);
+            yields_[i] = 1e-6 * operator_stats[i].gain_in_millionths / runtime;
+            best_yield = std::max(best_yield, yields_[i]);
+        }
+        if (best_yield <= 0.0) {
+            return;  // Nothing to compare yet.
+        }
+
+        for (std::size_t i = 0; i < operator_stats.size(); ++i) {
+            if (operator_stats[i].num_applications < warmup_applications_) {
+                continue;
+            }
+            probabilities_[i] = std::max(exploration_rate_, yields_[i] / best_yield);
+        }
+    }
+
+    // Returns true if the operator with the given index shall be applied to
+    // the next node.
+    bool shouldApply(std::size_t operator_index)
+    {
+        const auto probability = probabilities_[operator_index];
+        return probability >= 1.0 || distribution_(generator_) < probability;
+    }
+
+    // Returns the probabilities computed by the last call to update().
+    const std::vector<double>& probabilities() const
+    {
+        return probabilities_;
+    }
+
+private:
+    double exploration_rate_;
+    std::size_t warmup_applications_;
+    std::vector<double> yields_;
+    std::vector<double> probabilities_;
+    std::mt19937_64 generator_;
+    std::uniform_real_distribution<double> distribution_;
+};
+
+}  // namespace generic
+}  // namespace search
+
+#endif  // SEARCH_GENERIC_OPERATOR_SCHEDULER_HPP
@@ -0,0 +1,265 @@
+// PhaseTimer.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_PHASE_TIMER_HPP
+#define SEARCH_GENERIC_PHASE_TIMER_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#ifdef SEARCH_GENERIC_USDT_ENABLED
+#include <sys/sdt.h>
+#endif
+
+namespace search {
+namespace generic {
+
+// Phases of a search whose run time is measured by PhaseTimer. Phases may
+// nest (e.g. successor construction happens while operators are applied), so
+// their times do not add up to the total run time.
+enum class Phase : std::size_t {
+    kPrepareExpansion,        // Status::prepare_expansion
+    kOperators,               // Operator::apply
+    kSelection,               // Choosing where an operator is applied
+    kSuccessorConstruction,   // Building successor states
+    kHashing,                 // Computing state hash codes
+    kCostH,                   // Status::compute_cost_h
+    kDuplicateDetection,      // Probing OPEN and CLOSED for new successors
+    kOpenClosed,              // Moving nodes between OPEN and CLOSED
+    kPruning,                 // Enforcing the beam width and memory budget
+    kGoalCheck,               // Status::is_goal_state
+    kCheckpoint,              // Taking a frontier for a checkpoint
+    kNumPhases
+};
+
+constexpr std::size_t kNumPhases = static_cast<std::size_t>(Phase::kNumPhases);
+
+inline const char* PhaseName(Phase phase)
+{
+    static const char* const kNames[kNumPhases] = {
+        "prepare_expansion", "operators", "selection", "successor_construction", "hashing",
+        "cost_h", "duplicate_detection", "open_closed", "pruning", "goal_check", "checkpoint"
+    };
+    return kNames[static_cast<std::size_t>(phase)];
+}
+
+// Accumulated number of calls and clock ticks per phase.
+struct PhaseTotals {
+    std::array<std::uint64_t, kNumPhases> counts{};
+    std::array<std::uint64_t, kNumPhases> ticks{};
+
+    PhaseTotals& operator+=(const PhaseTotals& other)
+    {
+        for (std::size_t i = 0; i < kNumPhases; ++i) {
+            counts[i] += other.counts[i];
+            ticks[i] += other.ticks[i];
+        }
+        return *this;
+    }
+
+    PhaseTotals& operator-=(const PhaseTotals& other)
+    {
+        for (std::size_t i = 0; i < kNumPhases; ++i) {
+            counts[i] -= std::min(counts[i], other.counts[i]);
+            ticks[i] -= std::min(ticks[i], other.ticks[i]);
+        }
+        return *this;
+    }
+};
+
+// Process-wide registry of the per-thread phase counters.
+//
+// Each thread accumulates into its own counters, which only it writes, so
+// timing a phase costs two clock reads and no synchronization. The counters
+// are relaxed atomics, so that they can be summed up by another thread at any
+// time. Counters of exited threads are folded into a retired total.
+//
+// Ticks come from the time stamp counter on x86 and from the steady clock
+// elsewhere. They are converted to seconds with a rate calibrated against the
+// steady clock over the lifetime of the process.
+class PhaseTimers {
+public:
+    static std::uint64_t Now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static void Add(Phase phase, std::uint64_t ticks)
+    {
+        auto& counters = ThreadCounters();
+        const auto i = static_cast<std::size_t>(phase);
+        counters.counts[i].store(counters.counts[i].load(std::memory_order_relaxed) + 1,
+                                 std::memory_order_relaxed);
+        counters.ticks[i].store(counters.ticks[i].load(std::memory_order_relaxed) + ticks,
+                                std::memory_order_relaxed);
+    }
+
+    // Returns the totals of all threads so far.
+    static PhaseTotals Collect()
+    {
+        auto& registry = Instance();
+        std::lock_guard<std::mutex> lock(registry.mutex_);
+        PhaseTotals totals = registry.retired_;
+        for (const auto* counters : registry.counters_) {
+            totals += counters->Load();
+        }
+        return totals;
+    }
+
+    static double TicksToSeconds(std::uint64_t ticks)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        const auto& registry = Instance();
+        const auto elapsed_ticks = Now() - registry.start_ticks_;
+        const auto elapsed_seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - registry.start_time_).count();
+        if (elapsed_ticks == 0 || elapsed_seconds <= 0.0) {
+            return 0.0;
+        }
+        return ticks * (elapsed_seconds / elapsed_ticks);
+#else
+        return 1e-9 * ticks;
+#endif
+    }
+
+private:
+    struct Counters {
+        std::array<std::atomic<std::uint64_t>, kNumPhases> counts{};
+        std::array<std::atomic<std::uint64_t>, kNumPhases> ticks{};
+
+        Counters()
+        {
+            auto& registry = Instance();
+            std::lock_guard<std::mutex> lock(registry.mutex_);
+            registry.counters_.push_back(this);
+        }
+
+        ~Counters()
+        {
+            auto& registry = Instance();
+            std::lock_guard<std::mutex> lock(registry.mutex_);
+            registry.retired_ += Load();
+            registry.counters_.erase(std::remove(registry.counters_.begin(), registry.counters_.end(), this),
+                                     registry.counters_.end());
+        }
+
+        PhaseTotals Load() const
+        {
+            PhaseTotals totals;
+            for (std::size_t i = 0; i < kNumPhases; ++i) {
+                totals.counts[i] = counts[i].load(std::memory_order_relaxed);
+                totals.ticks[i] = ticks[i].load(std::memory_order_relaxed);
+            }
+            return totals;
+        }
+    };
+
+    PhaseTimers()
+            : start_ticks_(Now()), start_time_(std::chrono::steady_clock::now())
+    {
+    }
+
+    // Never destroyed, since thread-local counters may unregister after the
+    // end of main().
+    static PhaseTimers& Instance()
+    {
+        static PhaseTimers* instance = new PhaseTimers();
+        return *instance;
+    }
+
+    static Counters& ThreadCounters()
+    {
+        static thread_local Counters counters;
+        return counters;
+    }
+
+    const std::uint64_t start_ticks_;
+    const std::chrono::steady_clock::time_point start_time_;
+    std::mutex mutex_;
+    std::vector<const Counters*> counters_;
+    PhaseTotals retired_;
+};
+
+// Adds the time from construction to destruction to a phase.
+class ScopedPhaseTimer {
+public:
+    explicit ScopedPhaseTimer(Phase phase)
+            : phase_(phase), start_(PhaseTimers::Now())
+    {
+    }
+
+    ~ScopedPhaseTimer()
+    {
+        PhaseTimers::Add(phase_, PhaseTimers::Now() - start_);
+    }
+
+    ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+    ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+
+private:
+    const Phase phase_;
+    const std::uint64_t start_;
+};
+
+#ifdef SEARCH_GENERIC_USDT_ENABLED
+// Fires the USDT probes search_generic:phase_begin and search_generic:phase_end
+// with the index of the phase (see Phase) at construction and destruction, so
+// that tracers (e.g. perf, bpftrace) can attribute samples and latencies to the
+// phases of a search.
+class ScopedPhaseProbe {
+public:
+    explicit ScopedPhaseProbe(Phase phase)
+            : phase_(static_cast<int>(phase))
+    {
+        DTRACE_PROBE1(search_generic, phase_begin, phase_);
+    }
+
+    ~ScopedPhaseProbe()
+    {
+        DTRACE_PROBE1(search_generic, phase_end, phase_);
+    }
+
+    ScopedPhaseProbe(const ScopedPhaseProbe&) = delete;
+    ScopedPhaseProbe& operator=(const ScopedPhaseProbe&) = delete;
+
+private:
+    const int phase_;
+};
+#endif
+
+}  // namespace generic
+}  // namespace search
+
+// Times the rest of the enclosing scope as the given phase and marks it with
+// USDT probes. Compiles to nothing unless PHASE_TIMING_ENABLED or
+// SEARCH_GENERIC_USDT_ENABLED is defined.
+#define SEARCH_GENERIC_PHASE_CONCAT_(a, b) a##b
+#define SEARCH_GENERIC_PHASE_CONCAT(a, b) SEARCH_GENERIC_PHASE_CONCAT_(a, b)
+#ifdef PHASE_TIMING_ENABLED
+#define SEARCH_GENERIC_PHASE_TIMER_(phase) \
+    ::search::generic::ScopedPhaseTimer SEARCH_GENERIC_PHASE_CONCAT(phase_timer_, __LINE__)( \
+            ::search::generic::Phase::phase)
+#else
+#define SEARCH_GENERIC_PHASE_TIMER_(phase) static_cast<void>(0)
+#endif
+#ifdef SEARCH_GENERIC_USDT_ENABLED
+#define SEARCH_GENERIC_PHASE_PROBE_(phase) \
+    ::search::generic::ScopedPhaseProbe SEARCH_GENERIC_PHASE_CONCAT(phase_probe_, __LINE__)( \
+            ::search::generic::Phase::phase)
+#else
+#define SEARCH_GENERIC_PHASE_PROBE_(phase) static_cast<void>(0)
+#endif
+#define SEARCH_GENERIC_TIME_PHASE(phase) SEARCH_GENERIC_PHASE_TIMER_(phase); SEARCH_GENERIC_PHASE_PROBE_(phase)
+
+#endif  // SEARCH_GENERIC_PHASE_TIMER_HPP
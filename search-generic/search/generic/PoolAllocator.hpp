@@ -0,0 +1,239 @@
+// PoolAllocator.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_POOL_ALLOCATOR_HPP
+#define SEARCH_GENERIC_POOL_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace search {
+namespace generic {
+
+// A memory arena that serves small allocations from free lists of fixed size
+// classes, which are carved out of larger blocks. Freed chunks are recycled,
+// but blocks are only returned to the system when the arena is destroyed.
+// Allocations larger than kMaxChunkSize are forwarded to operator new.
+//
+// Note: By default the arena is not thread-safe. It is meant to back node-based
+// containers that are only used by a single thread at a time. A synchronized
+// arena guards its free lists with a mutex, so that objects can be allocated
+// and freed concurrently, e.g. search nodes created by operator tasks.
+class PoolArena {
+public:
+    static constexpr std::size_t kChunkAlignment = alignof(std::max_align_t);
+    static constexpr std::size_t kMaxChunkSize = 256;
+    static constexpr std::size_t kNumSizeClasses = kMaxChunkSize / kChunkAlignment;
+
+    explicit PoolArena(std::size_t block_size_in_bytes = 64 * 1024, bool synchronized = false)
+            : block_size_(block_size_in_bytes < kMaxChunkSize ? static_cast<std::size_t>(kMaxChunkSize) : block_size_in_bytes),
+              synchronized_(synchronized)
+    {
+        for (auto& head : free_lists_) {
+            head = nullptr;
+        }
+    }
+
+    PoolArena(const PoolArena&) = delete;
+
+    PoolArena& operator=(const PoolArena&) = delete;
+
+    void* allocate(std::size_t bytes)
+    {
+        if (bytes > kMaxChunkSize) {
+            return ::operator new(bytes);
+        }
+
+        const auto size_class = SizeClass(bytes);
+        const auto lock = Lock();
+        auto& head = free_lists_[size_class];
+        if (head == nullptr) {
+            Refill(size_class);
+        }
+        FreeChunk* chunk = head;
+        head = chunk->next;
+        return chunk;
+    }
+
+    void deallocate(void* pointer, std::size_t bytes)
+    {
+        if (bytes > kMaxChunkSize) {
+            ::operator delete(pointer);
+            return;
+        }
+
+        auto chunk = static_cast<FreeChunk*>(pointer);
+        const auto lock = Lock();
+        auto& head = free_lists_[SizeClass(bytes)];
+        chunk->next = head;
+        head = chunk;
+    }
+
+    // Returns the number of bytes reserved by this arena.
+    std::size_t reserved_bytes() const
+    {
+        const auto lock = Lock();
+        return blocks_.size() * block_size_;
+    }
+
+private:
+    struct FreeChunk {
+        FreeChunk* next;
+    };
+
+    std::unique_lock<std::mutex> Lock() const
+    {
+        return synchronized_ ? std::unique_lock<std::mutex>(mutex_) : std::unique_lock<std::mutex>();
+    }
+
+    static std::size_t SizeClass(std::size_t bytes)
+    {
+        return bytes == 0 ? 0 : (bytes - 1) / kChunkAlignment;
+    }
+
+    void Refill(std::size_t size_class)
+    {
+        const std::size_t chunk_size = (size_class + 1) * kChunkAlignment;
+        blocks_.emplace_back(new char[block_size_]);
+        char* block = blocks_.back().get();
+
+        FreeChunk* head = nullptr;
+        for (std::size_t offset = 0; offset + chunk_size <= block_size_; offset += chunk_size) {
+            auto chunk = reinterpret_cast<FreeChunk*>(block + offset);
+            chunk->next = head;
+            head = chunk;
+        }
+        free_lists_[size_class] = head;
+    }
+
+    std::size_t block_size_;
+    bool synchronized_;
+    mutable std::mutex mutex_;
+    FreeChunk* free_lists_[kNumSizeClasses];
+    std::vector<std::unique_ptr<char[]>> blocks_;
+};
+
+// A standard-conforming allocator backed by a shared PoolArena.
+// Copies and rebinds of an allocator share its arena, so that they compare
+// equal and memory can be freed through any of them. Moving an allocator
+// copies it, so a moved-from container still holds a valid arena.
+template<typename T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template<typename U>
+    struct rebind {
+        typedef PoolAllocator<U> other;
+    };
+
+    PoolAllocator()
+            : arena_(std::make_shared<PoolArena>())
+    {
+    }
+
+    explicit PoolAllocator(std::shared_ptr<PoolArena> arena)
+            : arena_(std::move(arena))
+    {
+    }
+
+    PoolAllocator(const PoolAllocator&) = default;
+
+    PoolAllocator& operator=(const PoolAllocator&) = default;
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>& other) noexcept
+            : arena_(other.arena())
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(arena_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, std::size_t n)
+    {
+        arena_->deallocate(pointer, n * sizeof(T));
+    }
+
+    const std::shared_ptr<PoolArena>& arena() const noexcept
+    {
+        return arena_;
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U>& other) const noexcept
+    {
+        return arena_ == other.arena();
+    }
+
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>& other) const noexcept
+    {
+        return arena_ != other.arena();
+    }
+
+private:
+    std::shared_ptr<PoolArena> arena_;
+};
+
+// Returns the arena for payloads that are allocated concurrently, such as the
+// data of states generated by operator tasks. That is the arena installed in
+// the calling thread by a ScopedPoolArena, e.g. the payload arena of the search
+// the thread works for, or else a synchronized arena of the thread. Objects
+// may be freed by any thread. Allocators keep the arena alive, so it is
+// released in bulk once the last object allocated from it has been freed.
+inline const std::shared_ptr<PoolArena>& CurrentPoolArena();
+
+// Installs an arena as the current arena of the calling thread (see
+// CurrentPoolArena) for the lifetime of this object.
+class ScopedPoolArena {
+public:
+    explicit ScopedPoolArena(std::shared_ptr<PoolArena> arena)
+            : previous_(std::move(Installed()))
+    {
+        Installed() = std::move(arena);
+    }
+
+    ScopedPoolArena(const ScopedPoolArena&) = delete;
+
+    ScopedPoolArena& operator=(const ScopedPoolArena&) = delete;
+
+    ~ScopedPoolArena()
+    {
+        Installed() = std::move(previous_);
+    }
+
+private:
+    friend const std::shared_ptr<PoolArena>& CurrentPoolArena();
+
+    static std::shared_ptr<PoolArena>& Installed()
+    {
+        static thread_local std::shared_ptr<PoolArena> arena;
+        return arena;
+    }
+
+    std::shared_ptr<PoolArena> previous_;
+};
+
+inline const std::shared_ptr<PoolArena>& CurrentPoolArena()
+{
+    const auto& installed = ScopedPoolArena::Installed();
+    if (installed) {
+        return installed;
+    }
+    static thread_local const auto arena = std::make_shared<PoolArena>(64 * 1024, true);
+    return arena;
+}
+
+}  // namespace generic
+}  // namespace search
+
+#endif  // SEARCH_GENERIC_POOL_ALLOCATOR_HPP
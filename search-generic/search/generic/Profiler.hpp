@@ -0,0 +1,191 @@
+// Profiler.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_PROFILER_HPP
+#define SEARCH_GENERIC_PROFILER_HPP
+
+#ifdef PROFILING_ENABLED
+#include <gperftools/profiler.h>
+#endif
+
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace search {
+namespace generic {
+
+// A process-wide CPU profiler, which writes one gperftools profile per
+// profiling window, so that long running processes can be profiled on demand.
+//
+// A window is requested with RequestWindow(), which is async-signal-safe and
+// can be called from a signal handler, or for the whole run of a search with
+// Options::profile_search. Searches poll the profiler once per expansion (see
+// Poll). The first search to poll after a request opens the window, which is
+// written to "<directory>/<label>-<pid>-<n>.prof" for the label of the search
+// (see Options::metrics_label). The window closes after the configured window
+// duration or when the search that opened it ends. Since gperftools samples
+// the whole process, a window also covers concurrent searches.
+//
+// Without PROFILING_ENABLED, or before Configure() was called, windows are
+// never opened.
+class Profiler {
+public:
+    static Profiler& Instance()
+    {
+        // Never destroyed, so that a window can still be closed by searches
+        // that end after main().
+        static Profiler* instance = new Profiler();
+        return *instance;
+    }
+
+    // Returns true if profiles can be written, i.e. gperftools is linked in.
+    static constexpr bool Supported()
+    {
+#ifdef PROFILING_ENABLED
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Requests a window of the configured duration. A request while a window
+    // is open takes effect when it closes. Async-signal-safe.
+    static void RequestWindow()
+    {
+        WindowRequested().store(true, std::memory_order_relaxed);
+    }
+
+    // Enables windows, whose profiles are written to the given directory.
+    void Configure(const std::string& directory, std::chrono::milliseconds window_duration)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        directory_ = directory.empty() ? "." : directory;
+        window_duration_ = window_duration;
+        enabled_ = Supported();
+    }
+
+    bool enabled() const
+    {
+        return enabled_;
+    }
+
+    // Opens a requested window for the given search or closes the open window
+    // when its time is up. Cheap unless a window is requested or open.
+    void Poll(const void* search, const std::string& label)
+    {
+        if (!enabled_ || (!WindowRequested().load(std::memory_order_relaxed) && !open_)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto now = std::chrono::steady_clock::now();
+        if (open_ && now >= window_end_) {
+            Stop();
+        }
+        if (!open_ && WindowRequested().exchange(false, std::memory_order_relaxed)) {
+            Start(search, label, now + window_duration_);
+        }
+    }
+
+    // Opens a window for the whole run of the given search, unless a window is
+    // already open.
+    void BeginSearchWindow(const void* search, const std::string& label)
+    {
+        if (!enabled_) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!open_) {
+            Start(search, label, std::chrono::steady_clock::time_point::max());
+        }
+    }
+
+    // Closes the open window if it was opened by the given search.
+    void EndSearch(const void* search)
+    {
+        if (!open_) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (open_ && owner_ == search) {
+            Stop();
+        }
+    }
+
+    // Returns the number of windows opened so far.
+    std::size_t num_windows() const
+    {
+        return num_windows_;
+    }
+
+private:
+    Profiler() = default;
+
+    static std::atomic<bool>& WindowRequested()
+    {
+        // Constant-initialized, so that it is safe to use in signal handlers.
+        static std::atomic<bool> requested(false);
+        return requested;
+    }
+
+    // Replaces characters that are not safe in file names, e.g. the slashes
+    // of an input file label.
+    static std::string FileNameOf(const std::string& label)
+    {
+        std::string name = label.empty() ? "search" : label;
+        for (auto& c : name) {
+            const bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+                    || c == '-' || c == '_' || c == '.';
+            if (!safe) {
+                c = '_';
+            }
+        }
+        return name;
+    }
+
+    // Requires mutex_ to be locked.
+    void Start(const void* search, const std::string& label, std::chrono::steady_clock::time_point end)
+    {
+#ifdef PROFILING_ENABLED
+        const auto filename = directory_ + "/" + FileNameOf(label) + "-" + std::to_string(getpid()) + "-"
+                + std::to_string(num_windows_ + 1) + ".prof";
+        if (!ProfilerStart(filename.c_str())) {
+            return;
+        }
+        ++num_windows_;
+        owner_ = search;
+        window_end_ = end;
+        open_ = true;
+#else
+        static_cast<void>(search);
+        static_cast<void>(label);
+        static_cast<void>(end);
+#endif
+    }
+
+    // Requires mutex_ to be locked.
+    void Stop()
+    {
+#ifdef PROFILING_ENABLED
+        ProfilerStop();
+#endif
+        owner_ = nullptr;
+        open_ = false;
+    }
+
+    std::mutex mutex_;
+    std::atomic<bool> enabled_{false};
+    std::atomic<bool> open_{false};
+    std::atomic<std::size_t> num_windows_{0};
+    std::string directory_;
+    std::chrono::milliseconds window_duration_{0};
+    std::chrono::steady_clock::time_point window_end_;
+    const void* owner_ = nullptr;
+};
+
+}  // namespace generic
+}  // namespace search
+
+#endif  // SEARCH_GENERIC_PROFILER_HPP
@@ -0,0 +1,153 @@
+// PrunedParents.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_PRUNED_PARENTS_HPP
+#define SEARCH_GENERIC_PRUNED_PARENTS_HPP
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "search/generic/ClosedList.hpp"
+#include "search/generic/Node.hpp"
+#include "search/generic/OpenList.hpp"
+
+namespace search {
+namespace generic {
+
+// The expanded parents of nodes pruned from OPEN, together with the cost f of
+// their best pruned child backed up as in SMA*.
+//
+// A parent stays in CLOSED until its backed-up priority is the lowest one,
+// i.e. until the lowest priority in OPEN rises above it (or OPEN runs empty).
+// Only then it is moved back to OPEN, with the backed-up cost h, so that its
+// pruned subtree is regenerated. Reopening it right away would regenerate the
+// same children, which are pruned again in the next round, and the search
+// would never get past them.
+//
+// Backups are kept in a heap ordered by priority. A newer backup of the same
+// parent supersedes the older one, which is skipped when it reaches the top.
+template<typename State>
+class PrunedParents {
+
+    typedef std::shared_ptr<Node<State>> SharedNode;
+
+    struct Backup {
+        float priority;
+        float cost_h;
+        SharedNode parent;
+    };
+
+public:
+    // Backs up the cost f of a pruned node to its parent, if the parent is in
+    // CLOSED. Parents in a compact CLOSED list have released their states and
+    // are not backed up.
+    void backup(const SharedNode& pruned, const OpenList<State>& open, const ClosedList<State>& closed)
+    {
+        const auto& parent = pruned->parent();
+        if (!parent || closed.compact() || closed.get(parent->state()) != parent) {
+            return;
+        }
+
+        restore(parent, std::max(parent->costH(), pruned->costF() - parent->costG()), open);
+    }
+
+    // Records a backed-up cost h of a parent in CLOSED directly, e.g. when a
+    // search is resumed from a checkpoint. A lower one that is already
+    // recorded is kept.
+    void restore(const SharedNode& parent, float cost_h, const OpenList<State>& open)
+    {
+        const auto inserted = cost_h_.emplace(parent.get(), cost_h);
+        if (!inserted.second) {
+            if (inserted.first->second <= cost_h) {
+                return;
+            }
+            inserted.first->second = cost_h;
+        }
+        heap_.push_back(Backup{open.priority(*parent, cost_h), cost_h, parent});
+        std::push_heap(heap_.begin(), heap_.end(), &PrunedParents::Greater);
+    }
+
+    // Calls f with each parent that has a pending backup and its backed-up
+    // cost h. Parents that have left CLOSED meanwhile are included.
+    template<typename Function>
+    void forEach(Function f) const
+    {
+        for (const auto& backup : heap_) {
+            const auto pos = cost_h_.find(backup.parent.get());
+            if (pos != cost_h_.end() && pos->second == backup.cost_h) {
+                f(backup.parent, backup.cost_h);
+            }
+        }
+    }
+
+    // Moves the parents whose backed-up priority is lower than the lowest
+    // priority in OPEN from CLOSED back to OPEN. If OPEN is empty, the parent
+    // with the lowest backed-up priority is moved in any case. Returns the
+    // number of reopened parents.
+    std::size_t reopen(OpenList<State>& open, ClosedList<State>& closed)
+    {
+        std::size_t num_reopened = 0;
+        while (!heap_.empty() && (open.empty() || heap_.front().priority < open.topPriority())) {
+            std::pop_heap(heap_.begin(), heap_.end(), &PrunedParents::Greater);
+            const Backup backup = std::move(heap_.back());
+            heap_.pop_back();
+
+            const auto pos = cost_h_.find(backup.parent.get());
+            if (pos == cost_h_.end() || pos->second != backup.cost_h) {
+                continue;  // Superseded by a lower backup.
+            }
+            cost_h_.erase(pos);
+            // The parent may have left CLOSED meanwhile, e.g. when it was
+            // reached on a cheaper path.
+            if (closed.get(backup.parent->state()) != backup.parent) {
+                continue;
+            }
+            closed.pop(backup.parent);
+            backup.parent->setCostH(backup.cost_h);
+            open.pushOrUpdate(backup.parent);
+            ++num_reopened;
+        }
+        return num_reopened;
+    }
+
+    // Recomputes the backed-up priorities after the weights or the tie
+    // breaking of OPEN have changed.
+    void reprioritize(const OpenList<State>& open)
+    {
+        for (auto& backup : heap_) {
+            backup.priority = open.priority(*backup.parent, backup.cost_h);
+        }
+        std::make_heap(heap_.begin(), heap_.end(), &PrunedParents::Greater);
+    }
+
+    // Drops all backups, e.g. after CLOSED was cleared.
+    void clear()
+    {
+        heap_.clear();
+        cost_h_.clear();
+    }
+
+    bool empty() const
+    {
+        return heap_.empty();
+    }
+
+private:
+    // Orders the heap by the lowest priority first, with ties broken in
+    // favor of the lower cost h as in OPEN.
+    static bool Greater(const Backup& lhs, const Backup& rhs)
+    {
+        return lhs.priority > rhs.priority || (lhs.priority == rhs.priority && lhs.cost_h > rhs.cost_h);
+    }
+
+    std::vector<Backup> heap_;
+    // The lowest backed-up cost h of each parent with a pending backup. Keys
+    // stay valid, since the heap holds a reference to each parent.
+    std::unordered_map<const Node<State>*, float> cost_h_;
+};
+
+}  // namespace generic
+}  // namespace search
+
+#endif  // SEARCH_GENERIC_PRUNED_PARENTS_HPP
@@ -0,0 +1,73 @@
+// SearchStrategy.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_SEARCH_STRATEGY_HPP
+#define SEARCH_GENERIC_SEARCH_STRATEGY_HPP
+
+#include <string>
+
+namespace search {
+namespace generic {
+
+// Order in which AstarSearch expands the nodes in OPEN (see Options).
+//
+// kAstar expands by f = g + h and returns an optimal goal if h is admissible.
+//
+// kWeightedAstar expands by f = g + w * h with w = Options::heuristic_weight.
+// It usually reaches a goal after far fewer expansions, and the cost of the
+// goal is at most w times the optimum.
+//
+// kAnytime starts out as kWeightedAstar, but does not stop at the first goal.
+// Each goal that is cheaper than the previous one is reported through the
+// callback, w is decreased by Options::anytime_weight_step, and the search
+// continues with OPEN and CLOSED as they are, i.e. it repairs the previous
+// search instead of starting over. Nodes that cannot lead to a cheaper goal
+// are dropped. The search ends when w has reached 1 and a goal is found, when
+// OPEN runs empty (the last goal is then optimal), or when it is aborted. The
+// result is the cheapest goal found.
+//
+// kGreedyRestarts expands by h only and ignores g. If the lowest h seen so far
+// has not improved for Options::restart_interval expansions, the search is
+// restarted from the initial node with OPEN and CLOSED cleared. Each restart
+// perturbs the cost h in the priorities by a different random factor (see
+// Options::restart_noise), so that ties between nodes of nearly equal cost h
+// are broken differently than before.
+enum class SearchStrategy {
+    kAstar,
+    kWeightedAstar,
+    kAnytime,
+    kGreedyRestarts
+};
+
+inline const char* SearchStrategyName(SearchStrategy strategy)
+{
+    switch (strategy) {
+        case SearchStrategy::kAstar:
+            return "astar";
+        case SearchStrategy::kWeightedAstar:
+            return "weighted";
+        case SearchStrategy::kAnytime:
+            return "anytime";
+        case SearchStrategy::kGreedyRestarts:
+            return "greedy";
+    }
+    return "";
+}
+
+// Parses a name returned by SearchStrategyName. Returns false if the name is
+// unknown.
+inline bool ParseSearchStrategy(const std::string& name, SearchStrategy& strategy)
+{
+    for (const auto candidate : {SearchStrategy::kAstar, SearchStrategy::kWeightedAstar,
+                                 SearchStrategy::kAnytime, SearchStrategy::kGreedyRestarts}) {
+        if (name == SearchStrategyName(candidate)) {
+            strategy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace generic
+}  // namespace search
+
+#endif  // SEARCH_GENERIC_SEARCH_STRATEGY_HPP
@@ -6,65 +6,35 @@
 #include <cassert>
 #include <atomic>
 #include <chrono>
-#include <fstream>
 #include <functional>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <condition_variable>
+#include "search/generic/MemoryGuard.hpp"
+#include "search/generic/Metrics.hpp"
 #include "search/generic/Node.hpp"
 #include "search/generic/OpenList.hpp"
+#include "search/generic/PhaseTimer.hpp"
 #include "search/generic/ClosedList.hpp"
 #include "search/generic/Operator.hpp"
 
 namespace search {
 namespace generic {
 
-// Returns the amount of the systems free memory in kilobytes as shown by the
-// tool gnome-system-monitor. Accordingly, the actual available memory contains
-// 1. Unused memory (MemFree)
-// 2. File IO buffer (Buffers)
-// 3. Cache memory (Cached)
+// Returns the amount of memory in kilobytes available to the current process,
+// i.e. the memory available on the host or in the cgroup of the process,
+// whichever is less (see MemoryProbe).
 inline std::size_t GetFreeMemoryInKilobytes()
 {
-    std::ifstream stream("/proc/meminfo");
-    assert(stream.is_open());
-    std::string name;
-    std::size_t value = 0;
-    std::size_t kbytes = 0;
-    while (stream >> name) {
-        if (name == "MemFree:") {
-            stream >> value;
-            kbytes += value;
-            continue;
-        }
-        if (name == "Buffers:") {
-            stream >> value;
-            kbytes += value;
-            continue;
-        }
-        if (name == "Cached:") {
-            stream >> value;
-            kbytes += value;
-            break;  // Assumes that this line comes at last.
-        }
-    }
-    return kbytes;
+    return static_cast<std::size_t>(std::min<std::uint64_t>(
+            MemoryProbe::Instance().availableInBytes() / 1024, std::numeric_limits<std::uint32_t>::max()));
 }
 
 // Returns the amount of memory in kilobytes used by the current process.
 inline std::size_t GetUsedMemoryInKilobytes()
 {
-    std::ifstream stream("/proc/self/status");
-    assert(stream.is_open());
-    std::string token;
-    std::size_t kbytes = 0;
-    while (stream >> token) {
-        if (token == "VmRSS:") {
-            stream >> kbytes;
-            break;
-        }
-    }
-    return kbytes;
+    return static_cast<std::size_t>(GetResidentMemoryInBytes() / 1024);
 }
 
 // A class to record statistics about the usage of a certain operator.
@@ -72,17 +42,24 @@ inline std::size_t GetUsedMemoryInKilobytes()
 // this type and its members will be updated when an operator was applied.
 // Since instances might be read and written asynchronously all data members
 // are of atomic (thread-safe) types.
+//
+// The gain of an operator is the sum of the decrease in cost h from parent to
+// child over all new (not duplicated) states it generated, in millionths.
 struct OperatorStats {
 
     OperatorStats()
-            : num_applications(0), num_generated_states(0), runtime_in_micros(0)
+            : num_applications(0), num_skipped_applications(0),
+              num_generated_states(0), runtime_in_micros(0),
+              gain_in_millionths(0)
     {
     }
 
     OperatorStats(const OperatorStats& other)
             : num_applications(other.num_applications.load()),
+              num_skipped_applications(other.num_skipped_applications.load()),
               num_generated_states(other.num_generated_states.load()),
-              runtime_in_micros(other.runtime_in_micros.load())
+              runtime_in_micros(other.runtime_in_micros.load()),
+              gain_in_millionths(other.gain_in_millionths.load())
     {
     }
 
@@ -90,15 +67,19 @@ struct OperatorStats {
     {
         if (&other != this) {
             num_applications = other.num_applications.load();
+            num_skipped_applications = other.num_skipped_applications.load();
             num_generated_states = other.num_generated_states.load();
             runtime_in_micros = other.runtime_in_micros.load();
+            gain_in_millionths = other.gain_in_millionths.load();
         }
         return *this;
     }
 
     std::atomic_uint_fast64_t num_applications;
+    std::atomic_uint_fast64_t num_skipped_applications;
     std::atomic_uint_fast64_t num_generated_states;
     std::atomic_uint_fast64_t runtime_in_micros;
+    std::atomic_uint_fast64_t gain_in_millionths;
 };
 
 // A class that serves as the central input and output parameter to the
@@ -122,6 +103,11 @@ struct OperatorStats {
 // * The cost h function (see A* search theory).
 // * The goal check function (see A* search theory).
 // * The initial/current node and its context.
+//
+// When a search ends without a goal state, e.g. because it was aborted or ran
+// out of its budget (see Options::time_limit_in_millis), the current node is
+// the best one taken from OPEN so far (see BestNodeScore), unless an
+// acceptable state ended the search.
 template<typename State, typename Context>
 struct Status {
 
@@ -130,6 +116,8 @@ struct Status {
     std::atomic_bool has_goal_state;
     std::atomic_bool aborted_by_caller;
     std::atomic_bool aborted_by_memguard;
+    std::atomic_bool aborted_by_budget;
+    std::atomic_bool has_acceptable_state;
     std::atomic_uint_fast32_t runtime_in_millis;
     std::atomic_uint_fast32_t branching_factor_min;
     std::atomic_uint_fast32_t branching_factor_max;
@@ -138,9 +126,13 @@ struct Status {
     std::atomic_uint_fast32_t free_memory_in_kbytes;
     std::atomic_uint_fast32_t num_duplicated_states;
     std::atomic_uint_fast32_t num_reopened_states;
+    std::atomic_uint_fast32_t num_pruned_states;
     std::atomic_uint_fast32_t num_goal_checks;
+    std::atomic_uint_fast32_t num_goal_states;
+    std::atomic_uint_fast32_t num_restarts;
     std::atomic_uint_fast32_t size_of_closed;
     std::atomic_uint_fast32_t size_of_open;
+    std::atomic_uint_fast64_t estimated_memory_in_bytes;
 
     // These members will not be mutated during a run of AstarSearch. Therefore
     // they can be accessed by multiple threads without additional locking.
@@ -163,20 +155,71 @@ struct Status {
     // state that might not be thread-safe.
 
     // Function that computes state's hash value.
-    std::function<std::string(const State&)> compute_hash;
+    std::function<HashCode(const State&)> compute_hash;
 
     // Function that computes an estimated cost of a state to reach a goal state.
     // Represents the h-function defined in heuristic search theory.
     std::function<double(const Node<State>&, const Context&)> compute_cost_h;
 
+    // Optional function that computes the cost h of sibling nodes, i.e. new
+    // nodes generated from the same parent, at once and writes it to the given
+    // array. It must give the same costs as compute_cost_h, but may share work
+    // between the siblings. If set, it is used for the successors generated by
+    // each application of an operator when the cost h is computed in the
+    // worker threads (see Options::compute_cost_h_in_workers).
+    std::function<void(const Node<State>* const* nodes, std::size_t num_nodes, const Context&, double* costs)>
+            compute_cost_h_batch;
+
     // Function that checks if a state is a goal state.
     std::function<bool(const Node<State>&, const Context&)> is_goal_state;
 
+    // Optional function that checks if a state is good enough to end the
+    // search early, although it is not a goal state. The search then ends with
+    // this state as the current node and has_acceptable_state set.
+    std::function<bool(const Node<State>&, const Context&)> is_acceptable_state;
+
+    // Optional function that measures the progress of a state towards a goal
+    // state, where larger is closer. If set, it selects the best node found so
+    // far instead of the cost h, which may not reflect the progress (e.g. if it
+    // includes an estimate of the remaining cost g).
+    std::function<double(const Node<State>&, const Context&)> compute_progress;
+
+    // Optional function that estimates the number of bytes owned by a state.
+    // Used to enforce Options::memory_budget_in_bytes. If not set, only
+    // sizeof(State) is accounted for.
+    std::function<std::size_t(const State&)> compute_memory;
+
+    // Optional function that releases the payload of an expanded state, which
+    // is only kept as a path record when Options::compact_closed_list is set.
+    // The released state is not hashed again, but it must still provide all
+    // information that is read from the ancestors of a node (e.g. for logging).
+    std::function<void(State&)> release_state;
+
+    // Optional functions that write a state to a checkpoint and read it back
+    // (see Options::checkpoint_filename). Released states must be written as
+    // well, since they may be path records. load_state throws an exception if
+    // the checkpoint is malformed.
+    std::function<void(const State&, std::ostream&)> save_state;
+    std::function<State(std::istream&)> load_state;
+
+    // Optional function that is called once for each node to be expanded
+    // before the operators are applied to it, e.g. to compute data that all
+    // operators share instead of each one computing it on its own. Nodes of a
+    // batch are prepared concurrently, so the function must be thread-safe if
+    // Options::expansion_batch_size is larger than 1.
+    std::function<void(const Node<State>&, Context&)> prepare_expansion;
+
+    // Optional function that adds problem-specific values (e.g. the progress
+    // towards a goal) of the current node to a metrics snapshot.
+    std::function<void(const Node<State>&, const Context&, MetricsSnapshot&)> annotate_metrics;
+
     Status()
             : finished(false),
               has_goal_state(false),
               aborted_by_caller(false),
               aborted_by_memguard(false),
+              aborted_by_budget(false),
+              has_acceptable_state(false),
               runtime_in_millis(0),
               branching_factor_min(std::numeric_limits<std::uint64_t>::max()),
               branching_factor_max(std::numeric_limits<std::uint64_t>::min()),
@@ -185,9 +228,13 @@ struct Status {
               free_memory_in_kbytes(0),
               num_duplicated_states(0),
               num_reopened_states(0),
+              num_pruned_states(0),
               num_goal_checks(0),
+              num_goal_states(0),
+              num_restarts(0),
               size_of_closed(0),
-              size_of_open(0)
+              size_of_open(0),
+              estimated_memory_in_bytes(0)
     {
     }
 
@@ -233,16 +280,101 @@ struct Status {
         return num;
     }
 
+    std::size_t getNumSkippedOperatorApplications() const
+    {
+        std::size_t num = 0;
+        for (const auto& stats : operator_stats) {
+            num += stats.num_skipped_applications;
+        }
+        return num;
+    }
+
+    // Starts measuring the phase times of a search (see getPhaseTotals).
+    void startPhaseTiming()
+    {
+        const auto totals = PhaseTimers::Collect();
+        std::lock_guard<std::mutex> lock(mutex_);
+        phase_baseline_ = totals;
+    }
+
+    // Returns the number of calls and clock ticks per phase since the search
+    // started. The counters are process-wide, so the phases of concurrent
+    // searches are included. All values are zero unless the search was built
+    // with PHASE_TIMING_ENABLED.
+    PhaseTotals getPhaseTotals() const
+    {
+        auto totals = PhaseTimers::Collect();
+        std::lock_guard<std::mutex> lock(mutex_);
+        totals -= phase_baseline_;
+        return totals;
+    }
+
+    // Returns a copy of the current values, taken for the given current node.
+    MetricsSnapshot takeMetricsSnapshot(const Node<State>& node,
+                                        const Context& context,
+                                        const std::string& label) const
+    {
+        MetricsSnapshot snapshot;
+        snapshot.label = label;
+        snapshot.finished = finished;
+        snapshot.has_goal_state = has_goal_state;
+        snapshot.runtime_in_millis = runtime_in_millis;
+        snapshot.size_of_open = size_of_open;
+        snapshot.size_of_closed = size_of_closed;
+        snapshot.num_goal_checks = num_goal_checks;
+        snapshot.num_generated_states = getNumGeneratedStates();
+        snapshot.num_duplicated_states = num_duplicated_states;
+        snapshot.num_reopened_states = num_reopened_states;
+        snapshot.num_pruned_states = num_pruned_states;
+        snapshot.num_goal_states = num_goal_states;
+        snapshot.num_restarts = num_restarts;
+        snapshot.used_memory_in_kbytes = used_memory_in_kbytes;
+        snapshot.free_memory_in_kbytes = free_memory_in_kbytes;
+        snapshot.estimated_memory_in_bytes = estimated_memory_in_bytes;
+        snapshot.depth = node.depth();
+        snapshot.cost_g = node.costG();
+        snapshot.cost_h = node.costH();
+        for (std::size_t i = 0; i < operator_stats.size(); ++i) {
+            OperatorMetrics op;
+            op.name = i < operators.size() ? operators[i]->name() : std::to_string(i);
+            op.num_applications = operator_stats[i].num_applications;
+            op.num_skipped_applications = operator_stats[i].num_skipped_applications;
+            op.num_generated_states = operator_stats[i].num_generated_states;
+            op.runtime_in_micros = operator_stats[i].runtime_in_micros;
+            op.gain = 1e-6 * operator_stats[i].gain_in_millionths;
+            snapshot.operators.push_back(op);
+        }
+#ifdef PHASE_TIMING_ENABLED
+        const auto phase_totals = getPhaseTotals();
+        for (std::size_t i = 0; i < kNumPhases; ++i) {
+            PhaseMetrics phase;
+            phase.name = PhaseName(static_cast<Phase>(i));
+            phase.count = phase_totals.counts[i];
+            phase.seconds = PhaseTimers::TicksToSeconds(phase_totals.ticks[i]);
+            snapshot.phases.push_back(phase);
+        }
+#endif
+        if (annotate_metrics) {
+            annotate_metrics(node, context, snapshot);
+        }
+        return snapshot;
+    }
+
     void recordBranching(std::size_t num_branches)
     {
         branching_factor_min = std::min(branching_factor_min.load(), num_branches);
         branching_factor_max = std::max(branching_factor_max.load(), num_branches);
     }
 
-    void recordMemoryUsage()
+    // Records the memory usage of the process, as sampled by the memory guard
+    // at most once per interval.
+    void recordMemoryUsage(std::chrono::milliseconds interval = std::chrono::milliseconds(0))
     {
-        used_memory_in_kbytes = GetUsedMemoryInKilobytes();
-        free_memory_in_kbytes = GetFreeMemoryInKilobytes();
+        auto& guard = MemoryGuard::Instance();
+        guard.refresh(interval);
+        used_memory_in_kbytes = guard.residentBytes() / 1024;
+        free_memory_in_kbytes = std::min<std::uint64_t>(guard.availableBytes() / 1024,
+                                                        std::numeric_limits<std::uint32_t>::max());
     }
 
     void recordRuntime(const std::chrono::high_resolution_clock::time_point& t0)
@@ -264,12 +396,22 @@ struct Status {
         lock.unlock();
     }
 
+    // Returns false if the computation has not completed until the deadline.
+    template<typename Clock, typename Duration>
+    bool waitForCompletionUntil(const std::chrono::time_point<Clock, Duration>& deadline)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return condition_.wait_until(lock, deadline, [this] { return finished.load(); });
+    }
+
     void print() const
     {
         std::cout << "\nfinished                  " << finished
                   << "\nhas_goal_state            " << has_goal_state
                   << "\naborted_by_caller         " << aborted_by_caller
                   << "\naborted_by_memory_guard   " << aborted_by_memguard
+                  << "\naborted_by_budget         " << aborted_by_budget
+                  << "\nhas_acceptable_state      " << has_acceptable_state
                   << "\nruntime_in_millis         " << runtime_in_millis
                   << "\nbranching_factor_min      " << branching_factor_min
                   << "\nbranching_factor_max      " << branching_factor_max
@@ -277,11 +419,26 @@ struct Status {
                   << "\nused_memory_in_kbytes     " << used_memory_in_kbytes
                   << "\nfree_memory_in_kbytes     " << free_memory_in_kbytes
                   << "\nnum_operator_applications " << getNumOperatorApplications()
+                  << "\nnum_skipped_applications  " << getNumSkippedOperatorApplications()
                   << "\nnum_generated_states      " << getNumGeneratedStates()
                   << "\nnum_duplicated_states     " << num_duplicated_states
+                  << "\nnum_pruned_states         " << num_pruned_states
                   << "\nnum_goal_checks           " << num_goal_checks
+                  << "\nnum_goal_states           " << num_goal_states
+                  << "\nnum_restarts              " << num_restarts
                   << "\nsize_of_closed            " << size_of_closed
-                  << "\nsize_of_open              " << size_of_open << std::endl;
+                  << "\nsize_of_open              " << size_of_open
+                  << "\nestimated_memory_in_bytes " << estimated_memory_in_bytes << std::endl;
+#ifdef PHASE_TIMING_ENABLED
+        const auto phase_totals = getPhaseTotals();
+        for (std::size_t i = 0; i < kNumPhases; ++i) {
+            const std::string name = PhaseName(static_cast<Phase>(i));
+            std::cout << "phase_" << name << std::string(std::max<std::size_t>(1, 20 - name.size()), ' ')
+                      << PhaseTimers::TicksToSeconds(phase_totals.ticks[i]) << " s ("
+                      << phase_totals.counts[i] << " calls)\n";
+        }
+        std::cout << std::flush;
+#endif
     }
 
 private:
@@ -293,6 +450,7 @@ private:
     // members are updated/set before each invocation of the callback function.
     Node<State> current_node_;
     Context context_;
+    PhaseTotals phase_baseline_;
 };
 
 }  // namespace generic
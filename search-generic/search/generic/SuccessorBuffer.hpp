@@ -0,0 +1,141 @@
+// SuccessorBuffer.hpp -*- C++ -*-
+// Copyright (C) 2014-2015 Martin Trenkmann
+#ifndef SEARCH_GENERIC_SUCCESSOR_BUFFER_HPP
+#define SEARCH_GENERIC_SUCCESSOR_BUFFER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "search/generic/Node.hpp"
+
+namespace search {
+namespace generic {
+
+// A container for the successor states generated by one operator application.
+//
+// States are deduplicated by their hash codes only, which must be cheap to
+// compute (i.e. precomputed by the state). This is the same notion of identity
+// that OPEN and CLOSED use, so no state is ever compared in full. Small
+// buffers are searched linearly, large ones through an index of hash codes.
+//
+// A buffer is move-only and keeps its capacity when cleared, so that it can be
+// reused for many operator applications without allocating.
+template<typename State, typename Hash = std::hash<State>>
+class SuccessorBuffer {
+public:
+    typedef typename std::vector<State>::iterator iterator;
+    typedef typename std::vector<State>::const_iterator const_iterator;
+
+    SuccessorBuffer() = default;
+    SuccessorBuffer(SuccessorBuffer&&) = default;
+    SuccessorBuffer& operator=(SuccessorBuffer&&) = default;
+    SuccessorBuffer(const SuccessorBuffer&) = delete;
+    SuccessorBuffer& operator=(const SuccessorBuffer&) = delete;
+
+    // Adds a state unless a state with the same hash code is already present.
+    // Returns false if the state was a duplicate.
+    bool push(State&& state)
+    {
+        const auto hash = static_cast<HashCode>(Hash()(state));
+        if (contains(hash)) {
+            return false;
+        }
+        hashes_.push_back(hash);
+        states_.push_back(std::move(state));
+        if (hashes_.size() > kLinearSearchLimit) {
+            indexHashes(hashes_.size() == kLinearSearchLimit + 1 ? hashes_.begin() : hashes_.end() - 1);
+        }
+        return true;
+    }
+
+    // Returns true if a state with the given hash code is present.
+    bool contains(HashCode hash) const
+    {
+        if (hashes_.size() > kLinearSearchLimit) {
+            return index_.count(hash) != 0;
+        }
+        return std::find(hashes_.begin(), hashes_.end(), hash) != hashes_.end();
+    }
+
+    // Keeps a uniformly chosen subset of at most n states.
+    template<typename RandomEngine>
+    void sample(std::size_t n, RandomEngine&& engine)
+    {
+        if (states_.size() <= n) {
+            return;
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            std::uniform_int_distribution<std::size_t> distribution(i, states_.size() - 1);
+            const auto j = distribution(engine);
+            std::swap(states_[i], states_[j]);
+            std::swap(hashes_[i], hashes_[j]);
+        }
+        states_.erase(states_.begin() + n, states_.end());
+        hashes_.erase(hashes_.begin() + n, hashes_.end());
+        index_.clear();
+        if (hashes_.size() > kLinearSearchLimit) {
+            indexHashes(hashes_.begin());
+        }
+    }
+
+    // Removes all states, but keeps the allocated capacity.
+    void clear()
+    {
+        states_.clear();
+        hashes_.clear();
+        index_.clear();
+    }
+
+    std::size_t size() const
+    {
+        return states_.size();
+    }
+
+    bool empty() const
+    {
+        return states_.empty();
+    }
+
+    // Mutable iterators allow to move the states out of the buffer, which
+    // must be cleared afterwards.
+    iterator begin()
+    {
+        return states_.begin();
+    }
+
+    iterator end()
+    {
+        return states_.end();
+    }
+
+    const_iterator begin() const
+    {
+        return states_.begin();
+    }
+
+    const_iterator end() const
+    {
+        return states_.end();
+    }
+
+private:
+    static constexpr std::size_t kLinearSearchLimit = 32;
+
+    void indexHashes(typename std::vector<HashCode>::const_iterator first)
+    {
+        index_.insert(first, hashes_.cend());
+    }
+
+    std::vector<State> states_;
+    std::vector<HashCode> hashes_;
+    std::unordered_set<HashCode> index_;
+};
+
+}  // namespace generic
+}  // namespace search
+
+#endif  // SEARCH_GENERIC_SUCCESSOR_BUFFER_HPP